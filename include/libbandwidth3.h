@@ -0,0 +1,109 @@
+#pragma once
+/*
+ * libbandwidth3 – the bandwidth3 sampler as a C library.
+ *
+ * Link state, Wi-Fi details and rates of the host's network adapters,
+ * sampled the way bandwidth3 samples them: one counter snapshot per
+ * call (/proc/net/dev or one netlink dump), link state from that dump or
+ * one batched sysfs read, Wi-Fi details cached until the station
+ * changes.
+ *
+ *     Bw3Sampler *s = bw3_sampler_new(&(Bw3Config){.interfaces = "wl*"});
+ *     Bw3Iface v[16];
+ *     char line[256];
+ *     for (;;) {
+ *       sleep(1);
+ *       int n = bw3_sample(s, v, 16);
+ *       for (int i = 0; i < n && i < 16; ++i)
+ *         if (bw3_format(s, &v[i], line, sizeof line) < sizeof line)
+ *           puts(line);
+ *     }
+ *     bw3_sampler_free(s);
+ *
+ * bw3_sampler_new() allocates everything the sampler needs.
+ * bw3_sample() and bw3_format() do not allocate; only an adapter never
+ * seen before grows the sampler's tables.  A sampler is not thread-safe:
+ * use one per thread, or lock around it.
+ * The library writes nothing to stdout/stderr and leaves process-wide
+ * settings alone: adapter state files are kept open within the soft
+ * RLIMIT_NOFILE it finds, less 256, and read one by one beyond that.
+ *
+ * Link with -lbandwidth3 -lm -lrt (or libbandwidth3.a).
+ */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(__GNUC__)
+#define BW3_API __attribute__((visibility("default")))
+#else
+#define BW3_API
+#endif
+
+#define BW3_NAME_MAX 48 /* adapter name, NUL included            */
+#define BW3_SSID_MAX 33 /* 32-byte SSID, NUL included            */
+
+typedef enum {
+  BW3_DISABLED,     /* administratively down                  */
+  BW3_DISCONNECTED, /* up, but no carrier / not associated    */
+  BW3_CONNECTED,    /* carrier present or Wi-Fi associated    */
+  BW3_ERR           /* state could not be read                */
+} Bw3State;
+
+typedef struct {
+  const char *interfaces; /* names/globs, comma-separated; NULL:
+                             every adapter but lo                 */
+  const char *exclude;    /* names/globs to leave out, or NULL    */
+  bool netlink;           /* one netlink dump instead of
+                             /proc/net/dev (falls back to it)     */
+  bool wifi;              /* SSID, signal and bitrates            */
+  const char *format;     /* bw3_format() layout, a -F spec as in
+                             bandwidth3(1); NULL: its default     */
+  bool bits;              /* bw3_format() rates in bits/s         */
+  bool si;                /* ... with 1000 rather than 1024 steps */
+} Bw3Config;
+
+typedef struct {
+  char name[BW3_NAME_MAX];
+  int ifindex; /* 0 when unknown                          */
+  Bw3State state;
+  bool wifi;
+  uint64_t rx_bytes;       /* counters at this sample           */
+  uint64_t tx_bytes;
+  double rx_rate;          /* bytes/s since the previous sample */
+  double tx_rate;
+  char ssid[BW3_SSID_MAX]; /* "" unless Bw3Config.wifi and associated */
+  int signal_dbm;          /* 0 when unknown                    */
+  uint32_t tx_bitrate;     /* 100 kbit/s units, 0 when unknown  */
+  uint32_t rx_bitrate;
+} Bw3Iface;
+
+typedef struct Bw3Sampler Bw3Sampler;
+
+/* A sampler for cfg (NULL: the defaults), with a first snapshot taken:
+ * the rates of the first bw3_sample() cover the time since.  NULL with
+ * errno set on failure (EINVAL: bad format or pattern). */
+BW3_API Bw3Sampler *bw3_sampler_new(const Bw3Config *cfg);
+
+/* Sample every adapter and copy up to cap of them to out, in the order
+ * they first appeared: the kernel's for those present at
+ * bw3_sampler_new(), hot-plugged ones after them.  Returns the number
+ * of adapters (more than cap when out was too small), or -1 with errno
+ * set when the counters could not be read. */
+BW3_API int bw3_sample(Bw3Sampler *s, Bw3Iface *out, size_t cap);
+
+/* Render one sampled adapter with the configured layout into buf, NUL
+ * terminated like snprintf().  Returns the length of the full line
+ * (truncated when >= len); 0 when the layout hides it in this state. */
+BW3_API size_t bw3_format(Bw3Sampler *s, const Bw3Iface *it, char *buf,
+                          size_t len);
+
+BW3_API void bw3_sampler_free(Bw3Sampler *s);
+
+#ifdef __cplusplus
+}
+#endif
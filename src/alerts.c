@@ -0,0 +1,192 @@
+/*
+ * Threshold alerts: per-adapter warn/crit limits on the rates (bytes/s)
+ * and the root qdisc's drops/s and backlog (bytes), with hysteresis and
+ * a hold time, and an optional hook command started on
+ * every level change.  Hooks are spawned, never waited for: children
+ * are reaped on later ticks, so a slow script cannot stall sampling.
+ */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <fnmatch.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+#define ALERT_MAX_RUNNING 8u /* hooks in flight; further changes are dropped */
+
+static const char *const LEVEL_NAME[] = {"ok", "warning", "critical"};
+static const char *const DIM_NAME[ALERT_DIMS] = {"rx", "tx", "drops",
+                                                 "backlog"};
+
+/* "[IFACE=]rx[:tx]" → rule.  IFACE may be a glob; without it the rule
+ * applies to every adapter.  A missing tx leaves that limit alone.  The
+ * caller moves a --qdisc-warn/-crit rule to drops[:backlog] (dim). */
+bool alert_rule_parse(AlertRule *r, const char *spec, bool crit) {
+  memset(r, 0, sizeof *r);
+  r->crit = crit;
+  const char *eq = strchr(spec, '=');
+  if (eq) {
+    size_t len = (size_t)(eq - spec);
+    if (!len || len >= sizeof r->scope)
+      return false;
+    memcpy(r->scope, spec, len);
+    spec = eq + 1;
+  } else {
+    strcpy(r->scope, "*");
+  }
+  for (int d = 0; d < 2; ++d) {
+    char *end = NULL;
+    errno = 0;
+    r->v[d] = strtoull(spec, &end, 10);
+    if (errno || end == spec || *spec == '-')
+      return false;
+    r->set[d] = true;
+    if (*end == '\0')
+      return true;
+    if (*end != ':' || d == 1)
+      return false;
+    spec = end + 1;
+  }
+  return true;
+}
+
+/* Limits of one adapter: later matching rules win, per value. */
+void alert_limits(AlertLimits *out, const AlertRule *rules, size_t n_rules,
+                  const char *ifname) {
+  memset(out, 0, sizeof *out);
+  for (size_t i = 0; i < n_rules; ++i) {
+    const AlertRule *r = &rules[i];
+    if (fnmatch(r->scope, ifname, 0) != 0)
+      continue;
+    for (int d = 0; d < 2; ++d)
+      if (r->set[d])
+        (r->crit ? out->crit : out->warn)[r->dim + d] = r->v[d];
+  }
+}
+
+/* Advance one direction's level for a rate of bps at now_ms; true when
+ * the level changed.  A level is left only once the rate drops below
+ * its limit less hysteresis_pct, and any new level must persist for
+ * hold_ms before it is taken. */
+bool alert_step(AlertState *s, uint64_t warn, uint64_t crit, double bps,
+                const Alerts *al, uint64_t now_ms) {
+  uint8_t want = (crit && bps > (double)crit)   ? ALERT_CRIT
+                 : (warn && bps > (double)warn) ? ALERT_WARN
+                                                : ALERT_OK;
+  double keep = (100.0 - al->hysteresis_pct) / 100.0;
+  if (want < s->level) {
+    if (s->level == ALERT_CRIT && crit && bps > (double)crit * keep)
+      want = ALERT_CRIT;
+    else if (want < ALERT_WARN && warn && bps > (double)warn * keep)
+      want = ALERT_WARN;
+  }
+  if (want == s->level) {
+    s->pending = want;
+    return false;
+  }
+  if (want != s->pending) {
+    s->pending = want;
+    s->since_ms = now_ms;
+  }
+  if (now_ms - s->since_ms < al->hold_ms)
+    return false;
+  s->level = want;
+  return true;
+}
+
+/* /bin/sh -c cmd with BW3_* describing the change; stdout goes to our
+ * stderr so a chatty hook cannot corrupt the bar. */
+static void spawn_hook(Alerts *al, const Iface *n, int dir, uint8_t from,
+                       double bps) {
+  if (al->running >= ALERT_MAX_RUNNING) {
+    if (!al->dropped++)
+      fputs("alert hook: too many still running, dropping events\n", stderr);
+    return;
+  }
+  char vars[5][64];
+  snprintf(vars[0], sizeof vars[0], "BW3_IFACE=%s", n->name);
+  snprintf(vars[1], sizeof vars[1], "BW3_DIRECTION=%s", DIM_NAME[dir]);
+  snprintf(vars[2], sizeof vars[2], "BW3_LEVEL=%s", LEVEL_NAME[n->al[dir].level]);
+  snprintf(vars[3], sizeof vars[3], "BW3_PREVIOUS=%s", LEVEL_NAME[from]);
+  snprintf(vars[4], sizeof vars[4], "BW3_RATE=%" PRIu64,
+           (uint64_t)(bps > 0.0 ? bps : 0.0));
+
+  size_t n_env = 0;
+  while (environ[n_env])
+    ++n_env;
+  char **envp = malloc((n_env + 6u) * sizeof *envp);
+  if (!envp) {
+    perror("alert hook");
+    return;
+  }
+  size_t k = 0;
+  for (int i = 0; i < 5; ++i)
+    envp[k++] = vars[i];
+  for (size_t i = 0; i < n_env; ++i)
+    if (strncmp(environ[i], "BW3_", 4) != 0) /* ours only */
+      envp[k++] = environ[i];
+  envp[k] = NULL;
+
+  posix_spawn_file_actions_t fa;
+  posix_spawnattr_t attr;
+  sigset_t dfl;
+  sigemptyset(&dfl);
+  sigaddset(&dfl, SIGINT);
+  sigaddset(&dfl, SIGTERM);
+  posix_spawn_file_actions_init(&fa);
+  posix_spawn_file_actions_adddup2(&fa, STDERR_FILENO, STDOUT_FILENO);
+  posix_spawnattr_init(&attr);
+  posix_spawnattr_setsigdefault(&attr, &dfl);
+  posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+
+  char *argv[] = {"sh", "-c", (char *)al->cmd, NULL};
+  pid_t pid;
+  int err = posix_spawn(&pid, "/bin/sh", &fa, &attr, argv, envp);
+  if (err) {
+    errno = err;
+    perror("alert hook");
+  } else {
+    ++al->running;
+  }
+  posix_spawnattr_destroy(&attr);
+  posix_spawn_file_actions_destroy(&fa);
+  free(envp);
+}
+
+/* The value dimension d of an adapter is judged on: a rate, its EWMA
+ * when smoothing is on and the adapter keeps one, or a qdisc figure. */
+static double alert_value(const Alerts *al, const Iface *n, int d) {
+  switch (d) {
+  case ALERT_DROPS:
+    return n->qd ? n->qd->drop_rate : 0.0;
+  case ALERT_BACKLOG:
+    return n->qd ? (double)n->qd->c.backlog : 0.0;
+  default:
+    return (al->smooth && n->rs) ? n->rs[d].ewma
+                                 : (d ? n->tx_rate : n->rx_rate);
+  }
+}
+
+/* Re-evaluate every dimension of an adapter. */
+void alert_update(Alerts *al, Iface *n, uint64_t now_ms) {
+  for (int d = 0; d < ALERT_DIMS; ++d) {
+    double v = alert_value(al, n, d);
+    uint8_t was = n->al[d].level;
+    if (alert_step(&n->al[d], n->lim.warn[d], n->lim.crit[d], v, al, now_ms) &&
+        al->cmd)
+      spawn_hook(al, n, d, was, v);
+  }
+}
+
+/* Collect finished hooks without blocking. */
+void alert_reap(Alerts *al) {
+  while (al->running && waitpid(-1, NULL, WNOHANG) > 0)
+    --al->running;
+}
@@ -20,6 +20,9 @@
 #include "bandwidth3.h"
 #include <errno.h>
 #include <getopt.h>
+#include <linux/rtnetlink.h>
+#include <poll.h>
+#include <sys/timerfd.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,53 +31,182 @@
 #include <unistd.h>
 #include <inttypes.h>    // for SCNu64, PRIu64, etc.
 
-/* forward‐declare parse_ifaces (defined later in this file) */
-static size_t parse_ifaces(const char *ifaces_raw, char **vec);
-// parse comma-separated interface list into vec
-static size_t parse_ifaces(const char *ifaces_raw, char **vec) {
-    size_t count = 0;
-    char *tmp = strdup(ifaces_raw);
-    if (!tmp) return 0;
-    char *token = strtok(tmp, ",");
-    while (token && count < 32) {
-        vec[count++] = token;
-        token = strtok(NULL, ",");
-    }
-    return count;
-}
-
 enum { STATE_OK, STATE_WARNING, STATE_CRITICAL, STATE_UNKNOWN };
 
+typedef enum {
+  RUN_STANDALONE, /* sample and print                              */
+  RUN_DAEMON,     /* sample and publish to shared memory, no output */
+  RUN_ATTACH,     /* print what a daemon publishes                 */
+  RUN_REPLAY      /* print what a --record log holds               */
+} RunMode;
+
+/* ---------- Resolved configuration (defaults < env < CLI) ------------ */
+typedef struct {
+  char unit;         /* 'B' bytes or 'b' bits                 */
+  unsigned refresh_ms; /* tick interval in milliseconds        */
+  unsigned divisor;  /* 1024 (IEC) or 1000 (SI)               */
+  AlertRule *alert_rules; /* -W/-C and WARN_RX..., later ones win */
+  size_t n_alert_rules;
+  unsigned hysteresis_pct; /* alerts clear below limit less this    */
+  unsigned alert_hold_ms;  /* a new alert level must last this long */
+  char *alert_cmd;   /* hook run on alert level changes       */
+  bool smooth;       /* --half-life given: alerts use the EWMA */
+  char *ifaces_raw;  /* names/globs; NULL = every link but lo  */
+  char *exclude_raw; /* globs to leave out                     */
+  bool wifi_only, eth_only;
+  SnapBackend backend;
+  bool link_events;  /* track state via RTNLGRP_LINK          */
+  RunMode mode;      /* standalone, --daemon or --attach       */
+  char *shm_name;    /* shared-memory object; NULL = default   */
+  char *listen;      /* OpenMetrics endpoint; NULL = off       */
+  char *record;      /* sample log to append to; NULL = off   */
+  char *replay;      /* sample log to play back (RUN_REPLAY)  */
+  bool realtime;     /* replay at the recorded pace           */
+  unsigned top_n;    /* {top}: flows shown per adapter        */
+  char *history;     /* round-robin history file; NULL = off  */
+  bool adaptive;     /* back off idle links, drop repeat lines */
+  unsigned idle_max_ms; /* --adaptive=T: slowest idle tick; 0 = fixed */
+  bool totals;       /* print totals from history and quit    */
+  HistPeriod totals_period;
+  unsigned totals_rows;
+  unsigned window_ms;    /* statistics window ({rxmax}, {rxp95}) */
+  unsigned half_life_ms; /* EWMA half-life ({rxavg})             */
+  char **formats;    /* -F/FORMAT layout specs, in order      */
+  size_t n_formats;
+  char **groups;     /* --group/IFACE_GROUPS specs, in order  */
+  size_t n_groups;
+  OutputProto proto; /* plain line, i3bar or waybar JSON      */
+  char *config;      /* --config/CONFIG_FILE; NULL = none     */
+  bool self_stats;   /* time tick phases, count syscalls      */
+  unsigned self_stats_ms; /* report every; 0 = on SIGUSR1 only */
+  unsigned sample_ms; /* --sample: sub-interval cadence; 0 = off */
+  uint64_t burst_bps; /* {bursts} threshold (Bytes/s); 0 = none */
+  bool qdisc;        /* dump qdiscs even if no layout shows them */
+  bool qdisc_classes; /* ... and the classes of classful roots   */
+} Config;
+
 static volatile sig_atomic_t g_run = 1;
 static void sigint_handler(int sig) {
   (void)sig;
   g_run = 0;
 }
 
+static volatile sig_atomic_t g_reload; /* SIGHUP or the config file changed */
+static void sighup_handler(int sig) {
+  (void)sig;
+  g_reload = 1;
+}
+
+static volatile sig_atomic_t g_report; /* SIGUSR1: print --self-stats */
+#ifdef BW3_SELF_STATS
+static void sigusr1_handler(int sig) {
+  (void)sig;
+  g_report = 1;
+}
+#endif
+
 /* --------------------------------------------------------------------- */
 static void print_usage(const char *argv0) {
   printf("bandwidth3 %s\n", BANDWIDTH3_VERSION);
   printf("Usage: %s [options]\n\n", argv0);
   printf("  -b | -B        Bits/s or Bytes/s (default Bytes)\n");
-  printf("  -t <sec>       Refresh time (default 1)\n");
-  printf("  -i <list>      Interfaces to monitor (comma‑separated)\n");
-  printf("  -W <rx:tx>     Warning thresholds (Bytes/s)\n");
-  printf("  -C <rx:tx>     Critical thresholds (Bytes/s)\n");
+  printf("  -t <time>      Refresh time: 2, 0.25, 1.5s or 250ms (default 1s)\n");
+  printf("  -i <list>      Interfaces to monitor: names or globs, comma‑separated\n"
+         "                 (default: every link except lo, hot-plug aware);\n"
+         "                 netns:NAME/eth0 or pid:PID/eth0 for other namespaces\n");
+  printf("  -x <list>      Interfaces to leave out: names or globs\n");
+  printf("  -W <[if=]rx:tx> Warning thresholds (Bytes/s); repeatable, with\n"
+         "                 if= (a name or glob) for one adapter only\n");
+  printf("  -C <[if=]rx:tx> Critical thresholds (Bytes/s), like -W\n");
+  printf("  --qdisc-warn <[if=]drops[:backlog]>\n"
+         "                 Warn on the root qdisc's drops/s or backlog\n"
+         "                 (Bytes queued), like -W\n");
+  printf("  --qdisc-crit <[if=]drops[:backlog]>\n"
+         "                 Critical qdisc thresholds, like -C\n");
+  printf("  --hysteresis <pct>\n"
+         "                 Clear an alert only below limit - pct%% (default 10)\n");
+  printf("  --alert-hold <t>\n"
+         "                 A new alert level must last t before it shows\n");
+  printf("  --alert-cmd <cmd>\n"
+         "                 Run cmd (sh -c) on every alert level change, with\n"
+         "                 BW3_IFACE, BW3_DIRECTION, BW3_LEVEL, BW3_PREVIOUS\n"
+         "                 and BW3_RATE set\n");
   printf("  -s             Use SI divisor (1000) instead of IEC (1024)\n");
   printf("  --wifi-only    Restrict to wireless adapters\n");
   printf("  --eth-only     Restrict to wired adapters\n");
+  printf("  --backend <b>  Counter source: procfs (default) or netlink\n");
+  printf("  --link-events  Track link state from netlink events, not sysfs\n");
+  printf("  --window <t>   Window of the min/max/p95/spark fields (default 60s)\n");
+  printf("  --half-life <t>\n"
+         "                 Half-life of the {rxavg}/{txavg} EWMA (default 3s)\n");
+  printf("  --daemon[=NAME]\n"
+         "                 Sample only, publishing to shared memory for readers\n");
+  printf("  --attach[=NAME]\n"
+         "                 Print what a --daemon publishes instead of sampling\n");
+  printf("  --listen <addr> Serve OpenMetrics on [host:]port or unix:/path\n"
+         "                 (a bare port binds to localhost)\n");
+  printf("  --top <n>      Flows per adapter in {top} (default 3, max %u)\n",
+         TOP_MAX);
+  printf("  --record <file> Append every tick's counters and states to a log\n");
+  printf("  --replay <file> Print a --record log at full speed instead of\n"
+         "                 sampling; with --realtime at the recorded pace\n");
+  printf("  --adaptive[=T]  Poll idle links' state less often and skip lines\n"
+         "                 identical to the last; with T, stretch the tick\n"
+         "                 up to T while every link is idle\n");
+  printf("  --history <file>\n"
+         "                 Keep second/minute/hour traffic totals in a file;\n"
+         "                 a restart resumes from its last counters\n");
+  printf("  --totals <p>[:n]\n"
+         "                 Print the last n second, minute, hour or day\n"
+         "                 totals from --history and exit\n");
+  printf("  -F <spec>      Layout template, repeatable: [SCOPE@]STATE=TEMPLATE\n"
+         "                 or TEMPLATE (connected state). SCOPE: wifi, eth or\n"
+         "                 an interface; STATE: up, down, off, err. Fields:\n"
+         "                 {icon} {name} {state} {ssid} {rx} {tx} {signal}\n"
+         "                 {txrate} {rxrate}, windowed {rxavg} {rxmin} {rxmax}\n"
+         "                 {rxp95} {rxspark} (and tx*), busiest TCP flows\n"
+         "                 {top}, sub-interval {rxpeak} {rxlow} (and tx*)\n"
+         "                 {bursts}, root qdisc {qdisc} {qbacklog} {qlen}\n"
+         "                 {qdrops} {qrequeues} {qoverlimits} (per second)\n"
+         "                 and its worst class {qclass}; \"{ f}\" adds a space\n"
+         "                 if f is set, an empty TEMPLATE hides the adapter\n");
+  printf("  --group <NAME=MEMBERS>\n"
+         "                 Extra segment summing MEMBERS (names, globs, @wifi,\n"
+         "                 @eth; ',' or '+' separated), repeatable; bond and\n"
+         "                 bridge ports of a member master count once\n");
+  printf("  --output <p>   Line protocol: plain (Polybar, default), i3bar\n"
+         "                 (also swaybar; click: left = bits/bytes, right =\n"
+         "                 SI/IEC) or waybar (return-type json)\n");
+  printf("  --config <file> KEY=VALUE lines named like the environment\n"
+         "                 variables below, applied over them; reloaded\n"
+         "                 when saved\n");
+  printf("  --sample <t>   Read the counters every t between lines (e.g.\n"
+         "                 20ms) for {rxpeak} {rxlow} (and tx*) {bursts}\n");
+  printf("  --burst <rate> Count rises above rate (Bytes/s) in {bursts}\n");
+  printf("  --qdisc[=classes]\n"
+         "                 Dump every link's root qdisc each tick (implied\n"
+         "                 by the q* fields and qdisc thresholds); classes\n"
+         "                 also dumps the classes of classful roots\n");
+  printf("  --self-stats[=T]\n"
+         "                 Time each tick phase and count syscalls; report\n"
+         "                 on stderr every T, on SIGUSR1 and at exit\n");
   printf("  -V, --version  Show version and exit\n");
   printf("  -h, --help     This help text\n\n");
   printf("Environment overrides: USE_BITS, USE_BYTES, USE_SI, REFRESH_TIME,\n"
-         "  INTERFACES, WARN_RX, WARN_TX, CRIT_RX, CRIT_TX, WIFI_ONLY, "
-         "ETH_ONLY\n");
+         "  INTERFACES, EXCLUDE, WARN_RX, WARN_TX, CRIT_RX, CRIT_TX,\n"
+         "  WIFI_ONLY, ETH_ONLY, BACKEND, LINK_EVENTS, FORMAT, WINDOW,\n"
+         "  HALF_LIFE, LISTEN, TOP, HISTORY, ADAPTIVE, HYSTERESIS, ALERT_HOLD,\n"
+         "  ALERT_CMD, IFACE_GROUPS (';' separated), OUTPUT, CONFIG_FILE,\n"
+         "  SELF_STATS, SAMPLE_INTERVAL, BURST_THRESHOLD, QDISC, QDISC_WARN,\n"
+         "  QDISC_CRIT\n\n");
+  printf("SIGHUP (or saving --config) reloads the configuration between\n"
+         "ticks; adapters keep their counters and statistics.\n");
 }
 
 /* ---------------------------------------------------------------------
- * Helper: safely parse an unsigned 64‑bit integer from environment
+ * Helper: safely parse an unsigned 64‑bit integer from a variable
  * ------------------------------------------------------------------- */
-static void env_to_u64(const char *name, uint64_t *dst) {
-  const char *v = getenv(name);
+static void var_to_u64(const char *v, uint64_t *dst) {
   if (v && *v) {
     char *end = NULL;
     uint64_t tmp = strtoull(v, &end, 10);
@@ -83,165 +215,503 @@ static void env_to_u64(const char *name, uint64_t *dst) {
   }
 }
 
+/* "2", "0.25", "1.5s" or "250ms" → milliseconds; false if unparsable/0. */
+static bool parse_interval_ms(const char *v, unsigned *dst) {
+  char *end = NULL;
+  errno = 0;
+  double val = strtod(v, &end);
+  if (errno || end == v || val <= 0.0)
+    return false;
+  if (strcmp(end, "ms") == 0)
+    ;
+  else if (*end == '\0' || strcmp(end, "s") == 0)
+    val *= 1000.0;
+  else
+    return false;
+  if (val < 1.0 || val > 86400000.0)
+    return false;
+  *dst = (unsigned)(val + 0.5);
+  return true;
+}
+
+/* --qdisc[=root|classes]: NULL is the root qdiscs only. */
+static bool parse_qdisc_mode(const char *v, Config *cfg) {
+  if (v && strcmp(v, "root") != 0 && strcmp(v, "classes") != 0)
+    return false;
+  cfg->qdisc = true;
+  cfg->qdisc_classes = v && strcmp(v, "classes") == 0;
+  return true;
+}
+
+/* Append a layout spec; later specs win over earlier ones. */
+static void add_format(Config *cfg, char *spec) {
+  char **v = realloc(cfg->formats, (cfg->n_formats + 1u) * sizeof *v);
+  if (!v) {
+    perror("format");
+    return;
+  }
+  cfg->formats = v;
+  cfg->formats[cfg->n_formats++] = spec;
+}
+
+/* Append a --group spec; groups print in this order. */
+static void add_group(Config *cfg, char *spec) {
+  char **v = realloc(cfg->groups, (cfg->n_groups + 1u) * sizeof *v);
+  if (!v) {
+    perror("group");
+    return;
+  }
+  cfg->groups = v;
+  cfg->groups[cfg->n_groups++] = spec;
+}
+
+/* Append a threshold rule; later rules win over earlier ones. */
+static bool add_alert_rule(Config *cfg, const AlertRule *r) {
+  AlertRule *v = realloc(cfg->alert_rules,
+                         (cfg->n_alert_rules + 1u) * sizeof *v);
+  if (!v) {
+    perror("threshold");
+    return false;
+  }
+  cfg->alert_rules = v;
+  cfg->alert_rules[cfg->n_alert_rules++] = *r;
+  return true;
+}
+
+/* Map a backend name to its enum; false for unknown names. */
+static bool parse_backend(const char *v, SnapBackend *dst) {
+  if (strcmp(v, "procfs") == 0)
+    *dst = BACKEND_PROCFS;
+  else if (strcmp(v, "netlink") == 0)
+    *dst = BACKEND_NETLINK;
+  else
+    return false;
+  return true;
+}
+
+/* "hour" or "day:7" → period and row count (default: a day's worth of
+ * hours, a month of days, ...); false for unknown periods. */
+static bool parse_totals(const char *v, HistPeriod *p, unsigned *rows) {
+  static const struct {
+    const char *name;
+    HistPeriod p;
+    unsigned rows;
+  } SPANS[] = {{"second", HIST_SEC, 60u},
+               {"minute", HIST_MIN, 60u},
+               {"hour", HIST_HOUR, 24u},
+               {"day", HIST_DAY, 30u}};
+  size_t len = strcspn(v, ":");
+  for (size_t i = 0; i < sizeof SPANS / sizeof SPANS[0]; ++i) {
+    if (strlen(SPANS[i].name) != len || strncmp(v, SPANS[i].name, len) != 0)
+      continue;
+    *p = SPANS[i].p;
+    *rows = SPANS[i].rows;
+    if (v[len] == ':') {
+      char *end = NULL;
+      unsigned long n = strtoul(v + len + 1, &end, 10);
+      if (!n || *end || n > 100000u)
+        return false;
+      *rows = (unsigned)n;
+    }
+    return true;
+  }
+  return false;
+}
+
 /* ---------------------------------------------------------------------
- * Apply environment variables.  Defaults should be set beforehand; CLI
- * will run afterwards (CLI overrides).
+ * Apply variables from the environment or a --config file: get(name,
+ * ctx) returns a value or NULL.  Defaults should be set beforehand; CLI
+ * will run afterwards (CLI overrides).  Strings are kept by reference
+ * and must outlive cfg.
  * ------------------------------------------------------------------- */
-static void apply_env(char *unit, unsigned *refresh, unsigned *divisor,
-                      uint64_t *warn_rx, uint64_t *warn_tx, uint64_t *crit_rx,
-                      uint64_t *crit_tx, char **ifaces_raw, bool *wifi_only,
-                      bool *eth_only) {
+static void apply_vars(Config *cfg,
+                       const char *(*get)(const char *name, const void *ctx),
+                       const void *ctx) {
   const char *v;
 
   /* ---- Units ---------------------------------------------------- */
-  v = getenv("USE_BITS");
+  v = get("USE_BITS", ctx);
   if (v && *v == '1')
-    *unit = 'b';
-  v = getenv("USE_BYTES");
+    cfg->unit = 'b';
+  v = get("USE_BYTES", ctx);
   if (v && *v == '1')
-    *unit = 'B';
+    cfg->unit = 'B';
 
   /* ---- Refresh time -------------------------------------------- */
-  v = getenv("REFRESH_TIME");
+  v = get("REFRESH_TIME", ctx);
   if (v && *v)
-    *refresh = (unsigned)strtoul(v, NULL, 10);
+    if (!parse_interval_ms(v, &cfg->refresh_ms))
+      fprintf(stderr, "Ignoring invalid REFRESH_TIME=%s\n", v);
 
   /* ---- Interface filter ---------------------------------------- */
-  v = getenv("INTERFACES");
+  v = get("INTERFACES", ctx);
   if (!v)
-    v = getenv("INTERFACE");
+    v = get("INTERFACE", ctx);
   if (v && *v)
-    *ifaces_raw = (char *)v; /* env string is static */
+    cfg->ifaces_raw = (char *)v;
+  v = get("EXCLUDE", ctx);
+  if (v && *v)
+    cfg->exclude_raw = (char *)v;
 
-  /* ---- Thresholds --------------------------------------------- */
-  env_to_u64("WARN_RX", warn_rx);
-  env_to_u64("WARN_TX", warn_tx);
-  env_to_u64("CRIT_RX", crit_rx);
-  env_to_u64("CRIT_TX", crit_tx);
+  /* ---- Thresholds (every adapter) ----------------------------- */
+  static const char *const LIMIT_ENV[] = {"WARN_RX", "WARN_TX", "CRIT_RX",
+                                          "CRIT_TX"};
+  for (int i = 0; i < 4; ++i) {
+    uint64_t val = UINT64_MAX;
+    var_to_u64(get(LIMIT_ENV[i], ctx), &val);
+    if (val == UINT64_MAX)
+      continue;
+    AlertRule r = {.scope = "*", .crit = i >= 2};
+    r.set[i & 1] = true;
+    r.v[i & 1] = val;
+    add_alert_rule(cfg, &r);
+  }
+  static const char *const QDISC_LIMIT_ENV[] = {"QDISC_WARN", "QDISC_CRIT"};
+  for (int i = 0; i < 2; ++i) {
+    AlertRule r;
+    v = get(QDISC_LIMIT_ENV[i], ctx);
+    if (!v || !*v)
+      continue;
+    if (!alert_rule_parse(&r, v, i == 1)) {
+      fprintf(stderr, "Ignoring invalid %s=%s\n", QDISC_LIMIT_ENV[i], v);
+      continue;
+    }
+    r.dim = ALERT_DROPS;
+    add_alert_rule(cfg, &r);
+  }
+  v = get("HYSTERESIS", ctx);
+  if (v && *v)
+    cfg->hysteresis_pct = (unsigned)strtoul(v, NULL, 10);
+  v = get("ALERT_HOLD", ctx);
+  if (v && *v && !parse_interval_ms(v, &cfg->alert_hold_ms))
+    fprintf(stderr, "Ignoring invalid ALERT_HOLD=%s\n", v);
+  v = get("ALERT_CMD", ctx);
+  if (v && *v)
+    cfg->alert_cmd = (char *)v;
 
   /* ---- Divisor ------------------------------------------------- */
-  v = getenv("USE_SI");
+  v = get("USE_SI", ctx);
   if (v && *v == '1')
-    *divisor = 1000u;
+    cfg->divisor = 1000u;
 
   /* ---- Transport filter --------------------------------------- */
-  v = getenv("WIFI_ONLY");
+  v = get("WIFI_ONLY", ctx);
+  if (v && *v == '1')
+    cfg->wifi_only = true;
+  v = get("ETH_ONLY", ctx);
   if (v && *v == '1')
-    *wifi_only = true;
-  v = getenv("ETH_ONLY");
+    cfg->eth_only = true;
+
+  /* ---- Counter backend ---------------------------------------- */
+  v = get("BACKEND", ctx);
+  if (v && *v && !parse_backend(v, &cfg->backend))
+    fprintf(stderr, "Ignoring unknown BACKEND=%s\n", v);
+  v = get("LINK_EVENTS", ctx);
   if (v && *v == '1')
-    *eth_only = true;
+    cfg->link_events = true;
+
+  /* ---- Statistics --------------------------------------------- */
+  v = get("WINDOW", ctx);
+  if (v && *v && !parse_interval_ms(v, &cfg->window_ms))
+    fprintf(stderr, "Ignoring invalid WINDOW=%s\n", v);
+  v = get("HALF_LIFE", ctx);
+  if (v && *v && !parse_interval_ms(v, &cfg->half_life_ms))
+    fprintf(stderr, "Ignoring invalid HALF_LIFE=%s\n", v);
+  else if (v && *v)
+    cfg->smooth = true;
+
+  /* ---- Metrics endpoint --------------------------------------- */
+  v = get("LISTEN", ctx);
+  if (v && *v)
+    cfg->listen = (char *)v;
+
+  /* ---- Top talkers -------------------------------------------- */
+  v = get("TOP", ctx);
+  if (v && *v)
+    cfg->top_n = (unsigned)strtoul(v, NULL, 10);
+
+  /* ---- Adaptive sampling: "1" or the slowest idle tick -------- */
+  v = get("ADAPTIVE", ctx);
+  if (v && *v && strcmp(v, "0") != 0) {
+    cfg->adaptive = true;
+    if (strcmp(v, "1") != 0 && !parse_interval_ms(v, &cfg->idle_max_ms))
+      fprintf(stderr, "Ignoring invalid ADAPTIVE=%s\n", v);
+  }
+
+  /* ---- Self-instrumentation: "1" or the report interval ------ */
+  v = get("SELF_STATS", ctx);
+  if (v && *v && strcmp(v, "0") != 0) {
+    cfg->self_stats = true;
+    if (strcmp(v, "1") != 0 && !parse_interval_ms(v, &cfg->self_stats_ms))
+      fprintf(stderr, "Ignoring invalid SELF_STATS=%s\n", v);
+  }
+
+  /* ---- Sub-interval sampling ---------------------------------- */
+  v = get("SAMPLE_INTERVAL", ctx);
+  if (v && *v && !parse_interval_ms(v, &cfg->sample_ms))
+    fprintf(stderr, "Ignoring invalid SAMPLE_INTERVAL=%s\n", v);
+  var_to_u64(get("BURST_THRESHOLD", ctx), &cfg->burst_bps);
+
+  /* ---- Queueing disciplines: "1" or "classes" ----------------- */
+  v = get("QDISC", ctx);
+  if (v && *v && strcmp(v, "0") != 0 &&
+      !parse_qdisc_mode(strcmp(v, "1") == 0 ? NULL : v, cfg))
+    fprintf(stderr, "Ignoring invalid QDISC=%s\n", v);
+
+  /* ---- Traffic history --------------------------------------- */
+  v = get("HISTORY", ctx);
+  if (v && *v)
+    cfg->history = (char *)v;
+
+  /* ---- Output layout ------------------------------------------ */
+  v = get("FORMAT", ctx);
+  if (v)
+    add_format(cfg, (char *)v);
+
+  /* ---- Bar protocol ------------------------------------------- */
+  v = get("OUTPUT", ctx);
+  if (v && *v && !parse_output_proto(v, &cfg->proto))
+    fprintf(stderr, "Ignoring unknown OUTPUT=%s\n", v);
+
+  /* ---- Interface groups: "up=eth0+eth1;air=@wifi" ------------- */
+  v = get("IFACE_GROUPS", ctx);
+  while (v && *v) {
+    v += strspn(v, "; ");
+    if (*v)
+      add_group(cfg, (char *)v); /* group_parse() stops at the ';' */
+    v += strcspn(v, ";");
+  }
 }
 
-/* --------------------------------------------------------------------- */
-static const char *state_icon(bool wifi, IfState st) {
-  const char *base = wifi ? "" : ""; /* Nerd Font glyphs */
-  switch (st) {
-  case IFSTATE_CONNECTED:
-    return base;
-  case IFSTATE_DISCONNECTED:
-    return "⚠";
-  case IFSTATE_DISABLED:
-    return "✗";
-  default:
-    return "�";
-  }
-}
-
-// --- Format strategy for Ethernet adapters: only print when connected
-static bool print_eth(Iface *n, double rx, double tx,
-                      char unit, unsigned divisor,
-                      uint64_t warn_rx, uint64_t warn_tx,
-                      uint64_t crit_rx, uint64_t crit_tx) {
-    if (n->state != IFSTATE_CONNECTED)
-        return false;
+static const char *env_get(const char *name, const void *ctx) {
+  (void)ctx;
+  return getenv(name);
+}
 
-    printf("[ %s | ", state_icon(n->wifi, n->state));
-    human_print(rx, unit, divisor, warn_rx, crit_rx);
-    printf(" ");
-    human_print(tx, unit, divisor, warn_tx, crit_tx);
-    printf(" ]");
-    return true;
+static const char *file_get(const char *name, const void *ctx) {
+  return conf_get(ctx, name);
 }
 
-// --- Format strategy for Wi-Fi adapters: hide when disabled, show disconnected when idle
-static bool print_wifi(Iface *n, double rx, double tx,
-                       char unit, unsigned divisor,
-                       uint64_t warn_rx, uint64_t warn_tx,
-                       uint64_t crit_rx, uint64_t crit_tx) {
-    if (n->state == IFSTATE_DISABLED)
-        return false;
+/* ---------- Configuration passes ------------------------------------ */
+static void config_defaults(Config *cfg) {
+  *cfg = (Config){.unit = 'B',
+                  .refresh_ms = 1000u,
+                  .window_ms = 60000u,
+                  .half_life_ms = 3000u,
+                  .hysteresis_pct = 10u,
+                  .divisor = 1024u,
+                  .backend = BACKEND_PROCFS};
+}
 
-    printf("[ %s", state_icon(n->wifi, n->state));
-    if (n->state == IFSTATE_CONNECTED) {
-        if (n->ssid[0] != '\0') {
-            printf(" %s", n->ssid);
-        }
-        printf(" | ");
-        human_print(rx, unit, divisor, warn_rx, crit_rx);
-        printf(" ");
-        human_print(tx, unit, divisor, warn_tx, crit_tx);
-    } else if (n->state == IFSTATE_DISCONNECTED) {
-        printf(" | [no-link]");
-    } else { // IFSTATE_ERR or other
-        printf(" | [err]");
-    }
-    printf(" ]");
-    return true;
+static void config_free(Config *cfg) {
+  free(cfg->formats);
+  free(cfg->alert_rules);
+  free(cfg->groups);
+  cfg->formats = NULL;
+  cfg->alert_rules = NULL;
+  cfg->groups = NULL;
+  cfg->n_formats = cfg->n_alert_rules = cfg->n_groups = 0;
 }
 
-/* --------------------------------------------------------------------- */
-int main(int argc, char *argv[]) {
-  /* ---------- 1. Defaults --------------------------------------- */
-  char unit = 'B';
-  unsigned refresh = 1u;
-  unsigned divisor = 1024u;
-  uint64_t warn_rx = 0, warn_tx = 0;
-  uint64_t crit_rx = 0, crit_tx = 0;
-  bool wifi_only = false, eth_only = false;
-  char *ifaces_raw = NULL; /* may point to env string */
-
-  /* ---------- 2. Environment (override defaults) ---------------- */
-  apply_env(&unit, &refresh, &divisor, &warn_rx, &warn_tx, &crit_rx, &crit_tx,
-            &ifaces_raw, &wifi_only, &eth_only);
-
-  /* ---------- 3. CLI parsing (override env) --------------------- */
-  static const struct option long_opts[] = {{"wifi-only", no_argument, 0, 1},
-                                            {"eth-only", no_argument, 0, 2},
-                                            {"help", no_argument, 0, 'h'},
-                                            {"version", no_argument, 0, 'V'},
-                                            {0, 0, 0, 0}};
+static const struct option long_opts[] = {{"wifi-only", no_argument, 0, 1},
+                                          {"eth-only", no_argument, 0, 2},
+                                          {"backend", required_argument, 0, 3},
+                                          {"link-events", no_argument, 0, 4},
+                                          {"window", required_argument, 0, 5},
+                                          {"half-life", required_argument, 0, 6},
+                                          {"daemon", optional_argument, 0, 7},
+                                          {"attach", optional_argument, 0, 8},
+                                          {"listen", required_argument, 0, 9},
+                                          {"record", required_argument, 0, 10},
+                                          {"replay", required_argument, 0, 11},
+                                          {"realtime", no_argument, 0, 12},
+                                          {"top", required_argument, 0, 13},
+                                          {"history", required_argument, 0, 14},
+                                          {"totals", required_argument, 0, 15},
+                                          {"adaptive", optional_argument, 0, 16},
+                                          {"hysteresis", required_argument, 0, 17},
+                                          {"alert-hold", required_argument, 0, 18},
+                                          {"alert-cmd", required_argument, 0, 19},
+                                          {"group", required_argument, 0, 20},
+                                          {"output", required_argument, 0, 21},
+                                          {"config", required_argument, 0, 22},
+                                          {"self-stats", optional_argument, 0, 23},
+                                          {"sample", required_argument, 0, 24},
+                                          {"burst", required_argument, 0, 25},
+                                          {"qdisc", optional_argument, 0, 26},
+                                          {"qdisc-warn", required_argument, 0, 27},
+                                          {"qdisc-crit", required_argument, 0, 28},
+                                          {"format", required_argument, 0, 'F'},
+                                          {"help", no_argument, 0, 'h'},
+                                          {"version", no_argument, 0, 'V'},
+                                          {0, 0, 0, 0}};
 
+/* Command-line options over cfg; -1 to go on, else the exit status.  May
+ * run more than once: every pass starts from the first argument. */
+static int parse_cli(Config *cfg, int argc, char *argv[]) {
   int opt, idx;
-  while ((opt = getopt_long(argc, argv, "bBsht:i:W:C:V", long_opts, &idx)) !=
+  optind = 0; /* glibc: full re-initialisation */
+  while ((opt = getopt_long(argc, argv, "bBsht:i:x:W:C:F:V", long_opts, &idx)) !=
          -1) {
     switch (opt) {
     case 'b':
-      unit = 'b';
+      cfg->unit = 'b';
       break;
     case 'B':
-      unit = 'B';
+      cfg->unit = 'B';
       break;
     case 't':
-      refresh = (unsigned)strtoul(optarg, NULL, 10);
+      if (!parse_interval_ms(optarg, &cfg->refresh_ms)) {
+        fprintf(stderr, "Invalid refresh time '%s'\n", optarg);
+        return STATE_UNKNOWN;
+      }
       break;
     case 'i':
-      ifaces_raw = optarg;
+      cfg->ifaces_raw = optarg;
       break;
-    case 'W':
-      sscanf(optarg, "%" SCNu64 ":%" SCNu64, &warn_rx, &warn_tx);
+    case 'x':
+      cfg->exclude_raw = optarg;
       break;
-    case 'C':
-      sscanf(optarg, "%" SCNu64 ":%" SCNu64, &crit_rx, &crit_tx);
+    case 'W':
+    case 'C': {
+      AlertRule r;
+      if (!alert_rule_parse(&r, optarg, opt == 'C')) {
+        fprintf(stderr, "Invalid threshold '%s' ([if=]rx[:tx])\n", optarg);
+        return STATE_UNKNOWN;
+      }
+      if (!add_alert_rule(cfg, &r))
+        return STATE_UNKNOWN;
       break;
+    }
     case 's':
-      divisor = 1000u;
+      cfg->divisor = 1000u;
       break;
     case 1:
-      wifi_only = true;
+      cfg->wifi_only = true;
       break;
     case 2:
-      eth_only = true;
+      cfg->eth_only = true;
+      break;
+    case 3:
+      if (!parse_backend(optarg, &cfg->backend)) {
+        fprintf(stderr, "Unknown backend '%s' (procfs|netlink)\n", optarg);
+        return STATE_UNKNOWN;
+      }
+      break;
+    case 4:
+      cfg->link_events = true;
+      break;
+    case 5:
+    case 6:
+    case 18:
+      if (!parse_interval_ms(optarg, opt == 5   ? &cfg->window_ms
+                                     : opt == 6 ? &cfg->half_life_ms
+                                                : &cfg->alert_hold_ms)) {
+        fprintf(stderr, "Invalid %s '%s'\n", long_opts[idx].name, optarg);
+        return STATE_UNKNOWN;
+      }
+      cfg->smooth |= opt == 6;
+      break;
+    case 7:
+    case 8:
+      cfg->mode = opt == 7 ? RUN_DAEMON : RUN_ATTACH;
+      cfg->shm_name = optarg;
+      break;
+    case 9:
+      cfg->listen = optarg;
+      break;
+    case 10:
+      cfg->record = optarg;
+      break;
+    case 11:
+      cfg->mode = RUN_REPLAY;
+      cfg->replay = optarg;
+      break;
+    case 12:
+      cfg->realtime = true;
+      break;
+    case 13:
+      cfg->top_n = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 14:
+      cfg->history = optarg;
+      break;
+    case 15:
+      if (!parse_totals(optarg, &cfg->totals_period, &cfg->totals_rows)) {
+        fprintf(stderr, "Invalid totals '%s' (second|minute|hour|day[:n])\n",
+                optarg);
+        return STATE_UNKNOWN;
+      }
+      cfg->totals = true;
+      break;
+    case 17:
+      cfg->hysteresis_pct = (unsigned)strtoul(optarg, NULL, 10);
+      break;
+    case 19:
+      cfg->alert_cmd = optarg;
+      break;
+    case 20:
+      add_group(cfg, optarg);
+      break;
+    case 22:
+      cfg->config = optarg;
+      break;
+    case 23:
+      cfg->self_stats = true;
+      if (optarg && !parse_interval_ms(optarg, &cfg->self_stats_ms)) {
+        fprintf(stderr, "Invalid report interval '%s'\n", optarg);
+        return STATE_UNKNOWN;
+      }
+      break;
+    case 24:
+      if (!parse_interval_ms(optarg, &cfg->sample_ms)) {
+        fprintf(stderr, "Invalid sample interval '%s'\n", optarg);
+        return STATE_UNKNOWN;
+      }
+      break;
+    case 25: {
+      char *end = NULL;
+      cfg->burst_bps = strtoull(optarg, &end, 10);
+      if (end == optarg || *end || *optarg == '-') {
+        fprintf(stderr, "Invalid burst threshold '%s' (Bytes/s)\n", optarg);
+        return STATE_UNKNOWN;
+      }
+      break;
+    }
+    case 26:
+      if (!parse_qdisc_mode(optarg, cfg)) {
+        fprintf(stderr, "Unknown qdisc mode '%s' (root|classes)\n", optarg);
+        return STATE_UNKNOWN;
+      }
+      break;
+    case 27:
+    case 28: {
+      AlertRule r;
+      if (!alert_rule_parse(&r, optarg, opt == 28)) {
+        fprintf(stderr, "Invalid qdisc threshold '%s' ([if=]drops[:backlog])\n",
+                optarg);
+        return STATE_UNKNOWN;
+      }
+      r.dim = ALERT_DROPS;
+      if (!add_alert_rule(cfg, &r))
+        return STATE_UNKNOWN;
+      break;
+    }
+    case 21:
+      if (!parse_output_proto(optarg, &cfg->proto)) {
+        fprintf(stderr, "Unknown output '%s' (plain|i3bar|waybar)\n", optarg);
+        return STATE_UNKNOWN;
+      }
+      break;
+    case 16:
+      cfg->adaptive = true;
+      if (optarg && !parse_interval_ms(optarg, &cfg->idle_max_ms)) {
+        fprintf(stderr, "Invalid idle tick '%s'\n", optarg);
+        return STATE_UNKNOWN;
+      }
+      break;
+    case 'F':
+      add_format(cfg, optarg);
       break;
     case 'V':
       printf("%s\n", BANDWIDTH3_VERSION);
@@ -254,76 +724,1383 @@ int main(int argc, char *argv[]) {
       return STATE_UNKNOWN;
     }
   }
+  return -1;
+}
+
+/* defaults < environment < --config file < command line.  The file's
+ * strings live in *file, which must outlive cfg; -1 to go on, else the
+ * exit status. */
+static int resolve_config(Config *cfg, ConfFile *file, int argc,
+                          char *argv[]) {
+  memset(file, 0, sizeof *file);
+  config_defaults(cfg); /* first pass: only to learn the file's name */
+  int rc = parse_cli(cfg, argc, argv);
+  char *path = cfg->config ? cfg->config : getenv("CONFIG_FILE");
+  config_free(cfg);
+  if (rc >= 0)
+    return rc;
 
-  /* Disallow conflicting filters */
-  if (wifi_only && eth_only) {
+  config_defaults(cfg);
+  apply_vars(cfg, env_get, NULL);
+  if (path && *path) {
+    char err[128];
+    if (!conf_load(file, path, err, sizeof err)) {
+      fprintf(stderr, "%s: %s\n", path, err);
+      conf_free(file);
+      config_free(cfg);
+      return STATE_UNKNOWN;
+    }
+    apply_vars(cfg, file_get, file);
+    cfg->config = path;
+  }
+  rc = parse_cli(cfg, argc, argv);
+  if (rc < 0 && cfg->wifi_only && cfg->eth_only) {
     fputs("Cannot combine --wifi-only and --eth-only\n", stderr);
-    return STATE_UNKNOWN;
+    rc = STATE_UNKNOWN;
+  }
+  if (rc >= 0) {
+    config_free(cfg);
+    conf_free(file);
+  }
+  return rc;
+}
+
+/* Periodic CLOCK_MONOTONIC timerfd armed on absolute deadlines: the
+ * kernel advances the deadline itself, so processing time never drifts
+ * the tick grid. */
+static bool tick_timer_arm(int fd, unsigned period_ms) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  struct timespec period = {.tv_sec = period_ms / 1000u,
+                            .tv_nsec = (long)(period_ms % 1000u) * 1000000L};
+  struct itimerspec its = {.it_interval = period, .it_value = now};
+  its.it_value.tv_sec += period.tv_sec;
+  its.it_value.tv_nsec += period.tv_nsec;
+  if (its.it_value.tv_nsec >= 1000000000L) {
+    its.it_value.tv_sec += 1;
+    its.it_value.tv_nsec -= 1000000000L;
+  }
+  return timerfd_settime(fd, TFD_TIMER_ABSTIME, &its, NULL) == 0;
+}
+
+static int tick_timer_open(unsigned period_ms) {
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (fd >= 0 && !tick_timer_arm(fd, period_ms)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* ---------- Runtime state shared by the loop helpers ----------------- */
+#define EV_BUF_SIZE 8192u
+
+typedef struct App {
+  Config cfg;
+  ConfFile conf;     /* --config contents cfg's strings point into      */
+  int conf_fd;       /* inotify watch on its directory, -1 when off     */
+  IfaceFilter filter;
+  IfaceTable tab;    /* every link seen; filtered ones are "ignored" */
+  NetSnapshot snap;
+  Formatter fmt;
+  Nl80211 nl;        /* opened lazily on the first Wi-Fi link          */
+  OutBuf out;
+  int ev_fd;         /* RTNLGRP_LINK subscription, -1 when polling      */
+  char *ev_buf;
+  uint32_t gen;      /* snapshot generation, for hot-unplug detection   */
+  uint32_t window_n; /* samples per statistics window                   */
+  bool stats;        /* keep RateWindows (layouts or daemon need them)  */
+  uint64_t ticks;    /* sampling passes so far                          */
+  ShmSeg shm;        /* --daemon: writer, --attach: reader mapping      */
+  char shm_name[64];
+  uint64_t shm_ticks; /* --attach: last sampler tick consumed           */
+  uint32_t shm_busy;  /* --attach: failed reads in a row                */
+  Exporter exp;      /* --listen scrape endpoint (fd -1 when off)       */
+  Recorder rec;      /* --record sample log (fd -1 when off)           */
+  Replay rp;         /* --replay source                                */
+  SockDiag sd;       /* {top} flow accounting (fd -1 when off)         */
+  QdiscDump qd;      /* --qdisc / q* fields (fd -1 when off)           */
+  History hist;      /* --history file (fd -1 when off)                */
+  Alerts alerts;     /* threshold settings and running hooks           */
+  IfaceGroup *groups; /* --group segments, after the adapters           */
+  size_t n_groups;
+  SysfsBatch sysfs;  /* polled link states, one batch per tick         */
+  NetnsSet netns;    /* -i netns:/pid: namespaces, a dump socket each  */
+  OutBuf last;       /* --adaptive: the line printed last              */
+  OutBuf tip;        /* --output waybar: tooltip being built           */
+  Template tip_tpl;  /* one tooltip line per adapter                   */
+  BarClicks clicks;  /* --output i3bar: click events on stdin          */
+  bool i3_more;      /* i3bar: later arrays are ',' separated          */
+  unsigned period_ms; /* current tick; above refresh_ms while idle     */
+  unsigned idle_ticks; /* consecutive ticks with every link idle       */
+  bool changed;      /* an event changed something worth re-rendering   */
+  uint64_t report_ms; /* --self-stats=T: last periodic report          */
+  int sample_fd;     /* --sample timer, -1 when off                    */
+  uint64_t burst_min_ns; /* shorter sub-intervals merge into the next  */
+} App;
+
+/* The i-th shown segment: visible adapters, then groups; NULL past
+ * the end. */
+static const Iface *segment(const App *a, size_t *i) {
+  for (; *i < a->tab.n; ++*i)
+    if (!a->tab.v[*i].ignored)
+      return &a->tab.v[(*i)++];
+  size_t g = *i - a->tab.n;
+  if (g >= a->n_groups)
+    return NULL;
+  ++*i;
+  return &a->groups[g].n;
+}
+
+/* The same segments as an i3bar block array or a waybar object. */
+static void render_json(App *a, const RenderOpts *ro) {
+  OutBuf *out = &a->out;
+  bool first = true;
+  AlertLevel level = ALERT_OK;
+  unsigned pct = 0;
+  const Iface *n;
+  if (a->cfg.proto == PROTO_I3BAR) {
+    if (a->i3_more)
+      out_put(out, ",", 1);
+    out_put(out, "[", 1);
+    a->i3_more = true;
+  } else
+    bar_waybar_begin(out, &a->tip);
+  for (size_t i = 0; (n = segment(a, &i));) {
+    const Template *t = n->layout[n->state];
+    bool shown = a->cfg.proto == PROTO_I3BAR
+                     ? bar_i3_block(out, t, n, ro, first)
+                     : bar_waybar_text(out, &a->tip, t, &a->tip_tpl, n, ro,
+                                       first);
+    if (!shown)
+      continue;
+    first = false;
+    for (int d = 0; d < ALERT_DIMS; ++d)
+      if (n->al[d].level > level)
+        level = (AlertLevel)n->al[d].level;
+    unsigned p = bar_percent(n);
+    pct = p > pct ? p : pct;
+  }
+  if (a->cfg.proto == PROTO_I3BAR)
+    out_put(out, "]\n", 2);
+  else
+    bar_waybar_end(out, &a->tip, level, pct);
+}
+
+/* Render one line – every visible adapter, separated by " | " – into
+ * the line buffer and emit it with a single write(). */
+static void render_line(App *a) {
+  const Config *cfg = &a->cfg;
+  const RenderOpts ro = {.unit = cfg->unit,
+                         .divisor = cfg->divisor,
+                         .json = cfg->proto != PROTO_PLAIN};
+  OutBuf *out = &a->out;
+  out->len = 0;
+  const Iface *n;
+  if (ro.json)
+    render_json(a, &ro);
+  for (size_t i = 0; !ro.json && (n = segment(a, &i));) {
+    size_t mark = out->len;
+    if (mark)
+      out_put(out, " | ", 3); // Separator between interface groups
+    if (!render_iface(out, n->layout[n->state], n, &ro))
+      out->len = mark;
+  }
+  if (out->len && !ro.json) // Only print newline if something was printed
+    out_put(out, "\n", 1);
+  if (out->len) {
+    if (a->cfg.adaptive) {
+      /* the bar redraws on every line: don't send it the same one */
+      if (out->len == a->last.len &&
+          memcmp(out->buf, a->last.buf, out->len) == 0) {
+        out->len = 0;
+        return;
+      }
+      a->last.len = 0;
+      out_put(&a->last, out->buf, out->len);
+    }
+    out_flush(out, STDOUT_FILENO);
+  }
+}
+
+/* Print the line, or hand the state to the readers in --daemon mode. */
+static void emit(App *a) {
+  uint64_t t0 = SELF_START();
+  if (a->cfg.mode != RUN_DAEMON)
+    render_line(a);
+  else if (!shm_publish(&a->shm, &a->tab, a->ticks, a->period_ms))
+    perror("shared memory");
+  SELF_END(PH_OUTPUT, t0);
+}
+
+/* ---------- Discovery ------------------------------------------------ */
+/* Filter verdict and group membership under the current configuration. */
+static void classify_link(App *a, Iface *n) {
+  n->ignored = !n->pinned && !iface_filter_match(&a->filter, n->name);
+  if ((a->cfg.wifi_only && !n->wifi) || (a->cfg.eth_only && n->wifi))
+    n->ignored = true;
+  n->groups = group_mask(a->groups, a->n_groups, n->name, n->wifi);
+}
+
+/* Layout, statistics windows and limits of a shown link. */
+static void bind_link(App *a, Iface *n) {
+  formatter_layout(&a->fmt, n->name, n->wifi, n->layout);
+  if (!n->rs && a->stats && !(n->rs = rate_stats_new(a->window_n)))
+    perror("rate statistics");
+  alert_limits(&n->lim, a->cfg.alert_rules, a->cfg.n_alert_rules, n->name);
+}
+
+/* Filter a new or re-created link and bind its layout and statistics;
+ * false (cached as ignored) when it is not to be shown.  Either way its
+ * ifindex is kept: the netlink backend re-probes a link only when that
+ * changes, so a negative match stands until the link is re-created. */
+static bool adopt_link(App *a, Iface *n, bool wifi, int ifindex) {
+  n->wifi = wifi;
+  classify_link(a, n);
+  iftab_set_index(&a->tab, n, ifindex);
+  if (n->ignored && !n->groups)
+    return false;
+
+  n->rx_rate = n->tx_rate = 0.0;
+  n->wl_stamp_ms = 0;
+  n->state_every_ms = 0;
+  sysfs_forget(n); /* re-created link: new sysfs directory */
+  if (n->ignored)
+    return true; /* hidden group member: counters and state only */
+
+  if (n->rs) {
+    rate_window_reset(&n->rs[0]); /* re-created link: start over */
+    rate_window_reset(&n->rs[1]);
+  }
+  bind_link(a, n);
+  memset(n->al, 0, sizeof n->al);
+  qdisc_forget(n); /* re-created link: a new root qdisc */
+  return true;
+}
+
+static void update_rates(App *a, Iface *n, const NetStats *now);
+
+/* wifi_refresh(), saying once when SSIDs fall back to the old ioctl. */
+static void refresh_wifi(App *a, Iface *n, uint64_t now) {
+  if (!wifi_refresh(&a->nl, n, now))
+    fputs("nl80211 unavailable, using wireless extensions\n", stderr);
+}
+
+/* (Re)probe a link that just appeared: kind, layout, state and a primed
+ * counter baseline so its first rate is a real delta, not a spike.  With
+ * --history, a previous run's counters make that first rate real too. */
+static void attach_link(App *a, Iface *n, const SnapEntry *e) {
+  if (!adopt_link(a, n, !n->netns && is_wireless(n->name),
+                  e->ifindex ? e->ifindex : iface_index(n->name)))
+    return;
+  n->prev = e->stats;
+  burst_prime(&n->burst, &e->stats);
+  n->state = iface_link_state(n, e);
+  if (n->groups)
+    n->master = e->has_link ? e->master : iface_master(n->name);
+  if (a->hist.map && !n->ignored && hist_resume(&a->hist, n, e->stats.ts_ns, &n->prev)) {
+    update_rates(a, n, &e->stats);
+    refresh_wifi(a, n, mono_ms());
+    a->changed = true; /* worth a line before the first tick */
+  }
+}
+
+static bool still_present(const Iface *n, void *ctx) {
+  const App *a = ctx;
+  return n->pinned || n->seen == a->gen;
+}
+
+/* Literal -i names stay visible as [err] while absent; other links that
+ * missed this pass are dropped. */
+static void forget_absent(App *a) {
+  for (size_t i = 0; i < a->tab.n; ++i) {
+    Iface *n = &a->tab.v[i];
+    if (n->pinned && n->seen != a->gen) {
+      n->state = IFSTATE_ERR;
+      n->rx_rate = n->tx_rate = 0.0;
+      n->wl = (WifiLink){0};
+    }
+  }
+  iftab_prune(&a->tab, still_present, a);
+}
+
+/* Feed the rates of the last dt seconds to the windows, which hold one
+ * sample per configured refresh: a tick stretched by --adaptive=T
+ * stands for dt / refresh of them, so the window keeps covering
+ * --window of time rather than window_n ticks. */
+static void window_push(const App *a, Iface *n, double dt) {
+  double ticks =
+      a->cfg.idle_max_ms ? dt * 1e3 / a->cfg.refresh_ms + 0.5 : 1.0;
+  uint32_t k = ticks < 1.0 ? 1u : (uint32_t)ticks;
+  if (k > a->window_n)
+    k = a->window_n; /* the whole window, once */
+  double alpha = ewma_alpha(dt / k, a->cfg.half_life_ms / 1e3);
+  for (uint32_t i = 0; i < k; ++i) {
+    rate_window_push(&n->rs[0], n->rx_rate, alpha);
+    rate_window_push(&n->rs[1], n->tx_rate, alpha);
+  }
+}
+
+/* New counters for a known adapter: rates and windowed statistics. */
+static void update_rates(App *a, Iface *n, const NetStats *now) {
+  /* divide by the measured interval, not the nominal refresh */
+  double dt = (double)(now->ts_ns - n->prev.ts_ns) / 1e9;
+  n->rx_rate = avg_rate(now->rx_bytes, n->prev.rx_bytes, dt);
+  n->tx_rate = avg_rate(now->tx_bytes, n->prev.tx_bytes, dt);
+  n->prev = *now;
+  if (n->rs)
+    window_push(a, n, dt);
+  alert_update(&a->alerts, n, now->ts_ns / 1000000u);
+}
+
+/* ---------- Adaptive sampling (--adaptive) -------------------------- */
+#define ADAPT_STATE_MAX_MS 2000u /* slowest state poll: how late "down" shows */
+#define ADAPT_IDLE_BPS 1024.0    /* below this (both ways) a link is idle    */
+#define ADAPT_IDLE_TICKS 5u      /* idle ticks before the tick stretches     */
+
+/* Whether to read a link's state from sysfs this tick.  With --adaptive
+ * a link whose counters stand still is polled after 1, 2, 4, ... s (up
+ * to ADAPT_STATE_MAX_MS); the first byte moved brings it back to every
+ * tick.  Netlink dumps carry the state for free. */
+static bool state_due(const App *a, Iface *n, const SnapEntry *e, bool moved,
+                      uint64_t now) {
+  if (!a->cfg.adaptive || e->has_link || moved) {
+    n->state_every_ms = 0;
+    return true;
+  }
+  if (n->state_every_ms && now - n->state_ms < n->state_every_ms)
+    return false;
+  n->state_ms = now;
+  n->state_every_ms = n->state_every_ms ? n->state_every_ms * 2u
+                                        : a->cfg.refresh_ms;
+  if (n->state_every_ms > ADAPT_STATE_MAX_MS)
+    n->state_every_ms = ADAPT_STATE_MAX_MS;
+  return true;
+}
+
+/* --adaptive=T: once every link has been idle (or down) for
+ * ADAPT_IDLE_TICKS, double the tick up to T; a busy link, a state change
+ * or a link event snaps it back to the configured refresh. */
+static void adapt_period(App *a, int tick_fd, bool busy) {
+  for (size_t i = 0; i < a->tab.n && !busy; ++i) {
+    const Iface *n = &a->tab.v[i];
+    busy = !n->ignored && (n->rx_rate >= ADAPT_IDLE_BPS ||
+                           n->tx_rate >= ADAPT_IDLE_BPS);
   }
+  for (size_t i = 0; i < a->n_groups && !busy; ++i)
+    busy = a->groups[i].n.rx_rate >= ADAPT_IDLE_BPS ||
+           a->groups[i].n.tx_rate >= ADAPT_IDLE_BPS;
+  unsigned want = a->cfg.refresh_ms;
+  if (busy)
+    a->idle_ticks = 0;
+  else if (a->idle_ticks < ADAPT_IDLE_TICKS)
+    ++a->idle_ticks;
+  else if ((want = a->period_ms * 2u) > a->cfg.idle_max_ms)
+    want = a->cfg.idle_max_ms;
+  if (want < a->cfg.refresh_ms)
+    want = a->cfg.refresh_ms;
+  if (want != a->period_ms && tick_timer_arm(tick_fd, want))
+    a->period_ms = want;
+}
+
+/* ---------- Interface groups (--group) ----------------------------- */
+/* Fold every group from the member rates and states already updated;
+ * on a tick (not for an event) also feed its windows and alerts. */
+static void update_groups(App *a, bool tick) {
+  uint64_t now = mono_ms();
+  for (size_t i = 0; i < a->n_groups; ++i) {
+    Iface *n = &a->groups[i].n;
+    bool wifi = n->wifi;
+    group_sum(&a->groups[i], i, &a->tab);
+    if (n->wifi != wifi)
+      formatter_layout(&a->fmt, n->name, n->wifi, n->layout);
+    if (!tick)
+      continue;
+    if (n->rs)
+      window_push(a, n, a->period_ms / 1e3);
+    alert_update(&a->alerts, n, now);
+  }
+}
+
+/* A polled link changed state: fetch Wi-Fi details anew and, for a
+ * group member, look again for a bond/bridge it may just have joined
+ * (the netlink backend reports that every tick). */
+static void state_changed(App *a, Iface *n) {
+  n->wl_stamp_ms = 0; /* (re)association: fetch SSID now */
+  a->changed = true;
+  if (n->groups && a->cfg.backend == BACKEND_PROCFS && !n->netns)
+    n->master = iface_master(n->name);
+}
+
+/* Table name of a snapshot entry: "NAME/ifname" when dumped from
+ * another namespace (ns), NULL if that does not fit. */
+static const char *link_name(const SnapEntry *e, const Netns *ns,
+                             char buf[IFACE_NAME_MAX]) {
+  if (!ns)
+    return e->name;
+  int len = snprintf(buf, IFACE_NAME_MAX, "%s/%s", ns->label, e->name);
+  return len < IFACE_NAME_MAX ? buf : NULL;
+}
+
+/* One snapshot entry: (re)probe a new link or update a known one; true
+ * when it closed a --sample sub-interval. */
+static bool sample_link(App *a, const SnapEntry *e, const Netns *ns,
+                        uint64_t now) {
+  char buf[IFACE_NAME_MAX];
+  const char *name = link_name(e, ns, buf);
+  if (!name)
+    return false;
+  Iface *n = iftab_find(&a->tab, name);
+  /* new, returning or re-created link: (re)probe it */
+  bool fresh = !n || !n->seen || n->seen + 1u != a->gen ||
+               (e->ifindex && e->ifindex != n->ifindex);
+  if (!n && !(n = iftab_add(&a->tab, name)))
+    return false;
+  if (fresh) {
+    n->seen = a->gen;
+    n->netns = ns != NULL;
+    attach_link(a, n, e);
+    return false;
+  }
+  n->seen = a->gen;
+  if (n->ignored && !n->groups)
+    return false;
+
+  IfState was = n->state;
+  bool sub = burst_sample(&n->burst, &e->stats, a->cfg.burst_bps,
+                          a->burst_min_ns);
+  bool moved = e->stats.rx_bytes != n->prev.rx_bytes ||
+               e->stats.tx_bytes != n->prev.tx_bytes;
+  /* event mode keeps state current (in our namespace); otherwise poll
+   * it: from the dump when it has it, or batched with every other sysfs
+   * read after the pass */
+  if ((a->ev_fd < 0 || ns) && state_due(a, n, e, moved, now)) {
+    if (e->has_link)
+      n->state = iface_link_state(n, e);
+    else
+      sysfs_batch_queue(&a->sysfs, (size_t)(n - a->tab.v));
+  }
+
+  update_rates(a, n, &e->stats);
+  if (e->has_link)
+    n->master = e->master;
+
+  if (n->state != was)
+    state_changed(a, n);
+  refresh_wifi(a, n, now);
+  return sub;
+}
+
+/* One snapshot pass: pick up new links, update known ones, forget
+ * vanished ones.  Cost is one hash lookup per link per tick, and one
+ * link dump per other namespace. */
+static void sample_tick(App *a) {
+  uint64_t now = mono_ms();
+  bool sub = false; /* the snapshot closed a --sample sub-interval */
+  uint64_t t0 = SELF_START();
+  if (!net_snapshot_read(&a->snap))
+    a->snap.n = 0;
+  ++a->gen;
+  SELF_END(PH_COUNTERS, t0);
 
-  /* ---------- Interface list ------------------------------------ */
-  char *vec[32] = {0};
-  size_t n_ifaces = 0;
+  /* before the pass: its alerts judge this tick's backlog and drops */
+  if (a->qd.fd >= 0) {
+    t0 = SELF_START();
+    qdisc_poll(&a->qd, &a->tab, mono_ns());
+    SELF_END(PH_QDISC, t0);
+  }
+
+  t0 = SELF_START();
+  for (size_t i = 0; i < a->snap.n; ++i)
+    sub |= sample_link(a, &a->snap.ent[i], NULL, now);
+  SELF_END(PH_LINKS, t0);
+
+  for (size_t k = 0; k < a->netns.n; ++k) {
+    Netns *ns = &a->netns.v[k];
+    t0 = SELF_START();
+    bool ok = netns_read(ns, now);
+    SELF_END(PH_COUNTERS, t0);
+    t0 = SELF_START();
+    for (size_t i = 0; ok && i < ns->snap.n; ++i)
+      sub |= sample_link(a, &ns->snap.ent[i], ns, now);
+    SELF_END(PH_LINKS, t0);
+  }
+
+  t0 = SELF_START();
+  if (!sysfs_batch_run(&a->sysfs, &a->tab))
+    perror("io_uring, falling back to pread");
+  for (size_t i = 0; i < a->sysfs.ran; ++i) {
+    Iface *n = &a->tab.v[a->sysfs.idx[i]];
+    if (n->state == (IfState)a->sysfs.state[i])
+      continue;
+    n->state = (IfState)a->sysfs.state[i];
+    state_changed(a, n);
+    refresh_wifi(a, n, now);
+  }
+  SELF_END(PH_STATE, t0);
+
+  ++a->ticks;
+  forget_absent(a);
+  update_groups(a, true);
+  for (size_t i = 0; sub && i < a->n_groups; ++i)
+    group_burst(&a->groups[i], i, &a->tab, a->cfg.burst_bps);
+
+  uint64_t ts = a->snap.n ? a->snap.ent[0].stats.ts_ns : mono_ns();
+  if (a->rec.fd >= 0 && !rec_tick(&a->rec, &a->tab, a->gen, ts)) {
+    perror("record");
+    rec_close(&a->rec); /* keep sampling, stop logging */
+  }
+  if (a->hist.map)
+    hist_tick(&a->hist, &a->tab, a->gen, (int64_t)time(NULL));
+}
+
+/* ---------- Sub-interval sampling (--sample) ------------------------ */
+/* A counter read between two lines, for the sub-interval extremes only:
+ * one snapshot read and a hash lookup per link; links the last tick did
+ * not see (new, or re-created) wait for it to probe them. */
+static bool burst_snapshot(App *a, const NetSnapshot *snap, const Netns *ns) {
+  bool sub = false;
+  char buf[IFACE_NAME_MAX];
+  for (size_t i = 0; i < snap->n; ++i) {
+    const SnapEntry *e = &snap->ent[i];
+    const char *name = link_name(e, ns, buf);
+    Iface *n = name ? iftab_find(&a->tab, name) : NULL;
+    if (!n || n->seen != a->gen || (n->ignored && !n->groups) ||
+        (e->ifindex && e->ifindex != n->ifindex))
+      continue;
+    sub |= burst_sample(&n->burst, &e->stats, a->cfg.burst_bps,
+                        a->burst_min_ns);
+  }
+  return sub;
+}
+
+static void burst_tick(App *a) {
+  uint64_t t0 = SELF_START();
+  bool sub = net_snapshot_read(&a->snap) && burst_snapshot(a, &a->snap, NULL);
+  uint64_t now = mono_ms();
+  for (size_t k = 0; k < a->netns.n; ++k) {
+    Netns *ns = &a->netns.v[k];
+    if (netns_read(ns, now))
+      sub |= burst_snapshot(a, &ns->snap, ns);
+  }
+  for (size_t i = 0; sub && i < a->n_groups; ++i)
+    group_burst(&a->groups[i], i, &a->tab, a->cfg.burst_bps);
+  SELF_END(PH_SAMPLE, t0);
+}
+
+/* A line went out: the next one reports the sub-intervals from here. */
+static void bursts_restart(App *a) {
+  for (size_t i = 0; i < a->tab.n; ++i)
+    burst_restart(&a->tab.v[i].burst);
+  for (size_t i = 0; i < a->n_groups; ++i)
+    burst_restart(&a->groups[i].n.burst);
+}
+
+/* --sample: (re)arm the sub-interval timer, or close it when off.  It
+ * only makes sense while sampling, and faster than the refresh. */
+static void sample_timer_set(App *a) {
+  unsigned ms = a->cfg.sample_ms;
+  if (ms && (a->cfg.mode != RUN_STANDALONE || ms >= a->cfg.refresh_ms)) {
+    fputs("--sample needs standalone sampling and a period below -t, "
+          "ignored\n", stderr);
+    ms = 0;
+  }
+  /* at the display tick's own read, a sub-sample would span microseconds */
+  a->burst_min_ns = (uint64_t)ms * 500000u;
+  if (!ms) {
+    if (a->sample_fd >= 0)
+      close(a->sample_fd);
+    a->sample_fd = -1;
+  } else if (a->sample_fd >= 0) {
+    tick_timer_arm(a->sample_fd, ms);
+  } else if ((a->sample_fd = tick_timer_open(ms)) < 0) {
+    perror("--sample timer");
+  }
+}
+
+/* ---------- Top talkers ({top}) ------------------------------------- */
+static void top_tick(App *a) {
+  uint64_t t0 = SELF_START();
+  if (!sockdiag_poll(&a->sd, mono_ns()))
+    for (size_t i = 0; i < a->tab.n; ++i)
+      a->tab.v[i].n_top = 0; /* stale ranking is worse than none */
+  else
+    sockdiag_top(&a->sd, &a->tab, a->cfg.top_n, mono_ns());
+  SELF_END(PH_TOP, t0);
+}
+
+/* ---------- Queueing disciplines (--qdisc) ------------------------- */
+/* Whether ticks dump the qdiscs: asked for, shown by a layout or
+ * judged by a --qdisc-warn/-crit limit. */
+static bool qdisc_wanted(const App *a) {
+  const Config *cfg = &a->cfg;
+  if (cfg->mode != RUN_STANDALONE && cfg->mode != RUN_DAEMON)
+    return false;
+  if (cfg->qdisc || (a->fmt.qdisc && cfg->mode == RUN_STANDALONE))
+    return true;
+  for (size_t i = 0; i < cfg->n_alert_rules; ++i)
+    if (cfg->alert_rules[i].dim == ALERT_DROPS)
+      return true;
+  return false;
+}
 
-  if (ifaces_raw)
-    n_ifaces = parse_ifaces(ifaces_raw, vec);
+/* Open or close the dump socket as the configuration now asks. */
+static void qdisc_setup(App *a) {
+  if (!qdisc_wanted(a)) {
+    if (a->qd.fd < 0)
+      return;
+    qdisc_close(&a->qd);
+    for (size_t i = 0; i < a->tab.n; ++i)
+      qdisc_forget(&a->tab.v[i]);
+  } else if (a->qd.fd >= 0) {
+    a->qd.classes = a->cfg.qdisc_classes;
+  } else if (!qdisc_open(&a->qd, a->cfg.qdisc_classes)) {
+    perror("qdisc statistics unavailable, q* fields stay empty");
+  }
+}
+
+/* ---------- Replay (--replay) ---------------------------------------- */
+#define REPLAY_MAX_GAP_MS 10000u /* sampler suspended: don't wait it out */
+
+/* Next tick of the log through the sampling path; the recorded state,
+ * kind and ifindex stand in for sysfs, Wi-Fi details are not logged. */
+static bool replay_tick(App *a) {
+  if (!replay_next(&a->rp))
+    return false;
+  if (a->rp.session)
+    ++a->gen; /* new recording run: every link starts over */
+  ++a->gen;
+  for (size_t i = 0; i < a->rp.n_ent; ++i) {
+    const RecEntry *e = &a->rp.ent[i];
+    const RecLink *l = &a->rp.links[e->link];
+    Iface *n = iftab_find(&a->tab, l->name);
+    bool fresh = !n || !n->seen || n->seen + 1u != a->gen ||
+                 l->ifindex != n->ifindex;
+    if (!n && !(n = iftab_add(&a->tab, l->name)))
+      continue;
+    n->seen = a->gen;
+    if (fresh) {
+      if (adopt_link(a, n, l->wifi, l->ifindex)) {
+        n->prev = e->stats;
+        n->state = (IfState)e->state;
+      }
+      continue;
+    }
+    if (n->ignored && !n->groups)
+      continue;
+    n->state = (IfState)e->state;
+    update_rates(a, n, &e->stats);
+  }
+  ++a->ticks;
+  forget_absent(a);
+  update_groups(a, true);
+  return true;
+}
+
+/* Play the whole log: as fast as it decodes, or spaced like the
+ * recording with --realtime.  A run's first tick only sets baselines. */
+static void replay_all(App *a) {
+  for (uint64_t last = 0; g_run && replay_tick(a); last = a->rp.ts_ns) {
+    if (a->rp.session)
+      continue;
+    if (a->cfg.realtime) {
+      uint64_t gap = a->rp.ts_ns - last, cap = REPLAY_MAX_GAP_MS * 1000000ull;
+      if (gap > cap)
+        gap = cap;
+      struct timespec ts = {.tv_sec = (time_t)(gap / 1000000000u),
+                            .tv_nsec = (long)(gap % 1000000000u)};
+      nanosleep(&ts, NULL); /* EINTR: the signal cleared g_run */
+    }
+    render_line(a);
+  }
+}
+
+/* ---------- Attached reader (--attach) ------------------------------- */
+#define SHM_STALE_TICKS 3u /* sampler ticks missed before showing err */
+
+/* Mirror the daemon's adapters: the read is a seqlock-protected copy
+ * out of the mapping, with no syscall unless the sampler is gone.  A
+ * read that fails (sampler busy for every retry) leaves everything as
+ * it was – the next good one picks up the samples missed – unless it
+ * keeps failing: a sampler that died mid-update looks like that. */
+static void attach_tick(App *a) {
+  size_t cnt = 0;
+  ShmInfo info = {0};
+  const ShmIface *v = NULL;
+  uint64_t t0 = SELF_START();
+  if (a->shm.map || shm_attach(&a->shm, a->shm_name))
+    v = shm_read(&a->shm, &cnt, &info);
+  SELF_END(PH_COUNTERS, t0);
+  if (!v && a->shm.map && ++a->shm_busy < SHM_STALE_TICKS)
+    return;
+  if (!v)
+    shm_close(&a->shm); /* stuck mid-update: re-open on the next tick */
+  a->shm_busy = 0;
+  uint64_t max_age_ms =
+      (uint64_t)SHM_STALE_TICKS * info.refresh_ms + a->cfg.refresh_ms;
+  if (v && mono_ns() - info.stamp_ns > max_age_ms * 1000000u) {
+    shm_close(&a->shm); /* sampler died: re-open on the next tick */
+    v = NULL;
+  }
+  ++a->gen;
+  if (!v)
+    cnt = 0; /* every adapter is absent: pinned ones show as err */
+
+  if (v && info.ticks < a->shm_ticks)
+    a->shm_ticks = 0; /* sampler restarted */
+  uint64_t new_samples = info.ticks - a->shm_ticks;
+  double alpha = ewma_alpha(info.refresh_ms / 1e3, a->cfg.half_life_ms / 1e3);
+  t0 = SELF_START();
+  for (size_t i = 0; i < cnt; ++i) {
+    const ShmIface *s = &v[i];
+    Iface *n = iftab_find(&a->tab, s->name);
+    bool fresh = !n || !n->seen || n->seen + 1u != a->gen ||
+                 s->ifindex != n->ifindex;
+    if (!n && !(n = iftab_add(&a->tab, s->name)))
+      continue;
+    n->seen = a->gen;
+    size_t k = new_samples < s->hist_n ? (size_t)new_samples : s->hist_n;
+    if (fresh) {
+      if (!adopt_link(a, n, s->wifi, s->ifindex))
+        continue;
+      k = s->hist_n; /* backfill the windows from the published history */
+    }
+    if (n->ignored && !n->groups)
+      continue;
+
+    n->state = s->state < IFSTATE_COUNT ? (IfState)s->state : IFSTATE_ERR;
+    n->rx_rate = s->rx_rate;
+    n->tx_rate = s->tx_rate;
+    n->wl = s->wl;
+    n->prev.rx_bytes = s->rx_bytes;
+    n->prev.tx_bytes = s->tx_bytes;
+    for (size_t j = s->hist_n - k; n->rs && j < s->hist_n; ++j) {
+      rate_window_push(&n->rs[0], s->hist_rx[j], alpha);
+      rate_window_push(&n->rs[1], s->hist_tx[j], alpha);
+    }
+    alert_update(&a->alerts, n, mono_ms());
+  }
+  SELF_END(PH_LINKS, t0);
+  if (v)
+    a->shm_ticks = info.ticks;
+  forget_absent(a);
+  update_groups(a, true);
+}
+
+/* ---------- Link-event mode (RTNLGRP_LINK) --------------------------- */
+static void on_link_event(const SnapEntry *link, bool removed, void *ctx) {
+  App *a = ctx;
+  Iface *n = iftab_find(&a->tab, link->name);
+  if (!n || (n->ignored && !n->groups))
+    return; /* new links are adopted by the next snapshot pass */
+  n->master = removed ? 0 : link->master;
+  IfState st = removed ? IFSTATE_ERR
+                       : iface_state_from_link(link->operstate, link->carrier);
+  if (st == n->state)
+    return;
+  n->state = st;
+  n->wl_stamp_ms = 0; /* caller refreshes Wi-Fi details */
+  a->changed = true;
+}
+
+/* i3bar click: left toggles bits/bytes, right SI/IEC; redrawn at once */
+static void on_click(int button, void *ctx) {
+  App *a = ctx;
+  if (button == 1)
+    a->cfg.unit = a->cfg.unit == 'b' ? 'B' : 'b';
+  else if (button == 3)
+    a->cfg.divisor = a->cfg.divisor == 1000u ? 1024u : 1000u;
+  else
+    return;
+  a->changed = true;
+}
+
+/* nl80211 "mlme" event: drop the cached SSID/station info of that link */
+static void on_wifi_event(int ifindex, void *ctx) {
+  App *a = ctx;
+  Iface *n = iftab_find_index(&a->tab, ifindex);
+  if (n && n->wifi && !n->ignored) {
+    n->wl_stamp_ms = 0;
+    a->changed = true;
+  }
+}
+
+/* Full state read after an event overrun. */
+static void seed_states(App *a) {
+  bool have_snap = net_snapshot_read(&a->snap);
+  for (size_t i = 0; i < a->tab.n; ++i) {
+    Iface *n = &a->tab.v[i];
+    if ((n->ignored && !n->groups) || n->netns)
+      continue; /* other namespaces: from their dump every tick */
+    const SnapEntry *e = have_snap ? net_snapshot_entry(&a->snap, n->name) : NULL;
+    n->state = e ? iface_link_state(n, e) : IFSTATE_ERR;
+  }
+}
+
+/* ---------- Configuration: start-up and reload ---------------------- */
+static bool build_filter(IfaceFilter *f, const Config *cfg) {
+  bool ok = iface_filter_add(f, cfg->ifaces_raw ? cfg->ifaces_raw : "*",
+                             false) &&
+            iface_filter_add(f, cfg->exclude_raw, true) &&
+            (cfg->ifaces_raw || iface_filter_add(f, "lo", true));
+  return ok && f->n_include > 0;
+}
+
+static void free_groups(IfaceGroup *g, size_t n) {
+  for (size_t i = 0; i < n; ++i)
+    group_free(&g[i]);
+  free(g);
+}
+
+/* Parse every --group spec; false (after a message) on a bad one. */
+static bool parse_groups(const Config *cfg, IfaceGroup **out) {
+  *out = NULL;
+  if (cfg->n_groups > GROUP_MAX) {
+    fprintf(stderr, "At most %u groups\n", GROUP_MAX);
+    return false;
+  }
+  if (cfg->n_groups && !(*out = calloc(cfg->n_groups, sizeof **out))) {
+    perror("group");
+    return false;
+  }
+  for (size_t i = 0; i < cfg->n_groups; ++i) {
+    if (group_parse(&(*out)[i], cfg->groups[i]))
+      continue;
+    fprintf(stderr, "Invalid group '%.*s' (NAME=MEMBER[,MEMBER...])\n",
+            (int)strcspn(cfg->groups[i], ";"), cfg->groups[i]);
+    free_groups(*out, i + 1u);
+    *out = NULL;
+    return false;
+  }
+  return true;
+}
 
-  if (n_ifaces == 0) {
+/* Settings that follow from a->cfg and the compiled layouts. */
+static void derive_settings(App *a) {
+  Config *cfg = &a->cfg;
+  a->window_n = cfg->window_ms / cfg->refresh_ms; /* see window_push() */
+  if (a->window_n < 2u)
+    a->window_n = 2u;
+  if (a->window_n > RS_WINDOW_MAX)
+    a->window_n = RS_WINDOW_MAX;
+  /* the daemon publishes a short history for its readers' statistics;
+   * smoothed alerts need the EWMA */
+  a->stats = a->fmt.stats || cfg->mode == RUN_DAEMON ||
+             (cfg->smooth && cfg->n_alert_rules);
+  if (cfg->mode == RUN_DAEMON && a->window_n < SHM_HIST)
+    a->window_n = SHM_HIST;
+  if (cfg->hysteresis_pct > 99u)
+    cfg->hysteresis_pct = 99u;
+  a->alerts.hysteresis_pct = cfg->hysteresis_pct;
+  a->alerts.hold_ms = cfg->alert_hold_ms;
+  a->alerts.smooth = cfg->smooth;
+  /* a replay re-judges the past, it must not page */
+  a->alerts.cmd = cfg->mode == RUN_REPLAY ? NULL : cfg->alert_cmd;
+  if (cfg->top_n == 0u || cfg->top_n > TOP_MAX)
+    cfg->top_n = cfg->top_n ? TOP_MAX : 3u;
+  /* a slow Wi-Fi driver may cost a quarter tick, not a whole one */
+  nl80211_set_wait(&a->nl, cfg->refresh_ms / 4u);
+}
+
+/* Literal -i names get their entry, in -i order, before they are seen. */
+static bool pin_adapters(App *a) {
+  for (size_t i = 0; i < a->filter.n_include; ++i) {
+    const char *name = a->filter.include[i];
+    if (!iface_filter_pinned(&a->filter, name) || iftab_find(&a->tab, name))
+      continue;
+    Iface *n = iftab_add(&a->tab, name);
+    if (!n) {
+      perror("interface table");
+      return false;
+    }
+    n->pinned = true;
+    n->wifi = is_wireless(name);
+    formatter_layout(&a->fmt, n->name, n->wifi, n->layout);
+  }
+  return true;
+}
+
+/* SIGHUP or a saved --config: resolve the configuration again and swap
+ * it in between ticks – all of it, or (on any error) none of it.  Known
+ * adapters keep counters, windows and alert state; links tracked only
+ * from now on are re-probed, and primed, when next seen.  The run mode
+ * and the sources and sinks (--daemon, --backend, --link-events,
+ * --listen, --record, --history, --output) change only on a restart. */
+static void reload_config(App *a, int argc, char *argv[], int tick_fd) {
+  Config cfg;
+  ConfFile conf;
+  if (resolve_config(&cfg, &conf, argc, argv) >= 0) {
+    fputs("reload: keeping the running configuration\n", stderr);
+    return;
+  }
+  IfaceFilter filter = {0};
+  Formatter fmt;
+  IfaceGroup *groups = NULL;
+  char err[128];
+  bool ok = build_filter(&filter, &cfg);
+  if (!ok)
+    fputs("No interfaces specified (use -i or INTERFACES)\n", stderr);
+  else if (!(ok = formatter_init(&fmt, cfg.formats, cfg.n_formats, err,
+                                 sizeof err)))
+    fprintf(stderr, "Invalid format: %s\n", err);
+  else if (!(ok = parse_groups(&cfg, &groups)))
+    formatter_free(&fmt);
+  if (!ok) {
+    iface_filter_free(&filter);
+    config_free(&cfg);
+    conf_free(&conf);
+    fputs("reload: keeping the running configuration\n", stderr);
+    return;
+  }
+  /* already opened: the paths of the rest only matter at start-up */
+  cfg.mode = a->cfg.mode;
+  cfg.backend = a->cfg.backend;
+  cfg.link_events = a->cfg.link_events;
+  cfg.proto = a->cfg.proto;
+  cfg.self_stats = a->cfg.self_stats;
+
+  /* ---- swap ---------------------------------------------------- */
+  IfaceGroup *old = a->groups;
+  size_t n_old = a->n_groups;
+  uint32_t window_n = a->window_n;
+  config_free(&a->cfg);
+  conf_free(&a->conf);
+  iface_filter_free(&a->filter);
+  formatter_free(&a->fmt);
+  a->cfg = cfg;
+  a->conf = conf;
+  a->filter = filter;
+  a->fmt = fmt;
+  a->groups = groups;
+  if (a->cfg.mode != RUN_ATTACH && !netns_collect(&a->netns, &a->filter))
+    perror("reload: netns");
+  a->n_groups = cfg.n_groups;
+  derive_settings(a);
+  bool resize = a->window_n != window_n; /* windows start over */
+
+  /* ---- rebind: layouts point into the new formatter ------------- */
+  for (size_t i = 0; i < a->n_groups; ++i) {
+    Iface *n = &a->groups[i].n;
+    for (size_t j = 0; j < n_old; ++j) {
+      if (strcmp(old[j].n.name, n->name) != 0)
+        continue;
+      *n = old[j].n; /* same group name: keep its rates and windows */
+      old[j].n.rs = NULL;
+      break;
+    }
+    if (resize) {
+      rate_stats_free(n->rs);
+      n->rs = NULL;
+    }
+    bind_link(a, n);
+  }
+  free_groups(old, n_old);
+  for (size_t i = 0; i < a->tab.n; ++i) {
+    Iface *n = &a->tab.v[i];
+    bool tracked = !n->ignored || n->groups;
+    uint32_t had = n->groups;
+    n->pinned = iface_filter_pinned(&a->filter, n->name);
+    classify_link(a, n);
+    if (!tracked || (n->ignored && !n->groups)) {
+      sysfs_forget(n);
+      n->seen = 0; /* adopt_link() decides again on the next pass */
+      continue;
+    }
+    if (resize) {
+      rate_stats_free(n->rs);
+      n->rs = NULL;
+    }
+    if (!n->ignored)
+      bind_link(a, n);
+    if (n->groups && !had && a->cfg.backend == BACKEND_PROCFS && !n->netns)
+      n->master = iface_master(n->name);
+  }
+  pin_adapters(a);
+
+  if (a->fmt.top && a->sd.fd < 0 && a->cfg.mode != RUN_DAEMON) {
+    if (sockdiag_open(&a->sd))
+      sockdiag_poll(&a->sd, mono_ns()); /* per-socket baselines */
+    else
+      perror("sock_diag unavailable, {top} stays empty");
+  } else if (!a->fmt.top && a->sd.fd >= 0) {
+    sockdiag_close(&a->sd);
+  }
+  bool qdisc_was = a->qd.fd >= 0;
+  qdisc_setup(a);
+  if (a->qd.fd >= 0 && !qdisc_was)
+    qdisc_poll(&a->qd, &a->tab, mono_ns()); /* baselines */
+  if (tick_fd >= 0 && tick_timer_arm(tick_fd, a->cfg.refresh_ms))
+    a->period_ms = a->cfg.refresh_ms;
+  if (a->cfg.sample_ms || a->sample_fd >= 0)
+    sample_timer_set(a);
+  a->idle_ticks = 0;
+  a->last.len = 0; /* --adaptive: print the next line whatever it is */
+  fputs("configuration reloaded\n", stderr);
+}
+
+/* ---------- Start-up, tick and shutdown ----------------------------- */
+/* Everything before the first tick, on a zeroed App: configuration,
+ * outputs and the discovery pass.  -1 to run, else the exit status. */
+int app_start(App *a, int argc, char *argv[]) {
+  /* ---------- Defaults < env < --config < CLI ------------------ */
+  a->ev_fd = a->conf_fd = a->sample_fd = -1;
+  a->nl = (Nl80211){.fd = -1, .ev_fd = -1};
+  a->qd.fd = -1;
+  Config cfg;
+  ConfFile conf;
+  int rc = resolve_config(&cfg, &conf, argc, argv);
+  if (rc >= 0)
+    return rc;
+
+  if (cfg.record && (cfg.mode == RUN_ATTACH || cfg.mode == RUN_REPLAY)) {
+    fputs("--record needs a sampling mode (not --attach or --replay)\n",
+          stderr);
+    return STATE_UNKNOWN;
+  }
+
+  /* ---------- Interface filter (names and globs) --------------- */
+  if (!build_filter(&a->filter, &cfg)) {
     fputs("No interfaces specified (use -i or INTERFACES env)\n", stderr);
     return STATE_UNKNOWN;
   }
 
-  /* ---------- Build Iface array --------------------------------- */
-  Iface ifs[32];
-  for (size_t i = 0; i < n_ifaces; ++i) {
-    strncpy(ifs[i].name, vec[i], IFNAMSIZ);
-    ifs[i].wifi = is_wireless(vec[i]);
-    ifs[i].state = IFSTATE_ERR;
-    ifs[i].prev = (NetStats){0};
-    ifs[i].ssid[0] = '\0'; // Initialize SSID to empty
-    read_iface_stats(vec[i], &ifs[i].prev);
+  /* ---------- Totals from the history file, no sampling -------- */
+  if (cfg.totals) {
+    History h;
+    if (!cfg.history)
+      fputs("--totals needs --history (or HISTORY)\n", stderr);
+    else if (!hist_open(&h, cfg.history, false))
+      fprintf(stderr, "%s: %s\n", cfg.history, strerror(errno));
+    if (!cfg.history || h.fd < 0) {
+      iface_filter_free(&a->filter);
+      return STATE_UNKNOWN;
+    }
+    hist_report(&h, cfg.totals_period, cfg.totals_rows, &a->filter, cfg.unit,
+                cfg.divisor);
+    hist_close(&h);
+    iface_filter_free(&a->filter);
+    return STATE_OK;
+  }
+
+  /* ---------- Output layouts (compiled once) -------------------- */
+  char fmt_err[128];
+  if (!formatter_init(&a->fmt, cfg.formats, cfg.n_formats, fmt_err,
+                      sizeof fmt_err)) {
+    fprintf(stderr, "Invalid format: %s\n", fmt_err);
+    return STATE_UNKNOWN;
+  }
+  out_reserve(&a->out, 4096u); /* preallocated line buffer */
+
+  /* ---------- Bar protocol: i3bar header, waybar tooltip line --- */
+  a->clicks.fd = -1;
+  if (cfg.proto == PROTO_WAYBAR) {
+    out_reserve(&a->tip, 4096u);
+    if (!fmt_compile(&a->tip_tpl, "{name} {state} {rx} {tx}{ ssid}", fmt_err,
+                     sizeof fmt_err)) {
+      fprintf(stderr, "tooltip: %s\n", fmt_err);
+      return STATE_UNKNOWN;
+    }
+  }
+  if (cfg.proto == PROTO_I3BAR && cfg.mode != RUN_DAEMON) {
+    bar_header(&a->out, cfg.proto);
+    out_flush(&a->out, STDOUT_FILENO);
+    a->clicks.fd = STDIN_FILENO;
+  }
+
+  /* ---------- Shared-memory segment ----------------------------- */
+  if (cfg.shm_name)
+    snprintf(a->shm_name, sizeof a->shm_name, "%s%s",
+             cfg.shm_name[0] == '/' ? "" : "/", cfg.shm_name);
+  else
+    shm_default_name(a->shm_name, sizeof a->shm_name);
+  a->shm.fd = -1;
+  if (cfg.mode == RUN_DAEMON && !shm_create(&a->shm, a->shm_name)) {
+    fprintf(stderr, "%s: cannot publish (another sampler running?): %s\n",
+            a->shm_name, strerror(errno));
+    return STATE_UNKNOWN;
+  }
+  if (cfg.mode == RUN_ATTACH && !shm_attach(&a->shm, a->shm_name))
+    fprintf(stderr, "%s: no sampler yet, waiting for bandwidth3 --daemon\n",
+            a->shm_name);
+
+  /* ---------- Sample log --------------------------------------- */
+  a->rec.fd = -1;
+  if (cfg.mode == RUN_REPLAY) {
+    if (!replay_open(&a->rp, cfg.replay)) {
+      fprintf(stderr, "%s: not a bandwidth3 log: %s\n", cfg.replay,
+              strerror(errno));
+      return STATE_UNKNOWN;
+    }
+    if (a->rp.refresh_ms)
+      cfg.refresh_ms = a->rp.refresh_ms; /* size windows as recorded */
+  }
+  if (cfg.record && !rec_open(&a->rec, cfg.record, cfg.refresh_ms)) {
+    fprintf(stderr, "%s: %s\n", cfg.record, strerror(errno));
+    return STATE_UNKNOWN;
+  }
+
+  /* ---------- Traffic history (written by samplers only) -------- */
+  a->hist.fd = -1;
+  if (cfg.history && (cfg.mode == RUN_STANDALONE || cfg.mode == RUN_DAEMON) &&
+      !hist_open(&a->hist, cfg.history, true))
+    fprintf(stderr, "%s: history off (in use, or not a history file): %s\n",
+            cfg.history, strerror(errno));
+
+  /* ---------- Counter snapshot (one read/dump per tick) --------- */
+  if (cfg.mode == RUN_ATTACH || cfg.mode == RUN_REPLAY)
+    cfg.backend = BACKEND_PROCFS; /* unused: nothing is sampled */
+  else if (cfg.backend == BACKEND_NETLINK &&
+      !(net_snapshot_init(&a->snap, BACKEND_NETLINK) &&
+        net_snapshot_read(&a->snap))) {
+    perror("netlink backend unavailable, falling back to procfs");
+    net_snapshot_free(&a->snap);
+    cfg.backend = BACKEND_PROCFS;
   }
+  if (cfg.mode != RUN_ATTACH && cfg.mode != RUN_REPLAY &&
+      cfg.backend == BACKEND_PROCFS &&
+      !(net_snapshot_init(&a->snap, BACKEND_PROCFS) &&
+        net_snapshot_read(&a->snap))) {
+    perror("/proc/net/dev");
+    return STATE_UNKNOWN;
+  }
+  if (cfg.mode != RUN_ATTACH && cfg.mode != RUN_REPLAY &&
+      !netns_collect(&a->netns, &a->filter)) {
+    perror("netns");
+    return STATE_UNKNOWN;
+  }
+  a->cfg = cfg;
+  a->conf = conf;
+  a->period_ms = cfg.refresh_ms;
+  derive_settings(a);
+
+  /* ---------- Interface groups (segments after the adapters) ---- */
+  if (!parse_groups(&cfg, &a->groups))
+    return STATE_UNKNOWN;
+  a->n_groups = cfg.n_groups;
+  for (size_t i = 0; i < a->n_groups; ++i)
+    bind_link(a, &a->groups[i].n);
+
+  /* ---------- Pinned adapters keep their -i order --------------- */
+  if (!pin_adapters(a))
+    return STATE_UNKNOWN;
 
   signal(SIGINT, sigint_handler);
   signal(SIGTERM, sigint_handler);
+  signal(SIGHUP, sighup_handler);
+
+  /* ---------- Self-instrumentation ------------------------------ */
+  if (cfg.self_stats) {
+#ifdef BW3_SELF_STATS
+    self_enable(&self_stats);
+    signal(SIGUSR1, sigusr1_handler);
+    a->report_ms = mono_ms();
+#else
+    fputs("--self-stats: built with SELF_STATS=0, ignored\n", stderr);
+    a->cfg.self_stats = false;
+#endif
+  }
+
+  /* ---------- Config file: reload when it is saved -------------- */
+  if (cfg.config && cfg.mode != RUN_REPLAY &&
+      (a->conf_fd = conf_watch(cfg.config)) < 0)
+    perror("config file watch unavailable, reload with SIGHUP");
+
+  /* ---------- Link events: subscribe first, then seed states ---- */
+  if (cfg.link_events && cfg.mode != RUN_ATTACH && cfg.mode != RUN_REPLAY) {
+    a->ev_fd = rtnl_open(RTMGRP_LINK);
+    a->ev_buf = malloc(EV_BUF_SIZE);
+    if (a->ev_fd < 0 || !a->ev_buf) {
+      perror("link events unavailable, polling state every tick");
+      if (a->ev_fd >= 0)
+        close(a->ev_fd);
+      a->ev_fd = -1;
+    }
+  }
+
+  /* ---------- Polled link state: one sysfs batch per tick -------- */
+  a->sysfs.ring_fd = -1;
+  if ((cfg.mode == RUN_STANDALONE || cfg.mode == RUN_DAEMON) && a->ev_fd < 0 &&
+      cfg.backend == BACKEND_PROCFS)
+    sysfs_batch_open(&a->sysfs, true); /* pread when io_uring is not there */
+
+  /* ---------- Top talkers: only when a layout shows them -------- */
+  a->sd.fd = -1;
+  if (a->fmt.top && cfg.mode != RUN_DAEMON && cfg.mode != RUN_REPLAY &&
+      !sockdiag_open(&a->sd))
+    perror("sock_diag unavailable, {top} stays empty");
+
+  /* ---------- Queueing disciplines: when shown, limited or asked -- */
+  qdisc_setup(a);
+
+  /* ---------- Metrics endpoint (served from the cached table) --- */
+  a->exp.fd = -1;
+  for (size_t i = 0; i < EXPORT_MAX_CLIENTS; ++i)
+    a->exp.cl[i].fd = -1; /* not fd 0: stdin carries i3bar clicks */
+  if (cfg.listen && cfg.mode != RUN_REPLAY &&
+      !exporter_open(&a->exp, cfg.listen)) {
+    fprintf(stderr, "Cannot listen on '%s': %s\n", cfg.listen, strerror(errno));
+    return STATE_UNKNOWN;
+  }
+
+  /* ---------- Discovery pass: adopt links, prime baselines ------ */
+  if (cfg.mode == RUN_STANDALONE || cfg.mode == RUN_DAEMON)
+    sample_tick(a);
+  if (a->changed)
+    emit(a); /* rates resumed from --history: no need to wait a tick */
+  if (a->sd.fd >= 0)
+    sockdiag_poll(&a->sd, mono_ns()); /* per-socket baselines */
+  if (a->qd.fd >= 0)
+    qdisc_poll(&a->qd, &a->tab, mono_ns()); /* per-link baselines */
+  return -1;
+}
+
+/* One display tick: sample (or read the daemon), rank flows, print. */
+void app_tick(App *a) {
+  uint64_t t0 = SELF_TICK_START();
+  alert_reap(&a->alerts); /* hooks that finished since the last tick */
+  if (a->cfg.mode == RUN_ATTACH)
+    attach_tick(a);
+  else
+    sample_tick(a);
+  if (a->sd.fd >= 0)
+    top_tick(a);
+  emit(a);
+  bursts_restart(a);
+  SELF_TICK_END(t0);
+}
+
+/* Close and free everything app_start() and the ticks set up. */
+void app_stop(App *a) {
+  if (a->sample_fd >= 0)
+    close(a->sample_fd);
+  if (a->cfg.self_stats)
+    self_report(&self_stats);
+  rec_close(&a->rec); /* flush and sync the log tail */
+  hist_close(&a->hist);
+  replay_close(&a->rp);
+  sockdiag_close(&a->sd);
+  qdisc_close(&a->qd);
+  sysfs_batch_close(&a->sysfs);
+  out_free(&a->out);
+  out_free(&a->last);
+  out_free(&a->tip);
+  fmt_free(&a->tip_tpl);
+  formatter_free(&a->fmt);
+  free_groups(a->groups, a->n_groups);
+  config_free(&a->cfg);
+  conf_free(&a->conf);
+  if (a->conf_fd >= 0)
+    close(a->conf_fd);
+  nl80211_close(&a->nl);
+  if (a->ev_fd >= 0)
+    close(a->ev_fd);
+  free(a->ev_buf);
+  net_snapshot_free(&a->snap);
+  netns_free(&a->netns);
+  iftab_free(&a->tab);
+  iface_filter_free(&a->filter);
+  shm_close(&a->shm);
+  exporter_close(&a->exp);
+}
+
+App *app_new(void) { return calloc(1, sizeof(App)); }
+
+size_t app_adapters(const App *a) { return a->tab.n; }
+
+/* The whole program (src/main.c): start, tick until a signal, stop. */
+int app_main(int argc, char *argv[]) {
+  static App app;
+  App *a = &app;
+  int rc = app_start(a, argc, argv);
+  if (rc >= 0)
+    return rc;
+  if (a->cfg.mode == RUN_REPLAY)
+    replay_all(a); /* the log drives the ticks, no timer */
 
   /* ---------- Main loop ----------------------------------------- */
-  while (g_run) {
-    sleep(refresh);
-    bool first_printed_interface = true;
-    for (size_t i = 0; i < n_ifaces; ++i) {
-      Iface *n = &ifs[i];
-      n->state = get_iface_state(n->name, n->wifi);
-      if (n->wifi && n->state == IFSTATE_CONNECTED) {
-        get_wifi_ssid(n->name, n->ssid);
-      } else {
-        n->ssid[0] = '\0'; // Clear SSID if not connected or not wifi
-      }
+  int tick_fd = -1;
+  if (a->cfg.mode != RUN_REPLAY &&
+      (tick_fd = tick_timer_open(a->cfg.refresh_ms)) < 0) {
+    perror("timerfd");
+    return STATE_UNKNOWN;
+  }
+  if (a->cfg.sample_ms)
+    sample_timer_set(a);
+  while (g_run && a->cfg.mode != RUN_REPLAY) {
+    if (g_reload) {
+      g_reload = 0;
+      reload_config(a, argc, argv, tick_fd);
+      emit(a); /* the new layout at once, not a tick later */
+    }
+    if (g_report) {
+      g_report = 0;
+      self_report(&self_stats);
+    }
 
-      NetStats cur;
-      if (!read_iface_stats(n->name, &cur))
-        n->state = IFSTATE_ERR;
+    /* Sleep until the next tick, but wake for link/association events */
+    struct pollfd pfd[6 + EXPORT_MAX_CLIENTS] = {
+        {.fd = tick_fd, .events = POLLIN},
+        {.fd = a->ev_fd, .events = POLLIN},
+        {.fd = a->nl.ev_fd, .events = POLLIN},
+        {.fd = a->clicks.fd, .events = POLLIN},
+        {.fd = a->conf_fd, .events = POLLIN},
+        {.fd = a->sample_fd, .events = POLLIN}};
+    size_t n_exp = exporter_pollfds(&a->exp, pfd + 6);
+    if (poll(pfd, 6 + n_exp, -1) < 0)
+      continue; /* EINTR: re-check the flags (negative fds are ignored) */
 
-      double rx = avg_rate(cur.rx_bytes, n->prev.rx_bytes, refresh);
-      double tx = avg_rate(cur.tx_bytes, n->prev.tx_bytes, refresh);
-      n->prev = cur;
+    /* scrapes are answered from the last tick's table, never re-read */
+    if (n_exp)
+      exporter_handle(&a->exp, pfd + 6, n_exp, &a->tab, mono_ms());
+    if ((pfd[4].revents & POLLIN) && conf_watch_read(a->conf_fd, a->cfg.config))
+      g_reload = 1; /* applied before the next poll */
 
-      bool printed_this_interface = n->wifi
-          ? print_wifi(n, rx, tx, unit, divisor, warn_rx, warn_tx, crit_rx, crit_tx)
-          : print_eth(n, rx, tx, unit, divisor, warn_rx, warn_tx, crit_rx, crit_tx);
+    a->changed = false;
+    if ((pfd[3].revents & (POLLIN | POLLHUP)) &&
+        !bar_clicks_read(&a->clicks, on_click, a))
+      a->clicks.fd = -1; /* bar closed our stdin: stop listening */
+    if ((pfd[1].revents & POLLIN) &&
+        !rtnl_read_link_events(a->ev_fd, a->ev_buf, EV_BUF_SIZE, on_link_event,
+                               a)) {
+      seed_states(a); /* events lost: resync */
+      a->changed = true;
+    }
+    if (pfd[2].revents & POLLIN)
+      nl80211_read_events(&a->nl, on_wifi_event, a);
 
-      if (printed_this_interface) {
-        if (!first_printed_interface) {
-          printf(" | "); // Separator between interface groups
-        }
-        first_printed_interface = false;
+    uint64_t expirations = 0;
+    /* a display tick due as well takes the sub-sample itself */
+    if ((pfd[5].revents & POLLIN) &&
+        read(a->sample_fd, &expirations, sizeof expirations) > 0 &&
+        !(pfd[0].revents & POLLIN))
+      burst_tick(a);
+    if (!(pfd[0].revents & POLLIN) ||
+        read(tick_fd, &expirations, sizeof expirations) != sizeof expirations) {
+      if (a->changed) {
+        uint64_t now = mono_ms();
+        for (size_t i = 0; i < a->tab.n; ++i)
+          if (!a->tab.v[i].ignored || a->tab.v[i].groups)
+            refresh_wifi(a, &a->tab.v[i], now);
+        update_groups(a, false);
+        emit(a); /* flap shows up immediately */
+        if (a->cfg.idle_max_ms)
+          adapt_period(a, tick_fd, true);
       }
+      continue;
     }
-    if (!first_printed_interface) { // Only print newline if something was printed
-        putchar('\n');
+
+    app_tick(a);
+    if (a->cfg.self_stats && a->cfg.self_stats_ms &&
+        mono_ms() - a->report_ms >= a->cfg.self_stats_ms) {
+      a->report_ms = mono_ms();
+      self_report(&self_stats);
     }
-    fflush(stdout);
+    if (a->cfg.idle_max_ms)
+      adapt_period(a, tick_fd, a->changed);
   }
 
+  if (tick_fd >= 0)
+    close(tick_fd);
+  app_stop(a);
   return STATE_OK;
 }
@@ -6,16 +6,19 @@
 
 #include <linux/if.h>       /* IFNAMSIZ */
 #include <linux/wireless.h> // Added for IW_ESSID_MAX_SIZE
+#include <poll.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
-#define MAX_IFACES 32 // maximum number of interfaces for parsing
+/* ---------- Adapter names ------------------------------------------- */
+#define IFACE_NAME_MAX 48 /* room for "NAME/ifname" of another netns  */
 
 /* ---------- Generic per-interface counters --------------------------- */
 typedef struct {
     uint64_t rx_bytes;
     uint64_t tx_bytes;
+    uint64_t ts_ns; /* CLOCK_MONOTONIC time the counters were read */
 } NetStats;
 
 /* ---------- Link status enumeration --------------------------------- */
@@ -25,25 +28,791 @@ typedef enum {
     IFSTATE_CONNECTED,    /* carrier present OR Wi-Fi associated       */
     IFSTATE_ERR           /* could not determine state                 */
 } IfState;
+#define IFSTATE_COUNT 4
+
+/* ---------- Output templates --------------------------------------- */
+typedef enum {
+    FOP_LIT,        /* literal slice of Template.lit            */
+    FOP_ICON,
+    FOP_NAME,
+    FOP_STATE,
+    FOP_SSID,
+    FOP_RX,
+    FOP_TX,
+    FOP_SIGNAL,
+    FOP_TX_BITRATE,
+    FOP_RX_BITRATE,
+    FOP_RX_PEAK,    /* sub-interval extremes (BurstStats)       */
+    FOP_TX_PEAK,
+    FOP_RX_LOW,
+    FOP_TX_LOW,
+    FOP_BURSTS,
+    FOP_QDISC,      /* root queueing discipline (QdiscInfo)     */
+    FOP_QBACKLOG,
+    FOP_QLEN,
+    FOP_QDROPS,
+    FOP_QREQUEUES,
+    FOP_QOVERLIMITS,
+    FOP_QCLASS,
+    FOP_TOP,        /* busiest TCP flows (sock_diag)            */
+    FOP_RX_AVG,     /* windowed statistics (RateWindow)         */
+    FOP_TX_AVG,
+    FOP_RX_MIN,
+    FOP_TX_MIN,
+    FOP_RX_MAX,
+    FOP_TX_MAX,
+    FOP_RX_P95,
+    FOP_TX_P95,
+    FOP_RX_SPARK,
+    FOP_TX_SPARK
+} FmtOpKind;
+
+typedef struct {
+    uint8_t kind;      /* FmtOpKind                                 */
+    bool space;        /* "{ field}": leading space if non-empty    */
+    uint32_t off, len; /* literal slice                             */
+    uint32_t joff, jlen; /* the same slice JSON-escaped, in jlit    */
+} FmtOp;
+
+typedef struct {
+    FmtOp *ops;
+    size_t n_ops;
+    char *lit;   /* unescaped literal text                    */
+    char *jlit;  /* literal text escaped for a JSON string    */
+    bool hidden; /* empty template: adapter not shown         */
+    bool stats;  /* uses a windowed statistics field          */
+    bool top;    /* uses {top}                                */
+    bool qdisc;  /* uses a qdisc field ({qdisc}, {qdrops} ...) */
+} Template;
+
+/* ---------- Windowed rate statistics (one per direction) ------------ */
+#define RS_WINDOW_MAX 65535u /* samples; ring slots fit in uint16_t   */
+#define RS_BUCKETS 385u      /* 1 + 48 octaves * 8 log-linear buckets */
+#define RS_SPARK_WIDTH 8u    /* sparkline glyphs (3 bytes each)       */
+
+typedef struct {
+    float *ring;        /* last cap samples (bytes/s)               */
+    uint16_t *dq_max;   /* ring slots, values decreasing: front=max */
+    uint16_t *dq_min;   /* ring slots, values increasing: front=min */
+    uint16_t *hist;     /* RS_BUCKETS counts of the samples in ring */
+    uint32_t cap, n;    /* capacity and fill level                  */
+    uint32_t head;      /* next slot to write                       */
+    uint32_t max_h, max_n, min_h, min_n;
+    double ewma;
+} RateWindow;
+
+/* ---------- Cached Wi-Fi association details ----------------------- */
+typedef struct {
+    char ssid[IW_ESSID_MAX_SIZE + 1];
+    int8_t signal_dbm;   /* 0 when unknown                      */
+    uint32_t tx_bitrate; /* 100 kbit/s units, 0 when unknown    */
+    uint32_t rx_bitrate;
+} WifiLink;
+
+/* ---------- Top talkers: one of an adapter's busiest flows ---------- */
+#define TOP_MAX 8u        /* flows per adapter, upper bound of --top  */
+#define TOP_LABEL_MAX 28u /* "process:port" or "address:port"         */
+
+typedef struct {
+    uint32_t flow;        /* SockDiag.v index while ranking           */
+    double rate;          /* bytes/s, both directions                 */
+    char label[TOP_LABEL_MAX];
+} FlowTop;
+
+/* ---------- Sub-interval extremes (--sample / --burst) ------------- */
+typedef struct {
+    NetStats last;      /* counters at the previous sub-sample       */
+    float cur[2];       /* last sub-interval rate, [0] rx [1] tx     */
+    float peak[2], low[2]; /* since the last line, bytes/s           */
+    uint32_t n;         /* sub-intervals since the last line         */
+    uint32_t bursts;    /* rises above the threshold since then      */
+    bool over;          /* the last sub-interval was above it        */
+} BurstStats;
+
+/* ---------- Queueing disciplines (--qdisc) ------------------------ */
+#define QDISC_KIND_MAX 16u /* TCA_KIND: "fq_codel", "htb" ...         */
+
+typedef struct {
+    uint32_t drops, requeues, overlimits; /* wrapping kernel counters */
+    uint32_t backlog;     /* bytes queued now                         */
+    uint32_t qlen;        /* packets queued now                       */
+} QdiscCounters;
+
+typedef struct {
+    uint32_t handle;      /* class id, major << 16 | minor            */
+    QdiscCounters c;
+    double drop_rate;     /* drops/s since the previous class dump    */
+    uint32_t seen;        /* QdiscDump.gen of the last dump hit       */
+} QdiscClass;
+
+typedef struct {
+    char kind[QDISC_KIND_MAX]; /* root qdisc; "" once it is gone      */
+    uint32_t handle;      /* root qdisc handle: a new one re-baselines */
+    QdiscCounters c;      /* root qdisc at the last dump              */
+    uint64_t ts_ns;       /* when dumped                              */
+    double drop_rate, requeue_rate, overlimit_rate; /* per second     */
+    uint32_t seen;        /* QdiscDump.gen of the last dump hit       */
+    QdiscClass *cls;      /* --qdisc classes, classful roots only     */
+    uint32_t n_cls, cap_cls;
+    uint64_t cls_ns;      /* when the classes were dumped             */
+    int worst;            /* cls index with most drops, then backlog;
+                             -1 while every class is idle            */
+} QdiscInfo;
+
+typedef struct {
+    int fd;               /* NETLINK_ROUTE, -1 when off               */
+    uint32_t seq, gen;
+    bool classes;         /* also dump the classes of classful roots  */
+    char *buf;            /* dump receive buffer                      */
+} QdiscDump;
+
+/* ---------- Threshold alerts ---------------------------------------- */
+typedef enum { ALERT_OK, ALERT_WARN, ALERT_CRIT } AlertLevel;
+
+/* What a limit applies to: the two rates, then the root qdisc's */
+enum { ALERT_RX, ALERT_TX, ALERT_DROPS, ALERT_BACKLOG, ALERT_DIMS };
+
+typedef struct {
+    uint64_t warn[ALERT_DIMS], crit[ALERT_DIMS]; /* 0 = none: bytes/s,
+                                       drops/s, bytes queued          */
+} AlertLimits;
+
+typedef struct {
+    char scope[IFACE_NAME_MAX]; /* interface name or glob, "*" = all */
+    bool crit;            /* -C rather than -W                       */
+    uint8_t dim;          /* v[0] is for ALERT_RX or ALERT_DROPS     */
+    bool set[2];          /* rx, tx (drops, backlog) given           */
+    uint64_t v[2];
+} AlertRule;
+
+typedef struct {
+    uint8_t level;        /* AlertLevel in effect                    */
+    uint8_t pending;      /* level the rate asks for ...             */
+    uint64_t since_ms;    /* ... since then (hold time)              */
+} AlertState;
 
 /* ---------- Per-adapter object -------------------------------------- */
 typedef struct {
-    char name[IFNAMSIZ];
+    char name[IFACE_NAME_MAX];
+    int ifindex;
     bool wifi; /* determined once with is_wireless()      */
     IfState state;
     NetStats prev; /* previous snapshot for rate calculation  */
-    char ssid[IW_ESSID_MAX_SIZE + 1]; // Added for storing SSID
+    double rx_rate, tx_rate; /* last computed rates (bytes/s)    */
+    WifiLink wl;           /* SSID + station info, cached         */
+    uint64_t wl_stamp_ms;  /* when wl was fetched; 0 = stale      */
+    const Template *layout[IFSTATE_COUNT]; /* resolved once per adapter */
+    bool pinned;   /* named literally: kept (as err) while absent  */
+    bool ignored;  /* seen but filtered out – cached negative match */
+    uint32_t seen; /* tick generation of the last snapshot hit     */
+    RateWindow *rs; /* [0] rx, [1] tx; NULL unless a layout uses it */
+    uint32_t rec_id; /* --record link id + 1; 0 = not logged yet    */
+    uint32_t hist_id; /* --history entry + 1; 0 = not looked up    */
+    uint32_t state_every_ms; /* --adaptive sysfs state poll backoff */
+    uint64_t state_ms;       /* when the state was last polled     */
+    AlertLimits lim;         /* resolved once per adapter            */
+    AlertState al[ALERT_DIMS]; /* indexed like AlertLimits           */
+    int sys_fd[2];  /* operstate, carrier fds + 1 (0 = closed), kept
+                       open across ticks by sysfs_batch.c           */
+    uint32_t groups; /* bit i: member of IfaceGroup i (--group)    */
+    int master;      /* ifindex of its bond/bridge, 0 = none        */
+    FlowTop *top;    /* [TOP_MAX], busiest first; NULL until needed */
+    uint8_t n_top;
+    BurstStats burst; /* sub-interval peak/low since the last line  */
+    bool netns;      /* in another network namespace (netns.c)     */
+    QdiscInfo *qd;   /* --qdisc: root qdisc; NULL until dumped      */
 } Iface;
 
+/* ---------- Interface discovery ------------------------------------- */
+typedef struct {
+    char **include; /* names or globs; empty = nothing matches  */
+    size_t n_include;
+    char **exclude;
+    size_t n_exclude;
+} IfaceFilter;
+
+typedef struct {
+    Iface *v;           /* dense, in display order                 */
+    size_t n, cap;
+    uint32_t *by_name;  /* open-addressed hashes (idx+1), 2*cap    */
+    uint32_t *by_index;
+} IfaceTable;
+
+/* ---------- Interface groups (--group) ----------------------------- */
+#define GROUP_MAX 32u /* Iface.groups is a bit mask                 */
+
+typedef struct {
+    IfaceFilter members;  /* names and globs                          */
+    bool wifi, eth;       /* "@wifi" / "@eth": every adapter of a kind */
+    Iface n;              /* the segment: name, state, summed rates   */
+} IfaceGroup;
+
+/* ---------- Per-socket TCP accounting (NETLINK_SOCK_DIAG) ---------- */
+typedef struct {
+    uint64_t cookie;      /* kernel socket id                         */
+    uint8_t family;       /* AF_INET or AF_INET6                      */
+    uint8_t laddr[16], raddr[16];
+    uint16_t lport, rport;
+    uint32_t inode;
+    uint64_t acked, received; /* tcpi_bytes_acked / _received         */
+} FlowSample;
+
+typedef struct {
+    FlowSample s;         /* last sample                              */
+    uint64_t ts_ns;       /* when it was taken                        */
+    uint64_t born_ns;     /* first dump that had it                   */
+    double rate;          /* bytes/s, both directions                 */
+    uint32_t seen;        /* SockDiag.gen of the last dump hit        */
+    char ifname[IFNAMSIZ]; /* adapter owning laddr, "" if unknown     */
+    char comm[16];        /* owning process, "" if not visible        */
+    bool comm_tried;      /* looked up in a /proc scan newer than it  */
+} Flow;
+
+typedef struct {
+    uint32_t inode;       /* socket inode                             */
+    char comm[16];        /* its process, or the pid if unreadable    */
+} SockOwner;
+
+typedef struct {
+    uint8_t family;
+    uint8_t addr[16];
+    char ifname[IFNAMSIZ];
+} AddrOwner;
+
+typedef struct {
+    int fd;               /* -1 when off                              */
+    uint32_t seq, gen;
+    Flow *v;              /* dense                                    */
+    size_t n, cap;
+    uint32_t *slots;      /* open-addressed by cookie (idx+1), 2*cap  */
+    AddrOwner *addrs;     /* local address → adapter                  */
+    size_t n_addrs;
+    uint64_t addrs_ns;    /* last getifaddrs()                        */
+    SockOwner *owners;    /* last /proc scan, sorted by inode         */
+    size_t n_owners, cap_owners;
+    uint64_t owners_ns;   /* when it ran; 0 = never                   */
+    char *buf;            /* dump receive buffer                      */
+} SockDiag;
+
+/* ---------- Shared-memory sampler (--daemon / --attach) ------------- */
+#define SHM_HIST 64u /* rate samples published per adapter          */
+
+typedef struct {
+    char name[IFACE_NAME_MAX];
+    int32_t ifindex;
+    uint8_t state;     /* IfState                                  */
+    bool wifi;
+    uint16_t hist_n;   /* valid samples in hist_*, oldest first    */
+    WifiLink wl;
+    uint64_t rx_bytes, tx_bytes; /* counters of the last sample      */
+    double rx_rate, tx_rate;
+    float hist_rx[SHM_HIST], hist_tx[SHM_HIST];
+} ShmIface;
+
+typedef struct {
+    uint64_t ticks;      /* sampler passes so far; restarts from 0  */
+    uint64_t stamp_ns;   /* CLOCK_MONOTONIC of the last publication */
+    uint32_t refresh_ms; /* sampler tick                            */
+} ShmInfo;
+
+typedef struct {
+    int fd;
+    void *map;       /* header + ShmIface slots                   */
+    size_t map_len;
+    char name[64];
+    void *copy;      /* reader: last consistent snapshot          */
+    size_t copy_cap;
+} ShmSeg;
+
+/* ---------- Per-tick counter snapshot ------------------------------- */
+typedef enum {
+    BACKEND_PROCFS,  /* /proc/net/dev text (fallback)           */
+    BACKEND_NETLINK  /* RTM_GETLINK dump with IFLA_STATS64      */
+} SnapBackend;
+
+typedef struct {
+    char name[IFNAMSIZ];
+    NetStats stats;
+    int ifindex;       /* 0 when the backend does not know it    */
+    bool has_link;     /* operstate/carrier below are valid      */
+    uint8_t operstate; /* IF_OPER_* from IFLA_OPERSTATE          */
+    bool carrier;      /* IFLA_CARRIER                           */
+    int master;        /* IFLA_MASTER: bond/bridge ifindex, or 0 */
+} SnapEntry;
+
+typedef struct {
+    SnapBackend backend;
+    int fd;          /* persistent /proc/net/dev fd or rtnl sock */
+    uint32_t seq;    /* netlink request sequence                 */
+    char *buf;       /* reusable read buffer                     */
+    size_t buf_cap;
+    SnapEntry *ent;  /* entries in file order                    */
+    size_t n, cap;
+    uint32_t *slots; /* open-addressed name hash (idx+1), 2*cap  */
+} NetSnapshot;
+
+/* ---------- Other network namespaces (-i netns:NAME/... pid:PID/...) */
+#define NETNS_RUN_DIR "/var/run/netns" /* where `ip netns add` puts them */
+
+typedef struct {
+    char label[IFACE_NAME_MAX]; /* "NAME" or "pid:PID": the name prefix */
+    NetSnapshot snap;  /* netlink dump socket created inside it  */
+    uint64_t ino;      /* namespace inode the socket belongs to  */
+    uint64_t check_ms; /* last open attempt or identity check    */
+    bool warned;       /* unavailable, said so once              */
+} Netns;
+
+typedef struct {
+    Netns *v;
+    size_t n;
+} NetnsSet;
+
+/* ---------- Batched sysfs state reads (io_uring or pread) ---------- */
+#define SB_READ_MAX 16u /* bytes read per state file                 */
+#define SB_PATH_MAX 256u /* state file paths opened in the ring      */
+
+typedef struct {
+    int ring_fd;          /* io_uring; -1 = pread fallback           */
+    void *sq_map, *cq_map, *sqes, *cqes;
+    size_t sq_len, cq_len, sqes_len;
+    uint32_t *sq_tail, *sq_array, *cq_head, *cq_tail;
+    uint32_t sq_mask, cq_mask, sq_entries;
+    size_t *idx;          /* IfaceTable indices queued this tick     */
+    uint8_t *state;       /* IfState read for each, after a run      */
+    char (*buf)[2][SB_READ_MAX]; /* operstate, carrier contents      */
+    int32_t (*res)[2];    /* bytes read or -errno                    */
+    size_t n, cap;        /* queued / allocated                      */
+    size_t ran;           /* entries the last run resolved           */
+    int fd_max;           /* keep no state file open at or above     */
+    bool fd_full;         /* the last open reached fd_max            */
+    bool direct;          /* registered slots: open/read/close chains */
+    char (*path)[SB_PATH_MAX]; /* their file names, one per slot      */
+} SysfsBatch;
+
+/* ---------- Filesystem roots (PROCFS_ROOT / SYSFS_ROOT) ------------ */
+typedef enum { FS_PROC, FS_SYS } FsRoot;
+
 /* ---------- Function prototypes (from net_stats.c) ----------------- */
+uint64_t mono_ns(void);
+uint64_t mono_ms(void);
+const char *fs_root(FsRoot which);
+void fs_root_set(FsRoot which, const char *path);
+bool net_snapshot_init(NetSnapshot *s, SnapBackend backend);
+bool net_snapshot_read(NetSnapshot *s);
+bool net_snapshot_load(NetSnapshot *s);
+size_t net_snapshot_parse(NetSnapshot *s, const char *text, size_t len);
+void net_snapshot_clear(NetSnapshot *s);
+SnapEntry *net_snapshot_add(NetSnapshot *s, const char *name);
+const SnapEntry *net_snapshot_entry(const NetSnapshot *s, const char *ifname);
+const NetStats *net_snapshot_find(const NetSnapshot *s, const char *ifname);
+void net_snapshot_free(NetSnapshot *s);
 bool read_iface_stats(const char *ifname, NetStats *out);
+bool read_aggregate_stats(const NetSnapshot *snap, char *const ifaces[],
+                          size_t n_ifaces, NetStats *out);
+double avg_rate(uint64_t now, uint64_t old, double sec_delta);
+
+/* ---------- Function prototypes (from netlink.c) ------------------- */
+struct nlmsghdr;
+int rtnl_open(uint32_t groups);
+bool rtnl_dump_links(NetSnapshot *s);
+bool rtnl_parse_link(const struct nlmsghdr *nh, SnapEntry *out);
+typedef void (*LinkEventFn)(const SnapEntry *link, bool removed, void *ctx);
+bool rtnl_read_link_events(int fd, char *buf, size_t cap, LinkEventFn fn,
+                           void *ctx);
+
+/* ---------- nl80211 generic-netlink session ------------------------ */
+typedef struct {
+    int fd;          /* request/response socket                 */
+    int ev_fd;       /* "mlme" multicast subscription, -1 if none */
+    uint16_t family; /* resolved nl80211 family id              */
+    uint32_t seq;
+    char *buf;
+    bool tried;      /* wifi_refresh() opened it (or failed to)  */
+    unsigned wait_ms; /* longest a reply may take; 0 = default   */
+} Nl80211;
+
+/* ---------- Function prototypes (from nl80211.c) ------------------- */
+bool nl80211_open(Nl80211 *nl);
+void nl80211_close(Nl80211 *nl);
+void nl80211_set_wait(Nl80211 *nl, unsigned ms);
+bool nl80211_query(Nl80211 *nl, int ifindex, WifiLink *out);
+void nl80211_parse_reply(const struct nlmsghdr *nh, WifiLink *out);
+void nl80211_read_events(Nl80211 *nl, void (*fn)(int ifindex, void *ctx),
+                         void *ctx);
+bool wifi_refresh(Nl80211 *nl, Iface *n, uint64_t now_ms);
+
+/* ---------- Function prototypes (from iface_table.c) --------------- */
+bool iface_filter_add(IfaceFilter *f, const char *csv, bool exclude);
+bool iface_filter_match(const IfaceFilter *f, const char *name);
+bool iface_filter_pinned(const IfaceFilter *f, const char *name);
+void iface_filter_free(IfaceFilter *f);
+Iface *iftab_add(IfaceTable *t, const char *name);
+Iface *iftab_find(const IfaceTable *t, const char *name);
+Iface *iftab_find_index(const IfaceTable *t, int ifindex);
+void iftab_set_index(IfaceTable *t, Iface *n, int ifindex);
+size_t iftab_prune(IfaceTable *t, bool (*keep)(const Iface *n, void *ctx),
+                   void *ctx);
+void iftab_free(IfaceTable *t);
+
+/* ---------- Function prototypes (from groups.c) ------------------- */
+bool group_parse(IfaceGroup *g, const char *spec);
+uint32_t group_mask(const IfaceGroup *g, size_t n_groups, const char *ifname,
+                    bool wifi);
+void group_sum(IfaceGroup *g, size_t idx, const IfaceTable *t);
+void group_burst(IfaceGroup *g, size_t idx, const IfaceTable *t,
+                 uint64_t threshold);
+void group_free(IfaceGroup *g);
+
+/* ---------- Function prototypes (from rate_stats.c) ---------------- */
+bool rate_window_init(RateWindow *w, uint32_t cap);
+void rate_window_reset(RateWindow *w);
+void rate_window_free(RateWindow *w);
+void rate_window_push(RateWindow *w, double bps, double alpha);
+double rate_window_min(const RateWindow *w);
+double rate_window_max(const RateWindow *w);
+double rate_window_pct(const RateWindow *w, unsigned pct);
+size_t rate_window_spark(const RateWindow *w, char *dst, size_t width);
+size_t rate_window_tail(const RateWindow *w, float *dst, size_t k);
+double ewma_alpha(double dt_s, double half_life_s);
+RateWindow *rate_stats_new(uint32_t cap);
+void rate_stats_free(RateWindow *rs);
+
+/* ---------- Function prototypes (from burst.c) --------------------- */
+void burst_prime(BurstStats *b, const NetStats *now);
+void burst_push(BurstStats *b, double rx, double tx, uint64_t threshold);
+bool burst_sample(BurstStats *b, const NetStats *now, uint64_t threshold,
+                  uint64_t min_ns);
+void burst_restart(BurstStats *b);
+
+/* ---------- Function prototypes (from shm.c) ----------------------- */
+void shm_default_name(char *dst, size_t cap);
+bool shm_create(ShmSeg *s, const char *name);
+bool shm_publish(ShmSeg *s, const IfaceTable *t, uint64_t ticks,
+                 unsigned refresh_ms);
+bool shm_attach(ShmSeg *s, const char *name);
+const ShmIface *shm_read(ShmSeg *s, size_t *n, ShmInfo *info);
+void shm_close(ShmSeg *s);
+
+/* ---------- Function prototypes (from netns.c) --------------------- */
+bool netns_collect(NetnsSet *s, const IfaceFilter *f);
+bool netns_read(Netns *ns, uint64_t now_ms);
+void netns_free(NetnsSet *s);
+
+/* ---------- Function prototypes (from sysfs_batch.c) --------------- */
+bool sysfs_batch_open(SysfsBatch *b, bool uring);
+void sysfs_batch_queue(SysfsBatch *b, size_t idx);
+bool sysfs_batch_run(SysfsBatch *b, IfaceTable *t);
+void sysfs_batch_close(SysfsBatch *b);
+void sysfs_forget(Iface *n);
 
 /* ---------- Function prototypes (from iface_state.c) --------------- */
 bool is_wireless(const char *ifname);
+int iface_index(const char *ifname);
 IfState get_iface_state(const char *ifname, bool wifi_hint);
+IfState iface_state_from_link(uint8_t operstate, bool carrier);
+IfState iface_link_state(const Iface *n, const SnapEntry *e);
+int iface_master(const char *ifname);
 void get_wifi_ssid(const char *ifname, char *ssid_buf); // Added prototype
 
-/* ---------- Function prototypes (from human_print.c) ------------- */
-double avg_rate(uint64_t now, uint64_t old, unsigned sec_delta);
+/* ---------- Output formatter / line buffer -------------------------- */
+typedef struct {
+    char scope[IFACE_NAME_MAX]; /* "", "wifi", "eth" or interface name */
+    int state;            /* IfState this rule applies to          */
+    Template tpl;
+} FmtRule;
+
+typedef struct {
+    FmtRule *rules; /* user rules, then 2*IFSTATE_COUNT defaults   */
+    size_t n_rules, n_user;
+    bool stats;     /* some rule uses windowed statistics          */
+    bool top;       /* some rule uses {top}                        */
+    bool qdisc;     /* some rule uses a qdisc field                */
+} Formatter;
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+} OutBuf;
+
+typedef struct {
+    char unit;
+    unsigned divisor;
+    bool json; /* escape for a JSON string, no "!"/"?" markers    */
+} RenderOpts;
+
+/* ---------- Status bar protocols (--output) ------------------------- */
+typedef enum {
+    PROTO_PLAIN,  /* one text line per tick (Polybar, lemonbar)     */
+    PROTO_I3BAR,  /* i3bar/swaybar JSON blocks, click events        */
+    PROTO_WAYBAR  /* one waybar custom-module JSON object per tick  */
+} OutputProto;
+
+typedef struct {
+    int fd;           /* click events (stdin), -1 = none            */
+    char buf[512];    /* partial event line                         */
+    size_t len;
+} BarClicks;
+
+#define FMT_RATE_MAX 40  /* longest fmt_rate() output              */
+#define FMT_FIELD_MAX 64 /* longest single rendered field          */
+#define FMT_TOP_MAX (TOP_MAX * (TOP_LABEL_MAX + FMT_RATE_MAX + 2u)) /* {top} */
+
+/* ---------- OpenMetrics exporter ------------------------------------ */
+#define EXPORT_MAX_CLIENTS 8 /* concurrent scrapes                  */
+
+typedef struct {
+    int fd;            /* -1 = free slot                           */
+    char req[1024];    /* request head, NUL-terminated             */
+    size_t req_len;
+    OutBuf out;        /* rendered response; len 0 while reading   */
+    size_t sent;
+    uint64_t since_ms; /* accept time, for the idle timeout        */
+} ExportClient;
+
+typedef struct {
+    int fd;            /* listening socket                         */
+    char path[108];    /* Unix socket path to unlink, or ""        */
+    ExportClient cl[EXPORT_MAX_CLIENTS];
+} Exporter;
+
+/* ---------- Sample log (--record / --replay) ------------------------ */
+typedef struct {
+    char name[IFACE_NAME_MAX];
+    int ifindex;
+    bool wifi;
+    uint64_t rx, tx;   /* delta base: counters last logged         */
+} RecLink;
+
+typedef struct {
+    int fd;            /* -1 when not recording                    */
+    OutBuf buf;        /* encoded ticks not written yet            */
+    RecLink *links;    /* indexed by Iface.rec_id - 1              */
+    uint32_t n_links, cap_links;
+    uint64_t last_ns;  /* timestamp of the previous tick           */
+    uint64_t flush_ns, sync_ns; /* last write() / fdatasync()      */
+} Recorder;
+
+typedef struct {
+    uint32_t link;     /* Replay.links index                       */
+    uint8_t state;     /* IfState                                  */
+    NetStats stats;
+} RecEntry;
+
+typedef struct {
+    const unsigned char *map;
+    size_t len, off;
+    RecLink *links;
+    uint32_t n_links, cap_links;
+    RecEntry *ent;     /* entries of the current tick              */
+    size_t n_ent, cap_ent;
+    uint64_t ts_ns;    /* timestamp of the current tick            */
+    unsigned refresh_ms; /* of the session being read              */
+    bool session;      /* current tick starts a recording session  */
+} Replay;
+
+/* ---------- Traffic history file (--history / --totals) ------------ */
+typedef enum {
+    HIST_SEC,   /* rings kept in the file                          */
+    HIST_MIN,
+    HIST_HOUR,
+    HIST_DAY    /* --totals only: local days summed from hours     */
+} HistPeriod;
+
+typedef struct {
+    int fd;     /* -1 when off                                     */
+    void *map;  /* the whole file, updated in place                */
+    uint32_t n; /* adapter entries mapped                          */
+    bool write; /* sampler (flock held) rather than a reader      */
+} History;
+
+typedef struct {
+    unsigned hysteresis_pct; /* leave a level below limit less this  */
+    unsigned hold_ms;        /* a new level must last this long      */
+    bool smooth;             /* judge the EWMA, not the raw rate     */
+    const char *cmd;         /* hook for /bin/sh -c; NULL = none     */
+    unsigned running;        /* hooks spawned, not reaped yet        */
+    unsigned dropped;        /* changes lost to ALERT_MAX_RUNNING    */
+} Alerts;
+
+/* ---------- Self-instrumentation (--self-stats) -------------------- */
+#define SELF_BUCKETS 40u /* log2 latency buckets, up to ~9 minutes    */
+
+typedef enum {
+    PH_COUNTERS,  /* /proc/net/dev, netlink dump or shm read       */
+    PH_LINKS,     /* per-link pass: lookups, rates, windows, alerts */
+    PH_STATE,     /* batched sysfs link-state reads                */
+    PH_WIFI,      /* SSID/station queries (part of PH_LINKS)       */
+    PH_TOP,       /* sock_diag flow ranking                        */
+    PH_QDISC,     /* qdisc (and class) dumps                       */
+    PH_OUTPUT,    /* render and write (or publish) the line        */
+    PH_TICK,      /* the whole tick                                */
+    PH_SAMPLE,    /* --sample sub-sample between ticks             */
+    PH_COUNT
+} SelfPhase;
+
+typedef enum {
+    SC_OPEN,      /* open, fopen, socket                           */
+    SC_READ,      /* read, pread, recv, io_uring_enter             */
+    SC_WRITE,     /* write, send                                   */
+    SC_IOCTL,
+    SC_OTHER,     /* stat, readlink, lseek, fdatasync              */
+    SC_COUNT
+} SelfCall;
+
+typedef struct {
+    bool on;
+    uint64_t since_ns;               /* enabled at                   */
+    uint64_t hist[PH_COUNT][SELF_BUCKETS];
+    uint64_t n[PH_COUNT], sum_ns[PH_COUNT], max_ns[PH_COUNT];
+    uint64_t calls[SC_COUNT];        /* running totals               */
+    uint64_t tick_calls[SC_COUNT];   /* totals when the tick began   */
+    uint64_t tick_sum[SC_COUNT];     /* issued within ticks          */
+    uint64_t max_calls[SC_COUNT];    /* most in one tick             */
+} SelfStats;
+
+extern SelfStats self_stats;
+
+/* Hooks for the hot path; empty unless built with BW3_SELF_STATS, and
+ * off until --self-stats: one flag test each, hinted not taken. */
+#ifdef BW3_SELF_STATS
+#define SELF_ON() __builtin_expect(self_stats.on, 0)
+#define SELF_CALL(kind) (SELF_ON() ? (void)++self_stats.calls[(kind)] : (void)0)
+#define SELF_START() (SELF_ON() ? mono_ns() : 0u)
+#define SELF_END(phase, t0) \
+    (SELF_ON() ? self_phase((phase), (t0)) : (void)0)
+#define SELF_TICK_START() (SELF_ON() ? self_tick_start() : 0u)
+#define SELF_TICK_END(t0) (SELF_ON() ? self_tick_end(t0) : (void)0)
+#else
+#define SELF_CALL(kind) ((void)0)
+#define SELF_START() 0u
+#define SELF_END(phase, t0) ((void)(t0))
+#define SELF_TICK_START() 0u
+#define SELF_TICK_END(t0) ((void)(t0))
+#endif
+
+/* ---------- Config file (--config) --------------------------------- */
+typedef struct {
+    char *text;        /* file contents, split in place             */
+    const char **kv;   /* key, value, key, value ... in file order  */
+    size_t n;          /* pairs                                     */
+} ConfFile;
+
+/* ---------- Function prototypes (from output.c) -------------------- */
+const char *state_icon(bool wifi, IfState st);
+bool fmt_compile(Template *t, const char *src, char *err, size_t errlen);
+void fmt_free(Template *t);
+bool formatter_init(Formatter *f, char *const specs[], size_t n_specs,
+                    char *err, size_t errlen);
+void formatter_free(Formatter *f);
+void formatter_layout(const Formatter *f, const char *ifname, bool wifi,
+                      const Template *out[IFSTATE_COUNT]);
+bool out_reserve(OutBuf *o, size_t extra);
+void out_put(OutBuf *o, const char *s, size_t len);
+bool out_flush(OutBuf *o, int fd);
+void out_free(OutBuf *o);
+size_t fmt_rate(char *dst, double bps, char unit, unsigned divisor,
+                uint64_t warn, uint64_t crit);
+bool render_iface(OutBuf *o, const Template *t, const Iface *n,
+                  const RenderOpts *ro);
+size_t json_escape(char *dst, const char *src, size_t len);
 void human_print(double bytes_per_s, char unit, unsigned divisor, uint64_t warn,
                  uint64_t crit);
+
+/* ---------- Function prototypes (from barproto.c) ------------------ */
+bool parse_output_proto(const char *v, OutputProto *dst);
+void bar_header(OutBuf *o, OutputProto p);
+bool bar_i3_block(OutBuf *o, const Template *t, const Iface *n,
+                  const RenderOpts *ro, bool first);
+void bar_waybar_begin(OutBuf *o, OutBuf *tip);
+bool bar_waybar_text(OutBuf *o, OutBuf *tip, const Template *t,
+                     const Template *tip_t, const Iface *n,
+                     const RenderOpts *ro, bool first);
+void bar_waybar_end(OutBuf *o, const OutBuf *tip, AlertLevel level,
+                    unsigned pct);
+unsigned bar_percent(const Iface *n);
+bool bar_clicks_read(BarClicks *c, void (*fn)(int button, void *ctx),
+                     void *ctx);
+
+/* ---------- Function prototypes (from exporter.c) ------------------ */
+bool exporter_open(Exporter *e, const char *addr);
+size_t exporter_pollfds(const Exporter *e, struct pollfd *pfd);
+void exporter_handle(Exporter *e, const struct pollfd *pfd, size_t n,
+                     const IfaceTable *t, uint64_t now_ms);
+void exporter_metrics(OutBuf *o, const IfaceTable *t);
+void exporter_close(Exporter *e);
+
+/* ---------- Function prototypes (from record.c) -------------------- */
+bool rec_open(Recorder *r, const char *path, unsigned refresh_ms);
+bool rec_tick(Recorder *r, IfaceTable *t, uint32_t gen, uint64_t ts_ns);
+bool rec_flush(Recorder *r, bool sync);
+void rec_close(Recorder *r);
+bool replay_open(Replay *r, const char *path);
+bool replay_next(Replay *r);
+void replay_close(Replay *r);
+
+/* ---------- Function prototypes (from sockdiag.c) ------------------ */
+bool sockdiag_open(SockDiag *sd);
+bool sockdiag_parse(const struct nlmsghdr *nh, FlowSample *out);
+bool sockdiag_poll(SockDiag *sd, uint64_t now_ns);
+void sockdiag_top(SockDiag *sd, IfaceTable *t, unsigned n_top,
+                  uint64_t now_ns);
+void sockdiag_close(SockDiag *sd);
+
+/* ---------- Function prototypes (from qdisc.c) --------------------- */
+bool qdisc_open(QdiscDump *q, bool classes);
+bool qdisc_parse(const struct nlmsghdr *nh, int *ifindex, uint32_t *parent,
+                 uint32_t *handle, char kind[QDISC_KIND_MAX], QdiscCounters *c);
+void qdisc_update(Iface *n, const char *kind, uint32_t handle,
+                  const QdiscCounters *c, uint64_t now_ns);
+bool qdisc_poll(QdiscDump *q, IfaceTable *t, uint64_t now_ns);
+void qdisc_forget(Iface *n);
+void qdisc_close(QdiscDump *q);
+
+/* ---------- Function prototypes (from history.c) ------------------- */
+bool hist_open(History *h, const char *path, bool write);
+bool hist_resume(History *h, Iface *n, uint64_t now_ns, NetStats *out);
+void hist_tick(History *h, IfaceTable *t, uint32_t gen, int64_t wall_s);
+bool hist_slot(const History *h, const char *ifname, HistPeriod p,
+               int64_t period, uint64_t *rx, uint64_t *tx);
+void hist_report(const History *h, HistPeriod p, unsigned rows,
+                 const IfaceFilter *f, char unit, unsigned divisor);
+void hist_close(History *h);
+
+/* ---------- Function prototypes (from alerts.c) -------------------- */
+bool alert_rule_parse(AlertRule *r, const char *spec, bool crit);
+void alert_limits(AlertLimits *out, const AlertRule *rules, size_t n_rules,
+                  const char *ifname);
+bool alert_step(AlertState *s, uint64_t warn, uint64_t crit, double bps,
+                const Alerts *al, uint64_t now_ms);
+void alert_update(Alerts *al, Iface *n, uint64_t now_ms);
+void alert_reap(Alerts *al);
+
+/* ---------- Function prototypes (from conffile.c) ------------------ */
+bool conf_parse(ConfFile *c, char *text, char *err, size_t errlen);
+bool conf_load(ConfFile *c, const char *path, char *err, size_t errlen);
+const char *conf_get(const ConfFile *c, const char *key);
+void conf_free(ConfFile *c);
+int conf_watch(const char *path);
+bool conf_watch_read(int fd, const char *path);
+
+/* ---------- Function prototypes (from selfstats.c) ----------------- */
+void self_enable(SelfStats *s);
+unsigned self_bucket(uint64_t ns);
+void self_record(SelfStats *s, SelfPhase p, uint64_t ns);
+void self_phase(SelfPhase p, uint64_t t0);
+uint64_t self_tick_start(void);
+void self_tick_end(uint64_t t0);
+uint64_t self_percentile(const SelfStats *s, SelfPhase p, unsigned pct);
+void self_report(const SelfStats *s);
+
+/* ---------- Function prototypes (from bandwidth3.c) ---------------- */
+/* The program itself, for src/main.c and the tests and benchmarks that
+ * drive its tick: app_new() gives a zeroed App, app_start() returns -1
+ * to run (else the exit status), app_stop() before free(). */
+typedef struct App App;
+App *app_new(void);
+int app_start(App *a, int argc, char *argv[]);
+void app_tick(App *a);
+void app_stop(App *a);
+size_t app_adapters(const App *a);
+int app_main(int argc, char *argv[]);
@@ -0,0 +1,160 @@
+/*
+ * Status bar protocols beside the plain Polybar line (--output):
+ *
+ *   i3bar   the i3bar/swaybar infinite array – a header, then one array
+ *           of blocks per tick; critical alerts set "urgent", warnings
+ *           the degraded colour; click events arrive on stdin.
+ *   waybar  one custom-module object per tick: "text", a per-adapter
+ *           "tooltip", the worst alert level as "class" and the busiest
+ *           link's share of its limit as "percentage".
+ *
+ * Everything is appended to the caller's line buffers from constant
+ * fragments and pre-escaped template literals, so a tick allocates
+ * nothing once the buffers have grown to size.
+ */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define I3_WARN_COLOR "#FFFF00" /* i3status' color_degraded */
+
+static const char *const LEVEL_CLASS[] = {"ok", "warning", "critical"};
+
+#define PUT(o, lit) out_put((o), (lit), sizeof(lit) - 1u)
+
+bool parse_output_proto(const char *v, OutputProto *dst) {
+  if (strcmp(v, "plain") == 0 || strcmp(v, "polybar") == 0)
+    *dst = PROTO_PLAIN;
+  else if (strcmp(v, "i3bar") == 0 || strcmp(v, "swaybar") == 0)
+    *dst = PROTO_I3BAR;
+  else if (strcmp(v, "waybar") == 0)
+    *dst = PROTO_WAYBAR;
+  else
+    return false;
+  return true;
+}
+
+/* Once, before the first line. */
+void bar_header(OutBuf *o, OutputProto p) {
+  if (p == PROTO_I3BAR)
+    PUT(o, "{\"version\":1,\"click_events\":true}\n[\n");
+}
+
+static void put_json_str(OutBuf *o, const char *s) {
+  size_t len = strlen(s);
+  if (out_reserve(o, len * 6u))
+    o->len += json_escape(o->buf + o->len, s, len);
+}
+
+static AlertLevel iface_level(const Iface *n) {
+  uint8_t level = ALERT_OK;
+  for (int d = 0; d < ALERT_DIMS; ++d)
+    level = n->al[d].level > level ? n->al[d].level : level;
+  return (AlertLevel)level;
+}
+
+/* One i3bar block; false (nothing appended) when the layout hides it. */
+bool bar_i3_block(OutBuf *o, const Template *t, const Iface *n,
+                  const RenderOpts *ro, bool first) {
+  if (!t || t->hidden)
+    return false;
+  if (!first)
+    PUT(o, ",");
+  PUT(o, "{\"name\":\"bandwidth3\",\"instance\":\"");
+  put_json_str(o, n->name);
+  PUT(o, "\",\"full_text\":\"");
+  render_iface(o, t, n, ro);
+  PUT(o, "\"");
+  AlertLevel level = iface_level(n);
+  if (level == ALERT_CRIT)
+    PUT(o, ",\"urgent\":true");
+  else if (level == ALERT_WARN)
+    PUT(o, ",\"color\":\"" I3_WARN_COLOR "\"");
+  PUT(o, "}");
+  return true;
+}
+
+/* A waybar object is built in two buffers: "text" straight into o after
+ * bar_waybar_begin(), the tooltip lines in tip, joined by _end(). */
+void bar_waybar_begin(OutBuf *o, OutBuf *tip) {
+  PUT(o, "{\"text\":\"");
+  tip->len = 0;
+}
+
+/* Append one adapter to the text (" | " separated) and a line to the
+ * tooltip; false when the layout hides it. */
+bool bar_waybar_text(OutBuf *o, OutBuf *tip, const Template *t,
+                     const Template *tip_t, const Iface *n,
+                     const RenderOpts *ro, bool first) {
+  if (!t || t->hidden)
+    return false;
+  if (!first)
+    PUT(o, " | ");
+  render_iface(o, t, n, ro);
+  if (tip->len)
+    PUT(tip, "\\n"); /* escaped: the tooltip is a JSON string */
+  render_iface(tip, tip_t, n, ro);
+  return true;
+}
+
+void bar_waybar_end(OutBuf *o, const OutBuf *tip, AlertLevel level,
+                    unsigned pct) {
+  PUT(o, "\",\"tooltip\":\"");
+  out_put(o, tip->buf, tip->len);
+  PUT(o, "\",\"class\":\"");
+  out_put(o, LEVEL_CLASS[level], strlen(LEVEL_CLASS[level]));
+  PUT(o, "\",\"percentage\":");
+  char num[4];
+  size_t len = 0;
+  if (pct > 100u)
+    pct = 100u;
+  if (pct >= 100u)
+    num[len++] = '1';
+  if (pct >= 10u)
+    num[len++] = (char)('0' + pct / 10u % 10u);
+  num[len++] = (char)('0' + pct % 10u);
+  out_put(o, num, len);
+  PUT(o, "}\n");
+}
+
+/* Busiest direction as a share of its critical (else warning) limit;
+ * 0 without limits. */
+unsigned bar_percent(const Iface *n) {
+  double best = 0.0;
+  for (int d = 0; d < 2; ++d) {
+    uint64_t lim = n->lim.crit[d] ? n->lim.crit[d] : n->lim.warn[d];
+    double bps = d ? n->tx_rate : n->rx_rate;
+    if (lim && bps / (double)lim > best)
+      best = bps / (double)lim;
+  }
+  return best >= 1.0 ? 100u : (unsigned)(best * 100.0);
+}
+
+/* Drain i3bar click events: a "[" line, then one object per line, each
+ * but the first led by ','.  fn gets each event's button; false once
+ * stdin is closed. */
+bool bar_clicks_read(BarClicks *c, void (*fn)(int button, void *ctx),
+                     void *ctx) {
+  ssize_t r = read(c->fd, c->buf + c->len, sizeof c->buf - 1u - c->len);
+  if (r == 0 || (r < 0 && errno != EINTR && errno != EAGAIN))
+    return false;
+  if (r < 0)
+    return true;
+  c->len += (size_t)r;
+  c->buf[c->len] = '\0';
+  char *line = c->buf, *nl;
+  while ((nl = strchr(line, '\n'))) {
+    *nl = '\0';
+    const char *b = strstr(line, "\"button\":");
+    if (b)
+      fn(atoi(b + 9), ctx);
+    line = nl + 1;
+  }
+  c->len -= (size_t)(line - c->buf);
+  if (c->len == sizeof c->buf - 1u)
+    c->len = 0; /* no newline in a full buffer: not an event, drop it */
+  memmove(c->buf, line, c->len);
+  return true;
+}
@@ -0,0 +1,61 @@
+/*
+ * Sub-interval extremes (--sample / --burst): between two printed lines
+ * the counters are read on a faster cadence, and each adapter keeps the
+ * highest and lowest rate of those sub-intervals plus the number of
+ * times the rate rose above the burst threshold.  A 1 s average hides a
+ * 50 ms burst; a 20 ms sub-interval does not.
+ *
+ * Only counters are involved – no state, Wi-Fi, windows or alerts – so
+ * a sub-sample costs one snapshot read and a hash lookup per link.
+ */
+#include "bandwidth3.h"
+
+/* New baseline (a link just (re)appeared); the extremes are kept. */
+void burst_prime(BurstStats *b, const NetStats *now) {
+  b->last = *now;
+  b->cur[0] = b->cur[1] = 0.0f;
+}
+
+/* One sub-interval's rates.  A burst is counted when either direction
+ * crosses the threshold upwards, so a burst spanning several
+ * sub-intervals (or two lines) counts once. */
+void burst_push(BurstStats *b, double rx, double tx, uint64_t threshold) {
+  const double r[2] = {rx, tx};
+  for (int d = 0; d < 2; ++d) {
+    b->cur[d] = (float)r[d];
+    if (!b->n || b->cur[d] > b->peak[d])
+      b->peak[d] = b->cur[d];
+    if (!b->n || b->cur[d] < b->low[d])
+      b->low[d] = b->cur[d];
+  }
+  ++b->n;
+  bool over = threshold && (rx > (double)threshold || tx > (double)threshold);
+  if (over && !b->over)
+    ++b->bursts;
+  b->over = over;
+}
+
+/* Counters of a sub-sample; false (nothing recorded) while the
+ * sub-interval is shorter than min_ns – it is then merged into the
+ * next one rather than measured over a few microseconds. */
+bool burst_sample(BurstStats *b, const NetStats *now, uint64_t threshold,
+                  uint64_t min_ns) {
+  if (!b->last.ts_ns || now->ts_ns <= b->last.ts_ns) {
+    burst_prime(b, now);
+    return false;
+  }
+  if (now->ts_ns - b->last.ts_ns < min_ns)
+    return false;
+  double dt = (double)(now->ts_ns - b->last.ts_ns) / 1e9;
+  burst_push(b, avg_rate(now->rx_bytes, b->last.rx_bytes, dt),
+             avg_rate(now->tx_bytes, b->last.tx_bytes, dt), threshold);
+  b->last = *now;
+  return true;
+}
+
+/* A line was printed: the next one reports from here on. */
+void burst_restart(BurstStats *b) {
+  b->peak[0] = b->peak[1] = b->low[0] = b->low[1] = 0.0f;
+  b->n = 0;
+  b->bursts = 0;
+}
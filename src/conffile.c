@@ -0,0 +1,165 @@
+/*
+ * Config file (--config / CONFIG_FILE): the environment variables'
+ * KEY=VALUE pairs in a file, one per line, so a running bar can be
+ * re-configured by editing it.  '#' starts a comment line, an optional
+ * "export " prefix and quotes around the value are accepted, so the
+ * same file can be sourced by a shell.
+ *
+ * The file is watched through its directory with inotify: editors
+ * usually save by renaming a new file over the old one, which a watch
+ * on the file itself would not survive.
+ */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CONF_MAX_SIZE (64u * 1024u) /* larger is not a config file */
+
+static char *trim(char *s) {
+  while (*s == ' ' || *s == '\t')
+    ++s;
+  size_t len = strlen(s);
+  while (len && strchr(" \t\r", s[len - 1]))
+    s[--len] = '\0';
+  return s;
+}
+
+/* Split text (owned by c from now on, even on failure) into pairs. */
+bool conf_parse(ConfFile *c, char *text, char *err, size_t errlen) {
+  memset(c, 0, sizeof *c);
+  c->text = text;
+  size_t cap = 0, line_no = 0;
+  for (char *line = text, *next; line; line = next) {
+    ++line_no;
+    if ((next = strchr(line, '\n')))
+      *next++ = '\0';
+    line = trim(line);
+    if (!*line || *line == '#')
+      continue;
+    if (strncmp(line, "export ", 7) == 0)
+      line = trim(line + 7);
+    char *eq = strchr(line, '=');
+    if (eq)
+      *eq = '\0';
+    if (!eq || !*(line = trim(line)) || line[strcspn(line, " \t")]) {
+      snprintf(err, errlen, "line %zu: expected KEY=VALUE", line_no);
+      return false;
+    }
+    char *val = trim(eq + 1);
+    size_t len = strlen(val);
+    if (len >= 2u && (val[0] == '"' || val[0] == '\'') &&
+        val[len - 1] == val[0]) {
+      val[len - 1] = '\0';
+      ++val;
+    }
+    if (c->n == cap) {
+      cap = cap ? cap * 2u : 16u;
+      const char **kv = realloc(c->kv, cap * 2u * sizeof *kv);
+      if (!kv) {
+        snprintf(err, errlen, "%s", strerror(errno));
+        return false;
+      }
+      c->kv = kv;
+    }
+    c->kv[2u * c->n] = line;
+    c->kv[2u * c->n + 1u] = val;
+    ++c->n;
+  }
+  return true;
+}
+
+/* Read and parse path; err says why not. */
+bool conf_load(ConfFile *c, const char *path, char *err, size_t errlen) {
+  memset(c, 0, sizeof *c);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    snprintf(err, errlen, "%s", strerror(errno));
+    if (fd >= 0)
+      close(fd);
+    return false;
+  }
+  char *text = NULL;
+  ssize_t r = -1;
+  if (st.st_size > (off_t)CONF_MAX_SIZE)
+    errno = EFBIG;
+  else if ((text = malloc((size_t)st.st_size + 1u)))
+    r = read(fd, text, (size_t)st.st_size);
+  if (r < 0) {
+    snprintf(err, errlen, "%s", strerror(errno));
+    free(text);
+    close(fd);
+    return false;
+  }
+  close(fd);
+  text[r] = '\0';
+  return conf_parse(c, text, err, errlen);
+}
+
+/* Value of key; the last assignment wins, NULL when absent. */
+const char *conf_get(const ConfFile *c, const char *key) {
+  for (size_t i = c->n; i-- > 0;)
+    if (strcmp(c->kv[2u * i], key) == 0)
+      return c->kv[2u * i + 1u];
+  return NULL;
+}
+
+void conf_free(ConfFile *c) {
+  free(c->kv);
+  free(c->text);
+  memset(c, 0, sizeof *c);
+}
+
+/* ---------- Change notification ------------------------------------ */
+static const char *base_name(const char *path) {
+  const char *slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+/* inotify descriptor reporting writes and renames in path's directory;
+ * -1 when inotify is not available. */
+int conf_watch(const char *path) {
+  char dir[PATH_MAX];
+  const char *slash = strrchr(path, '/');
+  if (!slash)
+    strcpy(dir, ".");
+  else if ((size_t)(slash - path) >= sizeof dir)
+    return -1;
+  else
+    snprintf(dir, sizeof dir, "%.*s", slash == path ? 1 : (int)(slash - path),
+             path);
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd >= 0 &&
+      inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Drain the watch; true when one of the events concerns path. */
+bool conf_watch_read(int fd, const char *path) {
+  const char *name = base_name(path);
+  union {
+    struct inotify_event ev; /* alignment */
+    char buf[4096];
+  } u;
+  bool hit = false;
+  ssize_t r;
+  while ((r = read(fd, u.buf, sizeof u.buf)) > 0) {
+    for (char *p = u.buf; p < u.buf + r;) {
+      const struct inotify_event *ev = (const struct inotify_event *)p;
+      if (ev->len && strcmp(ev->name, name) == 0)
+        hit = true;
+      p += sizeof *ev + ev->len;
+    }
+  }
+  return hit;
+}
@@ -0,0 +1,364 @@
+/*
+ * Minimal OpenMetrics endpoint: a non-blocking listener (TCP or Unix
+ * socket) multiplexed into the main poll() loop.  Scrapes are answered
+ * from the adapter table the loop already holds – never a fresh read –
+ * and a slow scraper only ever occupies its own connection slot.
+ */
+#define _GNU_SOURCE /* accept4() */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <netdb.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define EXPORT_TIMEOUT_MS 5000u /* idle/slow connections are dropped */
+#define EXPORT_BACKLOG 16
+
+static const char *const STATE_NAME[IFSTATE_COUNT] = {
+    [IFSTATE_DISABLED] = "off",
+    [IFSTATE_DISCONNECTED] = "down",
+    [IFSTATE_CONNECTED] = "up",
+    [IFSTATE_ERR] = "err",
+};
+
+/* --------------------------------------------------------------------- */
+/* "unix:/run/bw3.sock", "/run/bw3.sock", "9100", ":9100",               */
+/* "127.0.0.1:9100" or "[::1]:9100"; a bare port binds to localhost.     */
+static int listen_unix(Exporter *e, const char *path) {
+  struct sockaddr_un sa = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof sa.sun_path) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(sa.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0)
+    return -1;
+  unlink(path); /* stale socket of a previous run */
+  if (bind(fd, (struct sockaddr *)&sa, sizeof sa) < 0) {
+    close(fd);
+    return -1;
+  }
+  strcpy(e->path, path);
+  return fd;
+}
+
+static int listen_inet(const char *addr) {
+  char host[256] = "localhost";
+  const char *port = addr;
+  const char *colon = strrchr(addr, ':');
+  if (colon) {
+    size_t hlen = (size_t)(colon - addr);
+    if (hlen >= 2u && addr[0] == '[' && addr[hlen - 1u] == ']') {
+      ++addr; /* [v6]:port */
+      hlen -= 2u;
+    }
+    if (hlen >= sizeof host)
+      hlen = sizeof host - 1u;
+    if (hlen) {
+      memcpy(host, addr, hlen);
+      host[hlen] = '\0';
+    }
+    port = colon + 1;
+  }
+
+  struct addrinfo hints = {.ai_socktype = SOCK_STREAM,
+                           .ai_flags = AI_NUMERICSERV}, *res;
+  if (getaddrinfo(host, port, &hints, &res) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  int fd = -1;
+  for (struct addrinfo *ai = res; ai && fd < 0; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                0);
+    if (fd < 0)
+      continue;
+    int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (bind(fd, ai->ai_addr, ai->ai_addrlen) < 0) {
+      close(fd);
+      fd = -1;
+    }
+  }
+  freeaddrinfo(res);
+  return fd;
+}
+
+bool exporter_open(Exporter *e, const char *addr) {
+  memset(e, 0, sizeof *e);
+  for (size_t i = 0; i < EXPORT_MAX_CLIENTS; ++i)
+    e->cl[i].fd = -1;
+  if (strncmp(addr, "unix:", 5) == 0)
+    e->fd = listen_unix(e, addr + 5);
+  else if (addr[0] == '/')
+    e->fd = listen_unix(e, addr);
+  else
+    e->fd = listen_inet(addr);
+  if (e->fd < 0)
+    return false;
+  if (listen(e->fd, EXPORT_BACKLOG) < 0) {
+    exporter_close(e);
+    return false;
+  }
+  return true;
+}
+
+static void drop_client(ExportClient *c) {
+  close(c->fd);
+  c->fd = -1;
+  c->req_len = 0;
+  c->sent = 0;
+  c->out.len = 0; /* keep the buffer for the next scrape */
+}
+
+void exporter_close(Exporter *e) {
+  for (size_t i = 0; i < EXPORT_MAX_CLIENTS; ++i) {
+    if (e->cl[i].fd >= 0)
+      drop_client(&e->cl[i]);
+    out_free(&e->cl[i].out);
+  }
+  if (e->fd >= 0)
+    close(e->fd);
+  if (e->path[0])
+    unlink(e->path);
+  memset(e, 0, sizeof *e);
+  e->fd = -1;
+}
+
+/* --------------------------------------------------------------------- */
+/* OpenMetrics text exposition of the cached adapter table.              */
+static void put_str(OutBuf *o, const char *s) { out_put(o, s, strlen(s)); }
+
+static void put_fmt(OutBuf *o, const char *fmt, ...) {
+  char tmp[256];
+  va_list ap;
+  va_start(ap, fmt);
+  int len = vsnprintf(tmp, sizeof tmp, fmt, ap);
+  va_end(ap);
+  if (len > 0)
+    out_put(o, tmp, (size_t)len < sizeof tmp ? (size_t)len : sizeof tmp - 1u);
+}
+
+/* label value with \\, \" and \n escaped */
+static void put_label(OutBuf *o, const char *s) {
+  for (; *s; ++s) {
+    if (*s == '\\' || *s == '"')
+      out_put(o, "\\", 1);
+    if (*s == '\n')
+      put_str(o, "\\n");
+    else
+      out_put(o, s, 1);
+  }
+}
+
+static void put_series(OutBuf *o, const char *metric, const char *suffix,
+                       const Iface *n) {
+  put_str(o, metric);
+  put_str(o, suffix);
+  put_str(o, "{interface=\"");
+  put_label(o, n->name);
+  put_str(o, "\"} ");
+}
+
+void exporter_metrics(OutBuf *o, const IfaceTable *t) {
+  static const struct {
+    const char *family, *type, *unit, *help;
+  } FAM[] = {
+      {"bandwidth3_receive_bytes", "counter", "bytes", "Bytes received"},
+      {"bandwidth3_transmit_bytes", "counter", "bytes", "Bytes transmitted"},
+      {"bandwidth3_receive_rate_bytes_per_second", "gauge",
+       "bytes_per_second", "Receive rate over the last tick"},
+      {"bandwidth3_transmit_rate_bytes_per_second", "gauge",
+       "bytes_per_second", "Transmit rate over the last tick"},
+  };
+  for (size_t f = 0; f < sizeof FAM / sizeof FAM[0]; ++f) {
+    put_fmt(o, "# TYPE %s %s\n# UNIT %s %s\n# HELP %s %s.\n", FAM[f].family,
+            FAM[f].type, FAM[f].family, FAM[f].unit, FAM[f].family,
+            FAM[f].help);
+    for (size_t i = 0; i < t->n; ++i) {
+      const Iface *n = &t->v[i];
+      if (n->ignored)
+        continue;
+      bool counter = f < 2u;
+      put_series(o, FAM[f].family, counter ? "_total" : "", n);
+      if (counter)
+        put_fmt(o, "%llu\n", (unsigned long long)(f ? n->prev.tx_bytes
+                                                     : n->prev.rx_bytes));
+      else
+        put_fmt(o, "%.1f\n", f == 2u ? n->rx_rate : n->tx_rate);
+    }
+  }
+
+  put_str(o, "# TYPE bandwidth3_link_state stateset\n"
+             "# HELP bandwidth3_link_state Link state of the adapter.\n");
+  for (size_t i = 0; i < t->n; ++i) {
+    const Iface *n = &t->v[i];
+    if (n->ignored)
+      continue;
+    for (int s = 0; s < IFSTATE_COUNT; ++s) {
+      put_str(o, "bandwidth3_link_state{interface=\"");
+      put_label(o, n->name);
+      put_fmt(o, "\",bandwidth3_link_state=\"%s\"} %d\n", STATE_NAME[s],
+              n->state == (IfState)s);
+    }
+  }
+
+  put_str(o, "# TYPE bandwidth3_wifi info\n"
+             "# HELP bandwidth3_wifi Current Wi-Fi association.\n");
+  for (size_t i = 0; i < t->n; ++i) {
+    const Iface *n = &t->v[i];
+    if (n->ignored || !n->wifi || !n->wl.ssid[0])
+      continue;
+    put_str(o, "bandwidth3_wifi_info{interface=\"");
+    put_label(o, n->name);
+    put_str(o, "\",ssid=\"");
+    put_label(o, n->wl.ssid);
+    put_str(o, "\"} 1\n");
+  }
+  put_str(o, "# TYPE bandwidth3_wifi_signal_dbm gauge\n"
+             "# UNIT bandwidth3_wifi_signal_dbm dbm\n"
+             "# HELP bandwidth3_wifi_signal_dbm Signal of the associated AP.\n");
+  for (size_t i = 0; i < t->n; ++i) {
+    const Iface *n = &t->v[i];
+    if (n->ignored || !n->wifi || !n->wl.signal_dbm)
+      continue;
+    put_series(o, "bandwidth3_wifi_signal_dbm", "", n);
+    put_fmt(o, "%d\n", n->wl.signal_dbm);
+  }
+  put_str(o, "# EOF\n");
+}
+
+/* --------------------------------------------------------------------- */
+/* Connection handling                                                   */
+static void respond(ExportClient *c, const IfaceTable *t) {
+  static const char NOT_FOUND[] = "HTTP/1.1 404 Not Found\r\n"
+                                  "Content-Length: 0\r\n"
+                                  "Connection: close\r\n\r\n";
+  c->out.len = 0;
+  c->sent = 0;
+  if (strncmp(c->req, "GET /metrics", 12) != 0 &&
+      strncmp(c->req, "GET / ", 6) != 0) {
+    put_str(&c->out, NOT_FOUND);
+    return;
+  }
+  /* reserve the header, render the body, then fill in its length */
+  static const char HDR[] =
+      "HTTP/1.1 200 OK\r\n"
+      "Content-Type: application/openmetrics-text; version=1.0.0; "
+      "charset=utf-8\r\n"
+      "Connection: close\r\n"
+      "Content-Length: %10zu\r\n\r\n";
+  char hdr[sizeof HDR + 16];
+  int hlen = snprintf(hdr, sizeof hdr, HDR, (size_t)0);
+  out_put(&c->out, hdr, (size_t)hlen);
+  exporter_metrics(&c->out, t);
+  snprintf(hdr, sizeof hdr, HDR, c->out.len - (size_t)hlen);
+  memcpy(c->out.buf, hdr, (size_t)hlen);
+}
+
+/* Push as much as the socket takes; true once fully sent. */
+static bool flush_some(ExportClient *c) {
+  while (c->sent < c->out.len) {
+    ssize_t r = send(c->fd, c->out.buf + c->sent, c->out.len - c->sent,
+                     MSG_DONTWAIT | MSG_NOSIGNAL);
+    if (r < 0)
+      return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+    c->sent += (size_t)r;
+  }
+  return true;
+}
+
+static void on_readable(ExportClient *c, const IfaceTable *t) {
+  for (;;) {
+    size_t room = sizeof c->req - 1u - c->req_len;
+    if (!room) { /* oversized request: answer what we have */
+      respond(c, t);
+      break;
+    }
+    ssize_t r = recv(c->fd, c->req + c->req_len, room, MSG_DONTWAIT);
+    if (r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK &&
+                   errno != EINTR)) {
+      drop_client(c);
+      return;
+    }
+    if (r < 0)
+      return; /* wait for the rest of the request */
+    c->req_len += (size_t)r;
+    c->req[c->req_len] = '\0';
+    if (strstr(c->req, "\r\n\r\n") || strstr(c->req, "\n\n")) {
+      respond(c, t);
+      break;
+    }
+  }
+  if (flush_some(c))
+    drop_client(c);
+}
+
+size_t exporter_pollfds(const Exporter *e, struct pollfd *pfd) {
+  size_t n = 0, busy = 0;
+  for (size_t i = 0; i < EXPORT_MAX_CLIENTS; ++i) {
+    const ExportClient *c = &e->cl[i];
+    if (c->fd < 0)
+      continue;
+    ++busy;
+    pfd[n++] = (struct pollfd){.fd = c->fd,
+                               .events = c->out.len ? POLLOUT : POLLIN};
+  }
+  /* all slots taken: leave new connections in the backlog */
+  if (e->fd >= 0 && busy < EXPORT_MAX_CLIENTS)
+    pfd[n++] = (struct pollfd){.fd = e->fd, .events = POLLIN};
+  return n;
+}
+
+static ExportClient *client_of(Exporter *e, int fd) {
+  for (size_t i = 0; i < EXPORT_MAX_CLIENTS; ++i)
+    if (e->cl[i].fd == fd)
+      return &e->cl[i];
+  return NULL;
+}
+
+/* Service the descriptors exporter_pollfds() returned. */
+void exporter_handle(Exporter *e, const struct pollfd *pfd, size_t n,
+                     const IfaceTable *t, uint64_t now_ms) {
+  for (size_t i = 0; i < n; ++i) {
+    if (!pfd[i].revents)
+      continue;
+    if (pfd[i].fd == e->fd) {
+      ExportClient *c = client_of(e, -1);
+      /* hooks spawned by alerts must not inherit scrapers, and a slow
+       * one must never block the tick */
+      int fd = accept4(e->fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if (fd < 0)
+        continue;
+      if (!c) {
+        close(fd);
+        continue;
+      }
+      c->fd = fd;
+      c->since_ms = now_ms;
+      on_readable(c, t); /* the request often arrives with the SYN-ACK */
+      continue;
+    }
+    ExportClient *c = client_of(e, pfd[i].fd);
+    if (!c)
+      continue;
+    if (pfd[i].revents & (POLLERR | POLLNVAL))
+      drop_client(c);
+    else if (c->out.len) {
+      if (flush_some(c))
+        drop_client(c);
+    } else {
+      on_readable(c, t);
+    }
+  }
+
+  for (size_t i = 0; i < EXPORT_MAX_CLIENTS; ++i)
+    if (e->cl[i].fd >= 0 && now_ms - e->cl[i].since_ms > EXPORT_TIMEOUT_MS)
+      drop_client(&e->cl[i]);
+}
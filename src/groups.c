@@ -0,0 +1,121 @@
+/*
+ * Interface groups (--group NAME=MEMBERS): one extra segment per group
+ * with the summed rates and combined state of its members.  Groups are
+ * folded from the member rates the tick already computed from its one
+ * snapshot – no counters are read twice.  A member enslaved to a bond or
+ * bridge that is itself in the group is skipped: the master's counters
+ * already include its traffic.
+ */
+#include "bandwidth3.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* Best state wins: one live uplink makes the group connected. */
+static const uint8_t STATE_RANK[IFSTATE_COUNT] = {
+    [IFSTATE_ERR] = 0,
+    [IFSTATE_DISABLED] = 1,
+    [IFSTATE_DISCONNECTED] = 2,
+    [IFSTATE_CONNECTED] = 3,
+};
+
+/* "NAME=m1,m2+m3": members are names, globs, "@wifi" or "@eth" (every
+ * wired adapter but lo), separated by ',' or '+'.  A ';' ends the spec,
+ * so IFACE_GROUPS is parsed in place.  group_free() the result either
+ * way. */
+bool group_parse(IfaceGroup *g, const char *spec) {
+  memset(g, 0, sizeof *g);
+  g->n.state = IFSTATE_ERR;
+  const char *end = spec + strcspn(spec, ";");
+  const char *eq = memchr(spec, '=', (size_t)(end - spec));
+  size_t len = eq ? (size_t)(eq - spec) : 0u;
+  if (!len || len >= IFNAMSIZ || eq + 1 == end)
+    return false;
+  memcpy(g->n.name, spec, len);
+  for (const char *p = eq + 1; p < end; p += p < end) {
+    size_t tok = strcspn(p, ",+;");
+    char name[IFACE_NAME_MAX * 2]; /* globs, "netns:NAME/" prefixes */
+    if (tok >= sizeof name)
+      return false;
+    memcpy(name, p, tok);
+    name[tok] = '\0';
+    p += tok;
+    if (strcmp(name, "@wifi") == 0)
+      g->wifi = true;
+    else if (strcmp(name, "@eth") == 0)
+      g->eth = true;
+    else if (name[0] == '@' ||
+             (tok && !iface_filter_add(&g->members, name, false)))
+      return false;
+  }
+  return g->wifi || g->eth || g->members.n_include;
+}
+
+/* Bit i set for every group i the adapter belongs to. */
+uint32_t group_mask(const IfaceGroup *g, size_t n_groups, const char *ifname,
+                    bool wifi) {
+  uint32_t mask = 0;
+  for (size_t i = 0; i < n_groups && i < GROUP_MAX; ++i) {
+    bool in = (g[i].wifi && wifi) ||
+              (g[i].eth && !wifi && strcmp(ifname, "lo") != 0) ||
+              iface_filter_match(&g[i].members, ifname);
+    if (in)
+      mask |= 1u << i;
+  }
+  return mask;
+}
+
+/* Whether m adds to the group with this bit: a member not already
+ * counted through its bond or bridge. */
+static bool counted(const Iface *m, uint32_t bit, const IfaceTable *t) {
+  if (!(m->groups & bit))
+    return false;
+  const Iface *master = m->master ? iftab_find_index(t, m->master) : NULL;
+  return !master || !(master->groups & bit);
+}
+
+/* Fold group idx from the table: summed rates, best member state, and
+ * kind and Wi-Fi details from its connected members. */
+void group_sum(IfaceGroup *g, size_t idx, const IfaceTable *t) {
+  uint32_t bit = 1u << idx;
+  Iface *n = &g->n;
+  n->rx_rate = n->tx_rate = 0.0;
+  n->state = IFSTATE_ERR;
+  n->wl = (WifiLink){0};
+  bool any = false, all_wifi = true;
+  for (size_t i = 0; i < t->n; ++i) {
+    const Iface *m = &t->v[i];
+    if (!counted(m, bit, t))
+      continue;
+    any = true;
+    all_wifi &= m->wifi;
+    n->rx_rate += m->rx_rate;
+    n->tx_rate += m->tx_rate;
+    if (STATE_RANK[m->state] > STATE_RANK[n->state])
+      n->state = m->state;
+    if (m->wifi && m->state == IFSTATE_CONNECTED && !n->wl.ssid[0])
+      n->wl = m->wl;
+  }
+  n->wifi = any && all_wifi;
+}
+
+/* The members' last sub-interval rates, summed into one of the group's
+ * own (--sample). */
+void group_burst(IfaceGroup *g, size_t idx, const IfaceTable *t,
+                 uint64_t threshold) {
+  uint32_t bit = 1u << idx;
+  double rx = 0.0, tx = 0.0;
+  for (size_t i = 0; i < t->n; ++i) {
+    const Iface *m = &t->v[i];
+    if (!counted(m, bit, t))
+      continue;
+    rx += m->burst.cur[0];
+    tx += m->burst.cur[1];
+  }
+  burst_push(&g->n.burst, rx, tx, threshold);
+}
+
+void group_free(IfaceGroup *g) {
+  iface_filter_free(&g->members);
+  rate_stats_free(g->n.rs);
+  g->n.rs = NULL;
+}
@@ -0,0 +1,350 @@
+/*
+ * Persistent round-robin traffic history (--history / --totals).
+ *
+ * One file, mapped and updated in place: per adapter the counters of
+ * the last tick plus three rings of byte totals – seconds, minutes and
+ * hours of wall-clock time.  It starts with room for HIST_IFACES
+ * adapters and doubles when more are live at once; only an entry idle
+ * for a day is recycled.  A restarted sampler picks up
+ * the last counters (same boot, same link) and shows a real rate on its
+ * very first line; --totals reads the rings without any daemon.
+ */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HIST_MAGIC 0x62773368u /* "bw3h" */
+#define HIST_VERSION 1u
+#define HIST_IFACES 16u                  /* room in a new file, doubled   */
+#define HIST_RECYCLE_S 86400             /* idle this long: reusable      */
+#define HIST_SECS 3600u                  /* one hour of seconds           */
+#define HIST_MINS 1440u                  /* one day of minutes            */
+#define HIST_HOURS 8784u                 /* a (leap) year of hours        */
+#define HIST_RESUME_NS (60ull * 1000000000ull) /* older counters: no rate */
+
+typedef struct {
+    uint64_t t;      /* period number + 1 (since the epoch); 0 = empty */
+    uint64_t rx, tx; /* bytes moved in that period                      */
+} HistSlot;
+
+typedef struct {
+    char name[IFNAMSIZ];  /* "" = free entry                          */
+    int32_t ifindex;
+    uint32_t pad;
+    uint64_t rx_bytes, tx_bytes; /* counters at the last update         */
+    uint64_t mono_ns;     /* their CLOCK_MONOTONIC; 0 = none this boot */
+    int64_t wall_s;       /* last update, picks the entry to recycle  */
+    HistSlot sec[HIST_SECS], min[HIST_MINS], hour[HIST_HOURS];
+} HistIface;
+
+typedef struct {
+    uint32_t magic, version;
+    uint32_t n_ifaces;
+    uint32_t iface_size;  /* sizeof(HistIface): layout check          */
+    char boot_id[48];     /* counters are only valid within one boot  */
+    HistIface ifs[];
+} HistHeader;
+
+static const struct {
+    size_t off;           /* ring within HistIface                    */
+    uint32_t n;           /* slots                                    */
+    uint32_t len;         /* seconds per slot                         */
+} TIER[] = {[HIST_SEC] = {offsetof(HistIface, sec), HIST_SECS, 1u},
+            [HIST_MIN] = {offsetof(HistIface, min), HIST_MINS, 60u},
+            [HIST_HOUR] = {offsetof(HistIface, hour), HIST_HOURS, 3600u}};
+
+static size_t file_size(uint32_t n) {
+  return sizeof(HistHeader) + (size_t)n * sizeof(HistIface);
+}
+
+/* Map the first n entries of the file, replacing any older mapping. */
+static bool map_file(History *h, uint32_t n) {
+  void *m = mmap(NULL, file_size(n),
+                 h->write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED,
+                 h->fd, 0);
+  if (m == MAP_FAILED)
+    return false;
+  if (h->map)
+    munmap(h->map, file_size(h->n));
+  h->map = m;
+  h->n = n;
+  return true;
+}
+
+static HistSlot *ring(const HistIface *e, HistPeriod p) {
+  return (HistSlot *)((char *)e + TIER[p].off);
+}
+
+/* The kernel's per-boot UUID; "" when unreadable (never matches). */
+static void read_boot_id(char *dst, size_t cap) {
+  char path[PATH_MAX];
+  snprintf(path, sizeof path, "%s/sys/kernel/random/boot_id", fs_root(FS_PROC));
+  dst[0] = '\0';
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return;
+  ssize_t r = read(fd, dst, cap - 1u);
+  close(fd);
+  dst[r > 0 ? r : 0] = '\0';
+  dst[strcspn(dst, "\n")] = '\0';
+}
+
+/* --------------------------------------------------------------------- */
+/* Open or create the file.  The writer holds an exclusive flock() so    */
+/* two samplers never interleave updates; a file that is not ours is     */
+/* refused rather than overwritten.                                      */
+bool hist_open(History *h, const char *path, bool write) {
+  memset(h, 0, sizeof *h);
+  h->fd = open(path, write ? O_RDWR | O_CREAT | O_CLOEXEC : O_RDONLY | O_CLOEXEC,
+               0644);
+  if (h->fd < 0)
+    return false;
+  struct stat st;
+  if ((write && flock(h->fd, LOCK_EX | LOCK_NB) < 0) || fstat(h->fd, &st) < 0) {
+    hist_close(h);
+    return false;
+  }
+  bool fresh = write && st.st_size == 0;
+  HistHeader head = {.n_ifaces = HIST_IFACES};
+  if (fresh) {
+    /* allocate up front: a page fault on a full disk would be SIGBUS */
+    int err = posix_fallocate(h->fd, 0, (off_t)file_size(HIST_IFACES));
+    if (err) {
+      hist_close(h);
+      errno = err;
+      return false;
+    }
+  } else if (pread(h->fd, &head, sizeof head, 0) != (ssize_t)sizeof head ||
+             !head.n_ifaces || (size_t)st.st_size < file_size(head.n_ifaces)) {
+    hist_close(h); /* larger is fine: a writer grows it, then the header */
+    errno = EINVAL;
+    return false;
+  }
+  h->write = write;
+  if (!map_file(h, head.n_ifaces)) {
+    hist_close(h);
+    return false;
+  }
+
+  HistHeader *hd = h->map;
+  if (fresh) {
+    hd->magic = HIST_MAGIC;
+    hd->version = HIST_VERSION;
+    hd->n_ifaces = HIST_IFACES;
+    hd->iface_size = sizeof(HistIface);
+  }
+  if (hd->magic != HIST_MAGIC || hd->version != HIST_VERSION ||
+      hd->n_ifaces != h->n || hd->iface_size != sizeof(HistIface)) {
+    hist_close(h);
+    errno = EINVAL;
+    return false;
+  }
+  if (write) {
+    char boot[sizeof hd->boot_id];
+    read_boot_id(boot, sizeof boot);
+    if (!boot[0] || strcmp(boot, hd->boot_id) != 0) {
+      for (uint32_t i = 0; i < h->n; ++i)
+        hd->ifs[i].mono_ns = 0; /* rebooted: counters start over */
+      memcpy(hd->boot_id, boot, sizeof hd->boot_id);
+    }
+  }
+  return true;
+}
+
+void hist_close(History *h) {
+  if (h->map)
+    munmap(h->map, file_size(h->n));
+  if (h->fd >= 0)
+    close(h->fd);
+  memset(h, 0, sizeof *h);
+  h->fd = -1;
+}
+
+/* --------------------------------------------------------------------- */
+/* Entry of a named adapter; Iface.hist_id caches its index + 1.         */
+static HistIface *find(const History *h, const char *name) {
+  HistHeader *hd = h->map;
+  for (uint32_t i = 0; i < h->n; ++i)
+    if (strncmp(hd->ifs[i].name, name, IFNAMSIZ) == 0)
+      return &hd->ifs[i];
+  return NULL;
+}
+
+/* Double the file: new entries are allocated (SIGBUS, see hist_open())
+ * and mapped before the header says they exist. */
+static bool grow(History *h) {
+  uint32_t n = h->n * 2u;
+  int err = posix_fallocate(h->fd, 0, (off_t)file_size(n));
+  if (err) {
+    errno = err;
+    return false;
+  }
+  if (!map_file(h, n))
+    return false;
+  ((HistHeader *)h->map)->n_ifaces = n;
+  return true;
+}
+
+static HistIface *entry(History *h, Iface *n, bool create, int64_t wall_s) {
+  HistHeader *hd = h->map;
+  if (strlen(n->name) >= IFNAMSIZ)
+    return NULL; /* a long "NAME/ifname" of another netns: no room */
+  if (n->hist_id && n->hist_id <= h->n &&
+      strncmp(hd->ifs[n->hist_id - 1u].name, n->name, IFNAMSIZ) == 0)
+    return &hd->ifs[n->hist_id - 1u];
+  HistIface *e = find(h, n->name);
+  if (!e && create) {
+    /* a free entry, or the one idle the longest if that was a day ago;
+     * else a larger file */
+    e = &hd->ifs[0];
+    for (uint32_t i = 1; i < h->n && e->name[0]; ++i)
+      if (!hd->ifs[i].name[0] || hd->ifs[i].wall_s < e->wall_s)
+        e = &hd->ifs[i];
+    if (e->name[0] && wall_s - e->wall_s < HIST_RECYCLE_S) {
+      uint32_t i = h->n;
+      if (h->n > UINT32_MAX / 2u || !grow(h)) {
+        n->hist_id = 0;
+        return NULL; /* not recorded; tried again next tick */
+      }
+      hd = h->map;
+      e = &hd->ifs[i];
+    }
+    memset(e, 0, sizeof *e);
+    memcpy(e->name, n->name, IFNAMSIZ);
+  }
+  n->hist_id = e ? (uint32_t)(e - hd->ifs) + 1u : 0u;
+  return e;
+}
+
+/* Counters the previous run left for this very link, if recent enough
+ * to turn into a rate against now_ns. */
+bool hist_resume(History *h, Iface *n, uint64_t now_ns, NetStats *out) {
+  const HistIface *e = entry(h, n, false, 0);
+  if (!e || !e->mono_ns || e->ifindex != n->ifindex || e->mono_ns >= now_ns ||
+      now_ns - e->mono_ns > HIST_RESUME_NS)
+    return false;
+  *out = (NetStats){e->rx_bytes, e->tx_bytes, e->mono_ns};
+  return true;
+}
+
+static void add(HistIface *e, HistPeriod p, int64_t wall_s, uint64_t rx,
+                uint64_t tx) {
+  uint64_t t = (uint64_t)wall_s / TIER[p].len + 1u;
+  HistSlot *s = &ring(e, p)[t % TIER[p].n];
+  if (s->t != t)
+    *s = (HistSlot){t, 0, 0}; /* a lap old (or never used): start over */
+  s->rx += rx;
+  s->tx += tx;
+}
+
+/* Account every shown adapter of snapshot generation gen.  Bytes count
+ * against the last logged counters – including those moved while no
+ * sampler ran – and land in the current period; a link without a
+ * baseline from this boot (or re-created, or reset) only sets one. */
+void hist_tick(History *h, IfaceTable *t, uint32_t gen, int64_t wall_s) {
+  for (size_t i = 0; i < t->n; ++i) {
+    Iface *n = &t->v[i];
+    if (n->ignored || n->seen != gen)
+      continue;
+    HistIface *e = entry(h, n, true, wall_s);
+    if (!e)
+      continue;
+    const NetStats *c = &n->prev;
+    if (e->mono_ns && e->ifindex == n->ifindex && c->rx_bytes >= e->rx_bytes &&
+        c->tx_bytes >= e->tx_bytes) {
+      uint64_t rx = c->rx_bytes - e->rx_bytes, tx = c->tx_bytes - e->tx_bytes;
+      for (int p = HIST_SEC; p <= HIST_HOUR; ++p)
+        add(e, (HistPeriod)p, wall_s, rx, tx);
+    }
+    e->ifindex = n->ifindex;
+    e->rx_bytes = c->rx_bytes;
+    e->tx_bytes = c->tx_bytes;
+    e->mono_ns = c->ts_ns ? c->ts_ns : 1u;
+    e->wall_s = wall_s;
+  }
+}
+
+/* Bytes an adapter moved in period number `period` of tier p (seconds,
+ * minutes or hours since the epoch); false if the ring has no record. */
+bool hist_slot(const History *h, const char *ifname, HistPeriod p,
+               int64_t period, uint64_t *rx, uint64_t *tx) {
+  const HistIface *e = find(h, ifname);
+  if (!e || p > HIST_HOUR || period < 0)
+    return false;
+  uint64_t t = (uint64_t)period + 1u;
+  const HistSlot *s = &ring(e, p)[t % TIER[p].n];
+  if (s->t != t)
+    return false;
+  *rx = s->rx;
+  *tx = s->tx;
+  return true;
+}
+
+/* --------------------------------------------------------------------- */
+/* --totals: the last `rows` periods with traffic, oldest first.  Days   */
+/* are local calendar days summed from the hour ring.                    */
+static bool day_total(const History *h, const char *name, time_t now, int back,
+                      uint64_t *rx, uint64_t *tx, time_t *start) {
+  struct tm tm;
+  localtime_r(&now, &tm);
+  tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
+  tm.tm_mday -= back;
+  tm.tm_isdst = -1;
+  *start = mktime(&tm);
+  ++tm.tm_mday;
+  tm.tm_isdst = -1;
+  time_t end = mktime(&tm);
+  bool any = false;
+  *rx = *tx = 0;
+  for (int64_t hr = (*start + 3599) / 3600; hr * 3600 < end; ++hr) {
+    uint64_t r, t;
+    if (hist_slot(h, name, HIST_HOUR, hr, &r, &t)) {
+      *rx += r;
+      *tx += t;
+      any = true;
+    }
+  }
+  return any;
+}
+
+void hist_report(const History *h, HistPeriod p, unsigned rows,
+                 const IfaceFilter *f, char unit, unsigned divisor) {
+  static const char *const LABEL[] = {"%F %T", "%F %H:%M", "%F %H:00", "%F"};
+  const HistHeader *hd = h->map;
+  time_t now = time(NULL);
+  for (uint32_t i = 0; i < h->n; ++i) {
+    const char *name = hd->ifs[i].name;
+    if (!name[0] || !iface_filter_match(f, name))
+      continue;
+    for (int back = (int)rows - 1; back >= 0; --back) {
+      uint64_t rx, tx;
+      time_t start;
+      bool any;
+      if (p == HIST_DAY) {
+        any = day_total(h, name, now, back, &rx, &tx, &start);
+      } else {
+        int64_t period = (int64_t)now / TIER[p].len - back;
+        start = (time_t)(period * TIER[p].len);
+        any = hist_slot(h, name, p, period, &rx, &tx);
+      }
+      if (!any)
+        continue;
+      char when[32], r[FMT_RATE_MAX], t[FMT_RATE_MAX];
+      struct tm tm;
+      strftime(when, sizeof when, LABEL[p], localtime_r(&start, &tm));
+      /* a total prints like a rate, less the "/s" */
+      size_t rn = fmt_rate(r, (double)rx, unit, divisor, 0, 0) - 2u;
+      size_t tn = fmt_rate(t, (double)tx, unit, divisor, 0, 0) - 2u;
+      printf("%-*s %s %.*s rx %.*s tx\n", IFNAMSIZ - 1, name, when, (int)rn, r,
+             (int)tn, t);
+    }
+  }
+}
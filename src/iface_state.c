@@ -2,6 +2,8 @@
  * Low-level helpers for link-state detection.
  */
 #include "bandwidth3.h"
+#include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,51 +14,78 @@
 #include <netinet/in.h> // Added for struct sockaddr_in, not strictly needed for SIOCGIWESSID but good practice for socket programming
 #include <linux/if.h> // Added for IFNAMSIZ and struct ifreq (though iwreq is used from wireless.h)
 
+/* --------------------------------------------------------------------- */
+/* One read() of a small sysfs/procfs file into buf, NUL-terminated; its */
+/* length (0 when the read failed), -1 when it could not be opened.  No  */
+/* stdio: the state fallback runs every tick and must not allocate.      */
+static ssize_t read_small(const char *path, char *buf, size_t len) {
+  SELF_CALL(SC_OPEN);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return -1;
+  SELF_CALL(SC_READ);
+  ssize_t r = read(fd, buf, len - 1u);
+  close(fd);
+  r = r > 0 ? r : 0;
+  buf[r] = '\0';
+  return r;
+}
+
 /* --------------------------------------------------------------------- */
 /* Wi-Fi test: directory /sys/class/net/<iface>/wireless exists          */
 bool is_wireless(const char *ifname) {
-  char path[256];
-  snprintf(path, sizeof path, "/sys/class/net/%s/wireless", ifname);
+  char path[PATH_MAX];
+  snprintf(path, sizeof path, "%s/class/net/%s/wireless", fs_root(FS_SYS),
+           ifname);
 
   struct stat st;
+  SELF_CALL(SC_OTHER);
   return (stat(path, &st) == 0) && S_ISDIR(st.st_mode);
 }
 
 /* --------------------------------------------------------------------- */
 /* Helpers for Wi-Fi association:                                        */
 static bool wifi_has_link(const char *ifname) {
-  FILE *fp = fopen("/proc/net/wireless", "r");
-  if (!fp)
+  char path[PATH_MAX], buf[4096];
+  snprintf(path, sizeof path, "%s/net/wireless", fs_root(FS_PROC));
+  SELF_CALL(SC_OPEN);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
     return false;
+  size_t len = 0;
+  for (ssize_t r = 1; r > 0 && len < sizeof buf - 1u; len += (size_t)r) {
+    SELF_CALL(SC_READ); /* a seq_file: read until EOF */
+    r = read(fd, buf + len, sizeof buf - 1u - len);
+    r = r > 0 ? r : 0;
+  }
+  close(fd);
+  buf[len] = '\0';
 
-  char line[256];
   /* Skip headers (first two lines) */
-  fgets(line, sizeof line, fp);
-  fgets(line, sizeof line, fp);
-
-  bool linked = false;
-  while (fgets(line, sizeof line, fp)) {
-    if (strncmp(line, ifname, strlen(ifname)) == 0) {
+  const char *line = strchr(buf, '\n');
+  line = line ? strchr(line + 1, '\n') : NULL;
+  size_t nlen = strlen(ifname);
+  for (; line; line = strchr(line, '\n')) {
+    ++line;
+    while (*line == ' ')
+      ++line;
+    if (strncmp(line, ifname, nlen) == 0 && line[nlen] == ':') {
       unsigned link;
       /* field 3 is link quality */
-      if (sscanf(line + strlen(ifname), ":%*d %u", &link) == 1)
-        linked = link > 0;
-      break;
+      return sscanf(line + nlen, ":%*d %u", &link) == 1 && link > 0;
     }
   }
-  fclose(fp);
-  return linked;
+  return false;
 }
 
 /* --------------------------------------------------------------------- */
 /* Get current SSID for a wireless interface                             */
 void get_wifi_ssid(const char *ifname, char *ssid_buf) {
   ssid_buf[0] = '\0'; // Default to empty string
+  SELF_CALL(SC_OPEN);
   int sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-  if (sockfd < 0) {
-    perror("socket");
-    return;
-  }
+  if (sockfd < 0)
+    return; /* no SSID: the caller has nowhere to report it */
 
   struct iwreq wreq;
   memset(&wreq, 0, sizeof(struct iwreq));
@@ -67,6 +96,7 @@ void get_wifi_ssid(const char *ifname, char *ssid_buf) {
   wreq.u.essid.length = IW_ESSID_MAX_SIZE + 1;
   // wreq.u.essid.flags = 0; // Not strictly necessary for SIOCGIWESSID but good practice
 
+  SELF_CALL(SC_IOCTL);
   if (ioctl(sockfd, SIOCGIWESSID, &wreq) == 0) {
     // Check if an ESSID was actually returned (length > 0)
     // The kernel sets wreq.u.essid.length to the actual length of the SSID
@@ -89,31 +119,22 @@ void get_wifi_ssid(const char *ifname, char *ssid_buf) {
 /* --------------------------------------------------------------------- */
 /* Return current interface state                                        */
 IfState get_iface_state(const char *ifname, bool wifi_hint) {
-  char path[256], buf[32];
+  char path[PATH_MAX], buf[32];
+  const char *sys = fs_root(FS_SYS);
 
   /* operstate: "up", "down", "dormant", ... */
-  snprintf(path, sizeof path, "/sys/class/net/%s/operstate", ifname);
-  FILE *fp = fopen(path, "r");
-  if (!fp)
+  snprintf(path, sizeof path, "%s/class/net/%s/operstate", sys, ifname);
+  if (read_small(path, buf, sizeof buf) <= 0)
     return IFSTATE_ERR;
 
-  if (!fgets(buf, sizeof buf, fp)) {
-    fclose(fp);
-    return IFSTATE_ERR;
-  }
-  fclose(fp);
-
   if (strncmp(buf, "down", 4) == 0)
     return IFSTATE_DISABLED;
 
-  /* At this point interface is administratively UP */
-  snprintf(path, sizeof path, "/sys/class/net/%s/carrier", ifname);
-  fp = fopen(path, "r");
-  if (fp) {
-    int carrier = fgetc(fp);
-    fclose(fp);
-    return (carrier == '1') ? IFSTATE_CONNECTED : IFSTATE_DISCONNECTED;
-  }
+  /* At this point interface is administratively UP; reading carrier
+   * fails (EINVAL) while there is none */
+  snprintf(path, sizeof path, "%s/class/net/%s/carrier", sys, ifname);
+  if (read_small(path, buf, sizeof buf) >= 0)
+    return (buf[0] == '1') ? IFSTATE_CONNECTED : IFSTATE_DISCONNECTED;
 
   /* Some Wi-Fi drivers omit 'carrier' – fall back to /proc/net/wireless */
   if (wifi_hint)
@@ -121,3 +142,43 @@ IfState get_iface_state(const char *ifname, bool wifi_hint) {
 
   return IFSTATE_ERR;
 }
+
+/* --------------------------------------------------------------------- */
+/* Same mapping as get_iface_state(), from IFLA_OPERSTATE/IFLA_CARRIER.  */
+IfState iface_state_from_link(uint8_t operstate, bool carrier) {
+  if (operstate == IF_OPER_DOWN)
+    return IFSTATE_DISABLED;
+  return carrier ? IFSTATE_CONNECTED : IFSTATE_DISCONNECTED;
+}
+
+/* State of a link from its snapshot entry: netlink dumps carry it – no
+ * sysfs round trip needed – /proc/net/dev does not. */
+IfState iface_link_state(const Iface *n, const SnapEntry *e) {
+  return (e && e->has_link) ? iface_state_from_link(e->operstate, e->carrier)
+                            : get_iface_state(n->name, n->wifi);
+}
+
+/* --------------------------------------------------------------------- */
+/* ifindex of the bond/bridge the link is enslaved to (sysfs "master"    */
+/* symlink), 0 if none.                                                  */
+int iface_master(const char *ifname) {
+  char path[PATH_MAX], target[PATH_MAX];
+  snprintf(path, sizeof path, "%s/class/net/%s/master", fs_root(FS_SYS),
+           ifname);
+  SELF_CALL(SC_OTHER);
+  ssize_t len = readlink(path, target, sizeof target - 1u);
+  if (len <= 0)
+    return 0;
+  target[len] = '\0';
+  const char *slash = strrchr(target, '/');
+  return iface_index(slash ? slash + 1 : target);
+}
+
+/* --------------------------------------------------------------------- */
+/* Kernel ifindex from sysfs (0 if unknown); read once per adapter.      */
+int iface_index(const char *ifname) {
+  char path[PATH_MAX], buf[32];
+  snprintf(path, sizeof path, "%s/class/net/%s/ifindex", fs_root(FS_SYS),
+           ifname);
+  return read_small(path, buf, sizeof buf) > 0 ? atoi(buf) : 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Growable adapter table with hashed name and ifindex lookup, plus the
+ * include/exclude glob filter used for automatic interface discovery.
+ */
+#include "bandwidth3.h"
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* --------------------------------------------------------------------- */
+/* Include/exclude patterns                                              */
+static bool has_glob(const char *s) { return strpbrk(s, "*?[") != NULL; }
+
+static bool push_pattern(char ***v, size_t *n, const char *tok, size_t len) {
+  char **nv = realloc(*v, (*n + 1u) * sizeof *nv);
+  if (!nv)
+    return false;
+  *v = nv;
+  if (!(nv[*n] = strndup(tok, len)))
+    return false;
+  ++*n;
+  return true;
+}
+
+/* Add a comma-separated list of names/globs; no length or count cap.
+ * "netns:NAME/eth0" is kept as "NAME/eth0", the name such a link gets
+ * (pid:PID/eth0 already is one, see netns.c). */
+bool iface_filter_add(IfaceFilter *f, const char *csv, bool exclude) {
+  for (const char *p = csv; p && *p;) {
+    const char *comma = strchr(p, ',');
+    size_t len = comma ? (size_t)(comma - p) : strlen(p);
+    if (len > 6u && strncmp(p, "netns:", 6) == 0) {
+      p += 6;
+      len -= 6u;
+    }
+    if (len > 0u &&
+        !(exclude ? push_pattern(&f->exclude, &f->n_exclude, p, len)
+                  : push_pattern(&f->include, &f->n_include, p, len)))
+      return false;
+    p = comma ? comma + 1 : NULL;
+  }
+  return true;
+}
+
+void iface_filter_free(IfaceFilter *f) {
+  for (size_t i = 0; i < f->n_include; ++i)
+    free(f->include[i]);
+  for (size_t i = 0; i < f->n_exclude; ++i)
+    free(f->exclude[i]);
+  free(f->include);
+  free(f->exclude);
+  memset(f, 0, sizeof *f);
+}
+
+/* Included by any include pattern and excluded by none. */
+bool iface_filter_match(const IfaceFilter *f, const char *name) {
+  bool in = false;
+  for (size_t i = 0; !in && i < f->n_include; ++i)
+    in = fnmatch(f->include[i], name, 0) == 0;
+  for (size_t i = 0; in && i < f->n_exclude; ++i)
+    in = fnmatch(f->exclude[i], name, 0) != 0;
+  return in;
+}
+
+/* Literal (non-glob) include entries: shown even while the link is absent */
+bool iface_filter_pinned(const IfaceFilter *f, const char *name) {
+  for (size_t i = 0; i < f->n_include; ++i)
+    if (!has_glob(f->include[i]) && strcmp(f->include[i], name) == 0)
+      return true;
+  return false;
+}
+
+/* --------------------------------------------------------------------- */
+/* Table                                                                 */
+static uint32_t hash_str(const char *s) {
+  uint32_t h = 2166136261u; /* FNV-1a */
+  while (*s)
+    h = (h ^ (unsigned char)*s++) * 16777619u;
+  return h;
+}
+
+static uint32_t hash_int(int v) {
+  uint32_t h = (uint32_t)v * 2654435761u; /* Knuth multiplicative */
+  return h ^ (h >> 16);
+}
+
+static void index_ifindex(IfaceTable *t, size_t i) {
+  size_t mask = t->cap * 2u - 1u;
+  size_t h = hash_int(t->v[i].ifindex) & mask;
+  while (t->by_index[h])
+    h = (h + 1u) & mask;
+  t->by_index[h] = (uint32_t)i + 1u;
+}
+
+static void index_one(IfaceTable *t, size_t i) {
+  size_t mask = t->cap * 2u - 1u;
+  size_t h = hash_str(t->v[i].name) & mask;
+  while (t->by_name[h])
+    h = (h + 1u) & mask;
+  t->by_name[h] = (uint32_t)i + 1u;
+  if (t->v[i].ifindex > 0 && !t->v[i].netns) /* our ifindexes only */
+    index_ifindex(t, i);
+}
+
+/* Rebuild both hashes; O(n), only after removals or re-indexing. */
+static void reindex(IfaceTable *t) {
+  if (!t->cap)
+    return;
+  memset(t->by_name, 0, t->cap * 2u * sizeof *t->by_name);
+  memset(t->by_index, 0, t->cap * 2u * sizeof *t->by_index);
+  for (size_t i = 0; i < t->n; ++i)
+    index_one(t, i);
+}
+
+static bool grow(IfaceTable *t) {
+  size_t cap = t->cap ? t->cap * 2u : 16u;
+  Iface *v = realloc(t->v, cap * sizeof *v);
+  if (!v)
+    return false;
+  t->v = v;
+  uint32_t *bn = calloc(cap * 2u, sizeof *bn);
+  uint32_t *bi = calloc(cap * 2u, sizeof *bi);
+  if (!bn || !bi) {
+    free(bn);
+    free(bi);
+    return false;
+  }
+  free(t->by_name);
+  free(t->by_index);
+  t->by_name = bn;
+  t->by_index = bi;
+  t->cap = cap;
+  reindex(t);
+  return true;
+}
+
+/* Append a zeroed adapter (state ERR).  May move existing entries. */
+Iface *iftab_add(IfaceTable *t, const char *name) {
+  if (t->n == t->cap && !grow(t))
+    return NULL;
+  Iface *n = &t->v[t->n];
+  *n = (Iface){.state = IFSTATE_ERR};
+  strncpy(n->name, name, sizeof n->name - 1);
+  index_one(t, t->n++);
+  return n;
+}
+
+Iface *iftab_find(const IfaceTable *t, const char *name) {
+  if (!t->cap)
+    return NULL;
+  size_t mask = t->cap * 2u - 1u;
+  for (size_t h = hash_str(name) & mask; t->by_name[h]; h = (h + 1u) & mask) {
+    Iface *n = &t->v[t->by_name[h] - 1u];
+    if (strcmp(n->name, name) == 0)
+      return n;
+  }
+  return NULL;
+}
+
+Iface *iftab_find_index(const IfaceTable *t, int ifindex) {
+  if (!t->cap || ifindex <= 0)
+    return NULL;
+  size_t mask = t->cap * 2u - 1u;
+  for (size_t h = hash_int(ifindex) & mask; t->by_index[h];
+       h = (h + 1u) & mask) {
+    Iface *n = &t->v[t->by_index[h] - 1u];
+    if (n->ifindex == ifindex)
+      return n;
+  }
+  return NULL;
+}
+
+void iftab_set_index(IfaceTable *t, Iface *n, int ifindex) {
+  if (n->ifindex == ifindex)
+    return;
+  bool fresh = n->ifindex <= 0;
+  n->ifindex = ifindex;
+  if (!fresh)
+    reindex(t); /* stale slot must go: only when a link is re-created */
+  else if (ifindex > 0 && !n->netns)
+    index_ifindex(t, (size_t)(n - t->v));
+}
+
+/* Drop every entry with keep(n) == false, preserving display order.
+ * The table owns each entry's statistics, top flows, qdisc details and
+ * open sysfs state files, released here. */
+size_t iftab_prune(IfaceTable *t, bool (*keep)(const Iface *n, void *ctx),
+                   void *ctx) {
+  size_t w = 0;
+  for (size_t r = 0; r < t->n; ++r) {
+    if (!keep(&t->v[r], ctx)) {
+      rate_stats_free(t->v[r].rs);
+      free(t->v[r].top);
+      qdisc_forget(&t->v[r]);
+      sysfs_forget(&t->v[r]);
+      continue;
+    }
+    if (w != r)
+      t->v[w] = t->v[r];
+    ++w;
+  }
+  size_t removed = t->n - w;
+  t->n = w;
+  if (removed)
+    reindex(t);
+  return removed;
+}
+
+void iftab_free(IfaceTable *t) {
+  for (size_t i = 0; i < t->n; ++i) {
+    rate_stats_free(t->v[i].rs);
+    free(t->v[i].top);
+    qdisc_forget(&t->v[i]);
+    sysfs_forget(&t->v[i]);
+  }
+  free(t->v);
+  free(t->by_name);
+  free(t->by_index);
+  memset(t, 0, sizeof *t);
+}
@@ -0,0 +1,7 @@
+/*
+ * bandwidth3 entry point: the program lives in src/bandwidth3.c, which
+ * the tests and benchmarks link against too.
+ */
+#include "bandwidth3.h"
+
+int main(int argc, char *argv[]) { return app_main(argc, argv); }
@@ -10,136 +10,289 @@
 #include <sys/stat.h>
 #include <stdlib.h>
 
-/* Split comma-separated interface list into array. Returns count.       */
-size_t parse_ifaces(const char *arg, char *ifaces[MAX_IFACES]) {
-  if (!arg || !*arg)
-    return 0u;
-
-  char *dup = strdup(arg);
-  if (!dup)
-    return 0u;
-
-  size_t n = 0u;
-  char *saveptr = NULL, *tok = strtok_r(dup, ",", &saveptr);
-
-  while (tok && n < MAX_IFACES) {
-    size_t len = strnlen(tok, IFNAMSIZ - 1);
-    if (len) {
-      ifaces[n] = strndup(tok, len);
-      if (ifaces[n])
-        ++n;
-    }
-    tok = strtok_r(NULL, ",", &saveptr);
-  }
-  free(dup);
-  return n;
+/* --------------------------------------------------------------------- */
+/* Average byte delta over the measured interval -> bytes per second.   */
+/* A counter that went backwards (link re-created) yields 0, not 2^64.  */
+double avg_rate(uint64_t now, uint64_t old, double sec_delta) {
+  return (sec_delta <= 0.0 || now < old) ? 0.0 : (double)(now - old) / sec_delta;
 }
 
 /* --------------------------------------------------------------------- */
-/* Read /proc/net/dev and aggregate counters for requested ifaces.       */
-bool read_aggregate_stats(char *const ifaces[], size_t n_ifaces,
-                          NetStats *out) {
-  if (!out)
+/* /proc/net/dev snapshot: one read() per tick into a reusable buffer,   */
+/* parsed without sscanf into a name-keyed table.                        */
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SNAP_BUF_INIT 4096u
+
+static uint32_t name_hash(const char *s) {
+  uint32_t h = 2166136261u; /* FNV-1a */
+  while (*s)
+    h = (h ^ (unsigned char)*s++) * 16777619u;
+  return h;
+}
+
+/* --------------------------------------------------------------------- */
+/* Filesystem roots: PROCFS_ROOT / SYSFS_ROOT point the readers at a     */
+/* fixture tree (benchmarks, tests); resolved once, then cached.         */
+static const char *g_fs_root[2];
+
+const char *fs_root(FsRoot which) {
+  if (!g_fs_root[which]) {
+    const char *v = getenv(which == FS_SYS ? "SYSFS_ROOT" : "PROCFS_ROOT");
+    g_fs_root[which] = (v && *v) ? v : (which == FS_SYS ? "/sys" : "/proc");
+  }
+  return g_fs_root[which];
+}
+
+void fs_root_set(FsRoot which, const char *path) { g_fs_root[which] = path; }
+
+bool net_snapshot_init(NetSnapshot *s, SnapBackend backend) {
+  memset(s, 0, sizeof *s);
+  s->backend = backend;
+  if (backend == BACKEND_NETLINK) {
+    s->fd = rtnl_open(0);
+  } else {
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/net/dev", fs_root(FS_PROC));
+    SELF_CALL(SC_OPEN);
+    s->fd = open(path, O_RDONLY | O_CLOEXEC);
+  }
+  return s->fd >= 0;
+}
+
+void net_snapshot_free(NetSnapshot *s) {
+  if (s->fd >= 0)
+    close(s->fd);
+  free(s->buf);
+  free(s->ent);
+  free(s->slots);
+  memset(s, 0, sizeof *s);
+  s->fd = -1;
+}
+
+static void snap_index(NetSnapshot *s, size_t idx) {
+  size_t mask = s->cap * 2u - 1u;
+  size_t h = name_hash(s->ent[idx].name) & mask;
+  while (s->slots[h])
+    h = (h + 1u) & mask;
+  s->slots[h] = (uint32_t)idx + 1u;
+}
+
+/* Keep the hash at most half full; rebuilt whenever the entry array grows */
+static bool snap_reserve(NetSnapshot *s, size_t want) {
+  if (want <= s->cap)
+    return true;
+  size_t cap = s->cap ? s->cap : 16u;
+  while (cap < want)
+    cap *= 2u;
+
+  SnapEntry *ent = realloc(s->ent, cap * sizeof *ent);
+  if (!ent)
     return false;
+  s->ent = ent;
 
-  FILE *fp = fopen("/proc/net/dev", "r");
-  if (!fp)
+  uint32_t *slots = calloc(cap * 2u, sizeof *slots);
+  if (!slots)
     return false;
+  free(s->slots);
+  s->slots = slots;
+  s->cap = cap;
+  for (size_t i = 0; i < s->n; ++i)
+    snap_index(s, i);
+  return true;
+}
 
-  char line[256];
-  /* Skip first two header lines */
-  fgets(line, sizeof line, fp);
-  fgets(line, sizeof line, fp);
+/* Parse one unsigned decimal field, skipping leading blanks. */
+static const char *scan_u64(const char *p, const char *end, uint64_t *out) {
+  while (p < end && (*p == ' ' || *p == '\t'))
+    ++p;
+  if (p >= end || *p < '0' || *p > '9')
+    return NULL;
+  uint64_t v = 0;
+  while (p < end && *p >= '0' && *p <= '9')
+    v = v * 10u + (uint64_t)(*p++ - '0');
+  *out = v;
+  return p;
+}
 
-  uint64_t rx_total = 0, tx_total = 0;
+void net_snapshot_clear(NetSnapshot *s) {
+  s->n = 0;
+  if (s->slots)
+    memset(s->slots, 0, s->cap * 2u * sizeof *s->slots);
+}
 
-  while (fgets(line, sizeof line, fp)) {
-    char ifname[IFNAMSIZ];
-    uint64_t rx, tx;
+/* Append a zeroed, indexed entry; NULL on OOM or over-long name. */
+SnapEntry *net_snapshot_add(NetSnapshot *s, const char *name) {
+  size_t nlen = strnlen(name, IFNAMSIZ);
+  if (nlen == 0u || nlen >= IFNAMSIZ || !snap_reserve(s, s->n + 1u))
+    return NULL;
+  SnapEntry *e = &s->ent[s->n];
+  memset(e, 0, sizeof *e);
+  memcpy(e->name, name, nlen);
+  snap_index(s, s->n++);
+  return e;
+}
+
+/* Parse /proc/net/dev text into the snapshot table. Returns entry count. */
+size_t net_snapshot_parse(NetSnapshot *s, const char *text, size_t len) {
+  const char *p = text, *end = text + len;
+  net_snapshot_clear(s);
+
+  /* skip two header lines */
+  for (int hdr = 0; hdr < 2 && p < end; ++hdr) {
+    const char *nl = memchr(p, '\n', (size_t)(end - p));
+    p = nl ? nl + 1 : end;
+  }
 
-    if (sscanf(line, " %[^:]: %lu %*u %*u %*u %*u %*u %*u %*u %lu", ifname, &rx,
-               &tx) != 3)
-      continue;
+  while (p < end) {
+    const char *nl = memchr(p, '\n', (size_t)(end - p));
+    const char *eol = nl ? nl : end;
 
-    /* If no filter list given, accept all except loopback */
-    bool wanted = (n_ifaces == 0 && strcmp(ifname, "lo") != 0);
+    while (p < eol && *p == ' ')
+      ++p;
+    const char *colon = memchr(p, ':', (size_t)(eol - p));
+    size_t nlen = colon ? (size_t)(colon - p) : 0u;
 
-    for (size_t i = 0; !wanted && i < n_ifaces; ++i)
-      wanted = (strcmp(ifname, ifaces[i]) == 0);
+    uint64_t f[9];
+    const char *q = colon ? colon + 1 : NULL;
+    for (size_t i = 0; q && i < 9u; ++i)
+      q = scan_u64(q, eol, &f[i]);
 
-    if (wanted) {
-      rx_total += rx;
-      tx_total += tx;
+    if (q && nlen > 0u && nlen < IFNAMSIZ) {
+      char name[IFNAMSIZ];
+      memcpy(name, p, nlen);
+      name[nlen] = '\0';
+      SnapEntry *e = net_snapshot_add(s, name);
+      if (e) {
+        e->stats.rx_bytes = f[0];
+        e->stats.tx_bytes = f[8];
+      }
     }
+    p = nl ? nl + 1 : end;
   }
-  fclose(fp);
+  return s->n;
+}
 
-  out->rx_bytes = rx_total;
-  out->tx_bytes = tx_total;
+/* Read the /proc/net/dev text from s->fd's position up to EOF and parse */
+/* it.  seq_file hands out about a page per read() whatever the request, */
+/* so a short read is not the end: only a read() returning 0 is.         */
+bool net_snapshot_load(NetSnapshot *s) {
+  size_t len = 0;
+  for (;;) {
+    if (len == s->buf_cap) {
+      size_t cap = s->buf_cap ? s->buf_cap * 2u : SNAP_BUF_INIT;
+      char *buf = realloc(s->buf, cap);
+      if (!buf)
+        return false;
+      s->buf = buf;
+      s->buf_cap = cap;
+    }
+    SELF_CALL(SC_READ);
+    ssize_t r = read(s->fd, s->buf + len, s->buf_cap - len);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (r == 0)
+      break;
+    len += (size_t)r;
+  }
+  net_snapshot_parse(s, s->buf, len);
   return true;
 }
 
-/* --------------------------------------------------------------------- */
-/* Average byte delta over refresh period -> bytes per second.           */
-double avg_rate(uint64_t now, uint64_t old, unsigned sec_delta) {
-  return (sec_delta == 0u) ? 0.0 : (double)(now - old) / sec_delta;
+/* Re-read /proc/net/dev through the persistent fd: one lseek() and a    */
+/* read() per page plus the one returning 0; the buffer only grows when  */
+/* the file does.                                                        */
+static bool procfs_read(NetSnapshot *s) {
+  SELF_CALL(SC_OTHER);
+  if (lseek(s->fd, 0, SEEK_SET) < 0)
+    return false;
+  return net_snapshot_load(s);
 }
 
-/* --------------------------------------------------------------------- */
-/* Pretty-print a byte/s figure with SI or IEC prefixes.                  */
-#include <inttypes.h>
-#include <stdio.h>
-void human_print(double bps, char unit, unsigned divisor, uint64_t warn,
-                 uint64_t crit) {
-  /* Convert to bits if requested */
-  if (unit == 'b')
-    bps *= 8.0;
-
-  /* Threshold markers for Polybar colouring                        */
-  if (crit && bps > crit)
-    fputc('!', stdout); /* critical */
-  else if (warn && bps > warn)
-    fputc('?', stdout); /* warning  */
-
-  const char *suffix = (unit == 'b') ? "b/s" : "B/s";
-  const char *prefix[] = {"", "K", "M", "G", "T"};
-  size_t i = 0u;
-
-  while (bps >= divisor && i < 4u) {
-    bps /= divisor;
-    ++i;
+uint64_t mono_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t mono_ms(void) { return mono_ns() / 1000000u; }
+
+/* Every entry is stamped with the time its counters were taken so rates */
+/* divide by the measured interval, however late the tick ran.           */
+bool net_snapshot_read(NetSnapshot *s) {
+  if (s->fd < 0)
+    return false;
+  bool ok = (s->backend == BACKEND_NETLINK) ? rtnl_dump_links(s) : procfs_read(s);
+  uint64_t ts = mono_ns();
+  for (size_t i = 0; ok && i < s->n; ++i)
+    s->ent[i].stats.ts_ns = ts;
+  return ok;
+}
+
+const SnapEntry *net_snapshot_entry(const NetSnapshot *s, const char *ifname) {
+  if (!s->cap)
+    return NULL;
+  size_t mask = s->cap * 2u - 1u;
+  for (size_t h = name_hash(ifname) & mask; s->slots[h]; h = (h + 1u) & mask) {
+    const SnapEntry *e = &s->ent[s->slots[h] - 1u];
+    if (strcmp(e->name, ifname) == 0)
+      return e;
   }
-  printf("%7.1f %s%s", bps, prefix[i], suffix);
+  return NULL;
+}
+
+const NetStats *net_snapshot_find(const NetSnapshot *s, const char *ifname) {
+  const SnapEntry *e = net_snapshot_entry(s, ifname);
+  return e ? &e->stats : NULL;
 }
+
 /* --------------------------------------------------------------------- */
+/* Single-interface lookup on a private snapshot (one-shot callers).     */
 bool read_iface_stats(const char *ifname, NetStats *out) {
-  FILE *fp = fopen("/proc/net/dev", "r");
-  if (!fp)
+  static NetSnapshot snap = {.fd = -1};
+  if (snap.fd < 0 && !net_snapshot_init(&snap, BACKEND_PROCFS))
+    return false;
+  if (!net_snapshot_read(&snap))
     return false;
 
-  char line[256];
-  /* skip header lines */
-  fgets(line, sizeof line, fp);
-  fgets(line, sizeof line, fp);
-
-  bool ok = false;
-  while (fgets(line, sizeof line, fp)) {
-    char name[IFNAMSIZ];
-    uint64_t rx, tx;
+  const NetStats *st = net_snapshot_find(&snap, ifname);
+  if (!st)
+    return false;
+  *out = *st;
+  return true;
+}
 
-    if (sscanf(line, " %[^:]: %lu %*u %*u %*u %*u %*u %*u %*u %lu", name, &rx,
-               &tx) != 3)
-      continue;
+/* --------------------------------------------------------------------- */
+/* Sum counters of the requested ifaces (all but "lo" if none given).    */
+bool read_aggregate_stats(const NetSnapshot *snap, char *const ifaces[],
+                          size_t n_ifaces, NetStats *out) {
+  if (!snap || !out)
+    return false;
 
-    if (strcmp(name, ifname) == 0) {
-      out->rx_bytes = rx;
-      out->tx_bytes = tx;
-      ok = true;
-      break;
+  uint64_t rx_total = 0, tx_total = 0;
+  if (n_ifaces == 0) {
+    for (size_t i = 0; i < snap->n; ++i) {
+      if (strcmp(snap->ent[i].name, "lo") == 0)
+        continue;
+      rx_total += snap->ent[i].stats.rx_bytes;
+      tx_total += snap->ent[i].stats.tx_bytes;
+    }
+  }
+  for (size_t i = 0; i < n_ifaces; ++i) {
+    const NetStats *st = net_snapshot_find(snap, ifaces[i]);
+    if (st) {
+      rx_total += st->rx_bytes;
+      tx_total += st->tx_bytes;
     }
   }
-  fclose(fp);
-  return ok;
-}
 
-/* --- avg_rate & human_print unchanged from previous commit ----------- */
+  out->rx_bytes = rx_total;
+  out->tx_bytes = tx_total;
+  return true;
+}
@@ -0,0 +1,166 @@
+/*
+ * rtnetlink helpers: one RTM_GETLINK dump per tick over a persistent
+ * NETLINK_ROUTE socket yields counters *and* link state for every link.
+ */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <linux/if_link.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define RTNL_BUF_SIZE 32768u /* large enough for any single dump batch */
+
+/* --------------------------------------------------------------------- */
+/* Open a NETLINK_ROUTE socket, optionally joined to multicast groups.   */
+int rtnl_open(uint32_t groups) {
+  int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (fd < 0)
+    return -1;
+
+  struct sockaddr_nl sa = {.nl_family = AF_NETLINK, .nl_groups = groups};
+  if (bind(fd, (struct sockaddr *)&sa, sizeof sa) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* --------------------------------------------------------------------- */
+/* Decode the ifinfomsg + attributes of a RTM_NEWLINK/RTM_DELLINK.       */
+static bool parse_link_msg(const struct nlmsghdr *nh, SnapEntry *out) {
+  if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(struct ifinfomsg)))
+    return false;
+
+  const struct ifinfomsg *ifi = NLMSG_DATA(nh);
+  memset(out, 0, sizeof *out);
+  out->ifindex = ifi->ifi_index;
+  out->has_link = true;
+
+  bool have_name = false;
+  int len = (int)IFLA_PAYLOAD(nh);
+  for (const struct rtattr *rta = IFLA_RTA(ifi); RTA_OK(rta, len);
+       rta = RTA_NEXT(rta, len)) {
+    size_t plen = RTA_PAYLOAD(rta);
+    switch (rta->rta_type) {
+    case IFLA_IFNAME:
+      if (plen > 0u && plen <= IFNAMSIZ) {
+        memcpy(out->name, RTA_DATA(rta), plen);
+        out->name[IFNAMSIZ - 1] = '\0';
+        have_name = out->name[0] != '\0';
+      }
+      break;
+    case IFLA_STATS64:
+      if (plen >= sizeof(struct rtnl_link_stats64)) {
+        struct rtnl_link_stats64 st; /* payload is only 4-byte aligned */
+        memcpy(&st, RTA_DATA(rta), sizeof st);
+        out->stats.rx_bytes = st.rx_bytes;
+        out->stats.tx_bytes = st.tx_bytes;
+      }
+      break;
+    case IFLA_OPERSTATE:
+      if (plen >= 1u)
+        out->operstate = *(const uint8_t *)RTA_DATA(rta);
+      break;
+    case IFLA_CARRIER:
+      if (plen >= 1u)
+        out->carrier = *(const uint8_t *)RTA_DATA(rta) != 0;
+      break;
+    case IFLA_MASTER:
+      if (plen >= sizeof(uint32_t))
+        memcpy(&out->master, RTA_DATA(rta), sizeof out->master);
+      break;
+    default:
+      break;
+    }
+  }
+  return have_name;
+}
+
+/* Decode one RTM_NEWLINK message into a snapshot entry.                 */
+bool rtnl_parse_link(const struct nlmsghdr *nh, SnapEntry *out) {
+  return nh->nlmsg_type == RTM_NEWLINK && parse_link_msg(nh, out);
+}
+
+/* --------------------------------------------------------------------- */
+/* Replace the snapshot with one RTM_GETLINK dump of every link.         */
+bool rtnl_dump_links(NetSnapshot *s) {
+  if (s->buf_cap < RTNL_BUF_SIZE) {
+    char *buf = realloc(s->buf, RTNL_BUF_SIZE);
+    if (!buf)
+      return false;
+    s->buf = buf;
+    s->buf_cap = RTNL_BUF_SIZE;
+  }
+
+  struct {
+    struct nlmsghdr nh;
+    struct ifinfomsg ifi;
+  } req = {
+      .nh = {.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifinfomsg)),
+             .nlmsg_type = RTM_GETLINK,
+             .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+             .nlmsg_seq = ++s->seq},
+      .ifi = {.ifi_family = AF_UNSPEC},
+  };
+  SELF_CALL(SC_WRITE);
+  if (send(s->fd, &req, req.nh.nlmsg_len, 0) < 0)
+    return false;
+
+  net_snapshot_clear(s);
+  for (;;) {
+    SELF_CALL(SC_READ);
+    ssize_t r = recv(s->fd, s->buf, s->buf_cap, 0);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    int len = (int)r;
+    for (struct nlmsghdr *nh = (struct nlmsghdr *)s->buf; NLMSG_OK(nh, len);
+         nh = NLMSG_NEXT(nh, len)) {
+      if (nh->nlmsg_seq != s->seq)
+        continue; /* stale reply to an aborted dump */
+      if (nh->nlmsg_type == NLMSG_DONE)
+        return true;
+      if (nh->nlmsg_type == NLMSG_ERROR)
+        return false;
+
+      SnapEntry tmp;
+      if (!rtnl_parse_link(nh, &tmp))
+        continue;
+      SnapEntry *e = net_snapshot_add(s, tmp.name);
+      if (e)
+        *e = tmp;
+    }
+  }
+}
+
+/* --------------------------------------------------------------------- */
+/* Drain pending RTNLGRP_LINK notifications from a non-blocking socket.  */
+/* Returns false if the kernel dropped events (ENOBUFS): the caller must */
+/* then resynchronise its state from scratch.                            */
+bool rtnl_read_link_events(int fd, char *buf, size_t cap, LinkEventFn fn,
+                           void *ctx) {
+  for (;;) {
+    SELF_CALL(SC_READ);
+    ssize_t r = recv(fd, buf, cap, MSG_DONTWAIT);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return errno == EAGAIN || errno == EWOULDBLOCK;
+    }
+    int len = (int)r;
+    for (struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, len);
+         nh = NLMSG_NEXT(nh, len)) {
+      if (nh->nlmsg_type != RTM_NEWLINK && nh->nlmsg_type != RTM_DELLINK)
+        continue;
+      SnapEntry link;
+      if (parse_link_msg(nh, &link))
+        fn(&link, nh->nlmsg_type == RTM_DELLINK, ctx);
+    }
+  }
+}
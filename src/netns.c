@@ -0,0 +1,141 @@
+/*
+ * Links in other network namespaces: -i netns:NAME/eth0 (a namespace
+ * from `ip netns add`) or pid:PID/eth0 (the one process PID lives in).
+ * Such links are named "NAME/eth0" and "pid:PID/eth0" everywhere else.
+ *
+ * Each namespace gets one NETLINK_ROUTE socket, created inside it once –
+ * setns() there and straight back.  A socket stays bound to the
+ * namespace it was created in, so every tick after that is a plain link
+ * dump on it: no setns(), no re-opened sockets.  sysfs and the ioctls
+ * only ever see our own namespace, so these links are counted and their
+ * state read from the dump alone; Wi-Fi details and {top} stay empty.
+ *
+ * A namespace that is not there yet is retried, and one that went away
+ * (its container stopped, the process exited) is let go: the socket
+ * would otherwise keep the dead namespace and its frozen counters alive.
+ */
+#define _GNU_SOURCE /* setns(), CLONE_NEWNET */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define NETNS_CHECK_MS 5000u /* retry / identity check of a namespace */
+
+/* The namespace file behind a label. */
+static void ns_path(const Netns *ns, char *path, size_t len) {
+  if (strncmp(ns->label, "pid:", 4) == 0)
+    snprintf(path, len, "%s/%s/ns/net", fs_root(FS_PROC), ns->label + 4);
+  else
+    snprintf(path, len, "%s/%s", NETNS_RUN_DIR, ns->label);
+}
+
+/* Labels of the "LABEL/pattern" include entries, in order and without
+ * duplicates.  Sockets of labels still in use are kept, the rest
+ * closed; false only when out of memory. */
+bool netns_collect(NetnsSet *s, const IfaceFilter *f) {
+  Netns *v = calloc(f->n_include ? f->n_include : 1u, sizeof *v);
+  if (!v)
+    return false;
+  size_t n = 0;
+  for (size_t i = 0; i < f->n_include; ++i) {
+    const char *slash = strchr(f->include[i], '/');
+    size_t len = slash ? (size_t)(slash - f->include[i]) : 0u;
+    if (!len || len >= sizeof v->label)
+      continue;
+    size_t j = 0;
+    while (j < n && (strlen(v[j].label) != len ||
+                     memcmp(v[j].label, f->include[i], len) != 0))
+      ++j;
+    if (j < n)
+      continue;
+    memcpy(v[n].label, f->include[i], len);
+    v[n].snap.fd = -1;
+    for (size_t k = 0; k < s->n; ++k) {
+      if (s->v[k].snap.fd >= 0 && strcmp(s->v[k].label, v[n].label) == 0) {
+        v[n] = s->v[k]; /* same namespace: keep its socket */
+        s->v[k].snap = (NetSnapshot){.fd = -1};
+        break;
+      }
+    }
+    ++n;
+  }
+  netns_free(s);
+  s->v = v;
+  s->n = n;
+  return true;
+}
+
+/* Create the dump socket inside the namespace. */
+static bool ns_open(Netns *ns) {
+  char path[PATH_MAX];
+  ns_path(ns, path, sizeof path);
+  SELF_CALL(SC_OPEN);
+  int target = open(path, O_RDONLY | O_CLOEXEC);
+  SELF_CALL(SC_OPEN);
+  int self = open("/proc/thread-self/ns/net", O_RDONLY | O_CLOEXEC);
+  struct stat st;
+  bool ok = false;
+  SELF_CALL(SC_OTHER);
+  if (target >= 0 && self >= 0 && fstat(target, &st) == 0 &&
+      setns(target, CLONE_NEWNET) == 0) {
+    ok = net_snapshot_init(&ns->snap, BACKEND_NETLINK);
+    int err = errno;
+    if (setns(self, CLONE_NEWNET) != 0)
+      abort(); /* never sample on in the wrong namespace */
+    errno = err;
+    ns->ino = (uint64_t)st.st_ino;
+  }
+  int err = errno;
+  if (target >= 0)
+    close(target);
+  if (self >= 0)
+    close(self);
+  if (!ok) {
+    net_snapshot_free(&ns->snap);
+    if (!ns->warned)
+      fprintf(stderr, "netns %s: %s (retrying)\n", ns->label, strerror(err));
+    ns->warned = true;
+  } else {
+    ns->warned = false;
+  }
+  return ok;
+}
+
+/* This tick's dump of the namespace's links; false while it is not
+ * available.  Every NETNS_CHECK_MS a namespace that is gone or was
+ * replaced (another process behind the pid) is let go, and a missing
+ * one tried again. */
+bool netns_read(Netns *ns, uint64_t now_ms) {
+  if (!ns->check_ms || now_ms - ns->check_ms >= NETNS_CHECK_MS) {
+    ns->check_ms = now_ms ? now_ms : 1u;
+    char path[PATH_MAX];
+    struct stat st;
+    ns_path(ns, path, sizeof path);
+    SELF_CALL(SC_OTHER);
+    if (ns->snap.fd >= 0 &&
+        (stat(path, &st) != 0 || (uint64_t)st.st_ino != ns->ino))
+      net_snapshot_free(&ns->snap);
+    if (ns->snap.fd < 0 && !ns_open(ns))
+      return false;
+  }
+  if (!net_snapshot_read(&ns->snap))
+    return false;
+  for (size_t i = 0; i < ns->snap.n; ++i)
+    ns->snap.ent[i].master = 0; /* an ifindex of that namespace, not ours */
+  return true;
+}
+
+void netns_free(NetnsSet *s) {
+  for (size_t i = 0; i < s->n; ++i)
+    net_snapshot_free(&s->v[i].snap);
+  free(s->v);
+  s->v = NULL;
+  s->n = 0;
+}
@@ -0,0 +1,354 @@
+/*
+ * nl80211 over a long-lived generic-netlink socket: SSID, signal and
+ * bitrates for associated Wi-Fi interfaces, plus "mlme" multicast events
+ * so the cache is only refreshed when the station (re)associates.
+ */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <linux/genetlink.h>
+#include <linux/netlink.h>
+#include <linux/nl80211.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define NL80211_BUF_SIZE 16384u
+#define NL80211_WAIT_MS 250u /* reply bound unless the caller sets one */
+
+/* --------------------------------------------------------------------- */
+/* Tiny attribute builder for request messages.                          */
+typedef struct {
+    struct nlmsghdr nh;
+    struct genlmsghdr gh;
+    char attrs[64];
+} GenlReq;
+
+static void put_attr(GenlReq *req, uint16_t type, const void *data,
+                     size_t len) {
+  struct nlattr *na = (struct nlattr *)((char *)req + NLMSG_ALIGN(req->nh.nlmsg_len));
+  na->nla_type = type;
+  na->nla_len = (uint16_t)(NLA_HDRLEN + len);
+  memcpy((char *)na + NLA_HDRLEN, data, len);
+  req->nh.nlmsg_len = NLMSG_ALIGN(req->nh.nlmsg_len) + NLA_ALIGN(na->nla_len);
+}
+
+#define NLA_DATA(na) ((const void *)((const char *)(na) + NLA_HDRLEN))
+#define NLA_LEN(na) ((size_t)((na)->nla_len - NLA_HDRLEN))
+#define NLA_FOR_EACH(na, start, rem)                                           \
+  for (const struct nlattr *na = (start);                                      \
+       (rem) >= (int)sizeof(struct nlattr) && na->nla_len >= sizeof *na &&     \
+       (int)na->nla_len <= (rem);                                              \
+       (rem) -= NLA_ALIGN(na->nla_len),                                        \
+                          na = (const struct nlattr *)((const char *)na +      \
+                                                       NLA_ALIGN(na->nla_len)))
+
+static const struct nlattr *genl_attrs(const struct nlmsghdr *nh, int *rem) {
+  *rem = (int)nh->nlmsg_len - (int)NLMSG_LENGTH(GENL_HDRLEN);
+  return (const struct nlattr *)((const char *)NLMSG_DATA(nh) + GENL_HDRLEN);
+}
+
+/* Send a request and feed every reply message to fn until DONE/ACK.     */
+typedef void (*GenlReplyFn)(const struct nlmsghdr *nh, void *ctx);
+
+static bool genl_transact(Nl80211 *nl, GenlReq *req, GenlReplyFn fn,
+                          void *ctx) {
+  req->nh.nlmsg_seq = ++nl->seq;
+  req->nh.nlmsg_flags |= NLM_F_REQUEST | NLM_F_ACK;
+  SELF_CALL(SC_WRITE);
+  if (send(nl->fd, req, req->nh.nlmsg_len, 0) < 0)
+    return false;
+
+  for (;;) {
+    SELF_CALL(SC_READ);
+    ssize_t r = recv(nl->fd, nl->buf, NL80211_BUF_SIZE, 0);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    int len = (int)r;
+    for (struct nlmsghdr *nh = (struct nlmsghdr *)nl->buf; NLMSG_OK(nh, len);
+         nh = NLMSG_NEXT(nh, len)) {
+      if (nh->nlmsg_seq != nl->seq)
+        continue;
+      if (nh->nlmsg_type == NLMSG_DONE)
+        return true;
+      if (nh->nlmsg_type == NLMSG_ERROR) {
+        const struct nlmsgerr *err = NLMSG_DATA(nh);
+        return err->error == 0;
+      }
+      if (nh->nlmsg_len >= NLMSG_LENGTH(GENL_HDRLEN))
+        fn(nh, ctx);
+    }
+  }
+}
+
+static void genl_init(GenlReq *req, uint16_t family, uint8_t cmd,
+                      uint16_t flags) {
+  memset(req, 0, sizeof *req);
+  req->nh.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+  req->nh.nlmsg_type = family;
+  req->nh.nlmsg_flags = flags;
+  req->gh.cmd = cmd;
+  req->gh.version = 1;
+}
+
+/* --------------------------------------------------------------------- */
+/* Family / multicast-group resolution via the genl controller.          */
+typedef struct {
+    uint16_t family;
+    uint32_t mlme_group;
+} FamilyInfo;
+
+static void on_family(const struct nlmsghdr *nh, void *ctx) {
+  FamilyInfo *fi = ctx;
+  int rem;
+  NLA_FOR_EACH(na, genl_attrs(nh, &rem), rem) {
+    if (na->nla_type == CTRL_ATTR_FAMILY_ID && NLA_LEN(na) >= 2u) {
+      memcpy(&fi->family, NLA_DATA(na), sizeof fi->family);
+    } else if (na->nla_type == CTRL_ATTR_MCAST_GROUPS) {
+      int grem = (int)NLA_LEN(na);
+      NLA_FOR_EACH(grp, NLA_DATA(na), grem) {
+        const char *name = NULL;
+        uint32_t id = 0;
+        int arem = (int)NLA_LEN(grp);
+        NLA_FOR_EACH(a, NLA_DATA(grp), arem) {
+          if (a->nla_type == CTRL_ATTR_MCAST_GRP_NAME)
+            name = NLA_DATA(a);
+          else if (a->nla_type == CTRL_ATTR_MCAST_GRP_ID && NLA_LEN(a) >= 4u)
+            memcpy(&id, NLA_DATA(a), sizeof id);
+        }
+        if (name && strcmp(name, NL80211_MULTICAST_GROUP_MLME) == 0)
+          fi->mlme_group = id;
+      }
+    }
+  }
+}
+
+static int genl_socket(bool nonblock) {
+  int fd = socket(AF_NETLINK,
+                  SOCK_RAW | SOCK_CLOEXEC | (nonblock ? SOCK_NONBLOCK : 0),
+                  NETLINK_GENERIC);
+  if (fd < 0)
+    return -1;
+  struct sockaddr_nl sa = {.nl_family = AF_NETLINK};
+  if (bind(fd, (struct sockaddr *)&sa, sizeof sa) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/* Open the request socket and the "mlme" event socket.  False when the  */
+/* kernel has no nl80211 (no cfg80211 drivers) – callers then fall back  */
+/* to wireless extensions.                                               */
+bool nl80211_open(Nl80211 *nl) {
+  unsigned wait_ms = nl->wait_ms;
+  memset(nl, 0, sizeof *nl);
+  nl->fd = nl->ev_fd = -1;
+  nl->buf = malloc(NL80211_BUF_SIZE);
+  nl->fd = genl_socket(false);
+  if (!nl->buf || nl->fd < 0)
+    goto fail;
+  nl80211_set_wait(nl, wait_ms);
+
+  GenlReq req;
+  genl_init(&req, GENL_ID_CTRL, CTRL_CMD_GETFAMILY, 0);
+  put_attr(&req, CTRL_ATTR_FAMILY_NAME, NL80211_GENL_NAME,
+           sizeof NL80211_GENL_NAME);
+  FamilyInfo fi = {0};
+  if (!genl_transact(nl, &req, on_family, &fi) || fi.family == 0)
+    goto fail;
+  nl->family = fi.family;
+
+  /* Events on their own socket so they never interleave with replies */
+  if (fi.mlme_group) {
+    nl->ev_fd = genl_socket(true);
+    if (nl->ev_fd >= 0 &&
+        setsockopt(nl->ev_fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+                   &fi.mlme_group, sizeof fi.mlme_group) < 0) {
+      close(nl->ev_fd);
+      nl->ev_fd = -1;
+    }
+  }
+  return true;
+
+fail:
+  nl80211_close(nl);
+  return false;
+}
+
+/* A wedged or slow driver must not stall the sampling tick: every recv()
+ * on the request socket gives up after ms (0: NL80211_WAIT_MS). */
+void nl80211_set_wait(Nl80211 *nl, unsigned ms) {
+  nl->wait_ms = ms ? ms : NL80211_WAIT_MS;
+  if (nl->fd < 0)
+    return;
+  struct timeval tv = {.tv_sec = nl->wait_ms / 1000u,
+                       .tv_usec = (suseconds_t)(nl->wait_ms % 1000u) * 1000};
+  setsockopt(nl->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof tv);
+}
+
+void nl80211_close(Nl80211 *nl) {
+  if (nl->fd >= 0)
+    close(nl->fd);
+  if (nl->ev_fd >= 0)
+    close(nl->ev_fd);
+  free(nl->buf);
+  unsigned wait_ms = nl->wait_ms; /* a setting, not session state */
+  memset(nl, 0, sizeof *nl);
+  nl->fd = nl->ev_fd = -1;
+  nl->wait_ms = wait_ms;
+}
+
+/* --------------------------------------------------------------------- */
+/* Reply decoding: GET_INTERFACE carries the SSID, GET_STATION the       */
+/* signal and bitrates of the AP we are associated with.                 */
+static uint32_t rate_info_bitrate(const struct nlattr *nest) {
+  uint32_t rate32 = 0;
+  uint16_t rate16 = 0;
+  int rem = (int)NLA_LEN(nest);
+  NLA_FOR_EACH(a, NLA_DATA(nest), rem) {
+    if (a->nla_type == NL80211_RATE_INFO_BITRATE32 && NLA_LEN(a) >= 4u)
+      memcpy(&rate32, NLA_DATA(a), sizeof rate32);
+    else if (a->nla_type == NL80211_RATE_INFO_BITRATE && NLA_LEN(a) >= 2u)
+      memcpy(&rate16, NLA_DATA(a), sizeof rate16);
+  }
+  return rate32 ? rate32 : rate16;
+}
+
+void nl80211_parse_reply(const struct nlmsghdr *nh, WifiLink *out) {
+  int rem;
+  NLA_FOR_EACH(na, genl_attrs(nh, &rem), rem) {
+    if (na->nla_type == NL80211_ATTR_SSID) {
+      size_t len = NLA_LEN(na);
+      if (len > IW_ESSID_MAX_SIZE)
+        len = IW_ESSID_MAX_SIZE;
+      memcpy(out->ssid, NLA_DATA(na), len);
+      out->ssid[len] = '\0';
+    } else if (na->nla_type == NL80211_ATTR_STA_INFO) {
+      int srem = (int)NLA_LEN(na);
+      NLA_FOR_EACH(a, NLA_DATA(na), srem) {
+        switch (a->nla_type) {
+        case NL80211_STA_INFO_SIGNAL:
+          if (NLA_LEN(a) >= 1u)
+            out->signal_dbm = *(const int8_t *)NLA_DATA(a);
+          break;
+        case NL80211_STA_INFO_TX_BITRATE:
+          out->tx_bitrate = rate_info_bitrate(a);
+          break;
+        case NL80211_STA_INFO_RX_BITRATE:
+          out->rx_bitrate = rate_info_bitrate(a);
+          break;
+        default:
+          break;
+        }
+      }
+    }
+  }
+}
+
+static void on_reply(const struct nlmsghdr *nh, void *ctx) {
+  nl80211_parse_reply(nh, ctx);
+}
+
+/* Two round trips on the persistent socket; no socket()/close() churn. */
+bool nl80211_query(Nl80211 *nl, int ifindex, WifiLink *out) {
+  memset(out, 0, sizeof *out);
+  if (nl->fd < 0 || ifindex <= 0)
+    return false;
+
+  uint32_t idx = (uint32_t)ifindex;
+  GenlReq req;
+  genl_init(&req, nl->family, NL80211_CMD_GET_INTERFACE, 0);
+  put_attr(&req, NL80211_ATTR_IFINDEX, &idx, sizeof idx);
+  if (!genl_transact(nl, &req, on_reply, out))
+    return false;
+
+  genl_init(&req, nl->family, NL80211_CMD_GET_STATION, NLM_F_DUMP);
+  put_attr(&req, NL80211_ATTR_IFINDEX, &idx, sizeof idx);
+  genl_transact(nl, &req, on_reply, out); /* station info is optional */
+  return true;
+}
+
+/* --------------------------------------------------------------------- */
+/* Drain "mlme" notifications; fn(ifindex) for (dis)association events.  */
+void nl80211_read_events(Nl80211 *nl, void (*fn)(int ifindex, void *ctx),
+                         void *ctx) {
+  for (;;) {
+    SELF_CALL(SC_READ);
+    ssize_t r = recv(nl->ev_fd, nl->buf, NL80211_BUF_SIZE, MSG_DONTWAIT);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return; /* EAGAIN, or ENOBUFS – the slow timer covers lost events */
+    }
+    int len = (int)r;
+    for (struct nlmsghdr *nh = (struct nlmsghdr *)nl->buf; NLMSG_OK(nh, len);
+         nh = NLMSG_NEXT(nh, len)) {
+      if (nh->nlmsg_type != nl->family ||
+          nh->nlmsg_len < NLMSG_LENGTH(GENL_HDRLEN))
+        continue;
+      const struct genlmsghdr *gh = NLMSG_DATA(nh);
+      switch (gh->cmd) {
+      case NL80211_CMD_CONNECT:
+      case NL80211_CMD_DISCONNECT:
+      case NL80211_CMD_ASSOCIATE:
+      case NL80211_CMD_DISASSOCIATE:
+      case NL80211_CMD_DEAUTHENTICATE:
+      case NL80211_CMD_ROAM:
+        break;
+      default:
+        continue;
+      }
+      int rem;
+      NLA_FOR_EACH(na, genl_attrs(nh, &rem), rem) {
+        if (na->nla_type == NL80211_ATTR_IFINDEX && NLA_LEN(na) >= 4u) {
+          uint32_t idx;
+          memcpy(&idx, NLA_DATA(na), sizeof idx);
+          fn((int)idx, ctx);
+          break;
+        }
+      }
+    }
+  }
+}
+
+/* --------------------------------------------------------------------- */
+/* Cached Wi-Fi details: refreshed when invalidated (wl_stamp_ms = 0, on */
+/* an mlme event) or stale, cleared when not associated.  The session is */
+/* opened on the first associated link; false only from the call that    */
+/* failed to open it (wireless extensions from then on).                 */
+#define WIFI_INFO_TTL_MS 30000u /* slow timer for signal/bitrate drift */
+
+bool wifi_refresh(Nl80211 *nl, Iface *n, uint64_t now_ms) {
+  if (!n->wifi || n->state != IFSTATE_CONNECTED) {
+    n->wl = (WifiLink){0};
+    n->wl_stamp_ms = 0;
+    return true;
+  }
+  if (n->wl_stamp_ms && now_ms - n->wl_stamp_ms < WIFI_INFO_TTL_MS)
+    return true;
+  bool opened = true;
+  if (!nl->tried) {
+    opened = nl80211_open(nl);
+    nl->tried = true;
+  }
+  uint64_t t0 = SELF_START();
+  WifiLink wl;
+  if (nl->fd >= 0 && nl80211_query(nl, n->ifindex, &wl)) {
+    n->wl = wl;
+  } else if (nl->fd >= 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+    SELF_END(PH_WIFI, t0);
+    return opened; /* reply too slow: keep the last details, ask again */
+  } else {
+    /* legacy wireless-extensions ioctl for drivers without nl80211 */
+    n->wl = (WifiLink){0};
+    get_wifi_ssid(n->name, n->wl.ssid);
+  }
+  SELF_END(PH_WIFI, t0);
+  n->wl_stamp_ms = now_ms ? now_ms : 1u;
+  return opened;
+}
@@ -0,0 +1,714 @@
+/*
+ * Output templates: "{icon} {ssid} {rx} {tx}" style layouts compiled once
+ * into an op list, rendered into a preallocated line buffer with a
+ * fixed-point unit formatter and flushed with a single write(2) per tick.
+ */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* ---------- Built-in layouts (match the historic print_eth/wifi) ----- */
+static const char *const DEFAULT_LAYOUT[2][IFSTATE_COUNT] = {
+    /* wired: only shown while connected */
+    [0] = {[IFSTATE_CONNECTED] = "[ {icon} | {rx} {tx} ]",
+           [IFSTATE_DISCONNECTED] = "",
+           [IFSTATE_DISABLED] = "",
+           [IFSTATE_ERR] = ""},
+    /* wireless: hidden when disabled, otherwise always visible */
+    [1] = {[IFSTATE_CONNECTED] = "[ {icon}{ ssid} | {rx} {tx} ]",
+           [IFSTATE_DISCONNECTED] = "[ {icon} | [no-link] ]",
+           [IFSTATE_DISABLED] = "",
+           [IFSTATE_ERR] = "[ {icon} | [err] ]"},
+};
+
+static const char *const STATE_KEY[IFSTATE_COUNT] = {
+    [IFSTATE_DISABLED] = "off",
+    [IFSTATE_DISCONNECTED] = "down",
+    [IFSTATE_CONNECTED] = "up",
+    [IFSTATE_ERR] = "err",
+};
+
+static const struct {
+    const char *name;
+    FmtOpKind kind;
+} FIELDS[] = {
+    {"icon", FOP_ICON},       {"name", FOP_NAME},
+    {"state", FOP_STATE},     {"ssid", FOP_SSID},
+    {"rx", FOP_RX},           {"tx", FOP_TX},
+    {"signal", FOP_SIGNAL},   {"txrate", FOP_TX_BITRATE},
+    {"rxrate", FOP_RX_BITRATE}, {"rxavg", FOP_RX_AVG},
+    {"txavg", FOP_TX_AVG},    {"rxmin", FOP_RX_MIN},
+    {"txmin", FOP_TX_MIN},    {"rxmax", FOP_RX_MAX},
+    {"txmax", FOP_TX_MAX},    {"rxp95", FOP_RX_P95},
+    {"txp95", FOP_TX_P95},    {"rxspark", FOP_RX_SPARK},
+    {"txspark", FOP_TX_SPARK}, {"top", FOP_TOP},
+    {"rxpeak", FOP_RX_PEAK},  {"txpeak", FOP_TX_PEAK},
+    {"rxlow", FOP_RX_LOW},    {"txlow", FOP_TX_LOW},
+    {"bursts", FOP_BURSTS},   {"qdisc", FOP_QDISC},
+    {"qbacklog", FOP_QBACKLOG}, {"qlen", FOP_QLEN},
+    {"qdrops", FOP_QDROPS},   {"qrequeues", FOP_QREQUEUES},
+    {"qoverlimits", FOP_QOVERLIMITS}, {"qclass", FOP_QCLASS},
+};
+
+/* --------------------------------------------------------------------- */
+const char *state_icon(bool wifi, IfState st) {
+  const char *base = wifi ? "" : ""; /* Nerd Font glyphs */
+  switch (st) {
+  case IFSTATE_CONNECTED:
+    return base;
+  case IFSTATE_DISCONNECTED:
+    return "⚠";
+  case IFSTATE_DISABLED:
+    return "✗";
+  default:
+    return "�";
+  }
+}
+
+/* ---------- Template compiler ---------------------------------------- */
+static bool push_op(Template *t, FmtOp op) {
+  FmtOp *ops = realloc(t->ops, (t->n_ops + 1u) * sizeof *ops);
+  if (!ops)
+    return false;
+  t->ops = ops;
+  t->ops[t->n_ops++] = op;
+  return true;
+}
+
+/* Compile src into t.  Literal text is copied into t->lit (with "{{" and
+ * "}}" unescaped) so ops only carry offsets.  "{ field}" emits a leading
+ * space only when the field renders non-empty. */
+bool fmt_compile(Template *t, const char *src, char *err, size_t errlen) {
+  memset(t, 0, sizeof *t);
+  size_t srclen = strlen(src);
+  t->lit = malloc(srclen + 1u);
+  if (!t->lit) {
+    snprintf(err, errlen, "out of memory");
+    return false;
+  }
+
+  size_t lit_len = 0;
+  FmtOp lit = {.kind = FOP_LIT};
+  for (const char *p = src; *p;) {
+    if ((p[0] == '{' && p[1] == '{') || (p[0] == '}' && p[1] == '}')) {
+      t->lit[lit_len++] = *p;
+      p += 2;
+      continue;
+    }
+    if (*p == '}') {
+      snprintf(err, errlen, "unmatched '}' at offset %zu", (size_t)(p - src));
+      goto fail;
+    }
+    if (*p != '{') {
+      t->lit[lit_len++] = *p++;
+      continue;
+    }
+
+    const char *close = strchr(p, '}');
+    if (!close) {
+      snprintf(err, errlen, "unterminated '{' at offset %zu", (size_t)(p - src));
+      goto fail;
+    }
+    FmtOp op = {0};
+    const char *name = p + 1;
+    if (*name == ' ') {
+      op.space = true;
+      ++name;
+    }
+    size_t nlen = (size_t)(close - name);
+    bool known = false;
+    for (size_t i = 0; i < sizeof FIELDS / sizeof FIELDS[0]; ++i) {
+      if (strlen(FIELDS[i].name) == nlen &&
+          memcmp(FIELDS[i].name, name, nlen) == 0) {
+        op.kind = FIELDS[i].kind;
+        known = true;
+        break;
+      }
+    }
+    if (!known) {
+      snprintf(err, errlen, "unknown field '{%.*s}'", (int)nlen, name);
+      goto fail;
+    }
+
+    /* flush pending literal, then the field */
+    if (lit_len > lit.off) {
+      lit.len = (uint32_t)(lit_len - lit.off);
+      if (!push_op(t, lit))
+        goto oom;
+    }
+    if (!push_op(t, op))
+      goto oom;
+    t->stats |= op.kind >= FOP_RX_AVG;
+    t->top |= op.kind == FOP_TOP;
+    t->qdisc |= op.kind >= FOP_QDISC && op.kind <= FOP_QCLASS;
+    lit.off = (uint32_t)lit_len;
+    p = close + 1;
+  }
+  if (lit_len > lit.off) {
+    lit.len = (uint32_t)(lit_len - lit.off);
+    if (!push_op(t, lit))
+      goto oom;
+  }
+  /* JSON outputs copy literals pre-escaped, never escaping per tick */
+  if (!(t->jlit = malloc(lit_len * 6u + 1u)))
+    goto oom;
+  size_t jlen = 0;
+  for (size_t i = 0; i < t->n_ops; ++i) {
+    FmtOp *op = &t->ops[i];
+    if (op->kind != FOP_LIT)
+      continue;
+    op->joff = (uint32_t)jlen;
+    op->jlen = (uint32_t)json_escape(t->jlit + jlen, t->lit + op->off, op->len);
+    jlen += op->jlen;
+  }
+  t->hidden = (t->n_ops == 0u);
+  return true;
+
+oom:
+  snprintf(err, errlen, "out of memory");
+fail:
+  fmt_free(t);
+  return false;
+}
+
+void fmt_free(Template *t) {
+  free(t->ops);
+  free(t->lit);
+  free(t->jlit);
+  memset(t, 0, sizeof *t);
+}
+
+/* ---------- Layout selection ----------------------------------------- */
+/* Spec syntax: "[SCOPE@]STATE=TEMPLATE" or plain "TEMPLATE" (connected
+ * state of every adapter).  SCOPE is "wifi", "eth" or an interface name;
+ * STATE is up, down, off or err.  An empty template hides the adapter. */
+static bool split_spec(const char *spec, const char **scope, size_t *scope_len,
+                       int *state, const char **tpl) {
+  const char *eq = strchr(spec, '=');
+  const char *brace = strchr(spec, '{');
+  *scope = NULL;
+  *scope_len = 0;
+  *state = IFSTATE_CONNECTED;
+  *tpl = spec;
+  if (!eq || (brace && brace < eq))
+    return true;
+
+  const char *at = memchr(spec, '@', (size_t)(eq - spec));
+  const char *key = at ? at + 1 : spec;
+  for (int s = 0; s < IFSTATE_COUNT; ++s) {
+    if (strlen(STATE_KEY[s]) == (size_t)(eq - key) &&
+        memcmp(STATE_KEY[s], key, (size_t)(eq - key)) == 0) {
+      *state = s;
+      *tpl = eq + 1;
+      if (at) {
+        *scope = spec;
+        *scope_len = (size_t)(at - spec);
+      }
+      return true;
+    }
+  }
+  return !at; /* "x@bogus=..." is an error, "a=b" is just literal text */
+}
+
+bool formatter_init(Formatter *f, char *const specs[], size_t n_specs,
+                    char *err, size_t errlen) {
+  memset(f, 0, sizeof *f);
+  f->rules = calloc(n_specs + 2u * IFSTATE_COUNT, sizeof *f->rules);
+  if (!f->rules) {
+    snprintf(err, errlen, "out of memory");
+    return false;
+  }
+
+  /* user rules first: later specs override earlier ones on lookup */
+  for (size_t i = 0; i < n_specs; ++i) {
+    FmtRule *r = &f->rules[f->n_rules];
+    const char *scope, *tpl;
+    size_t scope_len;
+    int state;
+    if (!split_spec(specs[i], &scope, &scope_len, &state, &tpl) ||
+        scope_len >= sizeof r->scope) {
+      snprintf(err, errlen, "bad format spec '%s'", specs[i]);
+      goto fail;
+    }
+    if (scope)
+      memcpy(r->scope, scope, scope_len);
+    r->state = state;
+    if (!fmt_compile(&r->tpl, tpl, err, errlen))
+      goto fail;
+    f->stats |= r->tpl.stats;
+    f->top |= r->tpl.top;
+    f->qdisc |= r->tpl.qdisc;
+    ++f->n_rules;
+  }
+  f->n_user = f->n_rules;
+
+  for (int wifi = 0; wifi < 2; ++wifi) {
+    for (int s = 0; s < IFSTATE_COUNT; ++s) {
+      FmtRule *r = &f->rules[f->n_rules];
+      strcpy(r->scope, wifi ? "wifi" : "eth");
+      r->state = s;
+      if (!fmt_compile(&r->tpl, DEFAULT_LAYOUT[wifi][s], err, errlen))
+        goto fail;
+      ++f->n_rules;
+    }
+  }
+  return true;
+
+fail:
+  formatter_free(f);
+  return false;
+}
+
+void formatter_free(Formatter *f) {
+  for (size_t i = 0; i < f->n_rules; ++i)
+    fmt_free(&f->rules[i].tpl);
+  free(f->rules);
+  memset(f, 0, sizeof *f);
+}
+
+/* Resolve the per-state templates of one adapter (done once, not per
+ * tick): interface name beats adapter kind beats unscoped beats default. */
+void formatter_layout(const Formatter *f, const char *ifname, bool wifi,
+                      const Template *out[IFSTATE_COUNT]) {
+  const char *kind = wifi ? "wifi" : "eth";
+  for (int s = 0; s < IFSTATE_COUNT; ++s) {
+    const Template *by_name = NULL, *by_kind = NULL, *any = NULL;
+    for (size_t i = 0; i < f->n_user; ++i) {
+      const FmtRule *r = &f->rules[i];
+      if (r->state != s)
+        continue;
+      if (!r->scope[0])
+        any = &r->tpl;
+      else if (strcmp(r->scope, ifname) == 0)
+        by_name = &r->tpl;
+      else if (strcmp(r->scope, kind) == 0)
+        by_kind = &r->tpl;
+    }
+    out[s] = by_name ? by_name : by_kind ? by_kind : any;
+    if (!out[s])
+      out[s] = &f->rules[f->n_user + (size_t)(wifi ? IFSTATE_COUNT : 0) + (size_t)s].tpl;
+  }
+}
+
+/* ---------- Line buffer ---------------------------------------------- */
+bool out_reserve(OutBuf *o, size_t extra) {
+  if (o->len + extra <= o->cap)
+    return true;
+  size_t cap = o->cap ? o->cap : 256u;
+  while (cap < o->len + extra)
+    cap *= 2u;
+  char *buf = realloc(o->buf, cap);
+  if (!buf)
+    return false;
+  o->buf = buf;
+  o->cap = cap;
+  return true;
+}
+
+void out_put(OutBuf *o, const char *s, size_t len) {
+  if (!out_reserve(o, len))
+    return;
+  memcpy(o->buf + o->len, s, len);
+  o->len += len;
+}
+
+/* Emit the whole line with one write(2) (looping only on short writes). */
+bool out_flush(OutBuf *o, int fd) {
+  size_t off = 0;
+  while (off < o->len) {
+    SELF_CALL(SC_WRITE);
+    ssize_t r = write(fd, o->buf + off, o->len - off);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      o->len = 0;
+      return false;
+    }
+    off += (size_t)r;
+  }
+  o->len = 0;
+  return true;
+}
+
+void out_free(OutBuf *o) {
+  free(o->buf);
+  memset(o, 0, sizeof *o);
+}
+
+/* ---------- JSON strings --------------------------------------------- */
+/* Length of the well-formed UTF-8 sequence at s (n bytes left), 0 if
+ * there is none: no overlong forms, surrogates or code points past
+ * U+10FFFF, no sequence cut short. */
+static size_t utf8_len(const unsigned char *s, size_t n) {
+  unsigned char c = s[0], lo = 0x80u, hi = 0xbfu; /* second byte's range */
+  size_t len = c >= 0xf0u ? 4u : c >= 0xe0u ? 3u : 2u;
+  if (c < 0xc2u || c > 0xf4u || n < len)
+    return 0;
+  if (c == 0xe0u)
+    lo = 0xa0u;
+  else if (c == 0xedu)
+    hi = 0x9fu;
+  else if (c == 0xf0u)
+    lo = 0x90u;
+  else if (c == 0xf4u)
+    hi = 0x8fu;
+  if (s[1] < lo || s[1] > hi)
+    return 0;
+  for (size_t i = 2; i < len; ++i)
+    if ((s[i] & 0xc0u) != 0x80u)
+      return 0;
+  return len;
+}
+
+/* Escape len bytes of src for the inside of a JSON string; dst needs
+ * 6 * len bytes.  Valid UTF-8 passes through as is; any other byte – an
+ * SSID in Latin-1, a field cut mid-character – becomes U+FFFD, so the
+ * result is always valid JSON. */
+size_t json_escape(char *dst, const char *src, size_t len) {
+  static const char HEX[] = "0123456789abcdef";
+  size_t n = 0;
+  for (size_t i = 0; i < len; ++i) {
+    unsigned char c = (unsigned char)src[i];
+    if (c == '"' || c == '\\') {
+      dst[n++] = '\\';
+      dst[n++] = (char)c;
+    } else if (c == '\n') {
+      dst[n++] = '\\';
+      dst[n++] = 'n';
+    } else if (c < 0x20u) {
+      memcpy(dst + n, "\\u00", 4);
+      dst[n + 4] = HEX[c >> 4];
+      dst[n + 5] = HEX[c & 15u];
+      n += 6u;
+    } else if (c >= 0x80u) {
+      size_t k = utf8_len((const unsigned char *)src + i, len - i);
+      if (k) {
+        memcpy(dst + n, src + i, k);
+        n += k;
+        i += k - 1u;
+      } else {
+        memcpy(dst + n, "\xef\xbf\xbd", 3); /* U+FFFD */
+        n += 3u;
+      }
+    } else {
+      dst[n++] = (char)c;
+    }
+  }
+  return n;
+}
+
+/* ---------- Fixed-point number formatting ---------------------------- */
+static size_t put_u64(char *dst, uint64_t v) {
+  char tmp[20];
+  size_t n = 0;
+  do {
+    tmp[n++] = (char)('0' + v % 10u);
+    v /= 10u;
+  } while (v);
+  for (size_t i = 0; i < n; ++i)
+    dst[i] = tmp[n - 1u - i];
+  return n;
+}
+
+/* v → lower-case hex digits, like tc prints class ids */
+static size_t put_hex(char *dst, uint32_t v) {
+  char tmp[8];
+  size_t n = 0;
+  do {
+    tmp[n++] = "0123456789abcdef"[v & 15u];
+    v >>= 4;
+  } while (v);
+  for (size_t i = 0; i < n; ++i)
+    dst[i] = tmp[n - 1u - i];
+  return n;
+}
+
+/* tenths → "123.4", right-aligned to width (like "%*.1f") */
+static size_t put_tenths(char *dst, uint64_t tenths, size_t width) {
+  char tmp[24];
+  size_t n = put_u64(tmp, tenths / 10u);
+  tmp[n++] = '.';
+  tmp[n++] = (char)('0' + tenths % 10u);
+  size_t pad = (n < width) ? width - n : 0u;
+  memset(dst, ' ', pad);
+  memcpy(dst + pad, tmp, n);
+  return pad + n;
+}
+
+/* Round v >= 0 to integer tenths the way printf("%.1f") does: from its
+ * exact binary value, ties to even.  v * 10 itself is rounded, which
+ * moves values like 832.45000000000005 (just above the tie) onto it, so
+ * the candidate is checked with fma(), whose one rounding keeps the
+ * sign of v * 10 - t and v * 20 - (2t + 1) exact. */
+static uint64_t round_tenths(double v) {
+  double x = v * 10.0;
+  if (x >= 0x1p52)
+    return x >= 1.8e19 ? UINT64_MAX / 2u : (uint64_t)x; /* no fraction */
+  uint64_t t = (uint64_t)x;
+  if (t && fma(v, 10.0, -(double)t) < 0.0)
+    --t;
+  else if (fma(v, 10.0, -(double)(t + 1u)) >= 0.0)
+    ++t;
+  double half = fma(v, 20.0, -(double)(2u * t + 1u)); /* v - (t + .5)/10 */
+  return t + (half > 0.0 || (half == 0.0 && (t & 1u)));
+}
+
+/* Rate in bytes/s → "[!?]%7.1f <prefix><unit>/s" without stdio: the
+ * value is rounded to integer tenths once and printed digit by digit.
+ * dst needs FMT_RATE_MAX bytes. */
+size_t fmt_rate(char *dst, double bps, char unit, unsigned divisor,
+                uint64_t warn, uint64_t crit) {
+  size_t n = 0;
+  if (bps < 0.0)
+    bps = 0.0;
+
+  /* Threshold markers for Polybar colouring: limits are bytes/s    */
+  if (crit && bps > crit)
+    dst[n++] = '!'; /* critical */
+  else if (warn && bps > warn)
+    dst[n++] = '?'; /* warning  */
+
+  /* Convert to bits if requested */
+  if (unit == 'b')
+    bps *= 8.0;
+
+  static const char prefix[] = {'\0', 'K', 'M', 'G', 'T'};
+  size_t i = 0u;
+  while (bps >= divisor && i < 4u) {
+    bps /= divisor;
+    ++i;
+  }
+  n += put_tenths(dst + n, round_tenths(bps), 7u);
+  dst[n++] = ' ';
+  if (prefix[i])
+    dst[n++] = prefix[i];
+  dst[n++] = unit == 'b' ? 'b' : 'B';
+  dst[n++] = '/';
+  dst[n++] = 's';
+  return n;
+}
+
+/* --------------------------------------------------------------------- */
+/* Pretty-print a byte/s figure with SI or IEC prefixes.                  */
+void human_print(double bps, char unit, unsigned divisor, uint64_t warn,
+                 uint64_t crit) {
+  char buf[FMT_RATE_MAX];
+  fwrite(buf, 1, fmt_rate(buf, bps, unit, divisor, warn, crit), stdout);
+}
+
+/* ---------- Rendering ------------------------------------------------ */
+/* The "!"/"?" marker of the adapter's alert level in dimension d; JSON
+ * outputs carry the level in their own fields instead. */
+static size_t put_mark(char *dst, const Iface *n, int d, const RenderOpts *ro) {
+  static const char MARK[] = {0, '?', '!'};
+  if (!MARK[n->al[d].level] || ro->json)
+    return 0;
+  dst[0] = MARK[n->al[d].level];
+  return 1;
+}
+
+static size_t put_alert_rate(char *dst, double bps, const Iface *n, bool tx,
+                             const RenderOpts *ro) {
+  size_t len = put_mark(dst, n, tx, ro);
+  return len + fmt_rate(dst + len, bps, ro->unit, ro->divisor, 0, 0);
+}
+
+/* Bytes queued → "%7.1f <prefix>B", the rate format less its "/s". */
+static size_t put_bytes(char *dst, uint32_t bytes, const RenderOpts *ro) {
+  return fmt_rate(dst, bytes, 'B', ro->divisor, 0, 0) - 2u;
+}
+
+/* Events per second, rounded to a whole number. */
+static size_t put_per_s(char *dst, double rate) {
+  return put_u64(dst, (uint64_t)(rate + 0.5));
+}
+
+static size_t render_field(char *dst, const FmtOp *op, const Iface *n,
+                           const RenderOpts *ro) {
+  size_t len = 0;
+  const char *s = NULL;
+  /* qdisc fields stay empty until the first dump, or once it is gone */
+  const QdiscInfo *qd = n->qd && n->qd->kind[0] ? n->qd : NULL;
+  switch (op->kind) {
+  case FOP_ICON:
+    s = state_icon(n->wifi, n->state);
+    break;
+  case FOP_NAME:
+    s = n->name;
+    break;
+  case FOP_STATE:
+    s = STATE_KEY[n->state];
+    break;
+  case FOP_SSID:
+    s = n->wl.ssid;
+    break;
+  case FOP_RX:
+    return put_alert_rate(dst, n->rx_rate, n, false, ro);
+  case FOP_TX:
+    return put_alert_rate(dst, n->tx_rate, n, true, ro);
+  case FOP_SIGNAL:
+    if (n->wl.signal_dbm == 0)
+      return 0;
+    if (n->wl.signal_dbm < 0)
+      dst[len++] = '-';
+    len += put_u64(dst + len, (uint64_t)(n->wl.signal_dbm < 0 ? -n->wl.signal_dbm
+                                                                : n->wl.signal_dbm));
+    memcpy(dst + len, "dBm", 3);
+    return len + 3u;
+  case FOP_RX_AVG:
+  case FOP_TX_AVG:
+  case FOP_RX_MIN:
+  case FOP_TX_MIN:
+  case FOP_RX_MAX:
+  case FOP_TX_MAX:
+  case FOP_RX_P95:
+  case FOP_TX_P95:
+  case FOP_RX_SPARK:
+  case FOP_TX_SPARK: {
+    /* rx/tx variants alternate, rx first */
+    bool tx = (op->kind - FOP_RX_AVG) & 1;
+    const RateWindow *w = n->rs ? &n->rs[tx] : NULL;
+    if (!w || !w->n)
+      return 0;
+    switch (op->kind) {
+    case FOP_RX_AVG:
+    case FOP_TX_AVG:
+      return put_alert_rate(dst, w->ewma, n, tx, ro);
+    case FOP_RX_MIN:
+    case FOP_TX_MIN:
+      return fmt_rate(dst, rate_window_min(w), ro->unit, ro->divisor, 0, 0);
+    case FOP_RX_MAX:
+    case FOP_TX_MAX:
+      return fmt_rate(dst, rate_window_max(w), ro->unit, ro->divisor, 0, 0);
+    case FOP_RX_P95:
+    case FOP_TX_P95:
+      return fmt_rate(dst, rate_window_pct(w, 95u), ro->unit, ro->divisor, 0,
+                      0);
+    default:
+      return rate_window_spark(w, dst, RS_SPARK_WIDTH);
+    }
+  }
+  case FOP_RX_PEAK:
+  case FOP_TX_PEAK:
+  case FOP_RX_LOW:
+  case FOP_TX_LOW: {
+    /* sub-interval extremes since the last line; empty before one */
+    const BurstStats *b = &n->burst;
+    bool tx = (op->kind - FOP_RX_PEAK) & 1;
+    if (!b->n)
+      return 0;
+    return fmt_rate(dst, op->kind <= FOP_TX_PEAK ? b->peak[tx] : b->low[tx],
+                    ro->unit, ro->divisor, 0, 0);
+  }
+  case FOP_BURSTS:
+    return n->burst.n ? put_u64(dst, n->burst.bursts) : 0;
+  case FOP_QDISC:
+    if (!qd)
+      return 0;
+    s = qd->kind;
+    break;
+  case FOP_QBACKLOG:
+    if (!qd)
+      return 0;
+    len = put_mark(dst, n, ALERT_BACKLOG, ro);
+    return len + put_bytes(dst + len, qd->c.backlog, ro);
+  case FOP_QLEN:
+    return qd ? put_u64(dst, qd->c.qlen) : 0;
+  case FOP_QDROPS:
+    if (!qd)
+      return 0;
+    len = put_mark(dst, n, ALERT_DROPS, ro);
+    return len + put_per_s(dst + len, qd->drop_rate);
+  case FOP_QREQUEUES:
+    return qd ? put_per_s(dst, qd->requeue_rate) : 0;
+  case FOP_QOVERLIMITS:
+    return qd ? put_per_s(dst, qd->overlimit_rate) : 0;
+  case FOP_QCLASS: { /* "1:10 3/s 12.0 KB": the class dropping most */
+    if (!qd || qd->worst < 0)
+      return 0;
+    const QdiscClass *k = &qd->cls[qd->worst];
+    len = put_hex(dst, k->handle >> 16);
+    dst[len++] = ':';
+    len += put_hex(dst + len, k->handle & 0xffffu);
+    dst[len++] = ' ';
+    len += put_per_s(dst + len, k->drop_rate);
+    memcpy(dst + len, "/s ", 3);
+    len += 3u;
+    char size[FMT_RATE_MAX];
+    size_t r = put_bytes(size, k->c.backlog, ro), skip = 0;
+    while (skip < r && size[skip] == ' ')
+      ++skip;
+    memcpy(dst + len, size + skip, r - skip);
+    return len + r - skip;
+  }
+  case FOP_TX_BITRATE:
+  case FOP_RX_BITRATE: {
+    uint32_t r = op->kind == FOP_TX_BITRATE ? n->wl.tx_bitrate : n->wl.rx_bitrate;
+    if (r == 0u)
+      return 0;
+    len = put_tenths(dst, r, 0u); /* 100 kbit/s units → Mb/s */
+    memcpy(dst + len, "Mb/s", 4);
+    return len + 4u;
+  }
+  case FOP_TOP: /* "label rate, label rate" – dst holds FMT_TOP_MAX */
+    for (uint8_t i = 0; i < n->n_top; ++i) {
+      const FlowTop *f = &n->top[i];
+      if (i) {
+        memcpy(dst + len, ", ", 2);
+        len += 2u;
+      }
+      size_t l = strnlen(f->label, TOP_LABEL_MAX - 1u);
+      memcpy(dst + len, f->label, l);
+      len += l;
+      char rate[FMT_RATE_MAX];
+      size_t r = fmt_rate(rate, f->rate, ro->unit, ro->divisor, 0, 0), skip = 0;
+      while (skip < r && rate[skip] == ' ')
+        ++skip;
+      dst[len++] = ' ';
+      memcpy(dst + len, rate + skip, r - skip);
+      len += r - skip;
+    }
+    return len;
+  default:
+    return 0;
+  }
+  len = strlen(s);
+  memcpy(dst, s, len);
+  return len;
+}
+
+/* Append one adapter segment; false (nothing appended) when hidden.
+ * With ro->json the segment is escaped for a JSON string: literals come
+ * pre-escaped, fields go through a stack buffer. */
+bool render_iface(OutBuf *o, const Template *t, const Iface *n,
+                  const RenderOpts *ro) {
+  if (!t || t->hidden)
+    return false;
+  for (size_t i = 0; i < t->n_ops; ++i) {
+    const FmtOp *op = &t->ops[i];
+    if (op->kind == FOP_LIT) {
+      if (ro->json)
+        out_put(o, t->jlit + op->joff, op->jlen);
+      else
+        out_put(o, t->lit + op->off, op->len);
+      continue;
+    }
+    size_t max = 1u + (op->kind == FOP_TOP ? FMT_TOP_MAX : FMT_FIELD_MAX);
+    if (!out_reserve(o, ro->json ? max * 6u : max))
+      return true;
+    char *dst = o->buf + o->len;
+    char tmp[1u + FMT_TOP_MAX];
+    char *field = ro->json ? tmp : dst;
+    size_t len = render_field(field + op->space, op, n, ro);
+    if (len && op->space) {
+      field[0] = ' ';
+      ++len;
+    }
+    o->len += ro->json ? json_escape(dst, tmp, len) : len;
+  }
+  return true;
+}
@@ -0,0 +1,287 @@
+/*
+ * Queueing-discipline statistics (--qdisc, {qdisc}, {qdrops} ...): one
+ * RTM_GETQDISC dump per tick yields the root qdisc of every link – its
+ * kind, backlog and queue length and the drop, requeue and overlimit
+ * counters – joined onto the adapters by ifindex.  With --qdisc classes
+ * a classful root (htb, hfsc, mq ...) adds one RTM_GETTCLASS dump for
+ * its link, and the class dropping most (or holding the most backlog)
+ * shows in {qclass}.
+ *
+ * The kernel keeps these counters as u32: deltas are taken modulo 2^32,
+ * and a root qdisc replaced by tc (a new handle or kind) starts over
+ * from a fresh baseline rather than showing a bogus spike.
+ */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <linux/gen_stats.h>
+#include <linux/netlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/rtnetlink.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define QD_BUF_SIZE 32768u
+
+/* Roots whose classes carry statistics of their own. */
+static const char *const CLASSFUL[] = {"htb", "hfsc", "drr", "qfq", "ets",
+                                       "prio", "cbq", "mq", "mqprio",
+                                       "multiq", "taprio"};
+
+bool qdisc_open(QdiscDump *q, bool classes) {
+  memset(q, 0, sizeof *q);
+  q->classes = classes;
+  SELF_CALL(SC_OPEN);
+  q->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+  if (q->fd < 0)
+    return false;
+  if (!(q->buf = malloc(QD_BUF_SIZE))) {
+    qdisc_close(q);
+    return false;
+  }
+  return true;
+}
+
+void qdisc_close(QdiscDump *q) {
+  if (q->fd >= 0)
+    close(q->fd);
+  free(q->buf);
+  memset(q, 0, sizeof *q);
+  q->fd = -1;
+}
+
+void qdisc_forget(Iface *n) {
+  if (n->qd)
+    free(n->qd->cls);
+  free(n->qd);
+  n->qd = NULL;
+}
+
+/* --------------------------------------------------------------------- */
+/* Decode one RTM_NEWQDISC / RTM_NEWTCLASS; false if it carries no queue */
+/* statistics.  TCA_STATS2 is preferred, the legacy TCA_STATS is the    */
+/* fallback of old kernels.                                             */
+bool qdisc_parse(const struct nlmsghdr *nh, int *ifindex, uint32_t *parent,
+                 uint32_t *handle, char kind[QDISC_KIND_MAX],
+                 QdiscCounters *c) {
+  if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(struct tcmsg)))
+    return false;
+  const struct tcmsg *tm = NLMSG_DATA(nh);
+  *ifindex = tm->tcm_ifindex;
+  *parent = tm->tcm_parent;
+  *handle = tm->tcm_handle;
+  kind[0] = '\0';
+  memset(c, 0, sizeof *c);
+  bool stats2 = false, stats = false;
+
+  int len = (int)(nh->nlmsg_len - NLMSG_LENGTH(sizeof *tm));
+  for (const struct rtattr *rta = (const struct rtattr *)(tm + 1);
+       RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+    size_t plen = RTA_PAYLOAD(rta);
+    switch (rta->rta_type & NLA_TYPE_MASK) {
+    case TCA_KIND:
+      snprintf(kind, QDISC_KIND_MAX, "%.*s", (int)strnlen(RTA_DATA(rta), plen),
+               (const char *)RTA_DATA(rta));
+      break;
+    case TCA_STATS2: {
+      int slen = (int)plen;
+      for (const struct rtattr *sa = RTA_DATA(rta); RTA_OK(sa, slen);
+           sa = RTA_NEXT(sa, slen)) {
+        struct gnet_stats_queue gq = {0}; /* payload is 4-byte aligned */
+        if ((sa->rta_type & NLA_TYPE_MASK) != TCA_STATS_QUEUE ||
+            RTA_PAYLOAD(sa) < sizeof gq)
+          continue;
+        memcpy(&gq, RTA_DATA(sa), sizeof gq);
+        *c = (QdiscCounters){.drops = gq.drops,
+                             .requeues = gq.requeues,
+                             .overlimits = gq.overlimits,
+                             .backlog = gq.backlog,
+                             .qlen = gq.qlen};
+        stats2 = true;
+      }
+      break;
+    }
+    case TCA_STATS: {
+      struct tc_stats ts = {0};
+      if (stats2 || plen < sizeof ts)
+        break;
+      memcpy(&ts, RTA_DATA(rta), sizeof ts);
+      *c = (QdiscCounters){.drops = ts.drops,
+                           .overlimits = ts.overlimits,
+                           .backlog = ts.backlog,
+                           .qlen = ts.qlen};
+      stats = true;
+      break;
+    }
+    }
+  }
+  return stats2 || stats;
+}
+
+static double per_s(uint32_t now, uint32_t old, double dt) {
+  return dt > 0.0 ? (double)(uint32_t)(now - old) / dt : 0.0;
+}
+
+/* New root-qdisc counters for a link: rates since the previous dump, or
+ * a baseline when the qdisc is new to us. */
+void qdisc_update(Iface *n, const char *kind, uint32_t handle,
+                  const QdiscCounters *c, uint64_t now_ns) {
+  QdiscInfo *qd = n->qd;
+  if (!qd) {
+    if (!(qd = n->qd = calloc(1, sizeof *qd)))
+      return;
+    qd->worst = -1;
+  }
+  bool same = qd->kind[0] && qd->handle == handle &&
+              strcmp(qd->kind, kind) == 0 && now_ns > qd->ts_ns;
+  double dt = same ? (double)(now_ns - qd->ts_ns) / 1e9 : 0.0;
+  qd->drop_rate = per_s(c->drops, qd->c.drops, dt);
+  qd->requeue_rate = per_s(c->requeues, qd->c.requeues, dt);
+  qd->overlimit_rate = per_s(c->overlimits, qd->c.overlimits, dt);
+  if (!same) {
+    qd->n_cls = 0; /* replaced root: its classes went with it */
+    qd->worst = -1;
+  }
+  snprintf(qd->kind, sizeof qd->kind, "%s", kind);
+  qd->handle = handle;
+  qd->c = *c;
+  qd->ts_ns = now_ns;
+}
+
+static void class_update(QdiscInfo *qd, uint32_t handle, const QdiscCounters *c,
+                         uint64_t now_ns, uint32_t gen) {
+  QdiscClass *k = NULL;
+  for (uint32_t i = 0; i < qd->n_cls && !k; ++i)
+    if (qd->cls[i].handle == handle)
+      k = &qd->cls[i];
+  if (!k) {
+    if (qd->n_cls == qd->cap_cls) {
+      uint32_t cap = qd->cap_cls ? qd->cap_cls * 2u : 8u;
+      QdiscClass *v = realloc(qd->cls, cap * sizeof *v);
+      if (!v)
+        return;
+      qd->cls = v;
+      qd->cap_cls = cap;
+    }
+    k = &qd->cls[qd->n_cls++];
+    *k = (QdiscClass){.handle = handle, .c = *c};
+  }
+  double dt = k->seen + 1u == gen && now_ns > qd->cls_ns
+                  ? (double)(now_ns - qd->cls_ns) / 1e9
+                  : 0.0; /* new class, or its last dump failed */
+  k->drop_rate = per_s(c->drops, k->c.drops, dt);
+  k->c = *c;
+  k->seen = gen;
+}
+
+/* Drop classes missing from this dump and rank the rest. */
+static void classes_done(QdiscInfo *qd, uint64_t now_ns, uint32_t gen) {
+  uint32_t w = 0;
+  qd->worst = -1;
+  for (uint32_t r = 0; r < qd->n_cls; ++r) {
+    if (qd->cls[r].seen != gen)
+      continue;
+    qd->cls[w] = qd->cls[r];
+    const QdiscClass *k = &qd->cls[w];
+    if (k->drop_rate > 0.0 || k->c.backlog) {
+      const QdiscClass *b = qd->worst < 0 ? NULL : &qd->cls[qd->worst];
+      if (!b || k->drop_rate > b->drop_rate ||
+          (k->drop_rate == b->drop_rate && k->c.backlog > b->c.backlog))
+        qd->worst = (int)w;
+    }
+    ++w;
+  }
+  qd->n_cls = w;
+  qd->cls_ns = now_ns;
+}
+
+/* One RTM_GETQDISC dump of every link (cls NULL) or RTM_GETTCLASS dump
+ * of cls's link. */
+static bool dump(QdiscDump *q, IfaceTable *t, Iface *cls, uint64_t now_ns) {
+  struct {
+    struct nlmsghdr nh;
+    struct tcmsg tm;
+  } req = {
+      .nh = {.nlmsg_len = sizeof req,
+             .nlmsg_type = cls ? RTM_GETTCLASS : RTM_GETQDISC,
+             .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+             .nlmsg_seq = ++q->seq},
+      .tm = {.tcm_family = AF_UNSPEC, .tcm_ifindex = cls ? cls->ifindex : 0},
+  };
+  SELF_CALL(SC_WRITE);
+  if (send(q->fd, &req, sizeof req, 0) < 0)
+    return false;
+
+  for (;;) {
+    SELF_CALL(SC_READ);
+    ssize_t r = recv(q->fd, q->buf, QD_BUF_SIZE, 0);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    int len = (int)r;
+    for (struct nlmsghdr *nh = (struct nlmsghdr *)q->buf; NLMSG_OK(nh, len);
+         nh = NLMSG_NEXT(nh, len)) {
+      if (nh->nlmsg_seq != q->seq)
+        continue; /* stale reply to an aborted dump */
+      if (nh->nlmsg_type == NLMSG_DONE)
+        return true;
+      if (nh->nlmsg_type == NLMSG_ERROR)
+        return false;
+      int ifindex;
+      uint32_t parent, handle;
+      char kind[QDISC_KIND_MAX];
+      QdiscCounters c;
+      if (!qdisc_parse(nh, &ifindex, &parent, &handle, kind, &c))
+        continue;
+      if (cls) {
+        if (ifindex == cls->ifindex && cls->qd)
+          class_update(cls->qd, handle, &c, now_ns, q->gen);
+        continue;
+      }
+      if (parent != TC_H_ROOT)
+        continue; /* child qdiscs, ingress and clsact */
+      Iface *n = iftab_find_index(t, ifindex);
+      if (!n || n->ignored)
+        continue;
+      qdisc_update(n, kind, handle, &c, now_ns);
+      if (n->qd)
+        n->qd->seen = q->gen;
+    }
+  }
+}
+
+static bool classful(const char *kind) {
+  for (size_t i = 0; i < sizeof CLASSFUL / sizeof CLASSFUL[0]; ++i)
+    if (strcmp(kind, CLASSFUL[i]) == 0)
+      return true;
+  return false;
+}
+
+/* This tick's dump, joined onto t; false (every link unchanged) if it
+ * failed.  A link whose root qdisc was not in it lost it. */
+bool qdisc_poll(QdiscDump *q, IfaceTable *t, uint64_t now_ns) {
+  ++q->gen;
+  if (!dump(q, t, NULL, now_ns))
+    return false;
+  for (size_t i = 0; i < t->n; ++i) {
+    Iface *n = &t->v[i];
+    QdiscInfo *qd = n->qd;
+    if (!qd)
+      continue;
+    if (qd->seen != q->gen) {
+      qd->kind[0] = '\0';
+      qd->c = (QdiscCounters){0};
+      qd->drop_rate = qd->requeue_rate = qd->overlimit_rate = 0.0;
+      qd->n_cls = 0;
+      qd->worst = -1;
+    } else if (q->classes && classful(qd->kind)) {
+      if (dump(q, t, n, now_ns))
+        classes_done(qd, now_ns, q->gen);
+    }
+  }
+  return true;
+}
@@ -0,0 +1,180 @@
+/*
+ * Constant-memory rate statistics over a sliding window of samples:
+ * EWMA, min/max via monotonic deques, a log-bucket histogram for
+ * percentiles and a sparkline – every push is O(1) whatever the window.
+ */
+#include "bandwidth3.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* --------------------------------------------------------------------- */
+/* Histogram bucket of a rate: 0 for < 1 B/s, else 8 linear sub-buckets  */
+/* per power of two (relative error of the midpoint ≤ 1/16).            */
+static uint32_t bucket_of(double v) {
+  if (!(v >= 1.0))
+    return 0u;
+  int e;
+  double m = frexp(v, &e); /* v = m * 2^e, m in [0.5, 1) */
+  uint32_t b = 1u + (uint32_t)(e - 1) * 8u + (uint32_t)((m - 0.5) * 16.0);
+  return b < RS_BUCKETS ? b : RS_BUCKETS - 1u;
+}
+
+static double bucket_mid(uint32_t b) {
+  if (b == 0u)
+    return 0.0;
+  int e = (int)((b - 1u) / 8u) + 1;
+  double sub = (double)((b - 1u) % 8u);
+  return ldexp(0.5 + (sub + 0.5) / 16.0, e);
+}
+
+static uint32_t wrap(const RateWindow *w, uint32_t i) {
+  return i >= w->cap ? i - w->cap : i;
+}
+
+/* --------------------------------------------------------------------- */
+/* One allocation per window: ring, both deques and the histogram.       */
+bool rate_window_init(RateWindow *w, uint32_t cap) {
+  memset(w, 0, sizeof *w);
+  if (cap < 1u)
+    cap = 1u;
+  if (cap > RS_WINDOW_MAX)
+    cap = RS_WINDOW_MAX;
+  size_t bytes = cap * sizeof(float) + 2u * cap * sizeof(uint16_t) +
+                 RS_BUCKETS * sizeof(uint16_t);
+  char *mem = malloc(bytes);
+  if (!mem)
+    return false;
+  w->ring = (float *)mem;
+  w->dq_max = (uint16_t *)(mem + cap * sizeof(float));
+  w->dq_min = w->dq_max + cap;
+  w->hist = w->dq_min + cap;
+  w->cap = cap;
+  rate_window_reset(w);
+  return true;
+}
+
+/* Forget every sample (link re-created), keeping the allocation. */
+void rate_window_reset(RateWindow *w) {
+  memset(w->hist, 0, RS_BUCKETS * sizeof *w->hist);
+  w->n = w->head = 0u;
+  w->max_h = w->max_n = w->min_h = w->min_n = 0u;
+  w->ewma = 0.0;
+}
+
+void rate_window_free(RateWindow *w) {
+  free(w->ring);
+  memset(w, 0, sizeof *w);
+}
+
+/* Add one sample; the oldest drops out once the window is full.  Each
+ * slot enters and leaves each deque at most once: amortised O(1). */
+void rate_window_push(RateWindow *w, double bps, double alpha) {
+  uint32_t slot = w->head;
+  if (w->n == w->cap) {
+    /* the evicted sample is the oldest, so only ever at a deque front */
+    if (w->max_n && w->dq_max[w->max_h] == slot) {
+      w->max_h = wrap(w, w->max_h + 1u);
+      --w->max_n;
+    }
+    if (w->min_n && w->dq_min[w->min_h] == slot) {
+      w->min_h = wrap(w, w->min_h + 1u);
+      --w->min_n;
+    }
+    --w->hist[bucket_of(w->ring[slot])];
+  } else {
+    w->ewma = w->n ? w->ewma : bps; /* first sample seeds the average */
+    ++w->n;
+  }
+
+  float v = (float)(bps > 0.0 ? bps : 0.0);
+  w->ring[slot] = v;
+  ++w->hist[bucket_of(v)];
+  w->ewma += alpha * (bps - w->ewma);
+
+  while (w->max_n && w->ring[w->dq_max[wrap(w, w->max_h + w->max_n - 1u)]] <= v)
+    --w->max_n;
+  w->dq_max[wrap(w, w->max_h + w->max_n++)] = (uint16_t)slot;
+  while (w->min_n && w->ring[w->dq_min[wrap(w, w->min_h + w->min_n - 1u)]] >= v)
+    --w->min_n;
+  w->dq_min[wrap(w, w->min_h + w->min_n++)] = (uint16_t)slot;
+
+  w->head = wrap(w, slot + 1u);
+}
+
+double rate_window_max(const RateWindow *w) {
+  return w->max_n ? w->ring[w->dq_max[w->max_h]] : 0.0;
+}
+
+double rate_window_min(const RateWindow *w) {
+  return w->min_n ? w->ring[w->dq_min[w->min_h]] : 0.0;
+}
+
+/* Nearest-rank percentile from the histogram, clamped to [min, max]:
+ * cost depends on RS_BUCKETS only, never on the window length. */
+double rate_window_pct(const RateWindow *w, unsigned pct) {
+  if (!w->n)
+    return 0.0;
+  uint32_t rank = (uint32_t)(((uint64_t)w->n * pct + 99u) / 100u);
+  if (rank < 1u)
+    rank = 1u;
+  uint32_t seen = 0u, b = 0u;
+  for (; b < RS_BUCKETS - 1u; ++b)
+    if ((seen += w->hist[b]) >= rank)
+      break;
+  double v = bucket_mid(b), lo = rate_window_min(w), hi = rate_window_max(w);
+  return v < lo ? lo : v > hi ? hi : v;
+}
+
+/* Last `width` samples as "▁▂▃▄▅▆▇█", scaled to the window peak.
+ * dst needs 3 * width bytes; returns bytes written. */
+size_t rate_window_spark(const RateWindow *w, char *dst, size_t width) {
+  static const char GLYPH[8][4] = {"▁", "▂", "▃", "▄", "▅", "▆", "▇", "█"};
+  size_t k = w->n < width ? w->n : width;
+  double peak = rate_window_max(w);
+  uint32_t i = wrap(w, w->head + w->cap - (uint32_t)k);
+  for (size_t j = 0; j < k; ++j, i = wrap(w, i + 1u)) {
+    unsigned lvl = peak > 0.0 ? (unsigned)(w->ring[i] / peak * 7.0 + 0.5) : 0u;
+    memcpy(dst + 3u * j, GLYPH[lvl > 7u ? 7u : lvl], 3);
+  }
+  return 3u * k;
+}
+
+/* Copy the newest min(k, n) samples to dst, oldest first. */
+size_t rate_window_tail(const RateWindow *w, float *dst, size_t k) {
+  k = w->n < k ? w->n : k;
+  uint32_t i = wrap(w, w->head + w->cap - (uint32_t)k);
+  size_t first = w->cap - i < k ? w->cap - i : k; /* up to the ring end */
+  memcpy(dst, w->ring + i, first * sizeof *dst);
+  memcpy(dst + first, w->ring, (k - first) * sizeof *dst);
+  return k;
+}
+
+/* Smoothing factor for a sample dt seconds after the previous one: the
+ * weight of old data halves every half_life seconds, whatever the tick. */
+double ewma_alpha(double dt_s, double half_life_s) {
+  if (half_life_s <= 0.0 || dt_s <= 0.0)
+    return 1.0;
+  return 1.0 - exp2(-dt_s / half_life_s);
+}
+
+/* --------------------------------------------------------------------- */
+/* rx/tx pair owned by an Iface.                                         */
+RateWindow *rate_stats_new(uint32_t cap) {
+  RateWindow *rs = calloc(2u, sizeof *rs);
+  if (!rs)
+    return NULL;
+  if (!rate_window_init(&rs[0], cap) || !rate_window_init(&rs[1], cap)) {
+    rate_stats_free(rs);
+    return NULL;
+  }
+  return rs;
+}
+
+void rate_stats_free(RateWindow *rs) {
+  if (!rs)
+    return;
+  rate_window_free(&rs[0]);
+  rate_window_free(&rs[1]);
+  free(rs);
+}
@@ -0,0 +1,389 @@
+/*
+ * Compact binary sample log for --record / --replay.
+ *
+ * A log is a sequence of sessions, one per recording run (appends start
+ * a new one).  Every record begins with a tag byte:
+ *
+ *   'B' "W3R" ver varint(refresh_ms)           session header
+ *   'L' varint(id) varint(ifindex) u8(wifi)    link definition (or
+ *       u8(len) name                           re-definition)
+ *   'T' varint(dt_ns) varint(count)            one tick, dt against the
+ *       count × { varint(id) u8(state)         previous tick (absolute
+ *                 zigzag(drx) zigzag(dtx) }    for the first one)
+ *
+ * Counters are zigzag deltas against the last value logged for the
+ * link, so a steady link costs a few bytes per tick and a counter reset
+ * is just a negative delta.  Ids are session-local.  A torn tail (crash
+ * mid-write) reads as the end of the log, and the next recording cuts it
+ * off before appending its session.
+ */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define REC_VERSION 1u
+#define REC_FLUSH_BYTES 65536u            /* write() once this much is buffered */
+#define REC_FLUSH_NS 1000000000ull        /* ... or this long after the last one */
+#define REC_SYNC_NS (30ull * 1000000000ull) /* fdatasync() batching          */
+
+/* --------------------------------------------------------------------- */
+/* Encoding                                                              */
+static void put_u8(OutBuf *o, unsigned v) {
+  char c = (char)v;
+  out_put(o, &c, 1);
+}
+
+static void put_varint(OutBuf *o, uint64_t v) {
+  char b[10];
+  size_t n = 0;
+  while (v >= 0x80u) {
+    b[n++] = (char)(v | 0x80u);
+    v >>= 7;
+  }
+  b[n++] = (char)v;
+  out_put(o, b, n);
+}
+
+static uint64_t zigzag(uint64_t now, uint64_t base) {
+  int64_t d = (int64_t)(now - base); /* two's complement: wraps cleanly */
+  return ((uint64_t)d << 1) ^ (uint64_t)(d >> 63);
+}
+
+static uint64_t unzigzag(uint64_t z) { return (z >> 1) ^ (0u - (z & 1u)); }
+
+static bool grow_links(RecLink **v, uint32_t *cap, uint32_t need) {
+  if (need <= *cap)
+    return true;
+  uint32_t c = *cap ? *cap * 2u : 16u;
+  while (c < need)
+    c *= 2u;
+  RecLink *nv = realloc(*v, c * sizeof *nv);
+  if (!nv)
+    return false;
+  *v = nv;
+  *cap = c;
+  return true;
+}
+
+static size_t log_end(const unsigned char *map, size_t len);
+
+/* --------------------------------------------------------------------- */
+/* Writer.  Appends go to a buffer; write() happens every REC_FLUSH_NS   */
+/* or REC_FLUSH_BYTES, fdatasync() every REC_SYNC_NS – a tick costs no   */
+/* syscall at all most of the time.                                     */
+/* Cut a torn tail off an existing log, so the new session's header
+ * does not continue a half-written record; false if fd holds something
+ * that is not a sample log. */
+static bool trim_log(int fd) {
+  struct stat st;
+  if (fstat(fd, &st) < 0)
+    return false;
+  size_t len = (size_t)st.st_size;
+  if (!len)
+    return true;
+  void *m = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (m == MAP_FAILED)
+    return false;
+  size_t end = log_end(m, len);
+  bool log = end || memcmp(m, "BW3R", len < 4u ? len : 4u) == 0;
+  munmap(m, len);
+  if (!log) {
+    errno = EINVAL;
+    return false;
+  }
+  return end == len || ftruncate(fd, (off_t)end) == 0;
+}
+
+bool rec_open(Recorder *r, const char *path, unsigned refresh_ms) {
+  memset(r, 0, sizeof *r);
+  r->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  if (r->fd < 0)
+    return false;
+  if (!trim_log(r->fd)) {
+    int err = errno;
+    close(r->fd);
+    r->fd = -1;
+    errno = err;
+    return false;
+  }
+  out_put(&r->buf, "BW3R", 4);
+  put_u8(&r->buf, REC_VERSION);
+  put_varint(&r->buf, refresh_ms);
+  if (!r->buf.buf) {
+    rec_close(r);
+    errno = ENOMEM;
+    return false;
+  }
+  r->flush_ns = r->sync_ns = mono_ns();
+  return true;
+}
+
+static void put_link(Recorder *r, uint32_t id, const Iface *n) {
+  RecLink *l = &r->links[id];
+  l->ifindex = n->ifindex;
+  l->wifi = n->wifi;
+  size_t len = strnlen(n->name, sizeof n->name - 1);
+  put_u8(&r->buf, 'L');
+  put_varint(&r->buf, id);
+  put_varint(&r->buf, (uint64_t)(n->ifindex > 0 ? n->ifindex : 0));
+  put_u8(&r->buf, n->wifi);
+  put_u8(&r->buf, (unsigned)len);
+  out_put(&r->buf, n->name, len);
+}
+
+/* Log every shown adapter present in snapshot generation gen. */
+bool rec_tick(Recorder *r, IfaceTable *t, uint32_t gen, uint64_t ts_ns) {
+  size_t count = 0;
+  for (size_t i = 0; i < t->n; ++i) {
+    Iface *n = &t->v[i];
+    if (n->ignored || n->seen != gen)
+      continue;
+    ++count;
+    if (!n->rec_id) {
+      if (!grow_links(&r->links, &r->cap_links, r->n_links + 1u))
+        return false;
+      r->links[r->n_links] = (RecLink){0};
+      n->rec_id = ++r->n_links;
+      put_link(r, n->rec_id - 1u, n);
+    } else if (r->links[n->rec_id - 1u].ifindex != n->ifindex ||
+               r->links[n->rec_id - 1u].wifi != n->wifi) {
+      put_link(r, n->rec_id - 1u, n); /* link re-created */
+    }
+  }
+
+  put_u8(&r->buf, 'T');
+  put_varint(&r->buf, ts_ns - r->last_ns);
+  put_varint(&r->buf, count);
+  r->last_ns = ts_ns;
+  for (size_t i = 0; i < t->n; ++i) {
+    const Iface *n = &t->v[i];
+    if (n->ignored || n->seen != gen)
+      continue;
+    RecLink *l = &r->links[n->rec_id - 1u];
+    put_varint(&r->buf, n->rec_id - 1u);
+    put_u8(&r->buf, (unsigned)n->state);
+    put_varint(&r->buf, zigzag(n->prev.rx_bytes, l->rx));
+    put_varint(&r->buf, zigzag(n->prev.tx_bytes, l->tx));
+    l->rx = n->prev.rx_bytes;
+    l->tx = n->prev.tx_bytes;
+  }
+
+  if (r->buf.len >= REC_FLUSH_BYTES || ts_ns - r->flush_ns >= REC_FLUSH_NS)
+    return rec_flush(r, ts_ns - r->sync_ns >= REC_SYNC_NS);
+  return true;
+}
+
+/* Write out the buffer; with sync, make it durable as well. */
+bool rec_flush(Recorder *r, bool sync) {
+  size_t off = 0;
+  while (off < r->buf.len) {
+    SELF_CALL(SC_WRITE);
+    ssize_t w = write(r->fd, r->buf.buf + off, r->buf.len - off);
+    if (w < 0 && errno == EINTR)
+      continue;
+    if (w <= 0)
+      return false;
+    off += (size_t)w;
+  }
+  r->buf.len = 0;
+  r->flush_ns = mono_ns();
+  if (sync) {
+    SELF_CALL(SC_OTHER);
+    if (fdatasync(r->fd) < 0)
+      return false;
+    r->sync_ns = r->flush_ns;
+  }
+  return true;
+}
+
+void rec_close(Recorder *r) {
+  if (r->fd >= 0) {
+    rec_flush(r, true);
+    close(r->fd);
+  }
+  out_free(&r->buf);
+  free(r->links);
+  memset(r, 0, sizeof *r);
+  r->fd = -1;
+}
+
+/* --------------------------------------------------------------------- */
+/* Reader: the whole log is mapped and decoded in place.                 */
+static bool get_u8(Replay *r, unsigned *v) {
+  if (r->off >= r->len)
+    return false;
+  *v = r->map[r->off++];
+  return true;
+}
+
+static bool get_varint(Replay *r, uint64_t *v) {
+  uint64_t x = 0;
+  for (unsigned shift = 0; shift < 64u; shift += 7u) {
+    if (r->off >= r->len)
+      return false;
+    unsigned char b = r->map[r->off++];
+    x |= (uint64_t)(b & 0x7Fu) << shift;
+    if (!(b & 0x80u)) {
+      *v = x;
+      return true;
+    }
+  }
+  return false; /* over-long: corrupt */
+}
+
+static bool get_session(Replay *r) {
+  uint64_t refresh;
+  unsigned ver;
+  if (r->len - r->off < 3u || memcmp(r->map + r->off, "W3R", 3) != 0)
+    return false;
+  r->off += 3u;
+  if (!get_u8(r, &ver) || ver != REC_VERSION || !get_varint(r, &refresh))
+    return false;
+  r->refresh_ms = (unsigned)refresh;
+  r->n_links = 0;
+  r->ts_ns = 0;
+  r->session = true;
+  return true;
+}
+
+static bool get_link(Replay *r) {
+  uint64_t id, ifindex;
+  unsigned wifi, len;
+  if (!get_varint(r, &id) || id > r->n_links || !get_varint(r, &ifindex) ||
+      !get_u8(r, &wifi) || !get_u8(r, &len) || len >= IFACE_NAME_MAX ||
+      r->len - r->off < len)
+    return false;
+  if (id == r->n_links) {
+    if (!grow_links(&r->links, &r->cap_links, r->n_links + 1u))
+      return false;
+    r->links[r->n_links++] = (RecLink){0};
+  }
+  RecLink *l = &r->links[id];
+  memcpy(l->name, r->map + r->off, len);
+  l->name[len] = '\0';
+  l->ifindex = (int)ifindex;
+  l->wifi = wifi != 0u;
+  r->off += len;
+  return true;
+}
+
+static bool get_tick(Replay *r) {
+  uint64_t dt, count;
+  if (!get_varint(r, &dt) || !get_varint(r, &count) || count > r->len)
+    return false;
+  if (count > r->cap_ent) {
+    RecEntry *v = realloc(r->ent, count * sizeof *v);
+    if (!v)
+      return false;
+    r->ent = v;
+    r->cap_ent = count;
+  }
+  uint64_t ts = r->ts_ns + dt;
+  for (size_t i = 0; i < count; ++i) {
+    uint64_t id, drx, dtx;
+    unsigned state;
+    if (!get_varint(r, &id) || id >= r->n_links || !get_u8(r, &state) ||
+        !get_varint(r, &drx) || !get_varint(r, &dtx))
+      return false;
+    RecLink *l = &r->links[id];
+    l->rx += unzigzag(drx);
+    l->tx += unzigzag(dtx);
+    r->ent[i] = (RecEntry){.link = (uint32_t)id,
+                           .state = (uint8_t)(state < IFSTATE_COUNT
+                                                  ? state
+                                                  : IFSTATE_ERR),
+                           .stats = {l->rx, l->tx, ts}};
+  }
+  r->n_ent = count;
+  r->ts_ns = ts;
+  return true;
+}
+
+bool replay_open(Replay *r, const char *path) {
+  memset(r, 0, sizeof *r);
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(fd, &st) < 0 || st.st_size < 5) {
+    close(fd);
+    errno = EINVAL;
+    return false;
+  }
+  void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (m == MAP_FAILED)
+    return false;
+  r->map = m;
+  r->len = (size_t)st.st_size;
+  r->off = 1u; /* peek at the first session for its refresh */
+  if (r->map[0] != 'B' || !get_session(r)) {
+    replay_close(r);
+    errno = EINVAL;
+    return false;
+  }
+  r->off = 0u;
+  return true;
+}
+
+/* Length of the complete records at the start of a log: where a torn or
+ * damaged tail begins, len when there is none. */
+static size_t log_end(const unsigned char *map, size_t len) {
+  Replay r = {.map = map, .len = len};
+  size_t end = 0;
+  unsigned tag;
+  while (get_u8(&r, &tag)) {
+    bool ok = tag == 'B'   ? get_session(&r)
+              : tag == 'L' ? end && get_link(&r)
+              : tag == 'T' ? end && get_tick(&r)
+                           : false;
+    if (!ok)
+      break;
+    end = r.off;
+  }
+  free(r.links);
+  free(r.ent);
+  return end;
+}
+
+/* Decode up to and including the next tick; false at the end of the log
+ * or at the first damaged record. */
+bool replay_next(Replay *r) {
+  r->session = false;
+  unsigned tag;
+  while (get_u8(r, &tag)) {
+    bool ok;
+    switch (tag) {
+    case 'B':
+      ok = get_session(r);
+      break;
+    case 'L':
+      ok = get_link(r);
+      break;
+    case 'T':
+      if (get_tick(r))
+        return true;
+      ok = false;
+      break;
+    default:
+      ok = false;
+    }
+    if (!ok)
+      break;
+  }
+  r->off = r->len;
+  return false;
+}
+
+void replay_close(Replay *r) {
+  if (r->map)
+    munmap((void *)r->map, r->len);
+  free(r->links);
+  free(r->ent);
+  memset(r, 0, sizeof *r);
+}
@@ -0,0 +1,235 @@
+/*
+ * libbandwidth3: the sampling core behind the public C API in
+ * include/libbandwidth3.h.
+ *
+ * One bw3_sample() is the per-adapter part of a bandwidth3 polling tick
+ * – one snapshot read, a hash lookup per link, link state from the dump
+ * or one batched sysfs read, cached Wi-Fi details – without what the
+ * program layers on top (windows, alerts, groups, bar protocols).  All
+ * buffers are sized by bw3_sampler_new() and its first snapshot; later
+ * calls only grow them for an adapter never seen before.
+ */
+#include "bandwidth3.h"
+#include "../include/libbandwidth3.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(BW3_NAME_MAX == IFACE_NAME_MAX, "Bw3Iface.name");
+_Static_assert(BW3_SSID_MAX == IW_ESSID_MAX_SIZE + 1, "Bw3Iface.ssid");
+_Static_assert(BW3_DISABLED == (int)IFSTATE_DISABLED &&
+                   BW3_CONNECTED == (int)IFSTATE_CONNECTED &&
+                   BW3_ERR == (int)IFSTATE_ERR,
+               "Bw3State mirrors IfState");
+
+struct Bw3Sampler {
+  IfaceFilter filter;
+  IfaceTable tab;    /* every link seen; filtered ones are "ignored" */
+  NetSnapshot snap;
+  SysfsBatch sysfs;  /* states /proc/net/dev does not carry          */
+  Nl80211 nl;        /* opened on the first associated Wi-Fi link    */
+  bool wifi;         /* Bw3Config.wifi                               */
+  uint32_t gen;      /* snapshot generation, for hot-unplug detection */
+  Formatter fmt;
+  RenderOpts ro;
+  OutBuf out;        /* bw3_format() line, sized for the longest one */
+};
+
+/* Longest plain-text line render_iface() can produce for t. */
+static size_t render_bound(const Template *t) {
+  size_t len = 1u;
+  for (size_t i = 0; i < t->n_ops; ++i) {
+    const FmtOp *op = &t->ops[i];
+    len += op->kind == FOP_LIT ? op->len
+                               : 1u + (op->kind == FOP_TOP ? FMT_TOP_MAX
+                                                           : FMT_FIELD_MAX);
+  }
+  return len;
+}
+
+static bool build_filter(IfaceFilter *f, const Bw3Config *cfg) {
+  return iface_filter_add(f, cfg->interfaces ? cfg->interfaces : "*", false) &&
+         (!cfg->exclude || iface_filter_add(f, cfg->exclude, true)) &&
+         (cfg->interfaces || iface_filter_add(f, "lo", true));
+}
+
+static bool build_formatter(Bw3Sampler *s, const Bw3Config *cfg) {
+  char err[128];
+  char *spec = cfg->format ? strdup(cfg->format) : NULL;
+  if (cfg->format && !spec)
+    return false;
+  bool ok = formatter_init(&s->fmt, &spec, spec ? 1u : 0u, err, sizeof err);
+  free(spec);
+  if (!ok) {
+    errno = EINVAL;
+    return false;
+  }
+  size_t max = 0;
+  for (size_t i = 0; i < s->fmt.n_rules; ++i) {
+    size_t len = render_bound(&s->fmt.rules[i].tpl);
+    max = len > max ? len : max;
+  }
+  return out_reserve(&s->out, max);
+}
+
+Bw3Sampler *bw3_sampler_new(const Bw3Config *cfg) {
+  static const Bw3Config DEFAULTS = {0};
+  if (!cfg)
+    cfg = &DEFAULTS;
+  Bw3Sampler *s = calloc(1, sizeof *s);
+  if (!s)
+    return NULL;
+  s->snap.fd = -1;
+  s->nl = (Nl80211){.fd = -1, .ev_fd = -1};
+  s->wifi = cfg->wifi;
+  s->ro = (RenderOpts){.unit = cfg->bits ? 'b' : 'B',
+                       .divisor = cfg->si ? 1000u : 1024u};
+  sysfs_batch_open(&s->sysfs, true); /* pread when io_uring is not there */
+  errno = 0;
+  if (!build_filter(&s->filter, cfg)) {
+    if (!errno)
+      errno = EINVAL;
+    goto fail;
+  }
+  if (!build_formatter(s, cfg))
+    goto fail;
+  if (cfg->netlink && !(net_snapshot_init(&s->snap, BACKEND_NETLINK) &&
+                        net_snapshot_read(&s->snap)))
+    net_snapshot_free(&s->snap);
+  if (s->snap.fd < 0 && !net_snapshot_init(&s->snap, BACKEND_PROCFS))
+    goto fail;
+  /* baseline, then one pass as every later one: sizes every buffer */
+  if (bw3_sample(s, NULL, 0) < 0 || bw3_sample(s, NULL, 0) < 0)
+    goto fail;
+  return s;
+fail:;
+  int err = errno;
+  bw3_sampler_free(s);
+  errno = err;
+  return NULL;
+}
+
+/* A new or re-created link: kind, filter verdict and a primed counter
+ * baseline, so its first rate is a real delta rather than a spike.  An
+ * ignored link keeps its ifindex too: the netlink dump re-probes a link
+ * only when that changes, i.e. when it is re-created. */
+static void attach_link(Bw3Sampler *s, Iface *n, const SnapEntry *e) {
+  n->wifi = is_wireless(n->name);
+  n->ignored = !iface_filter_match(&s->filter, n->name);
+  iftab_set_index(&s->tab, n, e->ifindex ? e->ifindex : iface_index(n->name));
+  if (n->ignored)
+    return;
+  n->prev = e->stats;
+  n->rx_rate = n->tx_rate = 0.0;
+  n->wl_stamp_ms = 0;
+  sysfs_forget(n); /* re-created link: new sysfs directory */
+  n->state = iface_link_state(n, e);
+  formatter_layout(&s->fmt, n->name, n->wifi, n->layout);
+}
+
+static bool still_present(const Iface *n, void *ctx) {
+  const Bw3Sampler *s = ctx;
+  return n->seen == s->gen;
+}
+
+static void export_link(Bw3Iface *out, const Iface *n) {
+  memcpy(out->name, n->name, sizeof out->name);
+  out->ifindex = n->ifindex;
+  out->state = (Bw3State)n->state;
+  out->wifi = n->wifi;
+  out->rx_bytes = n->prev.rx_bytes;
+  out->tx_bytes = n->prev.tx_bytes;
+  out->rx_rate = n->rx_rate;
+  out->tx_rate = n->tx_rate;
+  memcpy(out->ssid, n->wl.ssid, sizeof out->ssid);
+  out->signal_dbm = n->wl.signal_dbm;
+  out->tx_bitrate = n->wl.tx_bitrate;
+  out->rx_bitrate = n->wl.rx_bitrate;
+}
+
+int bw3_sample(Bw3Sampler *s, Bw3Iface *out, size_t cap) {
+  if (!net_snapshot_read(&s->snap))
+    return -1;
+  ++s->gen;
+  uint64_t now = mono_ms();
+  for (size_t i = 0; i < s->snap.n; ++i) {
+    const SnapEntry *e = &s->snap.ent[i];
+    Iface *n = iftab_find(&s->tab, e->name);
+    bool fresh = !n || !n->seen || n->seen + 1u != s->gen ||
+                 (e->ifindex && e->ifindex != n->ifindex);
+    if (!n && !(n = iftab_add(&s->tab, e->name)))
+      continue;
+    n->seen = s->gen;
+    if (fresh) {
+      attach_link(s, n, e);
+      continue;
+    }
+    if (n->ignored)
+      continue;
+    if (e->has_link)
+      n->state = iface_link_state(n, e);
+    else
+      sysfs_batch_queue(&s->sysfs, (size_t)(n - s->tab.v));
+    /* divide by the measured interval, not the caller's nominal one */
+    double dt = (double)(e->stats.ts_ns - n->prev.ts_ns) / 1e9;
+    n->rx_rate = avg_rate(e->stats.rx_bytes, n->prev.rx_bytes, dt);
+    n->tx_rate = avg_rate(e->stats.tx_bytes, n->prev.tx_bytes, dt);
+    n->prev = e->stats;
+  }
+  sysfs_batch_run(&s->sysfs, &s->tab);
+  for (size_t i = 0; i < s->sysfs.ran; ++i)
+    s->tab.v[s->sysfs.idx[i]].state = (IfState)s->sysfs.state[i];
+  iftab_prune(&s->tab, still_present, s);
+
+  int count = 0;
+  for (size_t i = 0; i < s->tab.n; ++i) {
+    Iface *n = &s->tab.v[i];
+    if (n->ignored)
+      continue;
+    if (s->wifi)
+      wifi_refresh(&s->nl, n, now);
+    if ((size_t)count < cap)
+      export_link(&out[count], n);
+    ++count;
+  }
+  return count;
+}
+
+size_t bw3_format(Bw3Sampler *s, const Bw3Iface *it, char *buf, size_t len) {
+  Iface n = {.ifindex = it->ifindex,
+             .wifi = it->wifi,
+             .state = it->state <= BW3_ERR ? (IfState)it->state : IFSTATE_ERR,
+             .rx_rate = it->rx_rate,
+             .tx_rate = it->tx_rate};
+  memcpy(n.name, it->name, sizeof n.name);
+  n.name[sizeof n.name - 1u] = '\0';
+  memcpy(n.wl.ssid, it->ssid, sizeof n.wl.ssid);
+  n.wl.ssid[sizeof n.wl.ssid - 1u] = '\0';
+  n.wl.signal_dbm = (int8_t)it->signal_dbm;
+  n.wl.tx_bitrate = it->tx_bitrate;
+  n.wl.rx_bitrate = it->rx_bitrate;
+  formatter_layout(&s->fmt, n.name, n.wifi, n.layout);
+
+  s->out.len = 0;
+  if (!render_iface(&s->out, n.layout[n.state], &n, &s->ro))
+    s->out.len = 0;
+  if (len) {
+    size_t k = s->out.len < len ? s->out.len : len - 1u;
+    memcpy(buf, s->out.buf, k);
+    buf[k] = '\0';
+  }
+  return s->out.len;
+}
+
+void bw3_sampler_free(Bw3Sampler *s) {
+  if (!s)
+    return;
+  iface_filter_free(&s->filter);
+  iftab_free(&s->tab);
+  net_snapshot_free(&s->snap);
+  sysfs_batch_close(&s->sysfs);
+  nl80211_close(&s->nl);
+  formatter_free(&s->fmt);
+  out_free(&s->out);
+  free(s);
+}
@@ -0,0 +1,129 @@
+/*
+ * Self-instrumentation (--self-stats): how long each phase of a tick
+ * takes, as log2-bucketed latency histograms, and how many syscalls a
+ * tick issues, counted at the call sites by kind.  A report goes to
+ * stderr every --self-stats=T and on SIGUSR1.
+ *
+ * Built with SELF_STATS=0 the hooks are empty macros.  Built in but not
+ * enabled, each hook is a load of self_stats.on and a branch hinted not
+ * taken: no clock read, no counter store.
+ */
+#include "bandwidth3.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+SelfStats self_stats;
+
+static const char *const PHASE_NAME[PH_COUNT] = {
+    [PH_COUNTERS] = "counters", [PH_LINKS] = "links", [PH_STATE] = "state",
+    [PH_WIFI] = "wifi",         [PH_TOP] = "top",     [PH_QDISC] = "qdisc",
+    [PH_OUTPUT] = "output",     [PH_TICK] = "tick",   [PH_SAMPLE] = "sample"};
+
+static const char *const CALL_NAME[SC_COUNT] = {
+    [SC_OPEN] = "open", [SC_READ] = "read", [SC_WRITE] = "write",
+    [SC_IOCTL] = "ioctl", [SC_OTHER] = "other"};
+
+void self_enable(SelfStats *s) {
+  memset(s, 0, sizeof *s);
+  s->on = true;
+  s->since_ns = mono_ns();
+}
+
+/* Bucket i holds [2^(i-1), 2^i) ns; bucket 0 only 0 ns. */
+unsigned self_bucket(uint64_t ns) {
+  unsigned b = ns ? 64u - (unsigned)__builtin_clzll(ns) : 0u;
+  return b < SELF_BUCKETS ? b : SELF_BUCKETS - 1u;
+}
+
+void self_record(SelfStats *s, SelfPhase p, uint64_t ns) {
+  ++s->hist[p][self_bucket(ns)];
+  ++s->n[p];
+  s->sum_ns[p] += ns;
+  if (ns > s->max_ns[p])
+    s->max_ns[p] = ns;
+}
+
+void self_phase(SelfPhase p, uint64_t t0) {
+  self_record(&self_stats, p, mono_ns() - t0);
+}
+
+uint64_t self_tick_start(void) {
+  memcpy(self_stats.tick_calls, self_stats.calls, sizeof self_stats.calls);
+  return mono_ns();
+}
+
+/* Close a tick: its latency and the syscalls issued since the start. */
+void self_tick_end(uint64_t t0) {
+  SelfStats *s = &self_stats;
+  self_phase(PH_TICK, t0);
+  for (int k = 0; k < SC_COUNT; ++k) {
+    uint64_t d = s->calls[k] - s->tick_calls[k];
+    s->tick_sum[k] += d;
+    if (d > s->max_calls[k])
+      s->max_calls[k] = d;
+  }
+}
+
+/* Upper bound of the bucket holding the pct-th percentile (never above
+ * the maximum seen); 0 if empty. */
+uint64_t self_percentile(const SelfStats *s, SelfPhase p, unsigned pct) {
+  uint64_t want = (s->n[p] * pct + 99u) / 100u, seen = 0;
+  for (unsigned b = 0; b < SELF_BUCKETS && want; ++b) {
+    if ((seen += s->hist[p][b]) < want)
+      continue;
+    uint64_t top = b ? 1ull << b : 0u;
+    return top < s->max_ns[p] ? top : s->max_ns[p];
+  }
+  return s->max_ns[p];
+}
+
+static const char *dur(char *buf, size_t len, uint64_t ns) {
+  if (ns < 10000u)
+    snprintf(buf, len, "%" PRIu64 "ns", ns);
+  else if (ns < 10000000u)
+    snprintf(buf, len, "%.1fus", (double)ns / 1e3);
+  else if (ns < 10000000000ull)
+    snprintf(buf, len, "%.1fms", (double)ns / 1e6);
+  else
+    snprintf(buf, len, "%.1fs", (double)ns / 1e9);
+  return buf;
+}
+
+static double tv_s(struct timeval tv) {
+  return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
+}
+
+/* Everything so far, on stderr: CPU use, phase latencies (p50/p99 are
+ * bucket upper bounds) and syscalls per tick. */
+void self_report(const SelfStats *s) {
+  struct rusage ru;
+  getrusage(RUSAGE_SELF, &ru);
+  double wall = (double)(mono_ns() - s->since_ns) / 1e9;
+  double cpu = tv_s(ru.ru_utime) + tv_s(ru.ru_stime);
+  fprintf(stderr,
+          "bandwidth3 self-stats: %" PRIu64 " ticks in %.1f s, cpu %.3f s"
+          " user %.3f s sys (%.3f%%)\n",
+          s->n[PH_TICK], wall, tv_s(ru.ru_utime), tv_s(ru.ru_stime),
+          wall > 0.0 ? cpu * 100.0 / wall : 0.0);
+  fprintf(stderr, "  %-9s %10s %9s %9s %9s %9s\n", "phase", "count", "avg",
+          "p50", "p99", "max");
+  for (int p = 0; p < PH_COUNT; ++p) {
+    if (!s->n[p])
+      continue;
+    char b[4][16];
+    fprintf(stderr, "  %-9s %10" PRIu64 " %9s %9s %9s %9s\n", PHASE_NAME[p],
+            s->n[p], dur(b[0], sizeof b[0], s->sum_ns[p] / s->n[p]),
+            dur(b[1], sizeof b[1], self_percentile(s, (SelfPhase)p, 50u)),
+            dur(b[2], sizeof b[2], self_percentile(s, (SelfPhase)p, 99u)),
+            dur(b[3], sizeof b[3], s->max_ns[p]));
+  }
+  uint64_t ticks = s->n[PH_TICK];
+  fputs("  syscalls/tick", stderr);
+  for (int k = 0; k < SC_COUNT; ++k)
+    fprintf(stderr, "  %s %.2f (max %" PRIu64 ")", CALL_NAME[k],
+            ticks ? (double)s->tick_sum[k] / (double)ticks : 0.0,
+            s->max_calls[k]);
+  fputc('\n', stderr);
+}
@@ -0,0 +1,227 @@
+/*
+ * Shared-memory publication of the sampler state: one --daemon writes
+ * every tick under a seqlock, any number of --attach readers copy it out
+ * of the mapping without a single syscall on the read path.
+ */
+#include "bandwidth3.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SHM_MAGIC 0x62773373u /* "bw3s" */
+#define SHM_MIN_SLOTS 16u
+#define SHM_READ_TRIES 1000
+
+typedef struct {
+    uint32_t magic;
+    uint32_t slot_size;    /* sizeof(ShmIface): layout check         */
+    _Atomic uint32_t seq;  /* seqlock: odd while the sampler writes  */
+    uint32_t cap, n;       /* ShmIface slots mapped / in use         */
+    uint32_t refresh_ms;
+    uint64_t ticks;        /* sampling passes so far                 */
+    uint64_t stamp_ns;     /* CLOCK_MONOTONIC of the last one        */
+    int32_t pid;
+    uint32_t pad;
+    ShmIface ifs[];
+} ShmHeader;
+
+static size_t seg_size(uint32_t cap) {
+  return sizeof(ShmHeader) + (size_t)cap * sizeof(ShmIface);
+}
+
+void shm_default_name(char *dst, size_t cap) {
+  snprintf(dst, cap, "/bandwidth3-%u", (unsigned)getuid());
+}
+
+static bool map_seg(ShmSeg *s, size_t len, int prot) {
+  void *m = mmap(NULL, len, prot, MAP_SHARED, s->fd, 0);
+  if (m == MAP_FAILED)
+    return false;
+  if (s->map)
+    munmap(s->map, s->map_len);
+  s->map = m;
+  s->map_len = len;
+  return true;
+}
+
+/* --------------------------------------------------------------------- */
+/* Writer side.  An exclusive flock() keeps a second daemon out; it is   */
+/* released by the kernel when the sampler dies.                        */
+bool shm_create(ShmSeg *s, const char *name) {
+  memset(s, 0, sizeof *s);
+  snprintf(s->name, sizeof s->name, "%s", name);
+  s->fd = shm_open(s->name, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (s->fd < 0)
+    return false;
+  /* reuse a segment left by a previous sampler: readers stay attached,
+   * and it must never shrink under their mappings */
+  struct stat st;
+  uint32_t cap = SHM_MIN_SLOTS;
+  if (flock(s->fd, LOCK_EX | LOCK_NB) < 0 || fstat(s->fd, &st) < 0) {
+    shm_close(s);
+    return false;
+  }
+  while (seg_size(cap) < (size_t)st.st_size && cap < UINT32_MAX / 2u)
+    cap *= 2u;
+  if (ftruncate(s->fd, (off_t)seg_size(cap)) < 0 ||
+      !map_seg(s, seg_size(cap), PROT_READ | PROT_WRITE)) {
+    shm_close(s);
+    return false;
+  }
+  ShmHeader *h = s->map;
+  atomic_store_explicit(&h->seq, 0u, memory_order_relaxed);
+  h->n = 0;
+  h->ticks = 0;
+  h->cap = cap;
+  h->slot_size = sizeof(ShmIface);
+  h->pid = (int32_t)getpid();
+  atomic_thread_fence(memory_order_release);
+  h->magic = SHM_MAGIC;
+  return true;
+}
+
+/* Grow the object (never shrinks: readers may still map the old size). */
+static bool reserve_slots(ShmSeg *s, uint32_t need) {
+  ShmHeader *h = s->map;
+  if (need <= h->cap)
+    return true;
+  uint32_t cap = h->cap;
+  while (cap < need)
+    cap *= 2u;
+  if (ftruncate(s->fd, (off_t)seg_size(cap)) < 0 ||
+      !map_seg(s, seg_size(cap), PROT_READ | PROT_WRITE))
+    return false;
+  h = s->map;
+  h->cap = cap;
+  return true;
+}
+
+/* Publish every visible adapter plus its recent rate history. */
+bool shm_publish(ShmSeg *s, const IfaceTable *t, uint64_t ticks,
+                 unsigned refresh_ms) {
+  uint32_t n = 0;
+  for (size_t i = 0; i < t->n; ++i)
+    n += !t->v[i].ignored;
+  if (!reserve_slots(s, n))
+    return false;
+
+  ShmHeader *h = s->map;
+  uint32_t seq = atomic_load_explicit(&h->seq, memory_order_relaxed);
+  atomic_store_explicit(&h->seq, seq + 1u, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+
+  ShmIface *d = h->ifs;
+  for (size_t i = 0; i < t->n; ++i) {
+    const Iface *src = &t->v[i];
+    if (src->ignored)
+      continue;
+    memcpy(d->name, src->name, sizeof d->name);
+    d->ifindex = src->ifindex;
+    d->state = (uint8_t)src->state;
+    d->wifi = src->wifi;
+    d->wl = src->wl;
+    d->rx_bytes = src->prev.rx_bytes;
+    d->tx_bytes = src->prev.tx_bytes;
+    d->rx_rate = src->rx_rate;
+    d->tx_rate = src->tx_rate;
+    d->hist_n = src->rs ? (uint16_t)rate_window_tail(&src->rs[0], d->hist_rx,
+                                                     SHM_HIST)
+                        : 0u;
+    if (src->rs)
+      rate_window_tail(&src->rs[1], d->hist_tx, SHM_HIST);
+    ++d;
+  }
+  h->n = n;
+  h->refresh_ms = refresh_ms;
+  h->stamp_ns = mono_ns();
+  h->ticks = ticks;
+
+  atomic_store_explicit(&h->seq, seq + 2u, memory_order_release);
+  return true;
+}
+
+/* --------------------------------------------------------------------- */
+/* Reader side.                                                          */
+bool shm_attach(ShmSeg *s, const char *name) {
+  memset(s, 0, sizeof *s);
+  snprintf(s->name, sizeof s->name, "%s", name);
+  s->fd = shm_open(s->name, O_RDONLY | O_CLOEXEC, 0);
+  if (s->fd < 0)
+    return false;
+  struct stat st;
+  if (fstat(s->fd, &st) < 0 || (size_t)st.st_size < sizeof(ShmHeader) ||
+      !map_seg(s, (size_t)st.st_size, PROT_READ)) {
+    shm_close(s);
+    return false;
+  }
+  const ShmHeader *h = s->map;
+  if (h->magic != SHM_MAGIC || h->slot_size != sizeof(ShmIface)) {
+    shm_close(s);
+    return false;
+  }
+  return true;
+}
+
+/* The sampler grew the object past our mapping: the only syscalls a
+ * reader ever makes after attaching. */
+static bool remap(ShmSeg *s) {
+  struct stat st;
+  return fstat(s->fd, &st) == 0 && (size_t)st.st_size > s->map_len &&
+         map_seg(s, (size_t)st.st_size, PROT_READ);
+}
+
+/* Copy a consistent snapshot out of the mapping; NULL if the sampler
+ * kept it busy for SHM_READ_TRIES attempts.  The result stays valid
+ * until the next call. */
+const ShmIface *shm_read(ShmSeg *s, size_t *n, ShmInfo *info) {
+  if (!s->map)
+    return NULL;
+  for (int tries = 0; tries < SHM_READ_TRIES; ++tries) {
+    const ShmHeader *h = s->map;
+    uint32_t seq = atomic_load_explicit(&h->seq, memory_order_acquire);
+    if (seq & 1u)
+      continue;
+    uint32_t cnt = h->n;
+    size_t bytes = (size_t)cnt * sizeof(ShmIface);
+    if (seg_size(cnt) > s->map_len) {
+      remap(s); /* or a torn header: the retry re-checks either way */
+      continue;
+    }
+    if (bytes > s->copy_cap) {
+      void *c = realloc(s->copy, bytes);
+      if (!c)
+        return NULL;
+      s->copy = c;
+      s->copy_cap = bytes;
+    }
+    ShmInfo tmp = {.ticks = h->ticks,
+                   .stamp_ns = h->stamp_ns,
+                   .refresh_ms = h->refresh_ms};
+    memcpy(s->copy, h->ifs, bytes);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&h->seq, memory_order_relaxed) != seq)
+      continue;
+    *n = cnt;
+    *info = tmp;
+    return s->copy;
+  }
+  return NULL;
+}
+
+/* The name is left in place: a restarted sampler reuses the object and
+ * attached readers carry on without re-opening it. */
+void shm_close(ShmSeg *s) {
+  if (s->map)
+    munmap(s->map, s->map_len);
+  if (s->fd >= 0)
+    close(s->fd);
+  free(s->copy);
+  memset(s, 0, sizeof *s);
+  s->fd = -1;
+}
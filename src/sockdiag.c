@@ -0,0 +1,431 @@
+/*
+ * Top talkers from NETLINK_SOCK_DIAG: one INET_DIAG dump per family and
+ * tick yields tcpi_bytes_acked/received of every TCP socket.  The kernel
+ * does the accounting; we only diff per socket cookie, attribute flows
+ * to the adapter owning their local address and rank them per adapter.
+ */
+#include "bandwidth3.h"
+#include <arpa/inet.h>
+#include <dirent.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <linux/inet_diag.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define SD_BUF_SIZE 32768u
+#define SD_ADDR_TTL_NS (10ull * 1000000000ull) /* re-read local addresses */
+#define SD_ADDR_MISS_NS 1000000000ull /* ... or sooner on an unknown one */
+#define SD_SCAN_NS (5ull * 1000000000ull) /* /proc scans at most this often */
+
+/* TCP states worth accounting: everything with a full socket behind it
+ * (no LISTEN, no TIME_WAIT minisocks).  Bit n = kernel state n. */
+#define SD_STATES                                                           \
+  ((1u << 1) | (1u << 2) | (1u << 3) | (1u << 4) | (1u << 5) | (1u << 8) | \
+   (1u << 9) | (1u << 11)) /* ESTABLISHED … FIN_WAIT2, CLOSE_WAIT, LAST_ACK, CLOSING */
+
+/* tcp_info is versioned by length: older kernels stop before these */
+#define SD_INFO_MIN                                                         \
+  (offsetof(struct tcp_info, tcpi_bytes_received) +                        \
+   sizeof(((struct tcp_info *)0)->tcpi_bytes_received))
+
+bool sockdiag_open(SockDiag *sd) {
+  memset(sd, 0, sizeof *sd);
+  sd->fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+  if (sd->fd < 0)
+    return false;
+  if (!(sd->buf = malloc(SD_BUF_SIZE))) {
+    sockdiag_close(sd);
+    return false;
+  }
+  return true;
+}
+
+void sockdiag_close(SockDiag *sd) {
+  if (sd->fd >= 0)
+    close(sd->fd);
+  free(sd->v);
+  free(sd->slots);
+  free(sd->addrs);
+  free(sd->owners);
+  free(sd->buf);
+  memset(sd, 0, sizeof *sd);
+  sd->fd = -1;
+}
+
+/* --------------------------------------------------------------------- */
+/* Decode one inet_diag_msg carrying INET_DIAG_INFO; false if it has no  */
+/* (or a too old) tcp_info.  v4-mapped v6 sockets are reported as v4.    */
+bool sockdiag_parse(const struct nlmsghdr *nh, FlowSample *out) {
+  if (nh->nlmsg_len < NLMSG_LENGTH(sizeof(struct inet_diag_msg)))
+    return false;
+  const struct inet_diag_msg *m = NLMSG_DATA(nh);
+  memset(out, 0, sizeof *out);
+  out->cookie = (uint64_t)m->id.idiag_cookie[0] |
+                (uint64_t)m->id.idiag_cookie[1] << 32;
+  out->family = m->idiag_family;
+  out->inode = m->idiag_inode;
+  out->lport = ntohs(m->id.idiag_sport);
+  out->rport = ntohs(m->id.idiag_dport);
+  memcpy(out->laddr, m->id.idiag_src, 16);
+  memcpy(out->raddr, m->id.idiag_dst, 16);
+  static const uint8_t V4MAPPED[12] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff};
+  if (out->family == AF_INET6 && memcmp(out->laddr, V4MAPPED, 12) == 0) {
+    out->family = AF_INET;
+    memmove(out->laddr, out->laddr + 12, 4);
+    memmove(out->raddr, out->raddr + 12, 4);
+    memset(out->laddr + 4, 0, 12);
+    memset(out->raddr + 4, 0, 12);
+  }
+
+  int len = (int)(nh->nlmsg_len - NLMSG_LENGTH(sizeof *m));
+  for (const struct rtattr *rta = (const struct rtattr *)(m + 1);
+       RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+    if (rta->rta_type != INET_DIAG_INFO || RTA_PAYLOAD(rta) < SD_INFO_MIN)
+      continue;
+    struct tcp_info ti = {0}; /* payload is only 4-byte aligned */
+    size_t plen = RTA_PAYLOAD(rta);
+    memcpy(&ti, RTA_DATA(rta), plen < sizeof ti ? plen : sizeof ti);
+    out->acked = ti.tcpi_bytes_acked;
+    out->received = ti.tcpi_bytes_received;
+    return true;
+  }
+  return false;
+}
+
+/* ---------- Local address → adapter ---------------------------------- */
+static void load_addrs(SockDiag *sd, uint64_t now_ns) {
+  sd->addrs_ns = now_ns;
+  struct ifaddrs *ifa;
+  if (getifaddrs(&ifa) < 0)
+    return;
+  size_t n = 0;
+  for (const struct ifaddrs *p = ifa; p; p = p->ifa_next)
+    n += p->ifa_addr && (p->ifa_addr->sa_family == AF_INET ||
+                         p->ifa_addr->sa_family == AF_INET6);
+  AddrOwner *v = n ? realloc(sd->addrs, n * sizeof *v) : sd->addrs;
+  if (n && !v) {
+    freeifaddrs(ifa);
+    return;
+  }
+  sd->addrs = v;
+  sd->n_addrs = 0;
+  for (const struct ifaddrs *p = ifa; p; p = p->ifa_next) {
+    if (!p->ifa_addr)
+      continue;
+    AddrOwner o = {.family = (uint8_t)p->ifa_addr->sa_family};
+    if (o.family == AF_INET)
+      memcpy(o.addr, &((struct sockaddr_in *)p->ifa_addr)->sin_addr, 4);
+    else if (o.family == AF_INET6)
+      memcpy(o.addr, &((struct sockaddr_in6 *)p->ifa_addr)->sin6_addr, 16);
+    else
+      continue;
+    snprintf(o.ifname, sizeof o.ifname, "%s", p->ifa_name);
+    sd->addrs[sd->n_addrs++] = o;
+  }
+  freeifaddrs(ifa);
+}
+
+static const char *addr_owner(SockDiag *sd, const FlowSample *s,
+                              uint64_t now_ns) {
+  for (int pass = 0; pass < 2; ++pass) {
+    for (size_t i = 0; i < sd->n_addrs; ++i) {
+      const AddrOwner *o = &sd->addrs[i];
+      if (o->family == s->family &&
+          memcmp(o->addr, s->laddr, s->family == AF_INET ? 4u : 16u) == 0)
+        return o->ifname;
+    }
+    if (pass || now_ns - sd->addrs_ns < SD_ADDR_MISS_NS)
+      break;
+    load_addrs(sd, now_ns); /* address added since the last read */
+  }
+  return "";
+}
+
+/* ---------- Flow table (dense + open-addressed cookie index) ---------- */
+static uint32_t hash_cookie(uint64_t c) {
+  return (uint32_t)((c * 0x9E3779B97F4A7C15ull) >> 32);
+}
+
+static void index_flow(SockDiag *sd, size_t i) {
+  size_t mask = sd->cap * 2u - 1u;
+  size_t h = hash_cookie(sd->v[i].s.cookie) & mask;
+  while (sd->slots[h])
+    h = (h + 1u) & mask;
+  sd->slots[h] = (uint32_t)i + 1u;
+}
+
+static void reindex(SockDiag *sd) {
+  memset(sd->slots, 0, sd->cap * 2u * sizeof *sd->slots);
+  for (size_t i = 0; i < sd->n; ++i)
+    index_flow(sd, i);
+}
+
+static Flow *find_flow(const SockDiag *sd, uint64_t cookie) {
+  if (!sd->cap)
+    return NULL;
+  size_t mask = sd->cap * 2u - 1u;
+  for (size_t h = hash_cookie(cookie) & mask; sd->slots[h];
+       h = (h + 1u) & mask) {
+    Flow *f = &sd->v[sd->slots[h] - 1u];
+    if (f->s.cookie == cookie)
+      return f;
+  }
+  return NULL;
+}
+
+static Flow *add_flow(SockDiag *sd, uint64_t cookie) {
+  if (sd->n == sd->cap) {
+    size_t cap = sd->cap ? sd->cap * 2u : 64u;
+    Flow *v = realloc(sd->v, cap * sizeof *v);
+    if (!v)
+      return NULL;
+    sd->v = v;
+    uint32_t *slots = calloc(cap * 2u, sizeof *slots);
+    if (!slots)
+      return NULL;
+    free(sd->slots);
+    sd->slots = slots;
+    sd->cap = cap;
+    reindex(sd);
+  }
+  Flow *f = &sd->v[sd->n];
+  *f = (Flow){.s.cookie = cookie};
+  index_flow(sd, sd->n++);
+  return f;
+}
+
+/* New sample for a socket: rate since the previous dump, or a baseline. */
+static void account(SockDiag *sd, const FlowSample *s, uint64_t now_ns) {
+  Flow *f = find_flow(sd, s->cookie);
+  if (!f) {
+    if (!(f = add_flow(sd, s->cookie)))
+      return;
+    f->born_ns = now_ns;
+    snprintf(f->ifname, sizeof f->ifname, "%s", addr_owner(sd, s, now_ns));
+  } else if (now_ns > f->ts_ns) {
+    uint64_t d = (s->acked - f->s.acked) + (s->received - f->s.received);
+    f->rate = (double)d / ((double)(now_ns - f->ts_ns) / 1e9);
+  }
+  f->s = *s;
+  f->ts_ns = now_ns;
+  f->seen = sd->gen;
+}
+
+static bool dump_family(SockDiag *sd, uint8_t family, uint64_t now_ns) {
+  struct {
+    struct nlmsghdr nh;
+    struct inet_diag_req_v2 r;
+  } req = {
+      .nh = {.nlmsg_len = sizeof req,
+             .nlmsg_type = SOCK_DIAG_BY_FAMILY,
+             .nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP,
+             .nlmsg_seq = ++sd->seq},
+      .r = {.sdiag_family = family,
+            .sdiag_protocol = IPPROTO_TCP,
+            .idiag_ext = 1u << (INET_DIAG_INFO - 1),
+            .idiag_states = SD_STATES},
+  };
+  SELF_CALL(SC_WRITE);
+  if (send(sd->fd, &req, sizeof req, 0) < 0)
+    return false;
+
+  for (;;) {
+    SELF_CALL(SC_READ);
+    ssize_t r = recv(sd->fd, sd->buf, SD_BUF_SIZE, 0);
+    if (r < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    int len = (int)r;
+    for (struct nlmsghdr *nh = (struct nlmsghdr *)sd->buf; NLMSG_OK(nh, len);
+         nh = NLMSG_NEXT(nh, len)) {
+      if (nh->nlmsg_seq != sd->seq)
+        continue; /* stale reply to an aborted dump */
+      if (nh->nlmsg_type == NLMSG_DONE)
+        return true;
+      if (nh->nlmsg_type == NLMSG_ERROR)
+        return false;
+      FlowSample s;
+      if (sockdiag_parse(nh, &s))
+        account(sd, &s, now_ns);
+    }
+  }
+}
+
+/* One pass over every TCP socket; flows whose socket is gone are
+ * dropped (only after a complete pass, so a failed dump forgets none). */
+bool sockdiag_poll(SockDiag *sd, uint64_t now_ns) {
+  if (sd->fd < 0)
+    return false;
+  if (now_ns - sd->addrs_ns >= SD_ADDR_TTL_NS || !sd->addrs_ns)
+    load_addrs(sd, now_ns);
+  ++sd->gen;
+  if (!dump_family(sd, AF_INET, now_ns) || !dump_family(sd, AF_INET6, now_ns))
+    return false;
+
+  size_t w = 0;
+  for (size_t r = 0; r < sd->n; ++r)
+    if (sd->v[r].seen == sd->gen)
+      sd->v[w++] = sd->v[r];
+  if (w != sd->n) {
+    sd->n = w;
+    reindex(sd);
+  }
+  return true;
+}
+
+/* ---------- Ranking -------------------------------------------------- */
+/* Socket owners: one walk over every /proc/<pid>/fd, kept sorted by
+ * inode across ticks (only processes we may inspect are found). */
+static int cmp_owner(const void *a, const void *b) {
+  uint32_t x = ((const SockOwner *)a)->inode, y = ((const SockOwner *)b)->inode;
+  return (x > y) - (x < y);
+}
+
+static void add_owner(SockDiag *sd, uint32_t inode, const char *comm) {
+  if (sd->n_owners == sd->cap_owners) {
+    size_t cap = sd->cap_owners ? sd->cap_owners * 2u : 256u;
+    SockOwner *v = realloc(sd->owners, cap * sizeof *v);
+    if (!v)
+      return;
+    sd->owners = v;
+    sd->cap_owners = cap;
+  }
+  SockOwner *o = &sd->owners[sd->n_owners++];
+  o->inode = inode;
+  memcpy(o->comm, comm, sizeof o->comm);
+}
+
+/* The process name of pid dir name, or the pid itself. */
+static void read_comm(const char *proc, const char *pid, char comm[16]) {
+  char path[512];
+  snprintf(path, sizeof path, "%s/%.20s/comm", proc, pid);
+  comm[0] = '\0';
+  SELF_CALL(SC_OPEN);
+  FILE *fp = fopen(path, "r");
+  if (fp) {
+    SELF_CALL(SC_READ);
+    if (fgets(comm, 16, fp))
+      comm[strcspn(comm, "\n")] = '\0';
+    fclose(fp);
+  }
+  if (!comm[0])
+    snprintf(comm, 16, "%.15s", pid);
+}
+
+static void scan_owners(SockDiag *sd, uint64_t now_ns) {
+  const char *proc = fs_root(FS_PROC);
+  sd->owners_ns = now_ns;
+  sd->n_owners = 0;
+  DIR *pd = opendir(proc);
+  for (struct dirent *de; pd && (de = readdir(pd));) {
+    if (de->d_name[0] < '1' || de->d_name[0] > '9')
+      continue;
+    char path[512], link[64], comm[16] = "";
+    snprintf(path, sizeof path, "%s/%.20s/fd", proc, de->d_name);
+    DIR *fd_dir = opendir(path);
+    for (struct dirent *fe; fd_dir && (fe = readdir(fd_dir));) {
+      snprintf(path, sizeof path, "%s/%.20s/fd/%.20s", proc, de->d_name, fe->d_name);
+      SELF_CALL(SC_OTHER);
+      ssize_t l = readlink(path, link, sizeof link - 1u);
+      unsigned inode;
+      if (l <= 0)
+        continue;
+      link[l] = '\0';
+      if (sscanf(link, "socket:[%u]", &inode) != 1)
+        continue;
+      if (!comm[0])
+        read_comm(proc, de->d_name, comm); /* once per process */
+      add_owner(sd, inode, comm);
+    }
+    if (fd_dir)
+      closedir(fd_dir);
+  }
+  if (pd)
+    closedir(pd);
+  if (sd->n_owners)
+    qsort(sd->owners, sd->n_owners, sizeof *sd->owners, cmp_owner);
+}
+
+/* Owner of a ranked flow from the last scan.  A miss is final once a
+ * scan newer than the flow missed it too; otherwise true asks for one. */
+static bool lookup_owner(const SockDiag *sd, Flow *f) {
+  SockOwner key = {.inode = f->s.inode};
+  const SockOwner *o =
+      sd->n_owners ? bsearch(&key, sd->owners, sd->n_owners, sizeof key,
+                             cmp_owner)
+                   : NULL;
+  if (o)
+    memcpy(f->comm, o->comm, sizeof f->comm);
+  f->comm_tried = o || (sd->owners_ns && f->born_ns <= sd->owners_ns);
+  return !f->comm_tried;
+}
+
+static void put_label(char *dst, const Flow *f) {
+  char host[INET6_ADDRSTRLEN] = "";
+  const char *who = f->comm;
+  if (!who[0])
+    who = inet_ntop(f->s.family, f->s.raddr, host, sizeof host) ? host : "?";
+  snprintf(dst, TOP_LABEL_MAX, "%.*s:%u", (int)(TOP_LABEL_MAX - 7u), who,
+           (unsigned)f->s.rport);
+}
+
+/* Busiest n_top flows of every shown adapter into Iface.top, labelled
+ * with the owning process where visible, else the peer address.  Owners
+ * come from the cached /proc scan; a new one runs only for a ranked
+ * flow that appeared since, and at most every SD_SCAN_NS. */
+void sockdiag_top(SockDiag *sd, IfaceTable *t, unsigned n_top,
+                  uint64_t now_ns) {
+  if (n_top > TOP_MAX)
+    n_top = TOP_MAX;
+  for (size_t i = 0; i < t->n; ++i)
+    t->v[i].n_top = 0;
+
+  for (size_t k = 0; k < sd->n; ++k) {
+    const Flow *f = &sd->v[k];
+    if (!(f->rate > 0.0) || !f->ifname[0])
+      continue;
+    Iface *n = iftab_find(t, f->ifname);
+    if (!n || n->ignored ||
+        (!n->top && !(n->top = calloc(TOP_MAX, sizeof *n->top))))
+      continue;
+    size_t pos = n->n_top;
+    while (pos > 0 && n->top[pos - 1u].rate < f->rate)
+      --pos;
+    if (pos >= n_top)
+      continue;
+    size_t last = n->n_top < n_top ? n->n_top : n_top - 1u;
+    memmove(&n->top[pos + 1u], &n->top[pos], (last - pos) * sizeof *n->top);
+    n->top[pos] = (FlowTop){.flow = (uint32_t)k, .rate = f->rate};
+    if (n->n_top < n_top)
+      ++n->n_top;
+  }
+
+  for (int pass = 0; pass < 2; ++pass) {
+    bool stale = false;
+    for (size_t i = 0; i < t->n; ++i)
+      for (uint8_t j = 0; j < t->v[i].n_top; ++j) {
+        Flow *f = &sd->v[t->v[i].top[j].flow];
+        if (!f->comm_tried && f->s.inode)
+          stale |= lookup_owner(sd, f);
+      }
+    if (pass || !stale ||
+        (sd->owners_ns && now_ns - sd->owners_ns < SD_SCAN_NS))
+      break;
+    scan_owners(sd, now_ns);
+  }
+
+  for (size_t i = 0; i < t->n; ++i)
+    for (uint8_t j = 0; j < t->v[i].n_top; ++j)
+      put_label(t->v[i].top[j].label, &sd->v[t->v[i].top[j].flow]);
+}
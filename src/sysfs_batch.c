@@ -0,0 +1,388 @@
+/*
+ * Batched sysfs link-state reads for the polling path.
+ *
+ * Every polled adapter keeps its operstate and carrier files open across
+ * ticks (Iface.sys_fd) while the descriptor budget lasts; a tick queues
+ * the adapters whose state is due and reads all of them at offset 0 in
+ * one go – one io_uring_enter() per ring-full, or a plain pread() per
+ * file where io_uring is unavailable.  Adapters past the budget reuse
+ * SB_FIXED registered ring slots instead: each file is an openat, read
+ * and close chained in the same submission, so a large table costs no
+ * more syscalls than a small one.  Without io_uring they take the
+ * open/read/close of get_iface_state().  The ring is driven with raw
+ * syscalls, so there is no liburing dependency.
+ *
+ * Only operstate and carrier are read: nothing shown depends on speed,
+ * and the MTU would come from the netlink dump, not sysfs.
+ */
+#include "bandwidth3.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <linux/io_uring.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define SB_RING_ENTRIES 512u /* SQEs: 2 reads, or 2 × 3 chained, per adapter */
+#define SB_FD_SPARE 256      /* descriptors left for everything else    */
+#define SB_FIXED 256u        /* registered slots reused by the chains   */
+
+/* user_data: queue entry, file, step of its chain */
+enum { SB_READ, SB_OPEN, SB_CLOSE };
+#define SB_TAG(i, k, op) ((uint64_t)(i) << 3 | (uint64_t)(k) << 2 | (op))
+
+/* ---------- Raw io_uring plumbing ------------------------------------ */
+static int uring_setup(unsigned entries, struct io_uring_params *p) {
+  return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int uring_enter(int fd, unsigned submit, unsigned wait) {
+  SELF_CALL(SC_READ); /* one syscall for the whole batch */
+  return (int)syscall(__NR_io_uring_enter, fd, submit, wait,
+                      IORING_ENTER_GETEVENTS, NULL, 0);
+}
+
+/* Whether the kernel knows opcode op (IORING_OP_READ: 5.6+). */
+static bool uring_can(int fd, unsigned op) {
+  size_t len = sizeof(struct io_uring_probe) +
+               (op + 1u) * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe *p = calloc(1, len);
+  if (!p)
+    return false;
+  bool ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, p,
+                    op + 1u) == 0 &&
+            p->last_op >= op && (p->ops[op].flags & IO_URING_OP_SUPPORTED);
+  free(p);
+  return ok;
+}
+
+/* A sparse table of SB_FIXED slots for openat into the ring (5.19+: the
+ * sparse registration is what guarantees direct opens too). */
+static bool uring_register_slots(SysfsBatch *b) {
+#ifdef IORING_RSRC_REGISTER_SPARSE
+  struct io_uring_rsrc_register rr = {.nr = SB_FIXED,
+                                      .flags = IORING_RSRC_REGISTER_SPARSE};
+  if (!uring_can(b->ring_fd, IORING_OP_OPENAT) ||
+      !uring_can(b->ring_fd, IORING_OP_CLOSE) ||
+      !(b->path = calloc(SB_FIXED, sizeof *b->path)))
+    return false;
+  if (syscall(__NR_io_uring_register, b->ring_fd, IORING_REGISTER_FILES2, &rr,
+              sizeof rr) == 0)
+    return true;
+  free(b->path);
+  b->path = NULL;
+#else
+  (void)b;
+#endif
+  return false;
+}
+
+static void uring_unmap(SysfsBatch *b) {
+  if (b->sqes)
+    munmap(b->sqes, b->sqes_len);
+  if (b->cq_map && b->cq_map != b->sq_map)
+    munmap(b->cq_map, b->cq_len);
+  if (b->sq_map)
+    munmap(b->sq_map, b->sq_len);
+  if (b->ring_fd >= 0)
+    close(b->ring_fd);
+  b->sqes = b->sq_map = b->cq_map = NULL;
+  b->ring_fd = -1;
+  b->direct = false;
+}
+
+static bool uring_open(SysfsBatch *b) {
+  struct io_uring_params p;
+  memset(&p, 0, sizeof p);
+  b->ring_fd = uring_setup(SB_RING_ENTRIES, &p);
+  if (b->ring_fd < 0)
+    return false;
+  b->sq_len = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+  b->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP)
+    b->sq_len = b->cq_len = b->sq_len > b->cq_len ? b->sq_len : b->cq_len;
+  b->sq_map = mmap(NULL, b->sq_len, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, b->ring_fd, IORING_OFF_SQ_RING);
+  if (b->sq_map == MAP_FAILED) {
+    b->sq_map = NULL;
+    uring_unmap(b);
+    return false;
+  }
+  b->cq_map = (p.features & IORING_FEAT_SINGLE_MMAP)
+                  ? b->sq_map
+                  : mmap(NULL, b->cq_len, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, b->ring_fd,
+                         IORING_OFF_CQ_RING);
+  b->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  b->sqes = mmap(NULL, b->sqes_len, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_POPULATE, b->ring_fd, IORING_OFF_SQES);
+  if (b->cq_map == MAP_FAILED || b->sqes == MAP_FAILED) {
+    if (b->cq_map == MAP_FAILED)
+      b->cq_map = NULL;
+    if (b->sqes == MAP_FAILED)
+      b->sqes = NULL;
+    uring_unmap(b);
+    return false;
+  }
+  char *sq = b->sq_map, *cq = b->cq_map;
+  b->sq_tail = (uint32_t *)(sq + p.sq_off.tail);
+  b->sq_mask = *(uint32_t *)(sq + p.sq_off.ring_mask);
+  b->sq_array = (uint32_t *)(sq + p.sq_off.array);
+  b->sq_entries = p.sq_entries;
+  b->cq_head = (uint32_t *)(cq + p.cq_off.head);
+  b->cq_tail = (uint32_t *)(cq + p.cq_off.tail);
+  b->cq_mask = *(uint32_t *)(cq + p.cq_off.ring_mask);
+  b->cqes = cq + p.cq_off.cqes;
+  if (!uring_can(b->ring_fd, IORING_OP_READ)) {
+    uring_unmap(b);
+    return false;
+  }
+  b->direct = uring_register_slots(b);
+  return true;
+}
+
+/* ---------- Public interface ----------------------------------------- */
+/* Two fds per adapter, within the descriptor limit we were given: the
+ * soft RLIMIT_NOFILE is left alone (spawned hooks inherit it), the top
+ * SB_FD_SPARE below it stay free and adapters past that go through the
+ * ring slots (or the slow way).  io_uring only if asked and usable. */
+bool sysfs_batch_open(SysfsBatch *b, bool uring) {
+  memset(b, 0, sizeof *b);
+  b->ring_fd = -1;
+  struct rlimit rl;
+  b->fd_max = INT_MAX;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY)
+    b->fd_max = rl.rlim_cur > (rlim_t)INT_MAX ? INT_MAX
+                : rl.rlim_cur > SB_FD_SPARE ? (int)rl.rlim_cur - SB_FD_SPARE
+                                            : 0;
+  return uring && uring_open(b);
+}
+
+void sysfs_batch_close(SysfsBatch *b) {
+  uring_unmap(b);
+  free(b->idx);
+  free(b->state);
+  free(b->buf);
+  free(b->res);
+  free(b->path);
+  memset(b, 0, sizeof *b);
+  b->ring_fd = -1;
+}
+
+/* Close an adapter's state files (link gone or re-created). */
+void sysfs_forget(Iface *n) {
+  for (int k = 0; k < 2; ++k) {
+    if (n->sys_fd[k] > 0)
+      close(n->sys_fd[k] - 1);
+    n->sys_fd[k] = 0;
+  }
+}
+
+/* Queue table entry idx for this tick's run. */
+void sysfs_batch_queue(SysfsBatch *b, size_t idx) {
+  if (b->n == b->cap) {
+    size_t cap = b->cap ? b->cap * 2u : 64u;
+    size_t *v = realloc(b->idx, cap * sizeof *v);
+    if (!v)
+      return;
+    b->idx = v;
+    uint8_t *st = realloc(b->state, cap * sizeof *st);
+    if (!st)
+      return;
+    b->state = st;
+    char(*buf)[2][SB_READ_MAX] = realloc(b->buf, cap * sizeof *buf);
+    if (!buf)
+      return;
+    b->buf = buf;
+    int32_t(*res)[2] = realloc(b->res, cap * sizeof *res);
+    if (!res)
+      return;
+    b->res = res;
+    b->cap = cap;
+  }
+  b->idx[b->n++] = idx;
+}
+
+static const char *const FILES[2] = {"operstate", "carrier"};
+
+/* Descriptors are handed out lowest first, so the fd number itself
+ * tells how close to the limit we are.  Once there, only one adapter
+ * per run tries again, in case links went away since. */
+static void open_files(SysfsBatch *b, Iface *n, bool *tried) {
+  if (n->sys_fd[0] <= 0 && b->fd_full && *tried)
+    return;
+  for (int k = 0; k < 2; ++k) {
+    if (n->sys_fd[k] > 0)
+      continue;
+    char path[PATH_MAX];
+    snprintf(path, sizeof path, "%s/class/net/%s/%s", fs_root(FS_SYS), n->name,
+             FILES[k]);
+    SELF_CALL(SC_OPEN);
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    *tried = true;
+    b->fd_full = fd >= b->fd_max;
+    if (b->fd_full) {
+      close(fd);
+      sysfs_forget(n); /* both or neither: through the ring slots */
+      return;
+    }
+    n->sys_fd[k] = fd >= 0 ? fd + 1 : 0;
+    if (fd < 0 && k == 0)
+      return;
+  }
+}
+
+static struct io_uring_sqe *next_sqe(SysfsBatch *b, uint32_t *tail) {
+  uint32_t slot = (*tail)++ & b->sq_mask;
+  struct io_uring_sqe *sqe = &((struct io_uring_sqe *)b->sqes)[slot];
+  memset(sqe, 0, sizeof *sqe);
+  b->sq_array[slot] = slot;
+  return sqe;
+}
+
+/* Queue file k of entry i as openat → read → close on ring slot `slot`;
+ * hard links keep the chain going, so every step completes (and the
+ * slot is always released). */
+static bool queue_chain(SysfsBatch *b, uint32_t *tail, const Iface *n,
+                        size_t i, int k, unsigned slot) {
+  char *path = b->path[slot];
+  if ((size_t)snprintf(path, SB_PATH_MAX, "%s/class/net/%s/%s",
+                       fs_root(FS_SYS), n->name, FILES[k]) >= SB_PATH_MAX)
+    return false;
+  struct io_uring_sqe *sqe = next_sqe(b, tail);
+  sqe->opcode = IORING_OP_OPENAT;
+  sqe->fd = AT_FDCWD;
+  sqe->addr = (uint64_t)(uintptr_t)path;
+  sqe->open_flags = O_RDONLY; /* no fd table entry: O_CLOEXEC is EINVAL */
+  sqe->file_index = slot + 1u;
+  sqe->flags = IOSQE_IO_HARDLINK;
+  sqe->user_data = SB_TAG(i, k, SB_OPEN);
+  sqe = next_sqe(b, tail);
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = (int)slot;
+  sqe->addr = (uint64_t)(uintptr_t)b->buf[i][k];
+  sqe->len = SB_READ_MAX;
+  sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+  sqe->user_data = SB_TAG(i, k, SB_READ);
+  sqe = next_sqe(b, tail);
+  sqe->opcode = IORING_OP_CLOSE;
+  sqe->file_index = slot + 1u;
+  sqe->user_data = SB_TAG(i, k, SB_CLOSE);
+  return true;
+}
+
+/* Submit reads for queue entries from *i on, as many as the ring and its
+ * slots take, wait for all of them and advance *i past them. */
+static bool uring_run(SysfsBatch *b, IfaceTable *t, size_t *i) {
+  uint32_t tail = *b->sq_tail, queued = 0;
+  unsigned slots = 0;
+  for (; *i < b->n; ++*i) {
+    const Iface *n = &t->v[b->idx[*i]];
+    bool chain = n->sys_fd[0] <= 0 && b->direct;
+    if (queued + (chain ? 6u : 2u) > b->sq_entries ||
+        (chain && slots + 2u > SB_FIXED))
+      break;
+    for (int k = 0; k < 2; ++k) {
+      if (chain) {
+        if (!queue_chain(b, &tail, n, *i, k, slots))
+          break; /* path too long: decode() goes the slow way */
+        slots++;
+        queued += 3u;
+        continue;
+      }
+      if (n->sys_fd[k] <= 0)
+        continue;
+      struct io_uring_sqe *sqe = next_sqe(b, &tail);
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = n->sys_fd[k] - 1;
+      sqe->addr = (uint64_t)(uintptr_t)b->buf[*i][k];
+      sqe->len = SB_READ_MAX;
+      sqe->off = 0; /* sysfs regenerates the value on every read at 0 */
+      sqe->user_data = SB_TAG(*i, k, SB_READ);
+      ++queued;
+    }
+  }
+  __atomic_store_n(b->sq_tail, tail, __ATOMIC_RELEASE);
+  uint32_t done = 0;
+  while (done < queued) {
+    int r = uring_enter(b->ring_fd, queued - done, queued - done);
+    if (r < 0 && errno != EINTR)
+      return false;
+    uint32_t head = *b->cq_head;
+    uint32_t ctail = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+    const struct io_uring_cqe *cqes = b->cqes;
+    for (; head != ctail; ++head, ++done) {
+      const struct io_uring_cqe *c = &cqes[head & b->cq_mask];
+      int32_t *res = &b->res[c->user_data >> 3][(c->user_data >> 2) & 1u];
+      /* a failed open is the answer; the read after it only says EBADF */
+      if ((c->user_data & 3u) == SB_OPEN ? c->res < 0
+          : (c->user_data & 3u) == SB_READ && (c->res >= 0 || *res == -EBADF))
+        *res = c->res;
+    }
+    __atomic_store_n(b->cq_head, head, __ATOMIC_RELEASE);
+  }
+  return true;
+}
+
+/* Same mapping as get_iface_state(): operstate "down" is disabled,
+ * otherwise the carrier decides.  A link whose operstate was neither
+ * kept open nor read through the ring, or without a carrier file (some
+ * Wi-Fi drivers), takes the slow path. */
+static IfState decode(const Iface *n, const char *oper, int32_t oper_len,
+                      const char *carrier, int32_t carrier_len) {
+  bool kept = n->sys_fd[0] > 0;
+  if (!kept && oper_len == -EBADF)
+    return get_iface_state(n->name, n->wifi);
+  if (oper_len <= 0)
+    return IFSTATE_ERR;
+  if (oper_len >= 4 && strncmp(oper, "down", 4) == 0)
+    return IFSTATE_DISABLED;
+  if (kept ? n->sys_fd[1] <= 0 : carrier_len == -ENOENT)
+    return n->wifi ? get_iface_state(n->name, true) : IFSTATE_ERR;
+  /* reading carrier fails (EINVAL) while the link is down */
+  return (carrier_len > 0 && carrier[0] == '1') ? IFSTATE_CONNECTED
+                                                : IFSTATE_DISCONNECTED;
+}
+
+/* Read the state of every queued adapter into b->state[]; the queue is
+ * emptied by the next sysfs_batch_queue() after this.  False, with
+ * errno set, when io_uring failed and was dropped for pread() – the
+ * states are read all the same; saying so is up to the caller. */
+bool sysfs_batch_run(SysfsBatch *b, IfaceTable *t) {
+  int uring_err = 0;
+  bool tried = false;
+  for (size_t i = 0; i < b->n; ++i) {
+    open_files(b, &t->v[b->idx[i]], &tried);
+    b->res[i][0] = b->res[i][1] = -EBADF;
+  }
+  for (size_t i = 0; b->ring_fd >= 0 && i < b->n;) {
+    if (!uring_run(b, t, &i)) {
+      uring_err = errno;
+      uring_unmap(b);
+    }
+  }
+  for (size_t i = 0; i < b->n; ++i) {
+    Iface *n = &t->v[b->idx[i]];
+    for (int k = 0; b->ring_fd < 0 && k < 2; ++k) {
+      if (n->sys_fd[k] <= 0)
+        continue;
+      SELF_CALL(SC_READ);
+      ssize_t r = pread(n->sys_fd[k] - 1, b->buf[i][k], SB_READ_MAX, 0);
+      b->res[i][k] = r < 0 ? -errno : (int32_t)r;
+    }
+    b->state[i] = (uint8_t)decode(n, b->buf[i][0], b->res[i][0], b->buf[i][1],
+                                  b->res[i][1]);
+    if (b->res[i][0] == -ENODEV)
+      sysfs_forget(n); /* the link went away under us: reopen next time */
+  }
+  b->ran = b->n;
+  b->n = 0;
+  if (uring_err)
+    errno = uring_err;
+  return !uring_err;
+}
@@ -0,0 +1,413 @@
+/*
+ * Microbenchmarks for the sampling hot path: read_iface_stats(),
+ * get_iface_state(), the batched sysfs state reads (io_uring and pread),
+ * human_print(), one polling-mode tick of the program itself (src/
+ * bandwidth3.c, app_tick()), one --sample sub-sample
+ * (what sizes the sub-interval cadence) and one libbandwidth3
+ * bw3_sample() + bw3_format() of every adapter, run
+ * against generated procfs/sysfs trees of 1, 32, 1000 and 10000 adapters
+ * (PROCFS_ROOT / SYSFS_ROOT, see fs_root()).
+ *
+ * Reports wall time, syscalls and heap allocations per tick.  Counting
+ * is done at the libc boundary with -Wl,--wrap (see the Makefile):
+ * direct fd calls are one syscall each; a stdio fopen() is charged the
+ * openat + fstat + read it costs glibc plus its FILE and buffer
+ * allocations, fclose() one close.  read() hands out at most a page, as
+ * the seq_file behind /proc/net/dev does: the fixture is a plain file
+ * that would otherwise come back in one piece.
+ *
+ * Usage: bench [filter]   – run only benchmarks whose name contains it
+ *        BENCH_KEEP=1     – leave the fixture trees in place
+ */
+#include "../src/bandwidth3.h"
+#include "../include/libbandwidth3.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define BENCH_MIN_NS 300000000ull /* time budget per benchmark and size */
+#define BENCH_MIN_ITERS 5u
+
+#define BENCH_READ_MAX 4096u /* a seq_file read(): one page at most */
+
+static const unsigned SIZES[] = {1u, 32u, 1000u, 10000u};
+
+/* ---------- Syscall / allocation counters ---------------------------- */
+static struct {
+  uint64_t sys, alloc;
+} g_cnt;
+
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t sz);
+void *__real_realloc(void *p, size_t n);
+int __real_open(const char *path, int flags, ...);
+ssize_t __real_read(int fd, void *buf, size_t n);
+ssize_t __real_pread(int fd, void *buf, size_t n, off_t off);
+long __real_syscall(long nr, ...);
+off_t __real_lseek(int fd, off_t off, int whence);
+int __real_close(int fd);
+int __real_stat(const char *path, struct stat *st);
+FILE *__real_fopen(const char *path, const char *mode);
+int __real_fclose(FILE *fp);
+
+void *__wrap_malloc(size_t n) {
+  ++g_cnt.alloc;
+  return __real_malloc(n);
+}
+void *__wrap_calloc(size_t n, size_t sz) {
+  ++g_cnt.alloc;
+  return __real_calloc(n, sz);
+}
+void *__wrap_realloc(void *p, size_t n) {
+  ++g_cnt.alloc;
+  return __real_realloc(p, n);
+}
+int __wrap_open(const char *path, int flags, ...) {
+  ++g_cnt.sys;
+  return __real_open(path, flags, 0644);
+}
+ssize_t __wrap_read(int fd, void *buf, size_t n) {
+  ++g_cnt.sys;
+  return __real_read(fd, buf, n < BENCH_READ_MAX ? n : BENCH_READ_MAX);
+}
+ssize_t __wrap_pread(int fd, void *buf, size_t n, off_t off) {
+  ++g_cnt.sys;
+  return __real_pread(fd, buf, n, off);
+}
+/* io_uring setup/enter/register: six argument slots cover them all */
+long __wrap_syscall(long nr, ...) {
+  va_list ap;
+  long a[6];
+  va_start(ap, nr);
+  for (int i = 0; i < 6; ++i)
+    a[i] = va_arg(ap, long);
+  va_end(ap);
+  ++g_cnt.sys;
+  return __real_syscall(nr, a[0], a[1], a[2], a[3], a[4], a[5]);
+}
+off_t __wrap_lseek(int fd, off_t off, int whence) {
+  ++g_cnt.sys;
+  return __real_lseek(fd, off, whence);
+}
+int __wrap_close(int fd) {
+  ++g_cnt.sys;
+  return __real_close(fd);
+}
+int __wrap_stat(const char *path, struct stat *st) {
+  ++g_cnt.sys;
+  return __real_stat(path, st);
+}
+FILE *__wrap_fopen(const char *path, const char *mode) {
+  FILE *fp = __real_fopen(path, mode);
+  g_cnt.sys += fp ? 3u : 1u;
+  g_cnt.alloc += fp ? 2u : 0u;
+  return fp;
+}
+int __wrap_fclose(FILE *fp) {
+  ++g_cnt.sys;
+  return __real_fclose(fp);
+}
+
+/* ---------- Fixture trees -------------------------------------------- */
+static void put_file(const char *path, const char *text) {
+  FILE *fp = fopen(path, "w");
+  if (!fp || fputs(text, fp) < 0 || fclose(fp) != 0) {
+    perror(path);
+    exit(1);
+  }
+}
+
+static void make_dir(const char *path) {
+  if (mkdir(path, 0755) < 0 && errno != EEXIST) {
+    perror(path);
+    exit(1);
+  }
+}
+
+static void iface_name(char *dst, unsigned i) {
+  if (i == 0u)
+    snprintf(dst, IFNAMSIZ, "lo");
+  else
+    snprintf(dst, IFNAMSIZ, "veth%u", i - 1u);
+}
+
+/* <root>/proc/net/dev and <root>/sys/class/net/<if>/{operstate,carrier,
+ * ifindex} for n adapters; every eighth one is down. */
+static void fixture_build(const char *root, unsigned n) {
+  char path[PATH_MAX], name[IFNAMSIZ], val[32];
+  make_dir(root);
+  snprintf(path, sizeof path, "%s/proc", root);
+  make_dir(path);
+  snprintf(path, sizeof path, "%s/proc/net", root);
+  make_dir(path);
+  snprintf(path, sizeof path, "%s/sys", root);
+  make_dir(path);
+  snprintf(path, sizeof path, "%s/sys/class", root);
+  make_dir(path);
+  snprintf(path, sizeof path, "%s/sys/class/net", root);
+  make_dir(path);
+
+  snprintf(path, sizeof path, "%s/proc/net/dev", root);
+  FILE *dev = fopen(path, "w");
+  if (!dev) {
+    perror(path);
+    exit(1);
+  }
+  fputs("Inter-|   Receive                                                |  Transmit\n"
+        " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n",
+        dev);
+  for (unsigned i = 0; i < n; ++i) {
+    iface_name(name, i);
+    fprintf(dev, "%6s: %llu %u 0 0 0 0 0 0 %llu %u 0 0 0 0 0 0\n", name,
+            1000000ull * (i + 1u), i * 7u, 3000000ull * (i + 1u), i * 5u);
+
+    snprintf(path, sizeof path, "%s/sys/class/net/%s", root, name);
+    make_dir(path);
+    snprintf(path, sizeof path, "%s/sys/class/net/%s/operstate", root, name);
+    put_file(path, i % 8u == 7u ? "down\n" : "up\n");
+    snprintf(path, sizeof path, "%s/sys/class/net/%s/carrier", root, name);
+    put_file(path, "1\n");
+    snprintf(path, sizeof path, "%s/sys/class/net/%s/ifindex", root, name);
+    snprintf(val, sizeof val, "%u\n", i + 1u);
+    put_file(path, val);
+  }
+  fclose(dev);
+}
+
+static void fixture_remove(const char *root, unsigned n) {
+  static const char *const FILES[] = {"operstate", "carrier", "ifindex"};
+  char path[PATH_MAX], name[IFNAMSIZ];
+  for (unsigned i = 0; i < n; ++i) {
+    iface_name(name, i);
+    for (size_t f = 0; f < 3u; ++f) {
+      snprintf(path, sizeof path, "%s/sys/class/net/%s/%s", root, name,
+               FILES[f]);
+      unlink(path);
+    }
+    snprintf(path, sizeof path, "%s/sys/class/net/%s", root, name);
+    rmdir(path);
+  }
+  static const char *const DIRS[] = {"proc/net/dev", "proc/net", "proc",
+                                     "sys/class/net", "sys/class", "sys"};
+  for (size_t d = 0; d < sizeof DIRS / sizeof *DIRS; ++d) {
+    snprintf(path, sizeof path, "%s/%s", root, DIRS[d]);
+    if (remove(path) < 0)
+      perror(path);
+  }
+  rmdir(root);
+}
+
+/* ---------- Benchmarks ----------------------------------------------- */
+typedef struct {
+  unsigned n;          /* adapters in the fixture                */
+  char (*names)[IFNAMSIZ];
+  App *app;            /* the program, sampling the fixture      */
+  IfaceTable tab;      /* every adapter, for the pieces below    */
+  NetSnapshot snap;
+  SysfsBatch uring;    /* the sampler's batch; pread-only twin   */
+  SysfsBatch pread;
+  Bw3Sampler *lib;     /* the library's own table, same fixture  */
+  Bw3Iface *lib_v;
+} Bench;
+
+typedef void (*TickFn)(Bench *b);
+
+static void tick_read_iface_stats(Bench *b) {
+  NetStats st;
+  if (!read_iface_stats(b->names[b->n - 1u], &st))
+    abort();
+}
+
+static void tick_get_iface_state(Bench *b) {
+  for (unsigned i = 0; i < b->n; ++i)
+    if (get_iface_state(b->names[i], false) == IFSTATE_ERR)
+      abort();
+}
+
+static void state_batch(SysfsBatch *sb, Bench *b) {
+  for (size_t i = 0; i < b->tab.n; ++i)
+    sysfs_batch_queue(sb, i);
+  sysfs_batch_run(sb, &b->tab);
+  for (size_t i = 0; i < sb->ran; ++i)
+    if (sb->state[i] == IFSTATE_ERR)
+      abort();
+}
+
+static void tick_state_batch_uring(Bench *b) {
+  if (b->uring.ring_fd < 0)
+    abort();
+  state_batch(&b->uring, b);
+}
+
+static void tick_state_batch_pread(Bench *b) { state_batch(&b->pread, b); }
+
+static void tick_human_print(Bench *b) {
+  (void)b;
+  human_print(123456789.0, 'B', 1024u, 0u, 0u);
+}
+
+/* One polling-mode tick of the program: app_tick() – sample_tick() and
+ * the line, written to /dev/null here – exactly as its main loop runs
+ * it.  Every adapter must have been seen, short reads or not. */
+static void tick_full(Bench *b) {
+  app_tick(b->app);
+  if (app_adapters(b->app) != b->n)
+    abort();
+}
+
+/* One --sample sub-sample (burst_tick()): snapshot, lookup, extremes. */
+static void tick_burst_sample(Bench *b) {
+  if (!net_snapshot_read(&b->snap))
+    abort();
+  for (size_t i = 0; i < b->snap.n; ++i) {
+    const SnapEntry *e = &b->snap.ent[i];
+    Iface *n = iftab_find(&b->tab, e->name);
+    if (!n)
+      abort();
+    burst_sample(&n->burst, &e->stats, 1000000u, 0u);
+  }
+}
+
+/* One library sample and a formatted line per adapter: what an
+ * embedding agent pays per call.  Its state files come on top of the
+ * program's and the batches above, so with a low descriptor limit they
+ * run out first and go the slow way (alone it matches full_tick). */
+static void tick_lib_sample(Bench *b) {
+  char line[256];
+  int n = bw3_sample(b->lib, b->lib_v, b->n);
+  if (n != (int)b->n)
+    abort();
+  for (int i = 0; i < n; ++i)
+    bw3_format(b->lib, &b->lib_v[i], line, sizeof line);
+}
+
+static void setup_full(Bench *b) {
+  static char *argv[] = {"bandwidth3", "-i", "*", NULL};
+  sysfs_batch_open(&b->uring, true);
+  sysfs_batch_open(&b->pread, false);
+  if (!net_snapshot_init(&b->snap, BACKEND_PROCFS) ||
+      !net_snapshot_read(&b->snap))
+    abort();
+  for (unsigned i = 0; i < b->n; ++i) {
+    Iface *n = iftab_add(&b->tab, b->names[i]);
+    if (!n)
+      abort();
+    n->ifindex = iface_index(n->name);
+  }
+  /* its discovery pass adopts every adapter and primes the baselines;
+   * one tick keeps their state files open before anyone else's */
+  if (!(b->app = app_new()) || app_start(b->app, 3, argv) >= 0)
+    abort();
+  tick_full(b);
+  if (!(b->lib = bw3_sampler_new(&(Bw3Config){.interfaces = "*"})) ||
+      !(b->lib_v = calloc(b->n, sizeof *b->lib_v)))
+    abort();
+}
+
+static const struct {
+  const char *name;
+  TickFn fn;
+} BENCHES[] = {
+    {"read_iface_stats", tick_read_iface_stats},
+    {"get_iface_state", tick_get_iface_state},
+    {"state_batch_uring", tick_state_batch_uring},
+    {"state_batch_pread", tick_state_batch_pread},
+    {"human_print", tick_human_print},
+    {"full_tick", tick_full},
+    {"burst_sample", tick_burst_sample},
+    {"lib_sample", tick_lib_sample},
+};
+
+typedef struct {
+  uint64_t iters, ns, sys, alloc;
+} Result;
+
+static Result run_one(Bench *b, TickFn fn) {
+  fn(b); /* first call pays one-off setup: not a steady-state tick */
+  Result r = {.sys = g_cnt.sys, .alloc = g_cnt.alloc};
+  uint64_t t0 = mono_ns();
+  do {
+    fn(b);
+    ++r.iters;
+  } while ((r.ns = mono_ns() - t0) < BENCH_MIN_NS || r.iters < BENCH_MIN_ITERS);
+  r.sys = g_cnt.sys - r.sys;
+  r.alloc = g_cnt.alloc - r.alloc;
+  return r;
+}
+
+/* Each size in its own process: read_iface_stats() keeps a private
+ * snapshot open on the first root it saw. */
+static void run_size(const char *base, unsigned n, const char *filter) {
+  char root[256], proc[272], sys[272];
+  snprintf(root, sizeof root, "%s/%u", base, n);
+  snprintf(proc, sizeof proc, "%s/proc", root);
+  snprintf(sys, sizeof sys, "%s/sys", root);
+  fixture_build(root, n);
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0) {
+    fs_root_set(FS_PROC, proc);
+    fs_root_set(FS_SYS, sys);
+    Bench b = {.n = n, .names = calloc(n, IFNAMSIZ)};
+    if (!b.names)
+      abort();
+    for (unsigned i = 0; i < n; ++i)
+      iface_name(b.names[i], i);
+
+    /* the program's ticks and human_print() write to stdout: send it to
+     * /dev/null meanwhile, the warm-up tick in setup_full() included */
+    int saved = dup(STDOUT_FILENO), null = open("/dev/null", O_WRONLY);
+    fflush(stdout);
+    dup2(null, STDOUT_FILENO);
+    setup_full(&b);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    for (size_t i = 0; i < sizeof BENCHES / sizeof *BENCHES; ++i) {
+      if (filter && !strstr(BENCHES[i].name, filter))
+        continue;
+      fflush(stdout);
+      dup2(null, STDOUT_FILENO);
+      Result r = run_one(&b, BENCHES[i].fn);
+      fflush(stdout);
+      dup2(saved, STDOUT_FILENO);
+      double k = (double)r.iters;
+      printf("%-18s %7u %14.0f %13.2f %12.2f %10llu\n", BENCHES[i].name, n,
+             (double)r.ns / k, (double)r.sys / k, (double)r.alloc / k,
+             (unsigned long long)r.iters);
+    }
+    fflush(stdout);
+    _exit(0);
+  }
+  int status = 0;
+  if (pid < 0 || waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0)
+    fprintf(stderr, "bench: %u adapters failed\n", n);
+  if (!getenv("BENCH_KEEP"))
+    fixture_remove(root, n);
+}
+
+int main(int argc, char **argv) {
+  const char *filter = argc > 1 ? argv[1] : NULL;
+  char base[] = "/tmp/bandwidth3-bench-XXXXXX";
+  if (!mkdtemp(base)) {
+    perror("mkdtemp");
+    return 1;
+  }
+  printf("%-18s %7s %14s %13s %12s %10s\n", "benchmark", "ifaces", "ns/tick",
+         "syscalls/tick", "allocs/tick", "iters");
+  for (size_t i = 0; i < sizeof SIZES / sizeof *SIZES; ++i)
+    run_size(base, SIZES[i], filter);
+  if (getenv("BENCH_KEEP"))
+    printf("fixtures kept in %s\n", base);
+  else
+    rmdir(base);
+  return 0;
+}
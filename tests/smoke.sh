@@ -2,6 +2,7 @@
 # Very thin end-to-end smoke test: ensure binary prints version.
 
 BIN=$1
+VERSION=${2:-0.1.3}
 
 [ -x "$BIN" ] || {
     echo "Binary $BIN not found"
@@ -9,4 +10,4 @@ BIN=$1
 }
 
 OUT=$("$BIN" -V)
-echo "$OUT" | grep -q 0.1.3 # exits 1 → failure
+echo "$OUT" | grep -qF "$VERSION" # exits 1 → failure
@@ -1,10 +1,43 @@
 /*
  * Basic sanity checks for bandwidth3.
- * Compile standalone; needs only src/net_stats.c for avg_rate().
+ * Compile standalone; needs only src/net_stats.c for avg_rate() and the
+ * /proc/net/dev snapshot parser, plus src/netlink.c and src/nl80211.c for
+ * the netlink decoders, src/output.c for templates, src/iface_table.c
+ * for discovery, src/rate_stats.c for windowed statistics, src/shm.c for
+ * the shared-memory sampler, src/exporter.c for OpenMetrics and
+ * src/record.c for the sample log, src/sockdiag.c for top talkers and
+ * src/history.c for the round-robin history file, src/alerts.c for
+ * threshold alerts, src/sysfs_batch.c (with src/iface_state.c) for
+ * batched link-state reads, src/groups.c for interface groups,
+ * src/barproto.c for the i3bar/waybar protocols, src/conffile.c for the
+ * config file, src/selfstats.c for self-monitoring, src/burst.c for burst
+ * detection, src/netns.c for namespace-qualified names, src/sampler.c for
+ * the library sampler, src/qdisc.c for qdisc statistics and
+ * src/bandwidth3.c for the program tick.
  */
 #include "../src/bandwidth3.h"
+#include "../include/libbandwidth3.h"
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <linux/genetlink.h>
+#include <linux/if_link.h>
+#include <linux/inet_diag.h>
+#include <linux/nl80211.h>
+#include <linux/pkt_sched.h>
+#include <linux/gen_stats.h>
+#include <linux/rtnetlink.h>
+#include <linux/tcp.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
 
 /* 2 ───────────────── avg_rate maths */
 static void test_avg_rate(void) {
@@ -12,6 +45,8 @@ static void test_avg_rate(void) {
   assert(avg_rate(6000, 4000, 2) == 1000.0);
   /* Zero delta-time must never segfault or divide-by-zero */
   assert(avg_rate(10, 10, 0) == 0.0);
+  /* Measured sub-second intervals: 500 B over 250 ms → 2000 B/s */
+  assert(avg_rate(1500, 1000, 0.25) == 2000.0);
 }
 
 /* 3 ───────────────── Enum uniqueness (connected ≠ disconnected …) */
@@ -21,9 +56,1517 @@ static void test_enum_distinct(void) {
   assert(IFSTATE_DISCONNECTED != IFSTATE_DISABLED);
 }
 
-/* ─────────────────────────────────────────────────────────────── */
+/* 4 ───────────────── /proc/net/dev snapshot parsing */
+static const char PROC_NET_DEV[] =
+    "Inter-|   Receive                                                |  Transmit\n"
+    " face |bytes    packets errs drop fifo frame compressed multicast|bytes    packets errs drop fifo colls carrier compressed\n"
+    "    lo: 1169018     275    0    0    0     0          0         0  1169018     275    0    0    0     0       0          0\n"
+    "  eth0:    1116      16    0    0    0     0          0         0     1188      16    0    0    0     0       0          0\n"
+    "wlp3s0:18446744073709551615 1 0 0 0 0 0 0 42 1 0 0 0 0 0 0\n"
+    "broken: 1 2 3\n";
+
+static void test_snapshot_parse(void) {
+  NetSnapshot s = {.fd = -1};
+  assert(net_snapshot_parse(&s, PROC_NET_DEV, sizeof PROC_NET_DEV - 1) == 3);
+
+  const NetStats *eth = net_snapshot_find(&s, "eth0");
+  assert(eth && eth->rx_bytes == 1116 && eth->tx_bytes == 1188);
+  const NetStats *wl = net_snapshot_find(&s, "wlp3s0");
+  assert(wl && wl->rx_bytes == UINT64_MAX && wl->tx_bytes == 42);
+  assert(!net_snapshot_find(&s, "broken"));
+  assert(!net_snapshot_find(&s, "eth"));
+
+  /* Aggregate: explicit list vs. implicit "all but lo" */
+  char *list[] = {"eth0", "lo"};
+  NetStats agg;
+  assert(read_aggregate_stats(&s, list, 2, &agg));
+  assert(agg.rx_bytes == 1116 + 1169018 && agg.tx_bytes == 1188 + 1169018);
+  assert(read_aggregate_stats(&s, NULL, 0, &agg));
+  assert(agg.tx_bytes == 1188 + 42);
+
+  /* Re-parse reuses the table; growth keeps every entry reachable */
+  char big[64 * 128];
+  size_t len = (size_t)snprintf(big, sizeof big, "h1\nh2\n");
+  for (int i = 0; i < 100; ++i)
+    len += (size_t)snprintf(big + len, sizeof big - len,
+                            "veth%d: %d 0 0 0 0 0 0 0 %d 0 0 0 0 0 0 0\n", i,
+                            i, i * 2);
+  assert(net_snapshot_parse(&s, big, len) == 100);
+  for (int i = 0; i < 100; ++i) {
+    char name[IFNAMSIZ];
+    snprintf(name, sizeof name, "veth%d", i);
+    const NetStats *v = net_snapshot_find(&s, name);
+    assert(v && v->rx_bytes == (uint64_t)i && v->tx_bytes == (uint64_t)i * 2);
+  }
+  assert(!net_snapshot_find(&s, "eth0"));
+
+  /* seq_file hands out a page per read(): a short read is not EOF.  A
+   * SOCK_SEQPACKET pair returns one line per read() the same way. */
+  int sv[2];
+  assert(socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == 0);
+  assert(write(sv[1], "h1\nh2\n", 6) == 6);
+  for (int i = 0; i < 67; ++i) {
+    char line[128];
+    int l = snprintf(line, sizeof line,
+                     "veth%d: %d 0 0 0 0 0 0 0 %d 0 0 0 0 0 0 0\n", i, i, i);
+    assert(write(sv[1], line, (size_t)l) == l);
+  }
+  close(sv[1]);
+  s.fd = sv[0];
+  assert(net_snapshot_load(&s) && s.n == 67);
+  assert(net_snapshot_find(&s, "veth66"));
+  net_snapshot_free(&s);
+}
+
+/* 5 ───────────────── rtnetlink RTM_NEWLINK decoding */
+static void test_rtnl_parse_link(void) {
+  struct {
+    struct nlmsghdr nh;
+    struct ifinfomsg ifi;
+    char attrs[512];
+  } msg;
+  memset(&msg, 0, sizeof msg);
+  msg.nh.nlmsg_type = RTM_NEWLINK;
+  msg.ifi.ifi_index = 7;
+
+  size_t off = 0;
+#define PUT_ATTR(type, ptr, size)                                              \
+  do {                                                                         \
+    struct rtattr *rta = (struct rtattr *)(msg.attrs + off);                   \
+    rta->rta_type = (type);                                                    \
+    rta->rta_len = (unsigned short)RTA_LENGTH(size);                           \
+    memcpy(RTA_DATA(rta), (ptr), (size));                                      \
+    off += RTA_ALIGN(rta->rta_len);                                            \
+  } while (0)
+  struct rtnl_link_stats64 st = {.rx_bytes = 1ull << 40, .tx_bytes = 99};
+  uint8_t oper = IF_OPER_UP, carrier = 1;
+  PUT_ATTR(IFLA_IFNAME, "dummy0", 7);
+  PUT_ATTR(IFLA_STATS64, &st, sizeof st);
+  PUT_ATTR(IFLA_OPERSTATE, &oper, 1);
+  PUT_ATTR(IFLA_CARRIER, &carrier, 1);
+#undef PUT_ATTR
+  msg.nh.nlmsg_len = (uint32_t)(NLMSG_LENGTH(sizeof msg.ifi) + off);
+
+  SnapEntry e;
+  assert(rtnl_parse_link(&msg.nh, &e));
+  assert(strcmp(e.name, "dummy0") == 0 && e.ifindex == 7 && e.has_link);
+  assert(e.stats.rx_bytes == 1ull << 40 && e.stats.tx_bytes == 99);
+  assert(e.operstate == IF_OPER_UP && e.carrier);
+
+  msg.nh.nlmsg_type = RTM_DELLINK;
+  assert(!rtnl_parse_link(&msg.nh, &e));
+
+  /* Live dump: "lo" exists in every namespace (skip if netlink is denied) */
+  NetSnapshot s;
+  if (net_snapshot_init(&s, BACKEND_NETLINK)) {
+    assert(net_snapshot_read(&s));
+    const SnapEntry *lo = net_snapshot_entry(&s, "lo");
+    assert(lo && lo->has_link && lo->ifindex > 0);
+    assert(net_snapshot_read(&s)); /* socket is reusable across ticks */
+  }
+  net_snapshot_free(&s);
+}
+
+/* 6 ───────────────── nl80211 interface/station reply decoding */
+static void test_nl80211_parse(void) {
+  struct {
+    struct nlmsghdr nh;
+    struct genlmsghdr gh;
+    char attrs[256];
+  } msg;
+  memset(&msg, 0, sizeof msg);
+  char *p = msg.attrs;
+#define NLA_PUT(type, ptr, size)                                               \
+  do {                                                                         \
+    struct nlattr *na = (struct nlattr *)p;                                    \
+    na->nla_type = (type);                                                     \
+    na->nla_len = (uint16_t)(NLA_HDRLEN + (size));                             \
+    memcpy(p + NLA_HDRLEN, (ptr), (size));                                     \
+    p += NLA_ALIGN(na->nla_len);                                               \
+  } while (0)
+  /* GET_INTERFACE: SSID is not NUL-terminated on the wire */
+  NLA_PUT(NL80211_ATTR_SSID, "homenet", 7);
+  msg.nh.nlmsg_len = (uint32_t)(NLMSG_LENGTH(GENL_HDRLEN) + (size_t)(p - msg.attrs));
+  WifiLink wl = {0};
+  nl80211_parse_reply(&msg.nh, &wl);
+  assert(strcmp(wl.ssid, "homenet") == 0);
+
+  /* GET_STATION: nested STA_INFO { SIGNAL, TX_BITRATE { BITRATE32 } } */
+  memset(msg.attrs, 0, sizeof msg.attrs);
+  p = msg.attrs;
+  int8_t sig = -61;
+  uint32_t rate = 8667; /* 866.7 Mbit/s */
+  struct nlattr *sta = (struct nlattr *)p;
+  p += NLA_HDRLEN;
+  NLA_PUT(NL80211_STA_INFO_SIGNAL, &sig, 1);
+  char *rate_start = p;
+  p += NLA_HDRLEN;
+  NLA_PUT(NL80211_RATE_INFO_BITRATE32, &rate, 4);
+  ((struct nlattr *)rate_start)->nla_type = NL80211_STA_INFO_TX_BITRATE;
+  ((struct nlattr *)rate_start)->nla_len = (uint16_t)(p - rate_start);
+  sta->nla_type = NL80211_ATTR_STA_INFO;
+  sta->nla_len = (uint16_t)(p - (char *)sta);
+#undef NLA_PUT
+  msg.nh.nlmsg_len = (uint32_t)(NLMSG_LENGTH(GENL_HDRLEN) + (size_t)(p - msg.attrs));
+  nl80211_parse_reply(&msg.nh, &wl);
+  assert(strcmp(wl.ssid, "homenet") == 0); /* merged, not overwritten */
+  assert(wl.signal_dbm == -61 && wl.tx_bitrate == 8667 && wl.rx_bitrate == 0);
+
+  /* replies are waited for a bounded time, kept across (re)opening; the
+   * session itself needs cfg80211 (skip without) */
+  Nl80211 nl = {.fd = -1, .ev_fd = -1};
+  nl80211_set_wait(&nl, 0u);
+  assert(nl.wait_ms == 250u);
+  nl80211_set_wait(&nl, 40u);
+  if (nl80211_open(&nl)) {
+    struct timeval tv;
+    socklen_t len = sizeof tv;
+    assert(getsockopt(nl.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, &len) == 0);
+    assert(tv.tv_sec == 0 && tv.tv_usec >= 40000 && tv.tv_usec < 50000);
+  }
+  assert(nl.wait_ms == 40u);
+  nl80211_close(&nl);
+}
+
+/* 7 ───────────────── fixed-point rate formatter matches printf */
+static void ref_rate(char *out, double bps, unsigned div) {
+  const char *prefix[] = {"", "K", "M", "G", "T"};
+  size_t i = 0;
+  while (bps >= div && i < 4) {
+    bps /= div;
+    ++i;
+  }
+  sprintf(out, "%7.1f %sB/s", bps, prefix[i]);
+}
+
+static void test_fmt_rate(void) {
+  char a[64], b[FMT_RATE_MAX + 1];
+  for (double v = 0.0; v < 5e12; v = v * 1.013 + 0.7) {
+    ref_rate(a, v, 1024u);
+    b[fmt_rate(b, v, 'B', 1024u, 0, 0)] = '\0';
+    assert(strcmp(a, b) == 0);
+  }
+  /* limits are bytes/s, also when printing bits */
+  b[fmt_rate(b, 1000.0, 'b', 1000u, 400, 7000)] = '\0';
+  assert(strcmp(b, "?    8.0 Kb/s") == 0);
+  b[fmt_rate(b, 1000.0, 'b', 1000u, 0, 999)] = '\0';
+  assert(strcmp(b, "!    8.0 Kb/s") == 0);
+  b[fmt_rate(b, 0.25, 'B', 1024u, 0, 0)] = '\0';
+  assert(strcmp(b, "    0.2 B/s") == 0); /* ties round to even */
+  /* near-ties: the doubles around every x.x5, as printf sees them */
+  for (unsigned k = 1; k < 2048u * 10u; k += 2u) {
+    double tie = k / 20.0;
+    double vs[] = {nextafter(tie, 0.0), tie, nextafter(tie, 1e9)};
+    for (int j = 0; j < 3; ++j) {
+      ref_rate(a, vs[j], 1024u);
+      b[fmt_rate(b, vs[j], 'B', 1024u, 0, 0)] = '\0';
+      assert(strcmp(a, b) == 0);
+    }
+  }
+  b[fmt_rate(b, 832.45000000000005, 'B', 1024u, 0, 0)] = '\0';
+  assert(strcmp(b, "  832.5 B/s") == 0);
+}
+
+/* 8 ───────────────── template compilation and rendering */
+static void test_templates(void) {
+  char err[128];
+  Template t;
+  assert(!fmt_compile(&t, "{nope}", err, sizeof err));
+  assert(strstr(err, "nope"));
+  assert(!fmt_compile(&t, "{rx", err, sizeof err));
+  assert(!fmt_compile(&t, "rx}", err, sizeof err));
+  assert(fmt_compile(&t, "", err, sizeof err) && t.hidden);
+  fmt_free(&t);
+
+  char *specs[] = {"<{name}{ ssid}> {{{rx}}}", "eth@off=", "wifi@down={state}",
+                   "wl0@up={name}!"};
+  Formatter f;
+  assert(formatter_init(&f, specs, 4, err, sizeof err));
+
+  Iface n = {.name = "eth0", .state = IFSTATE_CONNECTED, .rx_rate = 1536.0};
+  formatter_layout(&f, n.name, false, n.layout);
+  RenderOpts ro = {.unit = 'B', .divisor = 1024u};
+  OutBuf o = {0};
+  assert(render_iface(&o, n.layout[n.state], &n, &ro));
+  assert(o.len == strlen("<eth0> {    1.5 KB/s}") &&
+         memcmp(o.buf, "<eth0> {    1.5 KB/s}", o.len) == 0);
+  assert(!render_iface(&o, n.layout[IFSTATE_DISABLED], &n, &ro));
+
+  /* Wi-Fi: optional-space field, per-kind and per-name rules */
+  Iface w = {.name = "wl1", .wifi = true, .state = IFSTATE_CONNECTED};
+  strcpy(w.wl.ssid, "cafe");
+  formatter_layout(&f, w.name, true, w.layout);
+  o.len = 0;
+  render_iface(&o, w.layout[IFSTATE_CONNECTED], &w, &ro);
+  assert(o.len > 11 && memcmp(o.buf, "<wl1 cafe> ", 11) == 0);
+  o.len = 0;
+  w.state = IFSTATE_DISCONNECTED;
+  render_iface(&o, w.layout[w.state], &w, &ro);
+  w.state = IFSTATE_CONNECTED;
+  assert(o.len == 4 && memcmp(o.buf, "down", 4) == 0);
+  strcpy(w.name, "wl0");
+  formatter_layout(&f, w.name, true, w.layout);
+  o.len = 0;
+  render_iface(&o, w.layout[IFSTATE_CONNECTED], &w, &ro);
+  assert(o.len == 4 && memcmp(o.buf, "wl0!", 4) == 0);
+  /* untouched states keep the built-in layout */
+  assert(w.layout[IFSTATE_DISABLED]->hidden);
+
+  out_free(&o);
+  formatter_free(&f);
+}
+
+/* 9 ───────────────── discovery filter and adapter table */
+static bool keep_even(const Iface *n, void *ctx) {
+  (void)ctx;
+  return n->ifindex % 2 == 0;
+}
+
+static void test_iface_table(void) {
+  IfaceFilter f = {0};
+  assert(iface_filter_add(&f, "eth*,wlan0,,br?", false));
+  assert(iface_filter_add(&f, "eth9", true));
+  assert(f.n_include == 3 && f.n_exclude == 1);
+  assert(iface_filter_match(&f, "eth0") && iface_filter_match(&f, "wlan0"));
+  assert(iface_filter_match(&f, "br1") && !iface_filter_match(&f, "br10"));
+  assert(!iface_filter_match(&f, "eth9") && !iface_filter_match(&f, "lo"));
+  assert(iface_filter_pinned(&f, "wlan0") && !iface_filter_pinned(&f, "eth0"));
+  iface_filter_free(&f);
+
+  /* no fixed cap: far past the old 32 entries, across several grows */
+  IfaceTable t = {0};
+  char name[IFNAMSIZ];
+  for (int i = 1; i <= 1000; ++i) {
+    snprintf(name, sizeof name, "veth%d", i);
+    Iface *n = iftab_add(&t, name);
+    assert(n && n->state == IFSTATE_ERR);
+    iftab_set_index(&t, n, i);
+  }
+  assert(t.n == 1000);
+  assert(iftab_find(&t, "veth777")->ifindex == 777);
+  assert(strcmp(iftab_find_index(&t, 512)->name, "veth512") == 0);
+  assert(!iftab_find(&t, "veth1001") && !iftab_find_index(&t, 1001));
+
+  /* re-created link: new ifindex, old one must no longer resolve */
+  iftab_set_index(&t, iftab_find(&t, "veth3"), 2002);
+  assert(!iftab_find_index(&t, 3));
+  assert(strcmp(iftab_find_index(&t, 2002)->name, "veth3") == 0);
+
+  /* pruning keeps display order and lookups */
+  assert(iftab_prune(&t, keep_even, NULL) == 499); /* veth3 is now even */
+  assert(t.n == 501 && strcmp(t.v[0].name, "veth2") == 0);
+  assert(strcmp(t.v[1].name, "veth3") == 0);
+  assert(!iftab_find(&t, "veth5") && !iftab_find_index(&t, 999));
+  assert(iftab_find_index(&t, 1000) == &t.v[500]);
+  iftab_free(&t);
+
+  /* Live netlink ticks: "lo" is left out by the filter, probed once
+   * (a stat() for /wireless) when discovered, never again; skip if
+   * netlink is denied */
+  static char *argv[] = {"bandwidth3", "--backend", "netlink", "-i",
+                         "nosuch*", NULL};
+  App *a = app_new();
+  assert(a);
+  int saved = dup(STDOUT_FILENO), null = open("/dev/null", O_WRONLY);
+  fflush(stdout);
+  dup2(null, STDOUT_FILENO); /* the ticks print their (empty) lines */
+  if (app_start(a, 5, argv) < 0) {
+    bool was = self_stats.on;
+    self_stats.on = true;
+    app_tick(a);
+    uint64_t probes = self_stats.calls[SC_OTHER];
+    app_tick(a);
+    app_tick(a);
+    assert(self_stats.calls[SC_OTHER] == probes);
+    self_stats.on = was;
+    app_stop(a);
+  }
+  fflush(stdout);
+  dup2(saved, STDOUT_FILENO);
+  close(null);
+  close(saved);
+  free(a);
+}
+
+/* 10 ──────────────── windowed min/max/p95/EWMA/sparkline */
+static int cmp_float(const void *a, const void *b) {
+  float x = *(const float *)a, y = *(const float *)b;
+  return (x > y) - (x < y);
+}
+
+static void test_rate_window(void) {
+  assert(ewma_alpha(1.0, 1.0) == 0.5 && ewma_alpha(0.25, 0.0) == 1.0);
+
+  enum { W = 50, N = 2000 };
+  RateWindow w;
+  assert(rate_window_init(&w, W));
+  static float hist[N];
+  uint32_t x = 12345u;
+  for (int i = 0; i < N; ++i) {
+    x = x * 1103515245u + 12345u; /* LCG: bursts across 6 decades */
+    float v = (float)((x >> 8) % 1000u) * (float)(1u << ((x >> 4) % 20u));
+    hist[i] = v;
+    rate_window_push(&w, v, 0.5);
+
+    /* brute force over the same window */
+    int lo = i + 1 > W ? i + 1 - W : 0;
+    float mn = hist[lo], mx = hist[lo], sorted[W];
+    for (int j = lo; j <= i; ++j) {
+      mn = hist[j] < mn ? hist[j] : mn;
+      mx = hist[j] > mx ? hist[j] : mx;
+      sorted[j - lo] = hist[j];
+    }
+    assert(rate_window_min(&w) == mn && rate_window_max(&w) == mx);
+    int cnt = i + 1 - lo;
+    qsort(sorted, (size_t)cnt, sizeof *sorted, cmp_float);
+    double exact = sorted[(cnt * 95 + 99) / 100 - 1];
+    double approx = rate_window_pct(&w, 95u);
+    assert(exact < 1.0 ? approx < 1.0 : fabs(approx - exact) <= exact / 16.0);
+  }
+  assert(w.n == W);
+
+  /* sparkline: last 8 samples scaled to the window peak */
+  rate_window_reset(&w);
+  char sp[3 * RS_SPARK_WIDTH];
+  assert(rate_window_spark(&w, sp, RS_SPARK_WIDTH) == 0);
+  for (int i = 0; i <= 7; ++i)
+    rate_window_push(&w, i * 100.0, 1.0);
+  assert(rate_window_spark(&w, sp, RS_SPARK_WIDTH) == 24);
+  assert(memcmp(sp, "▁▂▃▄▅▆▇█", 24) == 0);
+  assert(w.ewma == 700.0);
+  rate_window_free(&w);
+}
+
+/* 11 ──────────────── shared-memory publish / attach round trip */
+static void test_shm(void) {
+  char name[64];
+  snprintf(name, sizeof name, "/bandwidth3-test-%d", (int)getpid());
+  ShmSeg w, r, w2;
+  assert(shm_create(&w, name));
+  assert(!shm_create(&w2, name)); /* one sampler per segment */
+  assert(shm_attach(&r, name));
+
+  IfaceTable t = {0};
+  char ifn[IFNAMSIZ];
+  for (int i = 0; i < 40; ++i) { /* past the initial 16 slots */
+    snprintf(ifn, sizeof ifn, "eth%d", i);
+    Iface *n = iftab_add(&t, ifn);
+    n->ifindex = i + 1;
+    n->state = IFSTATE_CONNECTED;
+    n->rx_rate = 1000.0 * i;
+    n->ignored = (i == 3);
+    n->rs = rate_stats_new(100u);
+    for (int k = 0; k < 70; ++k)
+      rate_window_push(&n->rs[0], k, 1.0);
+  }
+  assert(shm_publish(&w, &t, 7u, 250u));
+
+  size_t cnt = 0;
+  ShmInfo info;
+  const ShmIface *v = shm_read(&r, &cnt, &info); /* remaps the growth */
+  assert(v && cnt == 39 && info.ticks == 7u && info.refresh_ms == 250u);
+  assert(strcmp(v[3].name, "eth4") == 0 && v[38].rx_rate == 39000.0);
+  assert(v[0].hist_n == SHM_HIST && v[0].hist_rx[SHM_HIST - 1] == 69.0f);
+  assert(v[0].hist_rx[0] == (float)(70 - SHM_HIST));
+
+  iftab_free(&t);
+  shm_close(&r);
+  shm_close(&w);
+  shm_unlink(name);
+}
+
+/* 12 ──────────────── OpenMetrics exposition */
+static void test_exporter_metrics(void) {
+  IfaceTable t = {0};
+  Iface *n = iftab_add(&t, "wlan0");
+  n->wifi = true;
+  n->state = IFSTATE_CONNECTED;
+  n->prev.rx_bytes = 123456789012ull;
+  n->rx_rate = 1536.0;
+  n->wl.signal_dbm = -52;
+  strcpy(n->wl.ssid, "caf\"e\\");
+  iftab_add(&t, "veth0")->ignored = true;
+
+  OutBuf o = {0};
+  exporter_metrics(&o, &t);
+  out_put(&o, "", 1); /* NUL-terminate */
+  assert(strstr(o.buf, "# TYPE bandwidth3_receive_bytes counter\n"));
+  assert(strstr(o.buf, "bandwidth3_receive_bytes_total{interface=\"wlan0\"} "
+                       "123456789012\n"));
+  assert(strstr(o.buf, "bandwidth3_receive_rate_bytes_per_second"
+                       "{interface=\"wlan0\"} 1536.0\n"));
+  assert(strstr(o.buf, "bandwidth3_link_state{interface=\"wlan0\","
+                       "bandwidth3_link_state=\"up\"} 1\n"));
+  assert(strstr(o.buf, "bandwidth3_wifi_info{interface=\"wlan0\","
+                       "ssid=\"caf\\\"e\\\\\"} 1\n"));
+  assert(strstr(o.buf, "bandwidth3_wifi_signal_dbm{interface=\"wlan0\"} -52\n"));
+  assert(!strstr(o.buf, "veth0"));
+  assert(o.len >= 7 && strcmp(o.buf + o.len - 7, "# EOF\n") == 0);
+  out_free(&o);
+  iftab_free(&t);
+}
+
+/* 13 ──────────────── Sample log round trip */
+static void test_record_replay(void) {
+  char path[64];
+  snprintf(path, sizeof path, "/tmp/bandwidth3-test-%d.log", (int)getpid());
+  unlink(path);
+
+  /* counters that grow, reset to zero and wrap around 2^64 */
+  static const uint64_t RX[3] = {UINT64_MAX - 5u, 10u, 0u};
+  for (int run = 0; run < 2; ++run) { /* the second run appends a session */
+    Recorder w;
+    IfaceTable t = {0};
+    assert(rec_open(&w, path, 250u));
+    Iface *a = iftab_add(&t, "eth0"), *b = iftab_add(&t, "wlan0");
+    iftab_add(&t, "virbr0")->ignored = true;
+    b->wifi = true;
+    for (uint32_t gen = 1; gen <= 3; ++gen) {
+      a->seen = b->seen = t.v[2].seen = gen;
+      a->ifindex = gen < 3 ? 2 : 9; /* re-created on the last tick */
+      a->state = IFSTATE_CONNECTED;
+      b->state = gen == 2 ? IFSTATE_DISABLED : IFSTATE_CONNECTED;
+      a->prev = (NetStats){RX[gen - 1u], 1000u * gen, 0};
+      b->prev = (NetStats){7u, 7u, 0};
+      assert(rec_tick(&w, &t, gen, 1000000000ull * gen));
+    }
+    iftab_free(&t);
+    rec_close(&w);
+  }
+
+  Replay r;
+  assert(replay_open(&r, path) && r.refresh_ms == 250u);
+  for (int run = 0; run < 2; ++run) {
+    for (uint32_t gen = 1; gen <= 3; ++gen) {
+      assert(replay_next(&r) && r.session == (gen == 1u) && r.n_ent == 2);
+      const RecLink *a = &r.links[r.ent[0].link], *b = &r.links[r.ent[1].link];
+      assert(strcmp(a->name, "eth0") == 0 && !a->wifi && b->wifi);
+      assert(a->ifindex == (gen < 3 ? 2 : 9));
+      assert(r.ent[0].stats.rx_bytes == RX[gen - 1u]);
+      assert(r.ent[0].stats.tx_bytes == 1000u * gen);
+      assert(r.ent[0].stats.ts_ns == 1000000000ull * gen);
+      assert(r.ent[1].state == (gen == 2 ? IFSTATE_DISABLED : IFSTATE_CONNECTED));
+    }
+  }
+  assert(!replay_next(&r));
+  size_t len = r.len;
+  replay_close(&r);
+
+  /* a torn tail ends the log early instead of producing garbage */
+  assert(truncate(path, (off_t)len - 1) == 0);
+  assert(replay_open(&r, path));
+  int ticks = 0;
+  while (replay_next(&r))
+    ++ticks;
+  assert(ticks == 5);
+  replay_close(&r);
+
+  /* the next recording cuts the torn tail off before its own session */
+  Recorder w;
+  IfaceTable t = {0};
+  assert(rec_open(&w, path, 500u));
+  Iface *a = iftab_add(&t, "eth0");
+  for (uint32_t gen = 1; gen <= 3; ++gen) {
+    a->seen = gen;
+    a->prev = (NetStats){gen, gen, 0};
+    assert(rec_tick(&w, &t, gen, 1000000000ull * gen));
+  }
+  iftab_free(&t);
+  rec_close(&w);
+  assert(replay_open(&r, path));
+  int sessions = 0;
+  for (ticks = 0; replay_next(&r); ++ticks)
+    sessions += r.session;
+  assert(ticks == 8 && sessions == 3);
+  assert(r.refresh_ms == 500u && r.ent[0].stats.rx_bytes == 3u);
+  replay_close(&r);
+
+  /* never truncate a file that is not a sample log */
+  FILE *f = fopen(path, "w");
+  assert(f && fputs("not a log\n", f) >= 0 && fclose(f) == 0);
+  assert(!rec_open(&w, path, 250u) && errno == EINVAL);
+  struct stat st;
+  assert(stat(path, &st) == 0 && st.st_size == 10);
+  unlink(path);
+}
+
+/* 14 ──────────────── sock_diag decoding and per-adapter top flows */
+static void test_sockdiag(void) {
+  struct {
+    struct nlmsghdr nh;
+    struct inet_diag_msg m;
+    char attrs[512];
+  } msg;
+  memset(&msg, 0, sizeof msg);
+  msg.m.idiag_family = AF_INET6;
+  msg.m.idiag_inode = 4242;
+  msg.m.id.idiag_cookie[0] = 7;
+  msg.m.id.idiag_cookie[1] = 1;
+  msg.m.id.idiag_sport = htons(22);
+  msg.m.id.idiag_dport = htons(50000);
+  uint8_t *src = (uint8_t *)msg.m.id.idiag_src, *dst = (uint8_t *)msg.m.id.idiag_dst;
+  src[10] = src[11] = dst[10] = dst[11] = 0xff; /* ::ffff:10.0.0.1 */
+  src[12] = dst[12] = 10;
+  src[15] = 1;
+  dst[15] = 2;
+  struct tcp_info ti = {.tcpi_bytes_acked = 1000, .tcpi_bytes_received = 1ull << 33};
+  struct rtattr *rta = (struct rtattr *)msg.attrs;
+  rta->rta_type = INET_DIAG_INFO;
+  rta->rta_len = (unsigned short)RTA_LENGTH(sizeof ti);
+  memcpy(RTA_DATA(rta), &ti, sizeof ti);
+  msg.nh.nlmsg_len = (uint32_t)(NLMSG_LENGTH(sizeof msg.m) + RTA_ALIGN(rta->rta_len));
+
+  FlowSample fs;
+  assert(sockdiag_parse(&msg.nh, &fs));
+  assert(fs.cookie == ((1ull << 32) | 7u) && fs.inode == 4242);
+  assert(fs.family == AF_INET && fs.lport == 22 && fs.rport == 50000);
+  assert(fs.laddr[0] == 10 && fs.laddr[3] == 1 && fs.raddr[3] == 2);
+  assert(fs.acked == 1000 && fs.received == 1ull << 33);
+  /* a kernel too old for tcpi_bytes_* is skipped, not misread */
+  rta->rta_len = (unsigned short)RTA_LENGTH(offsetof(struct tcp_info, tcpi_bytes_acked));
+  msg.nh.nlmsg_len = (uint32_t)(NLMSG_LENGTH(sizeof msg.m) + RTA_ALIGN(rta->rta_len));
+  assert(!sockdiag_parse(&msg.nh, &fs));
+
+  /* ranking: busiest first, capped at n_top, ignored adapters skipped */
+  SockDiag sd = {.fd = -1};
+  static const struct {
+    const char *ifname;
+    double rate;
+    uint16_t rport;
+  } FLOWS[] = {{"eth0", 10.0, 1}, {"eth0", 30.0, 2}, {"eth0", 0.0, 3},
+               {"eth0", 20.0, 4}, {"wlan0", 5.0, 5}, {"virbr0", 9.0, 6}};
+  sd.n = sd.cap = sizeof FLOWS / sizeof *FLOWS;
+  sd.v = calloc(sd.n, sizeof *sd.v);
+  for (size_t i = 0; i < sd.n; ++i) {
+    Flow *f = &sd.v[i];
+    snprintf(f->ifname, sizeof f->ifname, "%s", FLOWS[i].ifname);
+    f->rate = FLOWS[i].rate;
+    f->s.family = AF_INET;
+    f->s.raddr[0] = 192;
+    f->s.raddr[3] = (uint8_t)i;
+    f->s.rport = FLOWS[i].rport;
+  }
+  snprintf(sd.v[1].comm, sizeof sd.v[1].comm, "sshd");
+  IfaceTable t = {0};
+  iftab_add(&t, "eth0");
+  iftab_add(&t, "wlan0");
+  iftab_add(&t, "virbr0")->ignored = true;
+  sockdiag_top(&sd, &t, 2u, 1u);
+  const Iface *eth = iftab_find(&t, "eth0");
+  assert(eth->n_top == 2 && eth->top[0].rate == 30.0 && eth->top[1].rate == 20.0);
+  assert(strcmp(eth->top[0].label, "sshd:2") == 0);
+  assert(strcmp(eth->top[1].label, "192.0.0.3:4") == 0);
+  assert(iftab_find(&t, "wlan0")->n_top == 1);
+  assert(iftab_find(&t, "virbr0")->n_top == 0);
+
+  /* {top} renders "label rate" pairs */
+  Template tpl;
+  char err[64];
+  assert(fmt_compile(&tpl, "{name}{ top}", err, sizeof err) && tpl.top);
+  OutBuf o = {0};
+  RenderOpts ro = {.unit = 'B', .divisor = 1000u};
+  assert(render_iface(&o, &tpl, eth, &ro));
+  assert(o.len == strlen("eth0 sshd:2 30.0 B/s, 192.0.0.3:4 20.0 B/s") &&
+         memcmp(o.buf, "eth0 sshd:2 30.0 B/s, 192.0.0.3:4 20.0 B/s", o.len) == 0);
+  out_free(&o);
+  fmt_free(&tpl);
+  iftab_free(&t);
+  free(sd.v);
+
+  /* live, over loopback (skip if sock_diag is denied): a connection of
+   * our own is ranked on "lo" with its ports and this process as owner */
+  if (!sockdiag_open(&sd))
+    return;
+  int srv = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  struct sockaddr_in sin = {.sin_family = AF_INET,
+                            .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  socklen_t slen = sizeof sin;
+  assert(srv >= 0 && bind(srv, (struct sockaddr *)&sin, sizeof sin) == 0 &&
+         listen(srv, 1) == 0 &&
+         getsockname(srv, (struct sockaddr *)&sin, &slen) == 0);
+  int cli = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  assert(cli >= 0 && connect(cli, (struct sockaddr *)&sin, sizeof sin) == 0);
+  int acc = accept(srv, NULL, NULL);
+  struct sockaddr_in cin;
+  slen = sizeof cin;
+  assert(acc >= 0 && getsockname(cli, (struct sockaddr *)&cin, &slen) == 0);
+  uint16_t sport = ntohs(sin.sin_port), cport = ntohs(cin.sin_port);
+
+  uint64_t t0 = mono_ns();
+  assert(sockdiag_poll(&sd, t0)); /* baselines */
+  static char blob[65536];
+  size_t got = 0;
+  assert(send(cli, blob, sizeof blob, 0) == (ssize_t)sizeof blob);
+  while (got < sizeof blob) {
+    ssize_t r = recv(acc, blob, sizeof blob, 0);
+    assert(r > 0);
+    got += (size_t)r;
+  }
+  assert(sockdiag_poll(&sd, t0 + 1000000000ull));
+  iftab_add(&t, "lo");
+  sockdiag_top(&sd, &t, TOP_MAX, t0 + 1000000000ull);
+  char comm[16] = "", want[TOP_LABEL_MAX];
+  FILE *cf = fopen("/proc/self/comm", "r");
+  assert(cf && fgets(comm, sizeof comm, cf));
+  fclose(cf);
+  comm[strcspn(comm, "\n")] = '\0';
+  const Iface *lo = iftab_find(&t, "lo");
+  int found = 0;
+  for (uint8_t j = 0; j < lo->n_top; ++j) {
+    const Flow *f = &sd.v[lo->top[j].flow];
+    bool client = f->s.lport == cport && f->s.rport == sport;
+    if (!client && !(f->s.lport == sport && f->s.rport == cport))
+      continue;
+    snprintf(want, sizeof want, "%s:%u", comm, client ? sport : cport);
+    assert(strcmp(lo->top[j].label, want) == 0);
+    assert(lo->top[j].rate >= (double)sizeof blob);
+    ++found;
+  }
+  assert(found == 2); /* both ends */
+  /* cached: no second /proc scan for flows it already saw */
+  uint64_t scanned = sd.owners_ns;
+  sockdiag_top(&sd, &t, TOP_MAX, t0 + 60000000000ull);
+  assert(sd.owners_ns == scanned);
+  iftab_free(&t);
+  close(acc);
+  close(cli);
+  close(srv);
+  sockdiag_close(&sd);
+}
+
+/* 15 ──────────────── round-robin history: tiers, resume, foreign files */
+static void test_history(void) {
+  char path[64];
+  snprintf(path, sizeof path, "/tmp/bandwidth3-test-%d.hist", (int)getpid());
+  unlink(path);
+
+  History h;
+  IfaceTable t = {0};
+  assert(hist_open(&h, path, true));
+  Iface *n = iftab_add(&t, "eth0");
+  n->ifindex = 2;
+  /* baseline only, then 1000/500 bytes twice within minute 120 */
+  for (uint32_t gen = 1; gen <= 3; ++gen) {
+    n->seen = gen;
+    n->prev = (NetStats){5000u + 1000u * (gen - 1u), 500u * (gen - 1u),
+                         1000000000ull * gen};
+    hist_tick(&h, &t, gen, 7200 + (int64_t)gen);
+  }
+  n->seen = 4; /* next minute, then a counter reset: baseline only */
+  n->prev = (NetStats){7100u, 1000u, 4000000000ull};
+  hist_tick(&h, &t, 4, 7260);
+  n->seen = 5;
+  n->prev = (NetStats){10u, 10u, 5000000000ull};
+  hist_tick(&h, &t, 5, 7261);
+  hist_close(&h);
+
+  uint64_t rx, tx;
+  assert(hist_open(&h, path, false));
+  assert(hist_slot(&h, "eth0", HIST_SEC, 7202, &rx, &tx) && rx == 1000u);
+  assert(hist_slot(&h, "eth0", HIST_SEC, 7203, &rx, &tx) && tx == 500u);
+  assert(!hist_slot(&h, "eth0", HIST_SEC, 7201, &rx, &tx));
+  assert(!hist_slot(&h, "eth0", HIST_SEC, 7261, &rx, &tx));
+  assert(hist_slot(&h, "eth0", HIST_MIN, 120, &rx, &tx) && rx == 2000u);
+  assert(hist_slot(&h, "eth0", HIST_MIN, 121, &rx, &tx) && rx == 100u);
+  assert(hist_slot(&h, "eth0", HIST_HOUR, 2, &rx, &tx) && rx == 2100u &&
+         tx == 1000u);
+  assert(!hist_slot(&h, "wlan0", HIST_HOUR, 2, &rx, &tx));
+  hist_close(&h);
+
+  /* a restart on the same boot resumes the same link only */
+  NetStats old;
+  assert(hist_open(&h, path, true));
+  n->hist_id = 0;
+  assert(hist_resume(&h, n, 6000000000ull, &old) && old.rx_bytes == 10u &&
+         old.ts_ns == 5000000000ull);
+  assert(!hist_resume(&h, n, 5000000000ull + 61000000000ull, &old));
+  n->ifindex = 3;
+  assert(!hist_resume(&h, n, 6000000000ull, &old));
+  /* a second writer is locked out */
+  History h2;
+  assert(!hist_open(&h2, path, true));
+  hist_close(&h);
+  iftab_free(&t);
+
+  /* more live adapters than a new file holds: it grows, nobody is
+   * evicted; a day later an idle entry is recycled instead */
+  unlink(path);
+  assert(hist_open(&h, path, true) && h.n == 16u);
+  char name[IFNAMSIZ];
+  for (int i = 0; i < 40; ++i) {
+    snprintf(name, sizeof name, "veth%d", i);
+    iftab_add(&t, name)->ifindex = i + 1;
+  }
+  for (uint32_t gen = 1; gen <= 2; ++gen) {
+    for (size_t i = 0; i < t.n; ++i) {
+      t.v[i].seen = gen;
+      t.v[i].prev = (NetStats){100u * gen * (i + 1u), 0u, gen};
+    }
+    hist_tick(&h, &t, gen, 7200 + (int64_t)gen);
+  }
+  assert(h.n == 64u);
+  hist_close(&h);
+  assert(hist_open(&h, path, false) && h.n == 64u);
+  for (size_t i = 0; i < t.n; ++i)
+    assert(hist_slot(&h, t.v[i].name, HIST_SEC, 7202, &rx, &tx) &&
+           rx == 100u * (i + 1u));
+  hist_close(&h);
+  assert(hist_open(&h, path, true));
+  for (int i = 40; i < 64; ++i) { /* fill it up */
+    snprintf(name, sizeof name, "veth%d", i);
+    iftab_add(&t, name)->ifindex = i + 1;
+  }
+  for (size_t i = 0; i < t.n; ++i)
+    t.v[i].seen = 3;
+  hist_tick(&h, &t, 3, 7203);
+  assert(h.n == 64u);
+  Iface *late = iftab_add(&t, "late0");
+  late->seen = 4;
+  late->ifindex = 99;
+  hist_tick(&h, &t, 4, 7203 + 86400);
+  assert(h.n == 64u && !hist_slot(&h, "veth0", HIST_SEC, 7202, &rx, &tx));
+  hist_close(&h);
+  iftab_free(&t);
+
+  /* anything else is refused, not overwritten */
+  FILE *f = fopen(path, "w");
+  fputs("not a history file\n", f);
+  fclose(f);
+  assert(!hist_open(&h, path, true) && !hist_open(&h, path, false));
+  unlink(path);
+}
+
+/* 16 ──────────────── threshold rules, hysteresis, hold time and hooks */
+static void test_alerts(void) {
+  AlertRule r[3];
+  assert(alert_rule_parse(&r[0], "1000:500", false));
+  assert(alert_rule_parse(&r[1], "wl*=2000", false));
+  assert(alert_rule_parse(&r[2], "eth0=9000:8000", true));
+  assert(strcmp(r[0].scope, "*") == 0 && r[1].set[0] && !r[1].set[1]);
+  AlertRule bad;
+  assert(!alert_rule_parse(&bad, "x", false));
+  assert(!alert_rule_parse(&bad, "1:2:3", false));
+  assert(!alert_rule_parse(&bad, "=5", false));
+  assert(!alert_rule_parse(&bad, "-5", false));
+
+  AlertLimits l;
+  alert_limits(&l, r, 3, "wlan0");
+  assert(l.warn[0] == 2000u && l.warn[1] == 500u && !l.crit[0]);
+  alert_limits(&l, r, 3, "eth0");
+  assert(l.warn[0] == 1000u && l.crit[0] == 9000u && l.crit[1] == 8000u);
+
+  /* 10 % hysteresis: warn at > 1000, clear only below 900 */
+  Alerts al = {.hysteresis_pct = 10u};
+  AlertState s = {0};
+  assert(!alert_step(&s, 1000u, 9000u, 1000.0, &al, 0));
+  assert(alert_step(&s, 1000u, 9000u, 1001.0, &al, 1) && s.level == ALERT_WARN);
+  assert(!alert_step(&s, 1000u, 9000u, 950.0, &al, 2) && s.level == ALERT_WARN);
+  assert(alert_step(&s, 1000u, 9000u, 9500.0, &al, 3) && s.level == ALERT_CRIT);
+  assert(alert_step(&s, 1000u, 9000u, 8000.0, &al, 4) && s.level == ALERT_WARN);
+  assert(alert_step(&s, 1000u, 9000u, 899.0, &al, 5) && s.level == ALERT_OK);
+
+  /* hold: the new level must persist, a blip resets the clock */
+  al.hold_ms = 3000u;
+  assert(!alert_step(&s, 1000u, 0, 5000.0, &al, 10000));
+  assert(!alert_step(&s, 1000u, 0, 0.0, &al, 11000));
+  assert(!alert_step(&s, 1000u, 0, 5000.0, &al, 12000));
+  assert(!alert_step(&s, 1000u, 0, 5000.0, &al, 14999));
+  assert(alert_step(&s, 1000u, 0, 5000.0, &al, 15000) && s.level == ALERT_WARN);
+
+  /* hooks are spawned, not waited for, and see the change in BW3_* */
+  char path[64], cmd[160];
+  snprintf(path, sizeof path, "/tmp/bandwidth3-test-%d.alert", (int)getpid());
+  unlink(path);
+  snprintf(cmd, sizeof cmd,
+           "sleep 0.2; echo \"$BW3_IFACE $BW3_DIRECTION $BW3_PREVIOUS "
+           "$BW3_LEVEL $BW3_RATE\" > %s",
+           path);
+  Iface n = {.name = "eth0", .tx_rate = 9500.0};
+  alert_limits(&n.lim, r, 3, n.name);
+  Alerts hook = {.cmd = cmd};
+  uint64_t t0 = mono_ns();
+  alert_update(&hook, &n, 0);
+  assert(mono_ns() - t0 < 150000000ull); /* did not wait for the sleep */
+  assert(hook.running == 1u && n.al[1].level == ALERT_CRIT);
+  for (int i = 0; i < 100 && hook.running; ++i) {
+    usleep(20000);
+    alert_reap(&hook);
+  }
+  assert(hook.running == 0u);
+  FILE *f = fopen(path, "r");
+  char line[64] = "";
+  assert(f && fgets(line, sizeof line, f));
+  fclose(f);
+  assert(strcmp(line, "eth0 tx ok critical 9500\n") == 0);
+  unlink(path);
+}
+
+/* 17 ──────────────── batched sysfs state reads, io_uring and pread */
+static void put(const char *dir, const char *file, const char *text) {
+  char path[256];
+  snprintf(path, sizeof path, "%s/%s", dir, file);
+  FILE *f = fopen(path, "w");
+  assert(f && fputs(text, f) >= 0);
+  fclose(f);
+}
+
+static void test_sysfs_batch(void) {
+  static const char *const NAMES[] = {"eth0", "eth1", "eth2", "gone0"};
+  char root[] = "/tmp/bandwidth3-test-XXXXXX", dir[4][128];
+  assert(mkdtemp(root));
+  for (int i = 0; i < 3; ++i) {
+    snprintf(dir[i], sizeof dir[i], "%s/class", root);
+    mkdir(dir[i], 0755);
+    snprintf(dir[i], sizeof dir[i], "%s/class/net", root);
+    mkdir(dir[i], 0755);
+    snprintf(dir[i], sizeof dir[i], "%s/class/net/%s", root, NAMES[i]);
+    assert(mkdir(dir[i], 0755) == 0);
+  }
+  put(dir[0], "operstate", "up\n");
+  put(dir[0], "carrier", "1\n");
+  put(dir[1], "operstate", "up\n");
+  put(dir[1], "carrier", "0\n");
+  put(dir[2], "operstate", "down\n");
+  fs_root_set(FS_SYS, root);
+
+  for (int uring = 1; uring >= 0; --uring) {
+    IfaceTable t = {0};
+    for (int i = 0; i < 4; ++i)
+      iftab_add(&t, NAMES[i]);
+    SysfsBatch b;
+    sysfs_batch_open(&b, uring); /* may be refused: pread then */
+    for (int pass = 0; pass < 2; ++pass) { /* second pass: fds reused */
+      for (size_t i = 0; i < t.n; ++i)
+        sysfs_batch_queue(&b, i);
+      sysfs_batch_run(&b, &t);
+      assert(b.ran == 4u && b.n == 0u);
+      assert(b.state[0] == IFSTATE_CONNECTED);
+      assert(b.state[1] == IFSTATE_DISCONNECTED);
+      assert(b.state[2] == IFSTATE_DISABLED);
+      assert(b.state[3] == IFSTATE_ERR);
+    }
+    assert(t.v[0].sys_fd[0] > 0 && t.v[0].sys_fd[1] > 0);
+    assert(t.v[3].sys_fd[0] == 0);
+    put(dir[1], "carrier", "1\n"); /* same fd, fresh read at offset 0 */
+    sysfs_batch_queue(&b, 1);
+    sysfs_batch_run(&b, &t);
+    assert(b.ran == 1u && b.idx[0] == 1u && b.state[0] == IFSTATE_CONNECTED);
+    put(dir[1], "carrier", "0\n");
+    sysfs_batch_close(&b);
+    iftab_free(&t); /* closes the state files */
+  }
+  /* out of descriptors: through the ring slots (openat/read/close
+   * chains, several ring-fulls of them) or else the slow way */
+  for (int uring = 1; uring >= 0; --uring) {
+    IfaceTable t = {0};
+    for (int i = 0; i < 4; ++i)
+      iftab_add(&t, NAMES[i]);
+    SysfsBatch b;
+    sysfs_batch_open(&b, uring);
+    b.fd_max = 0;
+    bool was = self_stats.on;
+    self_stats.on = true;
+    uint64_t calls = self_stats.calls[SC_OPEN] + self_stats.calls[SC_READ];
+    for (size_t i = 0; i < 400u; ++i) /* 100 of each, ~5 ring-fulls */
+      sysfs_batch_queue(&b, i % t.n);
+    assert(sysfs_batch_run(&b, &t) && b.ran == 400u);
+    calls = self_stats.calls[SC_OPEN] + self_stats.calls[SC_READ] - calls;
+    self_stats.on = was;
+    for (size_t i = 0; i < 400u; i += 4u) {
+      assert(b.state[i] == IFSTATE_CONNECTED);
+      assert(b.state[i + 1u] == IFSTATE_DISCONNECTED);
+      assert(b.state[i + 2u] == IFSTATE_DISABLED);
+      assert(b.state[i + 3u] == IFSTATE_ERR);
+    }
+    assert(t.v[0].sys_fd[0] == 0 && t.v[0].sys_fd[1] == 0);
+    if (b.direct)
+      assert(calls < 16u); /* one probing open, an enter per ring-full */
+    sysfs_batch_close(&b);
+    iftab_free(&t);
+  }
+
+  for (int i = 2; i >= 0; --i) {
+    char path[160];
+    static const char *const FILES[] = {"operstate", "carrier"};
+    for (int k = 0; k < 2; ++k) {
+      snprintf(path, sizeof path, "%s/%s", dir[i], FILES[k]);
+      unlink(path);
+    }
+    rmdir(dir[i]);
+  }
+  snprintf(dir[3], sizeof dir[3], "%s/class/net", root);
+  rmdir(dir[3]);
+  snprintf(dir[3], sizeof dir[3], "%s/class", root);
+  rmdir(dir[3]);
+  rmdir(root);
+  fs_root_set(FS_SYS, NULL);
+}
+
+/* 18 ──────────────── interface groups: membership, sums, bond members */
+static void test_groups(void) {
+  IfaceGroup g[3], bad;
+  assert(group_parse(&g[0], "lan=br0+eth*"));
+  assert(group_parse(&g[1], "air=@wifi"));
+  assert(group_parse(&g[2], "wired=@eth,usb0"));
+  assert(strcmp(g[0].n.name, "lan") == 0 && g[0].members.n_include == 2u);
+  static const char *const BAD[] = {"nomembers=", "=eth0", "x=@bogus",
+                                     "much-too-long-name=eth0", "eth0"};
+  for (size_t i = 0; i < sizeof BAD / sizeof *BAD; ++i) {
+    assert(!group_parse(&bad, BAD[i]));
+    group_free(&bad);
+  }
+
+  assert(group_mask(g, 3, "eth1", false) == (1u | 4u));
+  assert(group_mask(g, 3, "wlan0", true) == 2u);
+  assert(group_mask(g, 3, "lo", false) == 0u);
+  assert(group_mask(g, 3, "usb0", true) == (2u | 4u));
+
+  /* br0 bridges eth1; eth2 stands alone and is down */
+  IfaceTable t = {0};
+  static const struct {
+    const char *name;
+    int ifindex, master;
+    IfState st;
+    double rx;
+  } L[] = {{"br0", 1, 0, IFSTATE_CONNECTED, 1000.0},
+           {"eth1", 2, 1, IFSTATE_CONNECTED, 900.0},
+           {"eth2", 3, 0, IFSTATE_DISABLED, 50.0},
+           {"wlan0", 4, 0, IFSTATE_DISCONNECTED, 0.0}};
+  for (size_t i = 0; i < 4; ++i) {
+    Iface *n = iftab_add(&t, L[i].name);
+    iftab_set_index(&t, n, L[i].ifindex);
+    n->wifi = i == 3;
+    n->master = L[i].master;
+    n->state = L[i].st;
+    n->rx_rate = L[i].rx;
+    n->groups = group_mask(g, 3, n->name, n->wifi);
+  }
+  group_sum(&g[0], 0, &t);
+  assert(g[0].n.rx_rate == 1050.0 && g[0].n.state == IFSTATE_CONNECTED);
+  assert(!g[0].n.wifi);
+  group_sum(&g[1], 1, &t);
+  assert(g[1].n.rx_rate == 0.0 && g[1].n.state == IFSTATE_DISCONNECTED);
+  assert(g[1].n.wifi);
+  /* without the bridge in the group its port counts */
+  t.v[0].groups = 0;
+  group_sum(&g[0], 0, &t);
+  assert(g[0].n.rx_rate == 950.0);
+  t.v[1].state = IFSTATE_DISCONNECTED;
+  group_sum(&g[0], 0, &t);
+  assert(g[0].n.state == IFSTATE_DISCONNECTED);
+  iftab_free(&t);
+  group_sum(&g[2], 2, &t); /* no members at all */
+  assert(g[2].n.state == IFSTATE_ERR && g[2].n.rx_rate == 0.0);
+  for (int i = 0; i < 3; ++i)
+    group_free(&g[i]);
+}
+
+/* 19 ──────────────── i3bar/waybar JSON escaping and blocks */
+static void test_bar_proto(void) {
+  char esc[64];
+  size_t len = json_escape(esc, "a\"b\\c\n\x01", 7);
+  assert(len == strlen("a\\\"b\\\\c\\n\\u0001") &&
+         memcmp(esc, "a\\\"b\\\\c\\n\\u0001", len) == 0);
+  /* UTF-8 kept; Latin-1, overlong, surrogate, cut short: U+FFFD each */
+  static const char BAD[] =
+      "\xc3\xa9\xf0\x9f\x93\xb6 caf\xe9 \xc0\xaf \xed\xa0\x80 \xe2\x82";
+  static const char FIXED[] =
+      "\xc3\xa9\xf0\x9f\x93\xb6 caf\xef\xbf\xbd \xef\xbf\xbd\xef\xbf\xbd "
+      "\xef\xbf\xbd\xef\xbf\xbd\xef\xbf\xbd \xef\xbf\xbd\xef\xbf\xbd";
+  len = json_escape(esc, BAD, sizeof BAD - 1u);
+  assert(len == sizeof FIXED - 1u && memcmp(esc, FIXED, len) == 0);
+
+  OutputProto p;
+  assert(parse_output_proto("swaybar", &p) && p == PROTO_I3BAR);
+  assert(parse_output_proto("waybar", &p) && p == PROTO_WAYBAR);
+  assert(parse_output_proto("plain", &p) && p == PROTO_PLAIN);
+  assert(!parse_output_proto("xmobar", &p));
+
+  char err[128];
+  Template t, tip;
+  assert(fmt_compile(&t, "\"{name}\" {rx}", err, sizeof err));
+  assert(fmt_compile(&tip, "{name} {state}", err, sizeof err));
+  Iface n = {.name = "eth0", .state = IFSTATE_CONNECTED, .rx_rate = 1536.0};
+  n.lim.crit[0] = 1024u;
+  n.al[0].level = ALERT_CRIT;
+  RenderOpts ro = {.unit = 'B', .divisor = 1024u, .json = true};
+  OutBuf o = {0}, tb = {0};
+  assert(bar_i3_block(&o, &t, &n, &ro, true));
+  static const char I3[] = "{\"name\":\"bandwidth3\",\"instance\":\"eth0\","
+                           "\"full_text\":\"\\\"eth0\\\"     1.5 KB/s\","
+                           "\"urgent\":true}";
+  assert(o.len == sizeof I3 - 1u && memcmp(o.buf, I3, o.len) == 0);
+  n.al[0].level = ALERT_WARN;
+  o.len = 0;
+  bar_i3_block(&o, &t, &n, &ro, false);
+  assert(o.buf[0] == ',' && strstr(o.buf, "\"color\":\"#FFFF00\"}"));
+
+  n.rx_rate = 512.0;
+  assert(bar_percent(&n) == 50u);
+  o.len = 0;
+  bar_waybar_begin(&o, &tb);
+  assert(bar_waybar_text(&o, &tb, &t, &tip, &n, &ro, true));
+  assert(bar_waybar_text(&o, &tb, &t, &tip, &n, &ro, false));
+  bar_waybar_end(&o, &tb, ALERT_WARN, bar_percent(&n));
+  out_put(&o, "", 1u);
+  static const char WB[] =
+      "{\"text\":\"\\\"eth0\\\"   512.0 B/s | \\\"eth0\\\"   512.0 B/s\","
+      "\"tooltip\":\"eth0 up\\neth0 up\",\"class\":\"warning\","
+      "\"percentage\":50}\n";
+  assert(strcmp(o.buf, WB) == 0);
+  n.lim.crit[0] = 0;
+  assert(bar_percent(&n) == 0u);
+
+  Template ssid; /* a Latin-1 SSID still makes valid JSON */
+  assert(fmt_compile(&ssid, "{ssid}", err, sizeof err));
+  snprintf(n.wl.ssid, sizeof n.wl.ssid, "Caf\xe9-5G");
+  o.len = 0;
+  assert(render_iface(&o, &ssid, &n, &ro));
+  assert(o.len == 9u && memcmp(o.buf, "Caf\xef\xbf\xbd-5G", 9) == 0);
+  fmt_free(&ssid);
+
+  out_free(&o);
+  out_free(&tb);
+  fmt_free(&t);
+  fmt_free(&tip);
+}
+
+/* 20 ──────────────── config file parsing, last key wins, bad lines */
+static void test_conffile(void) {
+  char err[64];
+  ConfFile c;
+  char *text = strdup("# bar\n"
+                      "  INTERFACES = eth0,wl*\r\n"
+                      "\n"
+                      "export FORMAT='{name} {rx}'\n"
+                      "IFACE_GROUPS=\"up=eth0+eth1;air=@wifi\"\n"
+                      "INTERFACES=br0\n");
+  assert(conf_parse(&c, text, err, sizeof err));
+  assert(c.n == 4u);
+  assert(strcmp(conf_get(&c, "INTERFACES"), "br0") == 0); /* last wins */
+  assert(strcmp(conf_get(&c, "FORMAT"), "{name} {rx}") == 0);
+  assert(!conf_get(&c, "EXCLUDE"));
+
+  /* IFACE_GROUPS is split in place: group_parse() stops at ';' */
+  const char *groups = conf_get(&c, "IFACE_GROUPS");
+  IfaceGroup g;
+  assert(group_parse(&g, groups) && strcmp(g.n.name, "up") == 0);
+  assert(g.members.n_include == 2u && !g.wifi);
+  group_free(&g);
+  assert(group_parse(&g, strchr(groups, ';') + 1) && g.wifi);
+  group_free(&g);
+  assert(!group_parse(&g, "up=;air=@wifi"));
+  group_free(&g);
+  conf_free(&c);
+
+  static const char *const BAD[] = {"just words\n", "=value\n",
+                                    "A B=c\n"};
+  for (size_t i = 0; i < sizeof BAD / sizeof *BAD; ++i) {
+    assert(!conf_parse(&c, strdup(BAD[i]), err, sizeof err));
+    assert(strncmp(err, "line 1", 6) == 0);
+    conf_free(&c);
+  }
+
+  char path[] = "/tmp/bw3-conf-XXXXXX";
+  int fd = mkstemp(path);
+  assert(fd >= 0);
+  assert(write(fd, "TOP=5\n", 6) == 6);
+  close(fd);
+  assert(conf_load(&c, path, err, sizeof err));
+  assert(strcmp(conf_get(&c, "TOP"), "5") == 0);
+  conf_free(&c);
+
+  /* a rename over the file, as editors save, is reported */
+  int w = conf_watch(path);
+  assert(w >= 0 && !conf_watch_read(w, path));
+  char tmp[sizeof path + 4];
+  snprintf(tmp, sizeof tmp, "%s.new", path);
+  FILE *f = fopen(tmp, "w");
+  assert(f && fputs("TOP=7\n", f) >= 0 && fclose(f) == 0);
+  assert(rename(tmp, path) == 0);
+  assert(conf_watch_read(w, path));
+  close(w);
+  unlink(path);
+  assert(!conf_load(&c, path, err, sizeof err));
+}
+
+/* 21 ──────────────── self-monitoring histograms and percentiles */
+static void test_selfstats(void) {
+  assert(self_bucket(0) == 0u && self_bucket(1) == 1u);
+  assert(self_bucket(1023) == 10u && self_bucket(1024) == 11u);
+  assert(self_bucket(UINT64_MAX) == SELF_BUCKETS - 1u);
+
+  static SelfStats s; /* not the global: the hooks may be compiled in */
+  self_enable(&s);
+  assert(s.on && self_percentile(&s, PH_LINKS, 50u) == 0u);
+  for (unsigned i = 0; i < 98u; ++i)
+    self_record(&s, PH_LINKS, 1000u); /* bucket 10: (512, 1024] */
+  self_record(&s, PH_LINKS, 50000u);
+  self_record(&s, PH_LINKS, 70000u);
+  assert(s.n[PH_LINKS] == 100u && s.max_ns[PH_LINKS] == 70000u);
+  assert(s.sum_ns[PH_LINKS] == 98000u + 120000u);
+  assert(self_percentile(&s, PH_LINKS, 50u) == 1024u);
+  assert(self_percentile(&s, PH_LINKS, 98u) == 1024u);
+  assert(self_percentile(&s, PH_LINKS, 99u) == 65536u);
+  assert(self_percentile(&s, PH_LINKS, 100u) == 70000u); /* capped */
+  assert(s.n[PH_TICK] == 0u);
+}
+
+/* 22 ──────────────── sub-interval burst detection */
+static void test_burst(void) {
+  BurstStats b = {0};
+  const uint64_t MS = 1000000u, THR = 100000u;
+  NetStats c = {.rx_bytes = 1000, .tx_bytes = 0, .ts_ns = 1000 * MS};
+  assert(!burst_sample(&b, &c, THR, 10 * MS)); /* primes */
+  static const struct {
+    uint64_t ms, rx; /* elapsed, bytes in the sub-interval */
+  } SUB[] = {{20, 200}, {20, 4000}, {20, 6000}, {20, 100}, {20, 3000}};
+  for (size_t i = 0; i < sizeof SUB / sizeof *SUB; ++i) {
+    c.ts_ns += SUB[i].ms * MS;
+    c.rx_bytes += SUB[i].rx;
+    assert(burst_sample(&b, &c, THR, 10 * MS));
+  }
+  assert(b.n == 5u && b.peak[0] == 300000.0f && b.low[0] == 5000.0f);
+  assert(b.bursts == 2u && b.over); /* two rises, one spanning two */
+  assert(b.peak[1] == 0.0f);
+
+  /* a read right after a sub-sample merges into the next one */
+  c.ts_ns += 1 * MS;
+  c.rx_bytes += 1000;
+  assert(!burst_sample(&b, &c, THR, 10 * MS) && b.n == 5u);
+  c.ts_ns += 19 * MS;
+  assert(burst_sample(&b, &c, THR, 10 * MS) && b.cur[0] == 50000.0f);
+
+  /* a new line starts over; a burst in progress is not counted again */
+  burst_push(&b, 200000.0, 0.0, THR);
+  assert(b.bursts == 3u);
+  burst_restart(&b);
+  assert(b.n == 0u && b.bursts == 0u);
+  burst_push(&b, 200000.0, 0.0, THR);
+  assert(b.bursts == 0u && b.peak[0] == 200000.0f && b.low[0] == 200000.0f);
+  burst_push(&b, 0.0, 0.0, 0u); /* no threshold: never a burst */
+  burst_push(&b, 0.0, 1e9, 0u);
+  assert(b.bursts == 0u && b.peak[1] == 1e9f);
+
+  /* fields render empty until a sub-interval closed */
+  char err[64];
+  Template tp;
+  assert(fmt_compile(&tp, "{rxpeak}/{rxlow} {bursts}", err, sizeof err));
+  assert(!tp.stats);
+  RenderOpts ro = {.unit = 'B', .divisor = 1024u};
+  OutBuf o = {0};
+  Iface n = {.name = "eth0"};
+  render_iface(&o, &tp, &n, &ro);
+  assert(o.len == 2u && memcmp(o.buf, "/ ", 2) == 0);
+  burst_push(&n.burst, 2048.0, 0.0, 1000u);
+  burst_push(&n.burst, 512.0, 0.0, 1000u);
+  o.len = 0;
+  render_iface(&o, &tp, &n, &ro);
+  assert(o.len == strlen("    2.0 KB/s/  512.0 B/s 1") &&
+         memcmp(o.buf, "    2.0 KB/s/  512.0 B/s 1", o.len) == 0);
+  out_free(&o);
+  fmt_free(&tp);
+
+  /* a group adds up its members' last sub-intervals */
+  IfaceGroup g;
+  assert(group_parse(&g, "lan=eth*"));
+  IfaceTable t = {0};
+  for (int i = 0; i < 2; ++i) {
+    Iface *m = iftab_add(&t, i ? "eth1" : "eth0");
+    m->groups = group_mask(&g, 1, m->name, false);
+    burst_push(&m->burst, 600.0 * (i + 1), 0.0, 0u);
+  }
+  group_burst(&g, 0, &t, 1000u);
+  assert(g.n.burst.cur[0] == 1800.0f && g.n.burst.bursts == 1u);
+  iftab_free(&t);
+  group_free(&g);
+}
+
+/* 23 ──────────────── namespace-qualified names and filters */
+static void test_netns(void) {
+  IfaceFilter f = {0};
+  assert(iface_filter_add(&f, "netns:blue/eth0,pid:42/*,eth0,blue/veth*",
+                          false));
+  assert(iface_filter_match(&f, "blue/eth0") && iface_filter_match(&f, "eth0"));
+  assert(iface_filter_match(&f, "pid:42/lo") && !iface_filter_match(&f, "lo"));
+  assert(iface_filter_pinned(&f, "blue/eth0"));
+
+  NetnsSet s = {0};
+  assert(netns_collect(&s, &f));
+  assert(s.n == 2u && strcmp(s.v[0].label, "blue") == 0 &&
+         strcmp(s.v[1].label, "pid:42") == 0 && s.v[0].snap.fd < 0);
+  iface_filter_free(&f);
+
+  /* a namespace that is not there: nothing read, no socket kept */
+  assert(iface_filter_add(&f, "netns:bw3-no-such-ns/*", false));
+  assert(netns_collect(&s, &f) && s.n == 1u);
+  s.v[0].warned = true; /* keep the test output quiet */
+  assert(!netns_read(&s.v[0], 1000u) && s.v[0].snap.fd < 0);
+  assert(!netns_read(&s.v[0], 2000u) && s.v[0].check_ms == 1000u);
+  netns_free(&s);
+  assert(!s.v && !s.n);
+  iface_filter_free(&f);
+}
+
+/* 24 ──────────────── library sampler over a fake procfs/sysfs */
+static void test_sampler(void) {
+  static const char *const NAMES[] = {"eth0", "lo", "wlan0"};
+  static const char *const STATE[][2] = {{"up\n", "1\n"}, {"unknown\n", "1\n"},
+                                         {"down\n", "0\n"}};
+  char root[] = "/tmp/bandwidth3-test-XXXXXX", dir[160], proc[64], sys[64];
+  assert(mkdtemp(root));
+  snprintf(proc, sizeof proc, "%s/proc", root);
+  snprintf(sys, sizeof sys, "%s/sys", root);
+  static const char *const DIRS[] = {"proc", "proc/net", "sys", "sys/class",
+                                     "sys/class/net"};
+  for (size_t i = 0; i < sizeof DIRS / sizeof *DIRS; ++i) {
+    snprintf(dir, sizeof dir, "%s/%s", root, DIRS[i]);
+    assert(mkdir(dir, 0755) == 0);
+  }
+  for (int i = 0; i < 3; ++i) {
+    snprintf(dir, sizeof dir, "%s/class/net/%s", sys, NAMES[i]);
+    assert(mkdir(dir, 0755) == 0);
+    put(dir, "operstate", STATE[i][0]);
+    put(dir, "carrier", STATE[i][1]);
+  }
+  snprintf(dir, sizeof dir, "%s/class/net/wlan0/wireless", sys);
+  assert(mkdir(dir, 0755) == 0);
+  snprintf(dir, sizeof dir, "%s/net", proc);
+  static const char HDR[] = "Inter-|\n face |\n";
+  char dev[256];
+  snprintf(dev, sizeof dev, "%s%s%s%s", HDR,
+           "  eth0: 1000 1 0 0 0 0 0 0 500 1 0 0 0 0 0 0\n",
+           "    lo: 100 1 0 0 0 0 0 0 100 1 0 0 0 0 0 0\n",
+           " wlan0: 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n");
+  put(dir, "dev", dev);
+  fs_root_set(FS_PROC, proc);
+  fs_root_set(FS_SYS, sys);
+
+  assert(!bw3_sampler_new(&(Bw3Config){.format = "{bogus}"}) &&
+         errno == EINVAL);
+  Bw3Sampler *s = bw3_sampler_new(&(Bw3Config){.format = "{name}:{state}"});
+  assert(s);
+  snprintf(dev, sizeof dev, "%s%s%s%s", HDR,
+           "  eth0: 9000 1 0 0 0 0 0 0 500 1 0 0 0 0 0 0\n",
+           "    lo: 100 1 0 0 0 0 0 0 100 1 0 0 0 0 0 0\n",
+           " wlan0: 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n");
+  put(dir, "dev", dev);
+  Bw3Iface v[4];
+  assert(bw3_sample(s, v, 4) == 2); /* lo left out by default */
+  assert(strcmp(v[0].name, "eth0") == 0 && v[0].state == BW3_CONNECTED);
+  assert(v[0].rx_bytes == 9000u && v[0].rx_rate > 0.0 && v[0].tx_rate == 0.0);
+  assert(strcmp(v[1].name, "wlan0") == 0 && v[1].wifi &&
+         v[1].state == BW3_DISABLED && !v[1].ssid[0]);
+
+  char line[64];
+  assert(bw3_format(s, &v[0], line, sizeof line) == 7u);
+  assert(strcmp(line, "eth0:up") == 0);
+  assert(bw3_format(s, &v[0], line, 4) == 7u && strcmp(line, "eth") == 0);
+  /* "{name}:{state}" is the connected layout; off wlan0 keeps the
+   * default, which hides it */
+  assert(bw3_format(s, &v[1], line, sizeof line) == 0u && !line[0]);
+
+  /* a short array still gets the count; a vanished link is dropped */
+  assert(bw3_sample(s, v, 1) == 2 && strcmp(v[0].name, "eth0") == 0);
+  snprintf(dev, sizeof dev, "%s%s", HDR,
+           " wlan0: 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n");
+  put(dir, "dev", dev);
+  assert(bw3_sample(s, v, 4) == 1 && strcmp(v[0].name, "wlan0") == 0);
+  bw3_sampler_free(s);
+
+  snprintf(dev, sizeof dev, "%s%s%s", HDR,
+           "    lo: 100 1 0 0 0 0 0 0 100 1 0 0 0 0 0 0\n",
+           " wlan0: 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0 0\n");
+  put(dir, "dev", dev);
+  s = bw3_sampler_new(&(Bw3Config){.interfaces = "lo,eth*"});
+  assert(s && bw3_sample(s, v, 4) == 1 && strcmp(v[0].name, "lo") == 0);
+  bw3_sampler_free(s);
+
+  fs_root_set(FS_PROC, NULL);
+  fs_root_set(FS_SYS, NULL);
+  for (int i = 0; i < 3; ++i) {
+    snprintf(dir, sizeof dir, "%s/class/net/%s", sys, NAMES[i]);
+    char path[200];
+    snprintf(path, sizeof path, "%s/operstate", dir);
+    unlink(path);
+    snprintf(path, sizeof path, "%s/carrier", dir);
+    unlink(path);
+    if (i == 2) {
+      snprintf(path, sizeof path, "%s/wireless", dir);
+      rmdir(path);
+    }
+    rmdir(dir);
+  }
+  snprintf(dir, sizeof dir, "%s/net/dev", proc);
+  unlink(dir);
+  for (size_t i = sizeof DIRS / sizeof *DIRS; i-- > 0;) {
+    snprintf(dir, sizeof dir, "%s/%s", root, DIRS[i]);
+    rmdir(dir);
+  }
+  rmdir(root);
+
+  /* Live netlink dumps: a link left out is probed (is_wireless()) when
+   * first seen, not on every sample (/proc/net/dev if netlink is denied) */
+  s = bw3_sampler_new(&(Bw3Config){.interfaces = "nosuch*", .netlink = true});
+  if (s) {
+    bool was = self_stats.on;
+    self_stats.on = true;
+    uint64_t probes = self_stats.calls[SC_OTHER];
+    assert(bw3_sample(s, v, 4) == 0 && bw3_sample(s, v, 4) == 0);
+    assert(self_stats.calls[SC_OTHER] == probes);
+    self_stats.on = was;
+  }
+  bw3_sampler_free(s);
+}
+
+/* 25 ──────────────── qdisc statistics decoding */
+static void test_qdisc(void) {
+  struct {
+    struct nlmsghdr nh;
+    struct tcmsg tm;
+    char attrs[256];
+  } msg;
+  memset(&msg, 0, sizeof msg);
+  msg.nh.nlmsg_type = RTM_NEWQDISC;
+  msg.tm.tcm_ifindex = 3;
+  msg.tm.tcm_parent = TC_H_ROOT;
+  msg.tm.tcm_handle = 0x80010000u;
+
+  size_t off = 0;
+#define PUT_ATTR(type, ptr, size)                                              \
+  do {                                                                         \
+    struct rtattr *rta = (struct rtattr *)(msg.attrs + off);                   \
+    rta->rta_type = (type);                                                    \
+    rta->rta_len = (unsigned short)RTA_LENGTH(size);                           \
+    memcpy(RTA_DATA(rta), (ptr), (size));                                      \
+    off += RTA_ALIGN(rta->rta_len);                                            \
+  } while (0)
+  struct {
+    struct rtattr hdr;
+    struct gnet_stats_queue q;
+  } stats2 = {.hdr = {.rta_len = RTA_LENGTH(sizeof(struct gnet_stats_queue)),
+                      .rta_type = TCA_STATS_QUEUE},
+              .q = {.qlen = 10, .backlog = 12000, .drops = UINT32_MAX - 9u,
+                    .requeues = 2, .overlimits = 150}};
+  PUT_ATTR(TCA_KIND, "tbf", 4);
+  PUT_ATTR(TCA_STATS2 | NLA_F_NESTED, &stats2, sizeof stats2);
+#undef PUT_ATTR
+  msg.nh.nlmsg_len = (uint32_t)(NLMSG_LENGTH(sizeof msg.tm) + off);
+
+  int ifindex;
+  uint32_t parent, handle;
+  char kind[QDISC_KIND_MAX];
+  QdiscCounters c;
+  assert(qdisc_parse(&msg.nh, &ifindex, &parent, &handle, kind, &c));
+  assert(ifindex == 3 && parent == TC_H_ROOT && handle == 0x80010000u);
+  assert(strcmp(kind, "tbf") == 0 && c.qlen == 10u && c.backlog == 12000u);
+  assert(c.drops == UINT32_MAX - 9u && c.requeues == 2u && c.overlimits == 150u);
+  msg.nh.nlmsg_len = (uint32_t)NLMSG_LENGTH(sizeof msg.tm);
+  assert(!qdisc_parse(&msg.nh, &ifindex, &parent, &handle, kind, &c));
+
+  /* first dump a baseline, then rates across the u32 wrap */
+  Iface n = {.name = "eth0", .state = IFSTATE_CONNECTED};
+  c = (QdiscCounters){.drops = UINT32_MAX - 9u, .requeues = 2, .backlog = 12000,
+                      .qlen = 10};
+  qdisc_update(&n, "tbf", 0x80010000u, &c, 1000000000ull);
+  assert(n.qd && n.qd->drop_rate == 0.0 && n.qd->worst == -1);
+  c.drops = 90u;
+  c.requeues = 4u;
+  qdisc_update(&n, "tbf", 0x80010000u, &c, 3000000000ull);
+  assert(n.qd->drop_rate == 50.0 && n.qd->requeue_rate == 1.0);
+  /* a replaced root starts over */
+  c.drops = 5u;
+  qdisc_update(&n, "tbf", 0x80020000u, &c, 4000000000ull);
+  assert(n.qd->drop_rate == 0.0 && n.qd->handle == 0x80020000u);
+  c.drops = 105u;
+  qdisc_update(&n, "tbf", 0x80020000u, &c, 6000000000ull);
+  assert(n.qd->drop_rate == 50.0);
+
+  /* drops/s and backlog as threshold inputs, marked in their fields */
+  AlertRule r;
+  assert(alert_rule_parse(&r, "eth*=10:20000", true));
+  r.dim = ALERT_DROPS;
+  alert_limits(&n.lim, &r, 1, n.name);
+  assert(n.lim.crit[ALERT_DROPS] == 10u && n.lim.crit[ALERT_BACKLOG] == 20000u);
+  assert(!n.lim.crit[ALERT_RX] && !n.lim.crit[ALERT_TX]);
+  Alerts al = {0};
+  alert_update(&al, &n, 0);
+  assert(n.al[ALERT_DROPS].level == ALERT_CRIT);
+  assert(n.al[ALERT_BACKLOG].level == ALERT_OK && n.al[ALERT_RX].level == ALERT_OK);
+
+  char err[128];
+  Template t;
+  assert(fmt_compile(&t, "{qdisc} {qbacklog} {qlen} {qdrops} {qrequeues}{ qclass}",
+                     err, sizeof err) &&
+         t.qdisc && !t.top && !t.stats);
+  RenderOpts ro = {.unit = 'b', .divisor = 1024u};
+  OutBuf o = {0};
+  render_iface(&o, &t, &n, &ro);
+  const char *want = "tbf    11.7 KB 10 !50 0";
+  assert(o.len == strlen(want) && memcmp(o.buf, want, o.len) == 0);
+  /* the worst class: most drops, then most backlog */
+  n.qd->cls = calloc(2, sizeof *n.qd->cls);
+  n.qd->n_cls = n.qd->cap_cls = 2u;
+  n.qd->cls[0] = (QdiscClass){.handle = 0x10010u, .c.backlog = 3072u};
+  n.qd->cls[1] = (QdiscClass){.handle = 0x1000au, .drop_rate = 2.0};
+  n.qd->worst = 0;
+  o.len = 0;
+  render_iface(&o, &t, &n, &ro);
+  want = "tbf    11.7 KB 10 !50 0 1:10 0/s 3.0 KB";
+  assert(o.len == strlen(want) && memcmp(o.buf, want, o.len) == 0);
+  fmt_free(&t);
+  /* no dump yet, or the qdisc is gone: empty fields */
+  assert(fmt_compile(&t, "{name}{ qdisc}{ qdrops}", err, sizeof err));
+  n.qd->kind[0] = '\0';
+  o.len = 0;
+  render_iface(&o, &t, &n, &ro);
+  assert(o.len == 4 && memcmp(o.buf, "eth0", 4) == 0);
+  fmt_free(&t);
+  out_free(&o);
+  qdisc_forget(&n);
+  assert(!n.qd);
+
+  /* Live dump: "lo" has a root qdisc in every namespace (noqueue at
+   * least); skip if netlink is denied */
+  QdiscDump q;
+  if (qdisc_open(&q, true)) {
+    IfaceTable tab = {0};
+    Iface *lo = iftab_add(&tab, "lo");
+    assert(lo);
+    iftab_set_index(&tab, lo, 1);
+    if (qdisc_poll(&q, &tab, mono_ns())) {
+      lo = iftab_find(&tab, "lo");
+      assert(lo->qd && lo->qd->kind[0] && lo->qd->seen == q.gen);
+    }
+    iftab_free(&tab);
+    qdisc_close(&q);
+  }
+}
+
 int main(void) {
   test_avg_rate();
   test_enum_distinct();
+  test_snapshot_parse();
+  test_rtnl_parse_link();
+  test_nl80211_parse();
+  test_fmt_rate();
+  test_templates();
+  test_iface_table();
+  test_rate_window();
+  test_shm();
+  test_exporter_metrics();
+  test_record_replay();
+  test_sockdiag();
+  test_history();
+  test_alerts();
+  test_sysfs_batch();
+  test_groups();
+  test_bar_proto();
+  test_conffile();
+  test_selfstats();
+  test_burst();
+  test_netns();
+  test_sampler();
+  test_qdisc();
   return 0; /* any assert() failure aborts non-zero */
 }